@@ -3,14 +3,54 @@
 #include "Pipeline.h"
 #include "Renderer.h"
 #include "Buffer.h"
+#include "Film.h"
+#include "TileScheduler.h"
+#include "AdaptiveSampler.h"
+#include "Readback.h"
+#include "ThreadPool.h"
+#include "ImageWriter.h"
+#include "Checkpoint.h"
+#include "Scene.h"
+#include "Bvh.h"
+#include "WideBvh.h"
+#include "Lbvh.h"
+#include "SceneCache.h"
+#include "GeometryPager.h"
+#include "PathGuide.h"
+#include "Random.h"
+#include "Sampler.h"
 #include "logging.h"
 
 #include <vector>
+#include <cfloat>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <random>
+#include <string>
+#include <algorithm>
+#include <chrono>
 
 static auto constexpr spectrumTestLayer_name = "spectrumTestLayer";
 
+enum class BvhMode
+{
+	BINARY, // SAH build on the thread pool
+	WIDE,   // SAH build collapsed to 8 wide nodes
+	DEVICE  // LBVH built in compute
+};
+
+// instances turning around a vertical axis through the center of their bounds, one step every passesPerFrame passes, after which
+// the film starts over. The BVH is refit, and rebuilt once the refits degraded it too much
+struct Turntable
+{
+	float degreesPerFrame; // 0 = static scene
+	uint32_t passesPerFrame;
+	uint32_t frame;
+	float pivot[3];
+	std::vector<float> transforms; // of the instances as loaded, 12 floats each
+};
+
 struct SpectrumTestLayer_data
 {
 	mxc::ShaderSet shaderSet;
@@ -19,12 +59,48 @@ struct SpectrumTestLayer_data
 	// TODO remove vector
 	struct ImageInfo { VkDescriptorImageInfo descriptorInfo; VkImageLayout currentLayout;};
 	std::vector<ImageInfo> swapchainImageInfos;
-	std::vector<VkDescriptorImageInfo> transactionImageInfos;
-	std::vector<mxc::Image> transactionImages;
-	std::vector<mxc::ImageView> transactionImageViews;
+	mxc::Film film;
+	mxc::SceneBuffers sceneBuffers;
+	mxc::TraversalCounters traversalCounters;
+	mxc::SamplerTables samplerTables;
+	mxc::SamplerType samplerType;
+	mxc::GeometryPager geometryPager;
+	mxc::GeometryPagerConfig geometryPagerConfig;
+	bool pageGeometry; // world triangles streamed through geometryPager instead of uploaded with the scene
+	mxc::PathGuide pathGuide;
+	mxc::PathGuideConfig pathGuideConfig;
+	bool guiding; // diffuse bounces sample directions from pathGuide too
+	char const* sceneFilename; // nullptr = Cornell box
+	mxc::RenderSettings renderSettings; // of a JSON scene, the command line overrides them
+	char const* sceneCacheDir; // nullptr = scenes are loaded from their files
+	BvhMode bvhMode;
+	// kept past the upload for the turntable, which moves instances and updates the BVH
+	mxc::Scene scene;
+	mxc::MeshBvhs meshBvhs;
+	mxc::Bvh bvh;
+	mxc::WideBvh wideBvh;
+	mxc::LbvhBuilder lbvhBuilder;
+	Turntable turntable;
+	mxc::TileScheduler tileScheduler;
+	mxc::TileSchedulerConfig tileSchedulerConfig;
+	mxc::AdaptiveSampler adaptiveSampler;
+	mxc::AdaptiveSamplingConfig adaptiveSamplingConfig;
+	mxc::Readback readback;
+	mxc::ThreadPool threadPool;
+	mxc::ImageWriteOptions dumpOptions;
+	uint32_t dumpEvery; // passes between two frame dumps, 0 = never
+	char const* outputFilename; // final image, nullptr = none
+	char const* checkpointFilename; // nullptr = no checkpoints
+	char const* resumeFilename;
+	float checkpointIntervalSeconds;
+	std::chrono::steady_clock::time_point lastCheckpoint;
+	bool checkpointDue;
+	uint64_t rngSeed; // of the whole render, shaders hash it with the pixel, pass, path and dimension of every number they draw
 	mxc::CommandBuffer layoutTransitionCmdBuf;
 	uint32_t samplesPerPixel;
 	uint32_t sampleIndex;
+	bool passDrawn; // every tile received the pass, which ends once the geometry pager leaves no path deferred
+	bool sweepDrawn; // the last submission dispatched the last tiles of the pass or of a make-up pass
 	bool usePushDescriptors;
 	bool ready;
 };
@@ -36,6 +112,44 @@ auto spectrumTestLayer_tick(mxc::ApplicationPtr appPtr, float deltaTime, void* l
 auto spectrumTestLayer_shutdown(mxc::ApplicationPtr appPtr, void* layerData) -> void;
 auto spectrumTestLayer_handler(mxc::ApplicationPtr appPtr, mxc::EventName name, void* layerData, mxc::EventData eventData) -> mxc::ApplicationSignal_t;
 
+// the path guide trained so far, saved next to the checkpoint when guiding
+static auto guideFilename(char const* checkpointFilename) -> std::string
+{
+	return std::string(checkpointFilename) + ".guide";
+}
+
+static auto checkpointImages(SpectrumTestLayer_data const* layerData, mxc::CheckpointImage* pOutImages) -> uint32_t
+{
+	layerData->film.checkpointImages(pOutImages);
+	pOutImages[mxc::Film::CHECKPOINT_IMAGE_COUNT] = layerData->adaptiveSampler.checkpointImage();
+	return mxc::Film::CHECKPOINT_IMAGE_COUNT + 1;
+}
+
+// runs on the readback thread, the encoding itself is spread over the thread pool
+static auto writeFrame(mxc::ReadbackFrame const& frame) -> void
+{
+	mxc::ImageData const image {
+		.pPixels = static_cast<float const*>(frame.pData),
+		.width = frame.width,
+		.height = frame.height,
+		.channel_count = 4
+	};
+
+	if (data.outputFilename && frame.frameId == data.samplesPerPixel)
+	{
+		mxc::ImageWriteOptions options = data.dumpOptions;
+		if (!mxc::imageFileFormatFromName(data.outputFilename, &options.format))
+			MXC_WARN("unknown extension of %s, writing it as %s", data.outputFilename, mxc::imageFileFormatExtension(options.format));
+		mxc::writeImage(data.threadPool, data.outputFilename, image, options);
+		return;
+	}
+
+	char filename[64];
+	snprintf(filename, sizeof(filename), "frame_%05llu.%s", static_cast<unsigned long long>(frame.frameId),
+	         mxc::imageFileFormatExtension(data.dumpOptions.format));
+	mxc::writeImage(data.threadPool, filename, image, data.dumpOptions);
+}
+
 static mxc::ApplicationLayer s_spectrumTestLayer {
 	.init = spectrumTestLayer_init,
 	.tick = spectrumTestLayer_tick,
@@ -45,14 +159,260 @@ static mxc::ApplicationLayer s_spectrumTestLayer {
 	.data = reinterpret_cast<void*>(&data)
 };
 
+// usage: spectrumTest [--headless <width>x<height>] [--spp <passes>] [--tile <size>] [--budget <milliseconds>] 
+//                     [--order scanline|morton|hilbert] [--crop <x>,<y>,<width>x<height>] [--adaptive] [--target-error <relative>]
+//                     [--dump-every <passes>] [--dump-format pfm|exr|exr-tiled|png] [--output <file.pfm|exr|png>]
+//                     [--checkpoint <file>] [--checkpoint-interval <seconds>] [--resume <file>] [--seed <integer>]
+//                     [--scene <file>] [--bvh binary|wide|device] [--turntable <degrees per frame>,<passes per frame>]
+//                     [--scene-cache <directory>] [--geometry-cache <MiB>] [--sampler random|sobol|blue-noise]
+//                     [--guiding <training iterations>]
+// with --guiding, --checkpoint <file> also writes the trained guide to <file>.guide, which --resume <file> reads back
+// the render object of a JSON scene gives defaults to --headless, --spp, --seed, --bvh and --output
 auto initializeApplication(mxc::VulkanApplication& app, int32_t argc, char** argv) -> bool
 {
+	data.samplesPerPixel = 25000;
+	data.tileSchedulerConfig = {};
+	data.adaptiveSamplingConfig = {};
+	data.dumpEvery = 0;
+	data.dumpOptions = {};
+	data.outputFilename = nullptr;
+	data.checkpointFilename = nullptr;
+	data.sceneFilename = nullptr;
+	data.sceneCacheDir = nullptr;
+	data.pageGeometry = false;
+	data.geometryPagerConfig = {};
+	data.guiding = false;
+	data.pathGuideConfig = {};
+	data.samplerType = mxc::SamplerType::SOBOL;
+	data.bvhMode = BvhMode::WIDE;
+	data.turntable.degreesPerFrame = 0.f;
+	data.turntable.passesPerFrame = 1;
+	data.turntable.frame = 0;
+	data.resumeFilename = nullptr;
+	data.checkpointIntervalSeconds = 600.f;
+	data.rngSeed = (static_cast<uint64_t>(std::random_device{}()) << 32) | std::random_device{}();
+
+	// settings of the scene first, such that the arguments parsed afterwards override them
+	data.renderSettings = {};
+	for (int32_t i = 1; i + 1 < argc; ++i)
+		if (strcmp(argv[i], "--scene") == 0)
+			data.sceneFilename = argv[++i];
+	if (data.sceneFilename)
+	{
+		mxc::RenderSettings& settings = data.renderSettings;
+		if (!mxc::loadRenderSettings(data.sceneFilename, &settings))
+			return false;
+		if (settings.width != 0)
+			app.setHeadless({ .width = settings.width, .height = settings.height });
+		if (settings.samplesPerPixel != 0)
+			data.samplesPerPixel = settings.samplesPerPixel;
+		if (settings.hasSeed)
+			data.rngSeed = settings.seed;
+		if (settings.bvh == "binary")      data.bvhMode = BvhMode::BINARY;
+		else if (settings.bvh == "wide")   data.bvhMode = BvhMode::WIDE;
+		else if (settings.bvh == "device") data.bvhMode = BvhMode::DEVICE;
+		if (!settings.output.empty())
+			data.outputFilename = settings.output.c_str();
+	}
+
+	for (int32_t i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc)
+		{
+			mxc::WindowExtent extent{};
+			if (sscanf(argv[++i], "%ux%u", &extent.width, &extent.height) != 2 || extent.width == 0 || extent.height == 0)
+			{
+				MXC_ERROR("--headless expects an extent formatted as <width>x<height>, got %s", argv[i]);
+				return false;
+			}
+			app.setHeadless(extent);
+		}
+		else if (strcmp(argv[i], "--spp") == 0 && i + 1 < argc)
+		{
+			data.samplesPerPixel = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+		}
+		else if (strcmp(argv[i], "--tile") == 0 && i + 1 < argc)
+		{
+			data.tileSchedulerConfig.tileSize = std::max(16u, static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)));
+		}
+		else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc)
+		{
+			data.tileSchedulerConfig.timeBudgetMs = std::max(1.f, strtof(argv[++i], nullptr));
+		}
+		else if (strcmp(argv[i], "--order") == 0 && i + 1 < argc)
+		{
+			++i;
+			if (strcmp(argv[i], "scanline") == 0)     data.tileSchedulerConfig.order = mxc::TileOrder::SCANLINE;
+			else if (strcmp(argv[i], "morton") == 0)  data.tileSchedulerConfig.order = mxc::TileOrder::MORTON;
+			else if (strcmp(argv[i], "hilbert") == 0) data.tileSchedulerConfig.order = mxc::TileOrder::HILBERT;
+			else MXC_WARN("unknown tile order %s, keeping hilbert", argv[i]);
+		}
+		else if (strcmp(argv[i], "--adaptive") == 0)
+		{
+			data.adaptiveSamplingConfig.enabled = true;
+		}
+		else if (strcmp(argv[i], "--target-error") == 0 && i + 1 < argc)
+		{
+			data.adaptiveSamplingConfig.targetRelativeError = strtof(argv[++i], nullptr);
+		}
+		else if (strcmp(argv[i], "--dump-every") == 0 && i + 1 < argc)
+		{
+			data.dumpEvery = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+		}
+		else if (strcmp(argv[i], "--dump-format") == 0 && i + 1 < argc)
+		{
+			++i;
+			if (strcmp(argv[i], "pfm") == 0)            data.dumpOptions.format = mxc::ImageFileFormat::PFM;
+			else if (strcmp(argv[i], "exr") == 0)       data.dumpOptions.format = mxc::ImageFileFormat::EXR;
+			else if (strcmp(argv[i], "exr-tiled") == 0) data.dumpOptions.format = mxc::ImageFileFormat::EXR_TILED;
+			else if (strcmp(argv[i], "png") == 0)       data.dumpOptions.format = mxc::ImageFileFormat::PNG;
+			else MXC_WARN("unknown dump format %s, keeping exr", argv[i]);
+		}
+		else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+		{
+			data.outputFilename = argv[++i];
+		}
+		else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc)
+		{
+			data.checkpointFilename = argv[++i];
+		}
+		else if (strcmp(argv[i], "--checkpoint-interval") == 0 && i + 1 < argc)
+		{
+			data.checkpointIntervalSeconds = std::max(1.f, strtof(argv[++i], nullptr));
+		}
+		else if (strcmp(argv[i], "--resume") == 0 && i + 1 < argc)
+		{
+			data.resumeFilename = argv[++i];
+		}
+		else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+		{
+			data.rngSeed = strtoull(argv[++i], nullptr, 10);
+		}
+		else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc)
+		{
+			data.sceneFilename = argv[++i];
+		}
+		else if (strcmp(argv[i], "--scene-cache") == 0 && i + 1 < argc)
+		{
+			data.sceneCacheDir = argv[++i];
+		}
+		else if (strcmp(argv[i], "--geometry-cache") == 0 && i + 1 < argc)
+		{
+			data.pageGeometry = true;
+			data.geometryPagerConfig.cacheBytes = strtoull(argv[++i], nullptr, 10) << 20;
+		}
+		else if (strcmp(argv[i], "--guiding") == 0 && i + 1 < argc)
+		{
+			data.pathGuideConfig.trainingIterations = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+			data.guiding = data.pathGuideConfig.trainingIterations != 0;
+		}
+		else if (strcmp(argv[i], "--sampler") == 0 && i + 1 < argc)
+		{
+			++i;
+			if (strcmp(argv[i], "random") == 0)     data.samplerType = mxc::SamplerType::RANDOM;
+			else if (strcmp(argv[i], "sobol") == 0) data.samplerType = mxc::SamplerType::SOBOL;
+			else if (strcmp(argv[i], "blue-noise") == 0) data.samplerType = mxc::SamplerType::BLUE_NOISE;
+			else MXC_WARN("unknown sampler %s, keeping sobol", argv[i]);
+		}
+		else if (strcmp(argv[i], "--bvh") == 0 && i + 1 < argc)
+		{
+			++i;
+			if (strcmp(argv[i], "binary") == 0)      data.bvhMode = BvhMode::BINARY;
+			else if (strcmp(argv[i], "wide") == 0)   data.bvhMode = BvhMode::WIDE;
+			else if (strcmp(argv[i], "device") == 0) data.bvhMode = BvhMode::DEVICE;
+			else MXC_WARN("unknown BVH %s, keeping wide", argv[i]);
+		}
+		else if (strcmp(argv[i], "--turntable") == 0 && i + 1 < argc)
+		{
+			Turntable& turntable = data.turntable;
+			if (sscanf(argv[++i], "%f,%u", &turntable.degreesPerFrame, &turntable.passesPerFrame) != 2 || turntable.passesPerFrame == 0)
+			{
+				MXC_ERROR("--turntable expects <degrees per frame>,<passes per frame>, got %s", argv[i]);
+				return false;
+			}
+		}
+		else if (strcmp(argv[i], "--crop") == 0 && i + 1 < argc)
+		{
+			VkRect2D& crop = data.tileSchedulerConfig.cropWindow;
+			if (sscanf(argv[++i], "%d,%d,%ux%u", &crop.offset.x, &crop.offset.y, &crop.extent.width, &crop.extent.height) != 4)
+			{
+				MXC_ERROR("--crop expects a region formatted as <x>,<y>,<width>x<height>, got %s", argv[i]);
+				return false;
+			}
+		}
+		else
+		{
+			MXC_WARN("ignoring unknown argument %s", argv[i]);
+		}
+	}
+
 	app.pushLayer(s_spectrumTestLayer, spectrumTestLayer_name);
 	return true;
 }
 
 // impl -----------------------------------------------------------------------
 
+// moves the instances to a later frame of the turntable, then refits or rebuilds the BVH. The film restarts unless it was
+// restored with passes of that frame. The device has to be idle
+static auto advanceTurntable(SpectrumTestLayer_data* layerData, mxc::VulkanContext* ctx, uint32_t frame, bool clearFilm) -> bool
+{
+	Turntable& turntable = layerData->turntable;
+	mxc::Scene& scene = layerData->scene;
+	turntable.frame = frame;
+	float const angle = static_cast<float>(turntable.frame) * turntable.degreesPerFrame * 3.14159265f / 180.f;
+	float const c = std::cos(angle), s = std::sin(angle);
+	for (uint32_t i = 0; i != scene.instanceCount(); ++i)
+	{
+		// rotation about y applied after the transform as loaded, around the pivot
+		float const* base = &turntable.transforms[12 * i];
+		float transform[12];
+		for (uint32_t column = 0; column != 4; ++column)
+		{
+			float const x = base[column] - (column == 3 ? turntable.pivot[0] : 0.f);
+			float const z = base[8 + column] - (column == 3 ? turntable.pivot[2] : 0.f);
+			transform[column] = c * x + s * z + (column == 3 ? turntable.pivot[0] : 0.f);
+			transform[4 + column] = base[4 + column];
+			transform[8 + column] = -s * x + c * z + (column == 3 ? turntable.pivot[2] : 0.f);
+		}
+		scene.setInstanceTransform(i, transform);
+	}
+
+	if (layerData->bvhMode == BvhMode::DEVICE)
+	{
+		// a full LBVH build takes about as long as a refit would
+		if (!layerData->sceneBuffers.update(ctx, scene, layerData->meshBvhs, nullptr)
+		    || !layerData->lbvhBuilder.build(ctx, layerData->sceneBuffers))
+			return false;
+	}
+	else
+	{
+		std::vector<mxc::Aabb> primitiveBounds;
+		mxc::computePrimitiveBounds(scene, &primitiveBounds);
+		mxc::Bvh& bvh = layerData->bvh;
+		bvh.refit(layerData->threadPool, primitiveBounds.data());
+		float const refitCost = bvh.sahCost();
+		bool const rebuild = bvh.needsRebuild();
+		if (rebuild)
+			bvh.build(layerData->threadPool, primitiveBounds.data(), static_cast<uint32_t>(primitiveBounds.size()));
+		MXC_INFO("turntable frame %u: BVH refit in %.2f ms, SAH cost %.2f%s", turntable.frame, bvh.refitMilliseconds(), refitCost,
+		         rebuild ? ", rebuilt" : "");
+
+		if (layerData->bvhMode == BvhMode::WIDE)
+			layerData->wideBvh.build(bvh);
+		if (!layerData->sceneBuffers.update(ctx, scene, layerData->meshBvhs, &bvh,
+		                                    layerData->bvhMode == BvhMode::WIDE ? &layerData->wideBvh : nullptr))
+			return false;
+	}
+
+	if (clearFilm)
+	{
+		layerData->film.clear(ctx);
+		if (layerData->adaptiveSampler.isEnabled())
+			layerData->adaptiveSampler.reset(ctx);
+	}
+	return true;
+}
+
 auto spectrumTestLayer_init(mxc::ApplicationPtr appPtr, void* layerData) -> bool
 {
 	MXC_DEBUG("Initialization of Spectrum Test Layer...");
@@ -65,14 +425,30 @@ auto spectrumTestLayer_init(mxc::ApplicationPtr appPtr, void* layerData) -> bool
 	spectrumTestLayerData->ready = true;
 
 	// create shaders and pipeline --------------------------------------------
-	uint32_t swapchainImageCount = ctx->swapchain.images.size();
-	static uint32_t constexpr POOLSIZES_COUNT = 1;
+	uint32_t swapchainImageCount = ctx->outputImageCount();
+	static uint32_t constexpr POOLSIZES_COUNT = 2;
+	static uint32_t constexpr IMAGE_BINDING_COUNT = mxc::Film::ACCUMULATION_BINDING_COUNT + 1;
+	static uint32_t constexpr BUFFER_BINDING_COUNT = mxc::SceneBuffers::BINDING_COUNT + 1 + mxc::GeometryPager::BINDING_COUNT
+	                                                 + mxc::SamplerTables::BINDING_COUNT + mxc::PathGuide::BINDING_COUNT;
 	VkDescriptorPoolSize const poolSizes[POOLSIZES_COUNT] {
-		{.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .descriptorCount = 2}
+		{.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .descriptorCount = IMAGE_BINDING_COUNT},
+		{.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = BUFFER_BINDING_COUNT}
 	};
-	uint32_t const bindingNumbers_counts[POOLSIZES_COUNT] { 2 };
-	uint32_t const bindingNumbers[] { 0, 1 };
-	VkPushConstantRange pushConstantRange{ .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT, .offset = 0, .size = 3*sizeof(uint32_t) };
+	uint32_t const bindingNumbers_counts[POOLSIZES_COUNT] { IMAGE_BINDING_COUNT, BUFFER_BINDING_COUNT };
+	uint32_t const bindingNumbers[] { 
+		0, 1, 2, 3, 4, // film sum, compensation, sample count, moments, sample budget
+		5, 6, 7, 8, 9, // sphere geometry, sphere materials, material albedos, material emissions, lights
+		10, 11, 12,    // vertex positions, triangle indices, triangle materials
+		13, 14, 15,    // BVH nodes, BVH primitive indices, wide BVH nodes
+		16, 17,        // instances, camera
+		18, 19, 20,    // light BVH nodes, light leaves, triangle lights
+		21, 22, 23,    // environment, environment texels, environment CDFs
+		24,            // traversal counters
+		25, 26, 27, 28, // page pool, page table, cluster stamps, deferred paths
+		29, 30,        // Sobol directions, blue noise ranks
+		31, 32, 33, 34 // guide spatial nodes, guide quadtree nodes, guide records, guide record count
+	};
+	VkPushConstantRange pushConstantRange{ .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT, .offset = 0, .size = 16*sizeof(uint32_t) };
 
 	mxc::ResourceConfiguration resConfig{};
 	resConfig.poolSizes_count = POOLSIZES_COUNT;
@@ -100,7 +476,7 @@ auto spectrumTestLayer_init(mxc::ApplicationPtr appPtr, void* layerData) -> bool
 	for (auto& [ descriptorInfo, layout ] : spectrumTestLayerData->swapchainImageInfos)
 	{
 		descriptorInfo.sampler = VK_NULL_HANDLE;
-		descriptorInfo.imageView = ctx->swapchain.images[i++].view;
+		descriptorInfo.imageView = ctx->outputImage(i++).view;
 		descriptorInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL; // update done after compute shader transition, before compute shader dispatch
 		layout = VK_IMAGE_LAYOUT_UNDEFINED;
 	}
@@ -117,36 +493,152 @@ auto spectrumTestLayer_init(mxc::ApplicationPtr appPtr, void* layerData) -> bool
 	if (!res)
 		return false;
 
-	// create descriptor sets update template ---------------------------------
-	for (uint32_t i = 0; i != 1; ++i)
-	{	
-		VkImageLayout constexpr targetLayout = VK_IMAGE_LAYOUT_GENERAL;
-		spectrumTestLayerData->transactionImages.push_back({ 
-			VK_IMAGE_TYPE_2D, 
-			VkExtent3D{.width = width, .height = height, .depth = 1},
-			ctx->swapchain.imageFormat.format,
-			VK_IMAGE_USAGE_STORAGE_BIT
-		});	
-
-		spectrumTestLayerData->transactionImageViews.push_back({ VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT });
-		spectrumTestLayerData->transactionImageInfos.push_back(VkDescriptorImageInfo{
-			.sampler = VK_NULL_HANDLE, // only used for descriptors of type sampler and combined image samplers
-			.imageView = spectrumTestLayerData->transactionImageViews[i].handle,
-			.imageLayout = targetLayout
-		});
-
-		vulkanDevice.createImage(
-			ctx, 
-			VK_IMAGE_TILING_OPTIMAL, 
-			&spectrumTestLayerData->transactionImages[i], 
-			&targetLayout, 
-			&spectrumTestLayerData->transactionImageViews[i],
-			mxc::CommandType::GRAPHICS);
-		MXC_ASSERT(spectrumTestLayerData->transactionImageViews[i].handle != VK_NULL_HANDLE, "transactionImageViews[%u].handle is null", i);
-		spectrumTestLayerData->transactionImageInfos[i].imageView = spectrumTestLayerData->transactionImageViews[i].handle;
+	// upload the scene and its BVH, shaders don't depend on it --------------
+	spectrumTestLayerData->threadPool.create();
+	auto const sceneStart = std::chrono::steady_clock::now();
+	if (spectrumTestLayerData->bvhMode == BvhMode::DEVICE && !spectrumTestLayerData->lbvhBuilder.create(ctx, shaderDir))
+		return false;
+
+	// clusters follow the leaf order of a host BVH, which the turntable rebuilds
+	Turntable& turntable = spectrumTestLayerData->turntable;
+	bool& pageGeometry = spectrumTestLayerData->pageGeometry;
+	if (pageGeometry && (spectrumTestLayerData->bvhMode == BvhMode::DEVICE || turntable.degreesPerFrame != 0.f))
+	{
+		MXC_WARN("--geometry-cache needs a BVH built on the host which doesn't change, geometry isn't paged");
+		pageGeometry = false;
+	}
+
+	// the cache holds the streams as uploaded, the turntable and the geometry pager need the host scene and BVH it doesn't hold
+	char const* bvhModeNames[] { "binary", "wide", "device" };
+	std::string cacheFilename;
+	bool const useCache = spectrumTestLayerData->sceneCacheDir && spectrumTestLayerData->sceneFilename && turntable.degreesPerFrame == 0.f
+	                      && !pageGeometry
+	                      && mxc::sceneCacheFilename(spectrumTestLayerData->sceneCacheDir, spectrumTestLayerData->sceneFilename,
+	                                                 bvhModeNames[static_cast<uint32_t>(spectrumTestLayerData->bvhMode)], &cacheFilename);
+	mxc::SceneCache sceneCache;
+	mxc::Scene& scene = spectrumTestLayerData->scene;
+	if (useCache && sceneCache.open(cacheFilename.c_str()))
+	{
+		// the sections go from the mapping to the staging buffers, with no copy on the host
+		mxc::SceneBuffers::Contents contents;
+		sceneCache.contents(&contents);
+		bool const created = spectrumTestLayerData->sceneBuffers.create(ctx, contents);
+		sceneCache.close();
+		if (!created)
+			return false;
+		if (spectrumTestLayerData->bvhMode == BvhMode::DEVICE
+		    && !spectrumTestLayerData->lbvhBuilder.build(ctx, spectrumTestLayerData->sceneBuffers))
+			return false;
+		MXC_INFO("scene %s loaded from cache %s in %.1f ms", spectrumTestLayerData->sceneFilename, cacheFilename.c_str(),
+		         std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - sceneStart).count());
+	}
+	else
+	{
+		std::vector<std::string> dependencies;
+		if (spectrumTestLayerData->sceneFilename)
+		{
+			if (!mxc::loadScene(spectrumTestLayerData->threadPool, spectrumTestLayerData->sceneFilename, &scene, &dependencies))
+				return false;
+		}
+		else
+			mxc::makeCornellBoxScene(&scene);
+
+		// instanced meshes get a bottom level BVH each, whichever way the top level over spheres, triangles and instances is built
+		mxc::MeshBvhs& meshBvhs = spectrumTestLayerData->meshBvhs;
+		meshBvhs.build(spectrumTestLayerData->threadPool, scene);
+		mxc::SceneBuffers::Contents contents;
+		if (spectrumTestLayerData->bvhMode == BvhMode::DEVICE)
+			mxc::SceneBuffers::gather(scene, meshBvhs, nullptr, nullptr, &contents);
+		else
+		{
+			std::vector<mxc::Aabb> primitiveBounds;
+			mxc::computePrimitiveBounds(scene, &primitiveBounds);
+			mxc::Bvh& bvh = spectrumTestLayerData->bvh;
+			bvh.build(spectrumTestLayerData->threadPool, primitiveBounds.data(), static_cast<uint32_t>(primitiveBounds.size()));
+			mxc::WideBvh& wideBvh = spectrumTestLayerData->wideBvh;
+			// the collapsed tree has to find the hits of the one it comes from, checked on the host before the shader relies on it
+			if (spectrumTestLayerData->bvhMode == BvhMode::WIDE)
+			{
+				wideBvh.build(bvh);
+				if (!wideBvh.validate(bvh, primitiveBounds.data(), 4096))
+					return false;
+			}
+			mxc::SceneBuffers::gather(scene, meshBvhs, &bvh, spectrumTestLayerData->bvhMode == BvhMode::WIDE ? &wideBvh : nullptr,
+			                          &contents, pageGeometry);
+		}
+		if (!spectrumTestLayerData->sceneBuffers.create(ctx, contents))
+			return false;
+		if (spectrumTestLayerData->bvhMode == BvhMode::DEVICE
+		    && !spectrumTestLayerData->lbvhBuilder.build(ctx, spectrumTestLayerData->sceneBuffers))
+			return false;
+		MXC_INFO("scene loaded and BVH built in %.1f ms",
+		         std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - sceneStart).count());
+		// a failed write only costs the next start its warm load
+		if (useCache)
+			mxc::SceneCache::write(cacheFilename.c_str(), contents, dependencies);
+	}
+
+	if (pageGeometry)
+	{
+		uint32_t const* pPrimitiveIndices = spectrumTestLayerData->bvhMode == BvhMode::WIDE ? spectrumTestLayerData->wideBvh.primitiveIndices()
+		                                                                                    : spectrumTestLayerData->bvh.primitiveIndices();
+		if (!spectrumTestLayerData->geometryPager.create(ctx, spectrumTestLayerData->geometryPagerConfig, scene, pPrimitiveIndices,
+		                                                 width, height))
+			return false;
+		// the pager holds the only host copy of the world triangles from here on
+		scene.releaseTriangles();
+	}
+	else if (!spectrumTestLayerData->geometryPager.create(ctx))
+		return false;
+
+	if (turntable.degreesPerFrame != 0.f && scene.instanceCount() == 0)
+	{
+		MXC_WARN("--turntable moves instances, the scene has none");
+		turntable.degreesPerFrame = 0.f;
+	}
+	if (turntable.degreesPerFrame != 0.f)
+	{
+		float boundsMin[3] { FLT_MAX, FLT_MAX, FLT_MAX }, boundsMax[3] { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		for (uint32_t i = 0; i != scene.instanceCount(); ++i)
+		{
+			float const* bounds = scene.instanceBounds() + 6 * i;
+			for (uint32_t a = 0; a != 3; ++a)
+			{
+				boundsMin[a] = std::min(boundsMin[a], bounds[a]);
+				boundsMax[a] = std::max(boundsMax[a], bounds[3 + a]);
+			}
+			float const* objectToWorld = scene.instanceTransforms() + 24 * i;
+			turntable.transforms.insert(turntable.transforms.end(), objectToWorld, objectToWorld + 12);
+		}
+		for (uint32_t a = 0; a != 3; ++a)
+			turntable.pivot[a] = 0.5f * (boundsMin[a] + boundsMax[a]);
 	}
+	if (!spectrumTestLayerData->traversalCounters.create(ctx))
+		return false;
+	if (!spectrumTestLayerData->samplerTables.create(ctx))
+		return false;
+	if (spectrumTestLayerData->guiding)
+	{
+		if (!spectrumTestLayerData->pathGuide.create(ctx, spectrumTestLayerData->pathGuideConfig))
+			return false;
+	}
+	else if (!spectrumTestLayerData->pathGuide.create(ctx))
+		return false;
 
-	uint32_t strides[POOLSIZES_COUNT] { sizeof(uint32_t) }; // VK_FORMAT_B8G8R8A8_UNORM
+	// create accumulation film and descriptor sets update template ----------
+	if (!spectrumTestLayerData->film.create(ctx, width, height, shaderDir))
+		return false;
+
+	if (!spectrumTestLayerData->adaptiveSampler.create(ctx, spectrumTestLayerData->adaptiveSamplingConfig, spectrumTestLayerData->film, shaderDir))
+		return false;
+
+	if (!spectrumTestLayerData->tileScheduler.create(ctx, spectrumTestLayerData->tileSchedulerConfig, width, height))
+		return false;
+
+	if (!spectrumTestLayerData->readback.create(ctx, width, height, mxc::Film::SUM_FORMAT, 4*sizeof(float), writeFrame))
+		return false;
+
+	uint32_t strides[POOLSIZES_COUNT] { 4*sizeof(float), 4*sizeof(float) }; // VK_FORMAT_R32G32B32A32_SFLOAT, float4 streams
 	spectrumTestLayerData->shaderSet.resources.createUpdateTemplate(ctx,VK_PIPELINE_BIND_POINT_COMPUTE,spectrumTestLayerData->pipeline.layout,strides);
 
 	// create buffers ---------------------------------------------------------
@@ -166,9 +658,9 @@ auto spectrumTestLayer_init(mxc::ApplicationPtr appPtr, void* layerData) -> bool
 	mxc::CommandBuffer cmdBuf;
 	cmdBuf.allocate(ctx, mxc::CommandType::GRAPHICS);
 	cmdBuf.begin();
-	for (uint32_t i = 0; i != ctx->swapchain.images.size(); ++i)
+	for (uint32_t i = 0; i != ctx->outputImageCount(); ++i)
 	{
-		VkImage image = ctx->swapchain.images[i].handle;
+		VkImage image = ctx->outputImage(i).handle;
 		vulkanDevice.insertImageMemoryBarrier(cmdBuf.handle, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,//PRESENT_SRC_KHR,
 			VK_IMAGE_ASPECT_COLOR_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
 	}
@@ -177,8 +669,33 @@ auto spectrumTestLayer_init(mxc::ApplicationPtr appPtr, void* layerData) -> bool
 	cmdBuf.free(ctx);
 
 	// Other Variables --------------------------------------------------------
-	spectrumTestLayerData->samplesPerPixel = 25000;
 	spectrumTestLayerData->sampleIndex = 0;
+	spectrumTestLayerData->passDrawn = false;
+	spectrumTestLayerData->sweepDrawn = false;
+	spectrumTestLayerData->checkpointDue = false;
+	spectrumTestLayerData->lastCheckpoint = std::chrono::steady_clock::now();
+
+	// continue a previous render, the film extent has to be the same ----------
+	if (spectrumTestLayerData->resumeFilename)
+	{
+		mxc::CheckpointImage images[mxc::CHECKPOINT_MAX_IMAGE_COUNT];
+		uint32_t const image_count = checkpointImages(spectrumTestLayerData, images);
+		mxc::CheckpointState state;
+		if (!mxc::loadCheckpoint(ctx, spectrumTestLayerData->resumeFilename, images, image_count, &state))
+			return false;
+
+		spectrumTestLayerData->sampleIndex = state.sampleIndex;
+		spectrumTestLayerData->rngSeed = state.rngSeed;
+		if (spectrumTestLayerData->pathGuide.isEnabled()
+		    && !spectrumTestLayerData->pathGuide.load(ctx, guideFilename(spectrumTestLayerData->resumeFilename).c_str(), state.sampleIndex))
+			return false;
+
+		// the turntable resumes at the frame of the last pass, whose passes the film holds: it is only cleared once the next pass
+		// starts a new frame
+		uint32_t const frame = state.sampleIndex == 0 ? 0 : (state.sampleIndex - 1) / turntable.passesPerFrame;
+		if (turntable.degreesPerFrame != 0.f && frame != 0 && !advanceTurntable(spectrumTestLayerData, ctx, frame, false))
+			return false;
+	}
 	
 	return true;
 }
@@ -192,16 +709,30 @@ auto spectrumTestLayer_tick(mxc::ApplicationPtr appPtr, float deltaTime, void* l
 	auto* ctx = renderer.getContextPointer();
 	auto& vulkanDevice = ctx->device;
 
-    static std::random_device r;
-    static std::mt19937 e1(r());
-    static std::uniform_int_distribution<uint32_t> uniformDist(1, UINT32_MAX);
-
 	if (!spectrumTestLayerData->ready)
 	{
 		spectrumTestLayerData->ready = true;
 		return mxc::ApplicationSignal_v::NONE;
 	}
 
+	// a batch run is over once all passes have been accumulated, a window instead keeps presenting the converged image
+	if (app.isHeadless() && spectrumTestLayerData->sampleIndex >= spectrumTestLayerData->samplesPerPixel)
+	{
+		MXC_INFO("Rendered %u passes, closing", spectrumTestLayerData->sampleIndex);
+		return mxc::ApplicationSignal_v::CLOSE_APP;
+	}
+
+	// the next turntable frame starts once the passes of the current one are accumulated, and written if dumps are due
+	Turntable const& turntable = spectrumTestLayerData->turntable;
+	uint32_t const turntableFrame = spectrumTestLayerData->sampleIndex / turntable.passesPerFrame;
+	if (turntable.degreesPerFrame != 0.f && turntableFrame != turntable.frame)
+	{
+		vkDeviceWaitIdle(ctx->device.logical);
+		if (!advanceTurntable(spectrumTestLayerData, ctx, turntableFrame, true))
+			return mxc::ApplicationSignal_v::CLOSE_APP;
+	}
+
+	uint32_t const passIndex = spectrumTestLayerData->sampleIndex;
 	uint32_t* outImageIndex = nullptr;
 	mxc::RendererStatus status = 
 	renderer.recordComputeCommands([ct = spectrumTestLayerData, ctx, &app, vulkanDevice, renderer, outImageIndex]
@@ -209,21 +740,27 @@ auto spectrumTestLayer_tick(mxc::ApplicationPtr appPtr, float deltaTime, void* l
 	{
 		outImageIndex = &imageIndex;
 		VkCommandBuffer drawCmdBuf = ctx->syncObjs[imageIndex].commandBuffer;
-		auto [width, height] = app.getWindowExtent();
 		auto& [ descriptorInfo, currentLayout ] = ct->swapchainImageInfos[imageIndex];
-		auto& transactionDescriptorInfo = ct->transactionImageInfos[0];
 		currentLayout = VK_IMAGE_LAYOUT_GENERAL;
 		descriptorInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 		descriptorInfo.imageView = swapchainView;
 
-		MXC_ASSERT(transactionDescriptorInfo.imageView != VK_NULL_HANDLE 
-				   && transactionDescriptorInfo.imageLayout == VK_IMAGE_LAYOUT_GENERAL, "transaction image info is not valid");
 		MXC_ASSERT(descriptorInfo.imageView != VK_NULL_HANDLE 
-				   && descriptorInfo.imageLayout == VK_IMAGE_LAYOUT_GENERAL, "transaction image info is not valid");
+				   && descriptorInfo.imageLayout == VK_IMAGE_LAYOUT_GENERAL, "swapchain image info is not valid");
 		MXC_ASSERT(renderer.fpCmdPushDescriptorSetWithTemplateKHR, "function pointer for push descriptors is nullptr");
 
-		// update descriptors with current content of the swapchain image
-		VkDescriptorImageInfo const thing[] = { descriptorInfo, transactionDescriptorInfo };
+		// update descriptors with the film images
+		uint32_t constexpr pagerBinding = mxc::Film::ACCUMULATION_BINDING_COUNT + 1 + mxc::SceneBuffers::BINDING_COUNT + 1;
+		uint32_t constexpr samplerBinding = pagerBinding + mxc::GeometryPager::BINDING_COUNT;
+		uint32_t constexpr guideBinding = samplerBinding + mxc::SamplerTables::BINDING_COUNT;
+		mxc::DescriptorInfo thing[guideBinding + mxc::PathGuide::BINDING_COUNT];
+		ct->film.accumulationDescriptors(thing);
+		thing[mxc::Film::ACCUMULATION_BINDING_COUNT] = ct->adaptiveSampler.budgetDescriptor();
+		ct->sceneBuffers.descriptors(thing + mxc::Film::ACCUMULATION_BINDING_COUNT + 1);
+		thing[mxc::Film::ACCUMULATION_BINDING_COUNT + 1 + mxc::SceneBuffers::BINDING_COUNT] = ct->traversalCounters.descriptor();
+		ct->geometryPager.descriptors(thing + pagerBinding);
+		ct->samplerTables.descriptors(thing + samplerBinding);
+		ct->pathGuide.descriptors(thing + guideBinding);
 		if (ct->usePushDescriptors)
 			renderer.fpCmdPushDescriptorSetWithTemplateKHR(cmdBuf, 
 				ct->shaderSet.resources.descriptorUpdateTemplates[0],
@@ -244,25 +781,115 @@ auto spectrumTestLayer_tick(mxc::ApplicationPtr appPtr, float deltaTime, void* l
 				nullptr/*pDynamicOffsets*/);
 		}
 
-		uint32_t rndSeed = uniformDist(e1);
-		uint32_t samplesIndex = ct->sampleIndex++;
-		uint32_t pushVar[] = { rndSeed, samplesIndex, ct->samplesPerPixel };
-		vkCmdPushConstants(
-			cmdBuf,
-			ct->pipeline.layout,
-			VK_SHADER_STAGE_COMPUTE_BIT,
-			0,
-			3*sizeof(uint32_t),
-			&pushVar);
-
 		vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, ct->pipeline.handle);
 
-		vkCmdDispatch(cmdBuf, static_cast<uint32_t>(ceil(width / 16.f)), static_cast<uint32_t>(ceil(height / 16.f)), 1);
+		// the numbers of a pixel don't depend on the tile it is in, a resumed render draws the same samples it would have drawn
+		uint32_t const rndSeed = mxc::shaderSeed(ct->rngSeed);
+		auto const dispatchTile = [ct, cmdBuf, rndSeed](mxc::Tile const& tile, bool makeUpPass)
+		{
+			uint32_t pushVar[] = { 
+				rndSeed, ct->sampleIndex, ct->samplesPerPixel, tile.x, tile.y, tile.width, tile.height,
+				ct->sceneBuffers.sphereCount(), ct->sceneBuffers.lightCount(), ct->sceneBuffers.triangleCount(),
+				ct->sceneBuffers.wideBvh() ? 1u : 0u, ct->sceneBuffers.instanceCount(), ct->sceneBuffers.firstStreamTriangle(),
+				ct->geometryPager.stamp(), static_cast<uint32_t>(ct->samplerType), makeUpPass ? 1u : 0u
+			};
+			vkCmdPushConstants(
+				cmdBuf,
+				ct->pipeline.layout,
+				VK_SHADER_STAGE_COMPUTE_BIT,
+				0,
+				sizeof(pushVar),
+				&pushVar);
+
+			vkCmdDispatch(cmdBuf, (tile.width + 15) / 16, (tile.height + 15) / 16, 1);
+		};
+
+		// as many tiles of the current pass as fit in the time budget, one dispatch each. With paged geometry the pass only ends
+		// in a later submission: the geometry pager reads back which pixels deferred paths once all the tiles were drawn, and
+		// make-up passes go over the tiles again, under the same budget, until none are left
+		bool completesPass = false;
+		ct->sweepDrawn = false;
+		if (!ct->passDrawn || ct->geometryPager.deferredPixelCount() != 0)
+		{
+			bool const makeUpPass = ct->passDrawn;
+			mxc::TileBatch const batch = ct->tileScheduler.beginBatch(ctx, cmdBuf);
+			for (uint32_t t = 0; t != batch.tile_count; ++t)
+				dispatchTile(batch.pTiles[t], makeUpPass);
+			ct->tileScheduler.endBatch(cmdBuf);
+			ct->sweepDrawn = batch.completesPass;
+			if (!makeUpPass)
+			{
+				ct->passDrawn = batch.completesPass;
+				completesPass = batch.completesPass && !ct->geometryPager.isEnabled();
+			}
+		}
+		else
+			completesPass = true;
+
+		if (completesPass)
+		{
+			// next pass budget from the variance estimates, all pixels received this one
+			ct->adaptiveSampler.recordUpdate(ctx, cmdBuf);
+			ct->passDrawn = false;
+			++ct->sampleIndex;
+
+			std::chrono::duration<float> const sinceCheckpoint = std::chrono::steady_clock::now() - ct->lastCheckpoint;
+			ct->checkpointDue = ct->checkpointFilename && sinceCheckpoint.count() >= ct->checkpointIntervalSeconds;
+		}
+
+		// average of the accumulated samples to the output image
+		ct->film.recordResolve(ctx, cmdBuf, swapchainView, imageIndex);
+
+		// HDR copy of the estimate, every dumpEvery passes and after the last one. Intermediate ones are dropped if the writer is
+		// lagging behind
+		bool const lastPass = ct->sampleIndex == ct->samplesPerPixel;
+		bool const dump = ct->dumpEvery != 0 && (ct->sampleIndex % ct->dumpEvery == 0 || lastPass);
+		if (completesPass && (dump || (lastPass && ct->outputFilename)))
+		{
+			if (!ct->readback.recordCopy(ctx, cmdBuf, ct->film.resolvedImage(), ct->sampleIndex) && lastPass)
+			{
+				// the final image is never skipped, wait for a staging buffer to free up
+				ct->readback.drain();
+				ct->readback.recordCopy(ctx, cmdBuf, ct->film.resolvedImage(), ct->sampleIndex);
+			}
+		}
 
 		return VK_SUCCESS;
 	});
 
 	status = renderer.submitCompute(true);
+	spectrumTestLayerData->readback.submit(ctx, vulkanDevice.computeQueue);
+
+	// the clusters missed by the pass or make-up pass which was drawn are uploaded before the next one starts. Only once all
+	// of its tiles were: the deferred pixel count is reset by the read back, the tiles left would go uncounted
+	if (spectrumTestLayerData->geometryPager.isEnabled() && spectrumTestLayerData->sweepDrawn)
+	{
+		vkDeviceWaitIdle(ctx->device.logical);
+		if (!spectrumTestLayerData->geometryPager.update(ctx))
+			return mxc::ApplicationSignal_v::CLOSE_APP;
+	}
+
+	// the records of the pass go to the trees being built, the next pass samples from the new ones once an iteration is over
+	if (spectrumTestLayerData->pathGuide.isEnabled() && spectrumTestLayerData->sampleIndex != passIndex)
+	{
+		vkDeviceWaitIdle(ctx->device.logical);
+		if (!spectrumTestLayerData->pathGuide.update(ctx))
+			return mxc::ApplicationSignal_v::CLOSE_APP;
+	}
+
+	// between two passes, the copies are ordered after the submission above
+	if (spectrumTestLayerData->checkpointDue)
+	{
+		mxc::CheckpointImage images[mxc::CHECKPOINT_MAX_IMAGE_COUNT];
+		uint32_t const image_count = checkpointImages(spectrumTestLayerData, images);
+		mxc::CheckpointState const state { .rngSeed = spectrumTestLayerData->rngSeed, .sampleIndex = spectrumTestLayerData->sampleIndex };
+		// the guide goes first, a checkpoint is only replaced once the guide of its pass is on disk
+		if (!spectrumTestLayerData->pathGuide.isEnabled()
+		    || spectrumTestLayerData->pathGuide.save(guideFilename(spectrumTestLayerData->checkpointFilename).c_str(), state.sampleIndex))
+			mxc::saveCheckpoint(ctx, spectrumTestLayerData->checkpointFilename, images, image_count, state);
+		spectrumTestLayerData->checkpointDue = false;
+		spectrumTestLayerData->lastCheckpoint = std::chrono::steady_clock::now();
+	}
 
 	if (status == mxc::RendererStatus::FATAL)
 		return mxc::ApplicationSignal_v::CLOSE_APP;
@@ -279,11 +906,33 @@ auto spectrumTestLayer_shutdown(mxc::ApplicationPtr appPtr, void* layerData) ->
 	auto* ctx = renderer.getContextPointer();
 	auto& vulkanDevice = ctx->device;
 
-	for (auto& view : spectrumTestLayerData->transactionImageViews)
-		vulkanDevice.destroyImageView(&view);
-
-	for (auto& image : spectrumTestLayerData->transactionImages)
-		vulkanDevice.destroyImage(&image);
+	vkDeviceWaitIdle(ctx->device.logical);
+	uint64_t rayCount, stepCount;
+	spectrumTestLayerData->traversalCounters.read(ctx, &rayCount, &stepCount);
+	if (rayCount != 0)
+		MXC_INFO("BVH traversal: %llu rays, %.2f nodes visited per ray", static_cast<unsigned long long>(rayCount),
+		         static_cast<double>(stepCount) / static_cast<double>(rayCount));
+	if (spectrumTestLayerData->geometryPager.isEnabled())
+		MXC_INFO("geometry pager: %llu pages uploaded, %llu evicted, %llu make-up passes",
+		         static_cast<unsigned long long>(spectrumTestLayerData->geometryPager.uploadCount()),
+		         static_cast<unsigned long long>(spectrumTestLayerData->geometryPager.evictionCount()),
+		         static_cast<unsigned long long>(spectrumTestLayerData->geometryPager.makeUpPassCount()));
+	if (spectrumTestLayerData->pathGuide.isEnabled())
+		MXC_INFO("path guide: %u iterations trained, %u spatial leaves", spectrumTestLayerData->pathGuide.iteration(),
+		         spectrumTestLayerData->pathGuide.spatialLeafCount());
+
+	spectrumTestLayerData->readback.destroy(ctx); // waits for the frames still being written
+	spectrumTestLayerData->threadPool.destroy();
+	spectrumTestLayerData->tileScheduler.destroy(ctx);
+	spectrumTestLayerData->adaptiveSampler.destroy(ctx);
+	spectrumTestLayerData->film.destroy(ctx);
+	spectrumTestLayerData->sceneBuffers.destroy(ctx);
+	spectrumTestLayerData->traversalCounters.destroy(ctx);
+	spectrumTestLayerData->samplerTables.destroy(ctx);
+	spectrumTestLayerData->geometryPager.destroy(ctx);
+	spectrumTestLayerData->pathGuide.destroy(ctx);
+	if (spectrumTestLayerData->bvhMode == BvhMode::DEVICE)
+		spectrumTestLayerData->lbvhBuilder.destroy(ctx);
 
     spectrumTestLayerData->layoutTransitionCmdBuf.free(ctx);
 	spectrumTestLayerData->pipeline.destroy(ctx);
@@ -305,6 +954,8 @@ auto spectrumTestLayer_handler(mxc::ApplicationPtr appPtr, mxc::EventName name,
 		MXC_WARN("I Should be running after Renderer::Resize");
 		spectrumTestLayerData->ready = false;
 		spectrumTestLayerData->sampleIndex = 0;
+		spectrumTestLayerData->passDrawn = false;
+		spectrumTestLayerData->sweepDrawn = false;
 		for (uint32_t i = 0; i != spectrumTestLayerData->swapchainImageInfos.size(); ++i)
 		{
 			spectrumTestLayerData->swapchainImageInfos[i].currentLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -323,42 +974,12 @@ auto spectrumTestLayer_handler(mxc::ApplicationPtr appPtr, mxc::EventName name,
 		vulkanDevice.flushCommandBuffer(&cmdBuf, mxc::CommandType::GRAPHICS);
 		cmdBuf.free(ctx);
 
-		// destroy and recreate transaction image
-		for (auto& view : spectrumTestLayerData->transactionImageViews)
-			vulkanDevice.destroyImageView(&view);
-
-		for (auto& image : spectrumTestLayerData->transactionImages)
-			vulkanDevice.destroyImage(&image);
-
-		spectrumTestLayerData->transactionImageViews.clear();
-		spectrumTestLayerData->transactionImages.clear();
-		for (uint32_t i = 0; i != 1; ++i)
-		{	
-			spectrumTestLayerData->transactionImages.push_back({ 
-				VK_IMAGE_TYPE_2D, 
-				VkExtent3D{.width = width, .height = height, .depth = 1},
-				ctx->swapchain.imageFormat.format,
-				VK_IMAGE_USAGE_STORAGE_BIT
-			});	
-
-			spectrumTestLayerData->transactionImageViews.push_back({ VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT });
-			spectrumTestLayerData->transactionImageInfos.push_back({
-				.sampler = VK_NULL_HANDLE, // only used for descriptors of type sampler and combined image samplers
-				.imageView = spectrumTestLayerData->transactionImageViews[i].handle,
-				.imageLayout = VK_IMAGE_LAYOUT_GENERAL
-			});
-
-			VkImageLayout constexpr targetLayout = VK_IMAGE_LAYOUT_GENERAL;
-			vulkanDevice.createImage(
-				ctx, 
-				VK_IMAGE_TILING_OPTIMAL, 
-				&spectrumTestLayerData->transactionImages[i], 
-				&targetLayout, 
-				&spectrumTestLayerData->transactionImageViews[i],
-				mxc::CommandType::GRAPHICS);
-
-			spectrumTestLayerData->transactionImageInfos[i].imageView = spectrumTestLayerData->transactionImageViews[i].handle;
-		}
+		// accumulated samples belong to the old extent
+		spectrumTestLayerData->film.resize(ctx, width, height);
+		spectrumTestLayerData->adaptiveSampler.resize(ctx, spectrumTestLayerData->film);
+		spectrumTestLayerData->tileScheduler.resize(width, height);
+		spectrumTestLayerData->readback.resize(ctx, width, height);
+		spectrumTestLayerData->geometryPager.resize(ctx, width, height);
 	}
 
 	return mxc::ApplicationSignal_v::NONE;
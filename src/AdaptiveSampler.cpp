@@ -0,0 +1,218 @@
+#include "AdaptiveSampler.h"
+#include "Film.h"
+#include "CommandBuffer.h"
+#include "logging.h"
+
+#include <string>
+
+namespace mxc
+{
+    // matches AdaptiveConstants in adaptive.comp
+    struct AdaptivePushConstants
+    {
+        uint32_t basePaths;
+        uint32_t maxPaths;
+        uint32_t warmupSamples;
+        float targetRelativeError;
+    };
+
+    auto AdaptiveSampler::create(VulkanContext* ctx, AdaptiveSamplingConfig const& config, Film const& film,
+                                 wchar_t const* shaderDir) -> bool
+    {
+        MXC_ASSERT(config.basePathsPerPixel != 0 && config.maxPathsPerPixel >= config.basePathsPerPixel,
+                   "AdaptiveSampler: invalid paths per pixel bounds");
+        m_config = config;
+
+        if (!createBudgetImage(ctx, film.width(), film.height()))
+            return false;
+
+        ctx->device.createBuffer(&m_errorSum);
+        if (m_config.enabled)
+        {
+            if (!createPass(ctx, shaderDir, L"/adaptiveError.comp", &m_errorShader, &m_errorPipeline)
+                || !createPass(ctx, shaderDir, L"/adaptiveBudget.comp", &m_budgetShader, &m_budgetPipeline))
+                return false;
+
+            updateDescriptors(ctx, film);
+            MXC_INFO("Adaptive sampling on: %u paths per pixel per pass on average, at most %u, target relative error %f",
+                     m_config.basePathsPerPixel, m_config.maxPathsPerPixel, m_config.targetRelativeError);
+        }
+
+        reset(ctx);
+        return true;
+    }
+
+    auto AdaptiveSampler::destroy(VulkanContext* ctx) -> void
+    {
+        if (m_config.enabled)
+        {
+            m_budgetPipeline.destroy(ctx);
+            m_errorPipeline.destroy(ctx);
+            m_budgetShader.destroy(ctx);
+            m_errorShader.destroy(ctx);
+        }
+        ctx->device.destroyBuffer(&m_errorSum);
+        destroyBudgetImage(ctx);
+    }
+
+    auto AdaptiveSampler::resize(VulkanContext* ctx, Film const& film) -> bool
+    {
+        destroyBudgetImage(ctx);
+        if (!createBudgetImage(ctx, film.width(), film.height()))
+            return false;
+
+        if (m_config.enabled)
+            updateDescriptors(ctx, film);
+
+        reset(ctx);
+        return true;
+    }
+
+    auto AdaptiveSampler::reset(VulkanContext* ctx) -> void
+    {
+        VkClearColorValue const base { .uint32 = {m_config.basePathsPerPixel, 0, 0, 0} };
+        VkImageSubresourceRange constexpr range {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .baseMipLevel = 0,
+            .levelCount = 1,
+            .baseArrayLayer = 0,
+            .layerCount = 1
+        };
+
+        CommandBuffer cmdBuf;
+        cmdBuf.allocate(ctx, CommandType::COMPUTE);
+        cmdBuf.begin();
+        vkCmdClearColorImage(cmdBuf.handle, m_budget.handle, VK_IMAGE_LAYOUT_GENERAL, &base, 1, &range);
+        ctx->device.insertMemoryBarrier(cmdBuf.handle, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                                        VK_PIPELINE_STAGE_TRANSFER_BIT);
+        cmdBuf.end();
+        ctx->device.flushCommandBuffer(&cmdBuf, CommandType::COMPUTE);
+        cmdBuf.free(ctx);
+    }
+
+    auto AdaptiveSampler::recordUpdate(VulkanContext* ctx, VkCommandBuffer cmdBuf) -> void
+    {
+        if (!m_config.enabled)
+            return;
+
+        AdaptivePushConstants const constants {
+            .basePaths = m_config.basePathsPerPixel,
+            .maxPaths = m_config.maxPathsPerPixel,
+            .warmupSamples = m_config.warmupPasses * m_config.basePathsPerPixel,
+            .targetRelativeError = m_config.targetRelativeError
+        };
+        uint32_t const groupsX = (m_budget.extent.width + GROUP_SIZE - 1) / GROUP_SIZE;
+        uint32_t const groupsY = (m_budget.extent.height + GROUP_SIZE - 1) / GROUP_SIZE;
+
+        // accumulation writes and previous budget reads -> error sum reset
+        ctx->device.insertMemoryBarrier(cmdBuf, VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT,
+                                        VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT,
+                                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                        VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        vkCmdFillBuffer(cmdBuf, m_errorSum.handle, 0, m_errorSum.size, 0);
+        ctx->device.insertMemoryBarrier(cmdBuf, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                                        VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+        struct { ShaderSet const* shader; Pipeline const* pipeline; } const passes[] {
+            {&m_errorShader, &m_errorPipeline}, {&m_budgetShader, &m_budgetPipeline}
+        };
+        for (auto const& [shader, pipeline] : passes)
+        {
+            vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->layout, 0, 1,
+                                    &shader->resources.descriptorSets[0], 0, nullptr);
+            vkCmdPushConstants(cmdBuf, pipeline->layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+            vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->handle);
+            vkCmdDispatch(cmdBuf, groupsX, groupsY, 1);
+            ctx->device.insertMemoryBarrier(cmdBuf);
+        }
+    }
+
+    auto AdaptiveSampler::budgetDescriptor() const -> DescriptorInfo
+    {
+        DescriptorInfo info;
+        info.image = { .sampler = VK_NULL_HANDLE, .imageView = m_budgetView.handle, .imageLayout = VK_IMAGE_LAYOUT_GENERAL };
+        return info;
+    }
+
+    auto AdaptiveSampler::checkpointImage() const -> CheckpointImage
+    {
+        return {.image = m_budget.handle, .extent = m_budget.extent, .format = m_budget.format, .bytesPerPixel = sizeof(uint32_t)};
+    }
+
+    auto AdaptiveSampler::createBudgetImage(VulkanContext* ctx, uint32_t width, uint32_t height) -> bool
+    {
+        VkImageLayout constexpr targetLayout = VK_IMAGE_LAYOUT_GENERAL;
+        m_budget.extent = {.width = width, .height = height, .depth = 1};
+        if (!ctx->device.createImage(ctx, VK_IMAGE_TILING_OPTIMAL, &m_budget, &targetLayout, &m_budgetView, CommandType::COMPUTE))
+        {
+            MXC_ERROR("AdaptiveSampler: couldn't create the %ux%u sample budget image", width, height);
+            return false;
+        }
+        return true;
+    }
+
+    auto AdaptiveSampler::destroyBudgetImage(VulkanContext* ctx) -> void
+    {
+        if (m_budgetView.isValid())
+            ctx->device.destroyImageView(&m_budgetView);
+        m_budgetView.handle = VK_NULL_HANDLE;
+
+        if (m_budget.handle != VK_NULL_HANDLE)
+            ctx->device.destroyImage(&m_budget);
+    }
+
+    auto AdaptiveSampler::createPass(VulkanContext* ctx, wchar_t const* shaderDir, wchar_t const* name,
+                                     ShaderSet* pShader, Pipeline* pPipeline) -> bool
+    {
+        // sample count, moments, budget, error sum
+        static uint32_t constexpr POOLSIZES_COUNT = 2;
+        VkDescriptorPoolSize const poolSizes[POOLSIZES_COUNT] {
+            {.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .descriptorCount = 3},
+            {.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 1}
+        };
+        uint32_t const bindingNumbers_counts[POOLSIZES_COUNT] { 3, 1 };
+        uint32_t const bindingNumbers[BINDING_COUNT] { 0, 1, 2, 3 };
+        ResourceConfiguration const resConfig {
+            .pPoolSizes = poolSizes,
+            .pBindingNumbers = bindingNumbers,
+            .pBindingNumbers_counts = bindingNumbers_counts,
+            .poolSizes_count = POOLSIZES_COUNT,
+            .usePushDescriptors = false
+        };
+
+        std::wstring const filename = std::wstring(shaderDir) + name;
+        wchar_t const* filenames[] { filename.c_str() };
+        VkShaderStageFlagBits const stageFlags[] { VK_SHADER_STAGE_COMPUTE_BIT };
+        ShaderConfiguration shaderConfig{};
+        shaderConfig.filenames = filenames;
+        shaderConfig.stageFlags = stageFlags;
+        shaderConfig.shaderDir = shaderDir;
+        shaderConfig.stage_count = 1;
+
+        VkPushConstantRange const pushConstantRange {
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT, .offset = 0, .size = sizeof(AdaptivePushConstants)
+        };
+        if (!pShader->create(ctx, shaderConfig, resConfig)
+            || !pPipeline->create(ctx, *pShader, m_budget.extent.width, m_budget.extent.height, VK_NULL_HANDLE, &pushConstantRange, 1))
+        {
+            MXC_ERROR("AdaptiveSampler: couldn't create the pipeline for an adaptive sampling pass");
+            return false;
+        }
+
+        uint32_t strides[POOLSIZES_COUNT] { sizeof(uint32_t), sizeof(uint32_t) };
+        pShader->resources.createUpdateTemplate(ctx, VK_PIPELINE_BIND_POINT_COMPUTE, pPipeline->layout, strides);
+        return true;
+    }
+
+    auto AdaptiveSampler::updateDescriptors(VulkanContext* ctx, Film const& film) -> void
+    {
+        DescriptorInfo infos[BINDING_COUNT];
+        infos[0] = film.sampleCountDescriptor();
+        infos[1] = film.momentsDescriptor();
+        infos[2] = budgetDescriptor();
+        infos[3].buffer = { .buffer = m_errorSum.handle, .offset = 0, .range = m_errorSum.size };
+
+        m_errorShader.resources.updateAll(ctx, infos);
+        m_budgetShader.resources.updateAll(ctx, infos);
+    }
+}
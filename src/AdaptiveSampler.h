@@ -0,0 +1,75 @@
+#ifndef MXC_ADAPTIVE_SAMPLER_H
+#define MXC_ADAPTIVE_SAMPLER_H
+
+#include <vulkan/vulkan.h>
+#include "VulkanCommon.h"
+#include "Image.h"
+#include "Buffer.h"
+#include "Shader.h"
+#include "Pipeline.h"
+#include "Checkpoint.h"
+#include "VulkanContext.inl"
+
+#include <cstdint>
+
+namespace mxc
+{
+	class Film;
+
+	struct AdaptiveSamplingConfig
+	{
+		uint32_t basePathsPerPixel = 80;  // paths per pixel of every pass when disabled, average paths per pixel per pass when enabled
+		uint32_t maxPathsPerPixel = 640;
+		uint32_t warmupPasses = 4;        // uniform passes before the per pixel variance is trusted
+		float targetRelativeError = 0.005f;
+		bool enabled = false;
+	};
+
+	// Owns the per pixel path budget image read by the accumulation shader (R32_UINT, binding given by budgetDescriptor).
+	// When enabled, after each complete pass two GPU passes redistribute the budget of the next one from the Welford moments kept by
+	// the Film: the average relative error of the pixel estimates is computed first, then each pixel gets basePathsPerPixel scaled by
+	// its error over the average, and converged pixels get none. When disabled the budget stays basePathsPerPixel everywhere
+	class AdaptiveSampler
+	{
+		static uint32_t constexpr GROUP_SIZE = 16; // ADAPTIVE_GROUP_SIZE in adaptive.comp
+		static uint32_t constexpr BINDING_COUNT = 4;
+	public:
+		auto create(VulkanContext* ctx, AdaptiveSamplingConfig const& config, Film const& film, wchar_t const* shaderDir) -> bool;
+		auto destroy(VulkanContext* ctx) -> void;
+
+		// to be called after Film::resize, the film images it reads have been recreated
+		auto resize(VulkanContext* ctx, Film const& film) -> bool;
+
+		// sets the budget of every pixel back to basePathsPerPixel, e.g. after the film has been cleared
+		auto reset(VulkanContext* ctx) -> void;
+
+		// error and budget passes, to be recorded after the last accumulation dispatch of a pass. No-op when disabled
+		auto recordUpdate(VulkanContext* ctx, VkCommandBuffer cmdBuf) -> void;
+
+		auto budgetDescriptor() const -> DescriptorInfo;
+		// budget of the next pass, saved next to the film images such that a resumed render continues with it
+		auto checkpointImage() const -> CheckpointImage;
+		auto isEnabled() const -> bool { return m_config.enabled; }
+
+	private:
+		auto createBudgetImage(VulkanContext* ctx, uint32_t width, uint32_t height) -> bool;
+		auto destroyBudgetImage(VulkanContext* ctx) -> void;
+		auto createPass(VulkanContext* ctx, wchar_t const* shaderDir, wchar_t const* name, ShaderSet* pShader, Pipeline* pPipeline) -> bool;
+		auto updateDescriptors(VulkanContext* ctx, Film const& film) -> void;
+
+	private:
+		AdaptiveSamplingConfig m_config;
+
+		Image m_budget{VK_IMAGE_TYPE_2D, {0, 0, 1}, VK_FORMAT_R32_UINT,
+		               VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT};
+		ImageView m_budgetView{VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT};
+		Buffer m_errorSum{2 * sizeof(uint32_t), BufferType_v::STORAGE}; // fixed point error sum, contributing pixel count
+
+		ShaderSet m_errorShader;
+		ShaderSet m_budgetShader;
+		Pipeline m_errorPipeline;
+		Pipeline m_budgetPipeline;
+	};
+}
+
+#endif // MXC_ADAPTIVE_SAMPLER_H
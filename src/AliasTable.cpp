@@ -0,0 +1,40 @@
+#include "AliasTable.h"
+
+#include <vector>
+
+namespace mxc
+{
+    auto buildAliasTable(float const* pWeights, uint32_t count, AliasBin* pOut) -> void
+    {
+        double sum = 0.0;
+        for (uint32_t i = 0; i != count; ++i)
+            sum += pWeights[i];
+
+        // probabilities scaled such that the average is 1, under 1 the bins take the rest of their column from a larger one
+        std::vector<double> scaled(count);
+        std::vector<uint32_t> small, large;
+        for (uint32_t i = 0; i != count; ++i)
+        {
+            scaled[i] = sum > 0.0 ? pWeights[i] * count / sum : 1.0;
+            (scaled[i] < 1.0 ? small : large).push_back(i);
+        }
+        while (!small.empty() && !large.empty())
+        {
+            uint32_t const s = small.back();
+            small.pop_back();
+            uint32_t const l = large.back();
+            pOut[s] = { static_cast<float>(scaled[s]), l };
+            scaled[l] -= 1.0 - scaled[s];
+            if (scaled[l] < 1.0)
+            {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+        // what remains is 1 up to rounding
+        for (uint32_t i : large)
+            pOut[i] = { 1.f, i };
+        for (uint32_t i : small)
+            pOut[i] = { 1.f, i };
+    }
+}
@@ -0,0 +1,21 @@
+#ifndef MXC_ALIAS_TABLE_H
+#define MXC_ALIAS_TABLE_H
+
+#include <cstdint>
+
+namespace mxc
+{
+	// a bin of an alias table: the bin is kept with probability q, its alias taken otherwise
+	struct AliasBin
+	{
+		float q;
+		uint32_t alias;
+	};
+
+	// Alias table of count weights by Vose's method (A Linear Algorithm For Generating Random Numbers With a Given Distribution,
+	// 1991), in linear time: picking bin floor(u * count), then itself or its alias, draws i with probability proportional to
+	// pWeights[i] in constant time. Weights summing to 0 give the uniform distribution
+	auto buildAliasTable(float const* pWeights, uint32_t count, AliasBin* pOut) -> void;
+}
+
+#endif // MXC_ALIAS_TABLE_H
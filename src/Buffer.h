@@ -20,7 +20,8 @@ namespace mxc
 			STAGING = 1<<3,
 			STORAGE = 1<<4,
 			UNIFORM_TEXEL = 1<<5,
-			STORAGE_TEXEL = 1<<6
+			STORAGE_TEXEL = 1<<6,
+			READBACK = 1<<7 // transfer destination, persistently mapped, host coherent and cached if possible
 		};
 	}
 
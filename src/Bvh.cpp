@@ -0,0 +1,517 @@
+#include "Bvh.h"
+#include "Scene.h"
+#include "ThreadPool.h"
+#include "logging.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <limits>
+
+namespace mxc
+{
+    // subtrees with fewer primitives are built on the thread which split their parent
+    static uint32_t constexpr PARALLEL_BUILD_THRESHOLD = 4096;
+    static uint32_t constexpr MAX_BIN_COUNT = 64;
+    static uint32_t constexpr MAX_LEAF_COUNT = 0xffff; // low 16 bits of BvhNode::info
+
+    static auto emptyAabb() -> Aabb
+    {
+        float constexpr inf = std::numeric_limits<float>::infinity();
+        return { { inf, inf, inf }, { -inf, -inf, -inf } };
+    }
+
+    static auto grow(Aabb* pBounds, Aabb const& other) -> void
+    {
+        for (uint32_t a = 0; a != 3; ++a)
+        {
+            pBounds->min[a] = std::min(pBounds->min[a], other.min[a]);
+            pBounds->max[a] = std::max(pBounds->max[a], other.max[a]);
+        }
+    }
+
+    static auto grow(Aabb* pBounds, float const p[3]) -> void
+    {
+        for (uint32_t a = 0; a != 3; ++a)
+        {
+            pBounds->min[a] = std::min(pBounds->min[a], p[a]);
+            pBounds->max[a] = std::max(pBounds->max[a], p[a]);
+        }
+    }
+
+    static auto surfaceArea(Aabb const& bounds) -> float
+    {
+        float const dx = bounds.max[0] - bounds.min[0];
+        float const dy = bounds.max[1] - bounds.min[1];
+        float const dz = bounds.max[2] - bounds.min[2];
+        return dx < 0.f ? 0.f : 2.f * (dx * dy + dy * dz + dz * dx);
+    }
+
+    struct BuildPrimitive
+    {
+        Aabb bounds;
+        float centroid[3];
+        uint32_t index;
+    };
+
+    // tree with explicit children, flattened once complete since subtrees finish in any order
+    struct BuildNode
+    {
+        Aabb bounds;
+        uint32_t children[2];
+        uint32_t first;
+        uint32_t count; // 0 for interior nodes
+        uint32_t axis;
+    };
+
+    struct BuildState
+    {
+        BvhBuildOptions options;
+        ThreadPool* pPool;
+        BuildPrimitive* pPrimitives;
+        BuildNode* pNodes;
+        std::atomic<uint32_t> node_count{0};
+        std::atomic<uint32_t> depth{0};
+    };
+
+    struct Bin
+    {
+        Aabb bounds;
+        uint32_t count;
+    };
+
+    static auto makeLeaf(BuildNode* pNode, uint32_t first, uint32_t count) -> void
+    {
+        pNode->first = first;
+        pNode->count = count;
+        pNode->axis = 0;
+    }
+
+    static auto buildRecursive(BuildState& state, uint32_t nodeIndex, uint32_t first, uint32_t count, uint32_t depth) -> void
+    {
+        BuildNode& node = state.pNodes[nodeIndex];
+        BuildPrimitive* pPrimitives = state.pPrimitives + first;
+
+        uint32_t deepest = state.depth.load(std::memory_order_relaxed);
+        while (deepest < depth + 1 && !state.depth.compare_exchange_weak(deepest, depth + 1, std::memory_order_relaxed))
+        {
+        }
+
+        node.bounds = emptyAabb();
+        Aabb centroidBounds = emptyAabb();
+        for (uint32_t i = 0; i != count; ++i)
+        {
+            grow(&node.bounds, pPrimitives[i].bounds);
+            grow(&centroidBounds, pPrimitives[i].centroid);
+        }
+
+        if (count == 1 || depth + 1 == BVH_MAX_DEPTH)
+        {
+            MXC_ASSERT(count <= MAX_LEAF_COUNT, "Bvh: leaf of %u primitives at the maximum depth", count);
+            makeLeaf(&node, first, count);
+            return;
+        }
+
+        uint32_t axis = 0;
+        for (uint32_t a = 1; a != 3; ++a)
+            if (centroidBounds.max[a] - centroidBounds.min[a] > centroidBounds.max[axis] - centroidBounds.min[axis])
+                axis = a;
+
+        // binned SAH over every axis, on the centroids
+        uint32_t const bin_count = std::clamp(state.options.binCount, 2u, MAX_BIN_COUNT);
+        float bestCost = std::numeric_limits<float>::infinity();
+        uint32_t bestAxis = axis;
+        uint32_t bestSplit = 0; // primitives in bins [0, bestSplit] go left
+        for (uint32_t a = 0; a != 3; ++a)
+        {
+            float const extent = centroidBounds.max[a] - centroidBounds.min[a];
+            if (extent <= 0.f)
+                continue;
+
+            Bin bins[MAX_BIN_COUNT];
+            for (uint32_t b = 0; b != bin_count; ++b)
+                bins[b] = { emptyAabb(), 0 };
+            float const scale = bin_count / extent;
+            for (uint32_t i = 0; i != count; ++i)
+            {
+                uint32_t const b = std::min(bin_count - 1, static_cast<uint32_t>((pPrimitives[i].centroid[a] - centroidBounds.min[a]) * scale));
+                grow(&bins[b].bounds, pPrimitives[i].bounds);
+                ++bins[b].count;
+            }
+
+            // right to left sweep for the area times count of the right side of each plane, then left to right for the cost
+            float rightCost[MAX_BIN_COUNT];
+            Aabb rightBounds = emptyAabb();
+            uint32_t rightCount = 0;
+            for (uint32_t b = bin_count - 1; b != 0; --b)
+            {
+                grow(&rightBounds, bins[b].bounds);
+                rightCount += bins[b].count;
+                rightCost[b - 1] = rightCount * surfaceArea(rightBounds);
+            }
+
+            Aabb leftBounds = emptyAabb();
+            uint32_t leftCount = 0;
+            for (uint32_t b = 0; b != bin_count - 1; ++b)
+            {
+                grow(&leftBounds, bins[b].bounds);
+                leftCount += bins[b].count;
+                float const cost = leftCount * surfaceArea(leftBounds) + rightCost[b];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = a;
+                    bestSplit = b;
+                }
+            }
+        }
+
+        uint32_t mid = first;
+        float const nodeArea = surfaceArea(node.bounds);
+        if (bestCost < std::numeric_limits<float>::infinity() && depth < BVH_MAX_DEPTH / 2)
+        {
+            float const splitCost = state.options.traversalCost + (nodeArea > 0.f ? bestCost / nodeArea : 0.f);
+            if (count <= state.options.maxLeafPrimitives && splitCost >= static_cast<float>(count))
+            {
+                makeLeaf(&node, first, count);
+                return;
+            }
+
+            float const extent = centroidBounds.max[bestAxis] - centroidBounds.min[bestAxis];
+            float const scale = bin_count / extent;
+            float const minimum = centroidBounds.min[bestAxis];
+            BuildPrimitive* pMid = std::partition(pPrimitives, pPrimitives + count, [=](BuildPrimitive const& primitive) {
+                return std::min(bin_count - 1, static_cast<uint32_t>((primitive.centroid[bestAxis] - minimum) * scale)) <= bestSplit;
+            });
+            mid = first + static_cast<uint32_t>(pMid - pPrimitives);
+            axis = bestAxis;
+        }
+
+        // coincident centroids, or deep enough that the tree could outgrow the traversal stack: median split, halving each level
+        if (mid == first || mid == first + count)
+        {
+            if (count <= state.options.maxLeafPrimitives)
+            {
+                makeLeaf(&node, first, count);
+                return;
+            }
+            mid = first + count / 2;
+            std::nth_element(pPrimitives, state.pPrimitives + mid, pPrimitives + count,
+                             [axis](BuildPrimitive const& a, BuildPrimitive const& b) { return a.centroid[axis] < b.centroid[axis]; });
+        }
+
+        uint32_t const children = state.node_count.fetch_add(2, std::memory_order_relaxed);
+        node.children[0] = children;
+        node.children[1] = children + 1;
+        node.count = 0;
+        node.axis = axis;
+
+        uint32_t const childFirst[2] { first, mid };
+        uint32_t const childCount[2] { mid - first, first + count - mid };
+        if (count >= PARALLEL_BUILD_THRESHOLD)
+        {
+            state.pPool->parallelFor(2, 1, [&](uint32_t begin, uint32_t end) {
+                for (uint32_t c = begin; c != end; ++c)
+                    buildRecursive(state, children + c, childFirst[c], childCount[c], depth + 1);
+            });
+        }
+        else
+        {
+            for (uint32_t c = 0; c != 2; ++c)
+                buildRecursive(state, children + c, childFirst[c], childCount[c], depth + 1);
+        }
+    }
+
+    // depth first, returns the index of the flattened node
+    static auto flatten(BuildNode const* pNodes, uint32_t nodeIndex, std::vector<BvhNode>* pOutNodes) -> uint32_t
+    {
+        BuildNode const& node = pNodes[nodeIndex];
+        uint32_t const flatIndex = static_cast<uint32_t>(pOutNodes->size());
+        pOutNodes->push_back({
+            .boundsMin = { node.bounds.min[0], node.bounds.min[1], node.bounds.min[2] },
+            .offset = node.first,
+            .boundsMax = { node.bounds.max[0], node.bounds.max[1], node.bounds.max[2] },
+            .info = node.count
+        });
+        if (node.count == 0)
+        {
+            flatten(pNodes, node.children[0], pOutNodes);
+            uint32_t const second = flatten(pNodes, node.children[1], pOutNodes);
+            (*pOutNodes)[flatIndex].offset = second;
+            (*pOutNodes)[flatIndex].info = node.axis << 16;
+        }
+        return flatIndex;
+    }
+
+    static auto nodeBounds(BvhNode const& node) -> Aabb
+    {
+        return { { node.boundsMin[0], node.boundsMin[1], node.boundsMin[2] }, { node.boundsMax[0], node.boundsMax[1], node.boundsMax[2] } };
+    }
+
+    // surface area weighted by what a hit costs, summed over the nodes and divided by the area of the root in sahCost
+    static auto nodeCost(BvhNode const& node, float traversalCost) -> float
+    {
+        uint32_t const count = node.info & 0xffff;
+        return surfaceArea(nodeBounds(node)) * (count != 0 ? static_cast<float>(count) : traversalCost);
+    }
+
+    static auto refitNode(BvhNode* pNodes, uint32_t nodeIndex, uint32_t const* pPrimitiveIndices, Aabb const* pPrimitiveBounds) -> void
+    {
+        BvhNode& node = pNodes[nodeIndex];
+        uint32_t const count = node.info & 0xffff;
+        Aabb bounds = emptyAabb();
+        if (count != 0)
+        {
+            for (uint32_t i = 0; i != count; ++i)
+                grow(&bounds, pPrimitiveBounds[pPrimitiveIndices[node.offset + i]]);
+        }
+        else
+        {
+            grow(&bounds, nodeBounds(pNodes[nodeIndex + 1]));
+            grow(&bounds, nodeBounds(pNodes[node.offset]));
+        }
+        std::copy_n(bounds.min, 3, node.boundsMin);
+        std::copy_n(bounds.max, 3, node.boundsMax);
+    }
+
+    // a subtree is the range from its root to its rightmost leaf, children come after their parent
+    static auto subtreeEnd(BvhNode const* pNodes, uint32_t nodeIndex) -> uint32_t
+    {
+        while ((pNodes[nodeIndex].info & 0xffff) == 0)
+            nodeIndex = pNodes[nodeIndex].offset;
+        return nodeIndex + 1;
+    }
+
+    auto Bvh::build(ThreadPool& pool, Aabb const* pPrimitiveBounds, uint32_t primitive_count, BvhBuildOptions const& options) -> void
+    {
+        clear();
+        if (primitive_count == 0)
+            return;
+
+        auto const start = std::chrono::steady_clock::now();
+
+        std::vector<BuildPrimitive> primitives(primitive_count);
+        pool.parallelFor(primitive_count, 16384, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i != end; ++i)
+            {
+                Aabb const& bounds = pPrimitiveBounds[i];
+                primitives[i].bounds = bounds;
+                for (uint32_t a = 0; a != 3; ++a)
+                    primitives[i].centroid[a] = 0.5f * (bounds.min[a] + bounds.max[a]);
+                primitives[i].index = i;
+            }
+        });
+
+        // a binary tree with at least one primitive per leaf has at most 2n - 1 nodes
+        std::vector<BuildNode> buildNodes(2 * static_cast<size_t>(primitive_count) - 1);
+        BuildState state;
+        state.options = options;
+        state.pPool = &pool;
+        state.pPrimitives = primitives.data();
+        state.pNodes = buildNodes.data();
+        state.node_count = 1;
+        buildRecursive(state, 0, 0, primitive_count, 0);
+
+        m_nodes.reserve(state.node_count.load());
+        flatten(buildNodes.data(), 0, &m_nodes);
+        m_primitiveIndices.resize(primitive_count);
+        for (uint32_t i = 0; i != primitive_count; ++i)
+            m_primitiveIndices[i] = primitives[i].index;
+        m_depth = state.depth.load();
+        m_options = options;
+
+        float cost = 0.f;
+        for (BvhNode const& node : m_nodes)
+            cost += nodeCost(node, m_options.traversalCost);
+        float const rootArea = surfaceArea(nodeBounds(m_nodes[0]));
+        m_sahCost = m_builtSahCost = rootArea > 0.f ? cost / rootArea : 0.f;
+
+        std::chrono::duration<float, std::milli> const elapsed = std::chrono::steady_clock::now() - start;
+        m_buildMilliseconds = elapsed.count();
+        MXC_INFO("Bvh: %u primitives, %u nodes, depth %u, built in %.2f ms on %u threads", primitive_count, nodeCount(), m_depth,
+                 m_buildMilliseconds, pool.threadCount() + 1);
+    }
+
+    auto Bvh::refit(ThreadPool& pool, Aabb const* pPrimitiveBounds) -> void
+    {
+        if (m_nodes.empty())
+            return;
+
+        auto const start = std::chrono::steady_clock::now();
+
+        // subtrees below a cut a few levels deep, enough for a few per thread, are contiguous ranges refit from their end. The nodes
+        // above the cut are listed in depth first order, any of them after its ancestors, and refit in reverse once the cut is done
+        std::vector<uint32_t> subtrees;
+        std::vector<uint32_t> topNodes;
+        uint32_t const cutDepth = nodeCount() < PARALLEL_BUILD_THRESHOLD ? 0 : std::bit_width(4 * (pool.threadCount() + 1));
+        struct StackEntry { uint32_t nodeIndex; uint32_t depth; };
+        std::vector<StackEntry> stack { { 0, 0 } };
+        while (!stack.empty())
+        {
+            StackEntry const entry = stack.back();
+            stack.pop_back();
+            BvhNode const& node = m_nodes[entry.nodeIndex];
+            if ((node.info & 0xffff) != 0 || entry.depth == cutDepth)
+            {
+                subtrees.push_back(entry.nodeIndex);
+                continue;
+            }
+            topNodes.push_back(entry.nodeIndex);
+            stack.push_back({ node.offset, entry.depth + 1 });
+            stack.push_back({ entry.nodeIndex + 1, entry.depth + 1 });
+        }
+
+        std::vector<float> subtreeCosts(subtrees.size());
+        pool.parallelFor(static_cast<uint32_t>(subtrees.size()), 1, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t s = begin; s != end; ++s)
+            {
+                float cost = 0.f;
+                for (uint32_t i = subtreeEnd(m_nodes.data(), subtrees[s]); i-- != subtrees[s];)
+                {
+                    refitNode(m_nodes.data(), i, m_primitiveIndices.data(), pPrimitiveBounds);
+                    cost += nodeCost(m_nodes[i], m_options.traversalCost);
+                }
+                subtreeCosts[s] = cost;
+            }
+        });
+
+        float cost = 0.f;
+        for (float const subtreeCost : subtreeCosts)
+            cost += subtreeCost;
+        for (auto it = topNodes.rbegin(); it != topNodes.rend(); ++it)
+        {
+            refitNode(m_nodes.data(), *it, m_primitiveIndices.data(), pPrimitiveBounds);
+            cost += nodeCost(m_nodes[*it], m_options.traversalCost);
+        }
+        float const rootArea = surfaceArea(nodeBounds(m_nodes[0]));
+        m_sahCost = rootArea > 0.f ? cost / rootArea : 0.f;
+
+        std::chrono::duration<float, std::milli> const elapsed = std::chrono::steady_clock::now() - start;
+        m_refitMilliseconds = elapsed.count();
+    }
+
+    auto Bvh::clear() -> void
+    {
+        m_nodes.clear();
+        m_primitiveIndices.clear();
+        m_depth = 0;
+        m_buildMilliseconds = 0.f;
+        m_refitMilliseconds = 0.f;
+        m_sahCost = 0.f;
+        m_builtSahCost = 0.f;
+    }
+
+    auto MeshBvhs::build(ThreadPool& pool, Scene const& scene, BvhBuildOptions const& options) -> void
+    {
+        clear();
+        m_roots.reserve(scene.meshCount());
+        std::vector<Aabb> bounds;
+        Bvh bvh;
+        for (uint32_t m = 0; m != scene.meshCount(); ++m)
+        {
+            Mesh const& mesh = scene.meshes()[m];
+            bounds.resize(mesh.triangleCount);
+            for (uint32_t i = 0; i != mesh.triangleCount; ++i)
+            {
+                uint32_t const* indices = scene.meshTriangleIndices() + 3 * (mesh.firstTriangle + i);
+                bounds[i] = emptyAabb();
+                for (uint32_t v = 0; v != 3; ++v)
+                    grow(&bounds[i], scene.meshVertexPositions() + 3 * indices[v]);
+            }
+            bvh.build(pool, bounds.data(), mesh.triangleCount, options);
+
+            uint32_t const nodeBase = nodeCount();
+            uint32_t const primitiveBase = primitiveCount();
+            m_roots.push_back(nodeBase);
+            for (uint32_t i = 0; i != bvh.nodeCount(); ++i)
+            {
+                BvhNode node = bvh.nodes()[i];
+                node.offset += (node.info & 0xffff) != 0 ? primitiveBase : nodeBase;
+                m_nodes.push_back(node);
+            }
+            for (uint32_t i = 0; i != bvh.primitiveCount(); ++i)
+                m_primitiveIndices.push_back(mesh.firstTriangle + bvh.primitiveIndices()[i]);
+            m_depth = std::max(m_depth, bvh.depth());
+        }
+    }
+
+    auto MeshBvhs::clear() -> void
+    {
+        m_nodes.clear();
+        m_primitiveIndices.clear();
+        m_roots.clear();
+        m_depth = 0;
+    }
+
+    auto computePrimitiveBounds(Scene const& scene, std::vector<Aabb>* pOutBounds) -> void
+    {
+        pOutBounds->resize(scene.sphereCount() + scene.triangleCount() + scene.instanceCount());
+        Aabb* pBounds = pOutBounds->data();
+        for (uint32_t i = 0; i != scene.sphereCount(); ++i)
+        {
+            float const* sphere = scene.sphereGeometry() + 4 * i;
+            pBounds[i] = {
+                { sphere[0] - sphere[3], sphere[1] - sphere[3], sphere[2] - sphere[3] },
+                { sphere[0] + sphere[3], sphere[1] + sphere[3], sphere[2] + sphere[3] }
+            };
+        }
+
+        pBounds += scene.sphereCount();
+        for (uint32_t i = 0; i != scene.triangleCount(); ++i)
+        {
+            pBounds[i] = emptyAabb();
+            for (uint32_t v = 0; v != 3; ++v)
+                grow(&pBounds[i], scene.vertexPositions() + 3 * scene.triangleIndices()[3 * i + v]);
+        }
+
+        pBounds += scene.triangleCount();
+        for (uint32_t i = 0; i != scene.instanceCount(); ++i)
+        {
+            float const* instance = scene.instanceBounds() + 6 * i;
+            pBounds[i] = { { instance[0], instance[1], instance[2] }, { instance[3], instance[4], instance[5] } };
+        }
+    }
+
+    auto TraversalCounters::create(VulkanContext* ctx) -> bool
+    {
+        if (!ctx->device.createBuffer(&m_buffer))
+        {
+            MXC_ERROR("TraversalCounters: couldn't create the counters buffer");
+            return false;
+        }
+
+        uint32_t const zeros[4] {};
+        Buffer staging{sizeof(zeros), BufferType_v::STAGING};
+        ctx->device.createBuffer(&staging, BufferMemoryOptions::SYSTEM_MEMORY);
+        ctx->device.copyToBuffer(zeros, sizeof(zeros), &staging);
+        bool const copied = ctx->device.copyBuffer(ctx, &staging, &m_buffer);
+        ctx->device.destroyBuffer(&staging);
+        return copied;
+    }
+
+    auto TraversalCounters::destroy(VulkanContext* ctx) -> void
+    {
+        if (m_buffer.handle != VK_NULL_HANDLE)
+            ctx->device.destroyBuffer(&m_buffer);
+        m_buffer = Buffer(4 * sizeof(uint32_t), BufferType_v::STORAGE);
+    }
+
+    auto TraversalCounters::descriptor() const -> DescriptorInfo
+    {
+        DescriptorInfo info;
+        info.buffer = { .buffer = m_buffer.handle, .offset = 0, .range = m_buffer.size };
+        return info;
+    }
+
+    auto TraversalCounters::read(VulkanContext* ctx, uint64_t* pOutRayCount, uint64_t* pOutStepCount) -> void
+    {
+        Buffer readback{m_buffer.size, BufferType_v::READBACK};
+        ctx->device.createBuffer(&readback);
+        ctx->device.copyBuffer(ctx, &m_buffer, &readback);
+        uint32_t const* words = static_cast<uint32_t const*>(readback.mapped);
+        *pOutRayCount = (static_cast<uint64_t>(words[1]) << 32) | words[0];
+        *pOutStepCount = (static_cast<uint64_t>(words[3]) << 32) | words[2];
+        ctx->device.destroyBuffer(&readback);
+    }
+}
@@ -0,0 +1,128 @@
+#ifndef MXC_BVH_H
+#define MXC_BVH_H
+
+#include <vulkan/vulkan.h>
+#include "VulkanCommon.h"
+#include "Buffer.h"
+#include "Shader.h"
+#include "VulkanContext.inl"
+
+#include <cstdint>
+#include <vector>
+
+namespace mxc
+{
+	class Scene;
+	class ThreadPool;
+
+	struct Aabb
+	{
+		float min[3];
+		float max[3];
+	};
+
+	// 32 bytes, two nodes per cache line, BvhNode in shaders/spectrumTest/bvh.comp
+	struct BvhNode
+	{
+		float boundsMin[3];
+		uint32_t offset; // leaf: first entry in the primitive indices, interior: second child, the first one is the next node
+		float boundsMax[3];
+		uint32_t info;   // primitive count in the low 16 bits, 0 for interior nodes, which keep the split axis in the high 16 bits
+	};
+	static_assert(sizeof(BvhNode) == 32);
+
+	struct BvhBuildOptions
+	{
+		uint32_t binCount = 16;          // per axis, candidate split planes are the bin boundaries
+		uint32_t maxLeafPrimitives = 4;  // larger leaves are split even when the SAH says otherwise
+		float traversalCost = 1.f;       // of an interior node, relative to a primitive intersection
+		float rebuildCostRatio = 1.3f;   // refits raising the SAH cost of the tree past this multiple of the built one ask for a rebuild
+	};
+
+	// traversal stack size in the shaders. The builder switches to median splits past half of it, such that no tree is deeper
+	static uint32_t constexpr BVH_MAX_DEPTH = 64;
+
+	// Binary BVH built with the binned surface area heuristic, flattened depth first: the first child of an interior node is the
+	// node after it, such that descending left is a sequential read. Primitives are referenced through an index array sorted by
+	// leaf, the scene streams keep their order since lights and materials refer to them
+	class Bvh
+	{
+	public:
+		// subtrees larger than a few thousand primitives are built in parallel on the pool
+		auto build(ThreadPool& pool, Aabb const* pPrimitiveBounds, uint32_t primitive_count, BvhBuildOptions const& options = {}) -> void;
+		// Recomputes the boxes bottom up for primitives which moved since the build, in time linear in the tree size, keeping its
+		// topology and the order of the primitive indices. Subtrees are refit in parallel on the pool, then the nodes above them
+		auto refit(ThreadPool& pool, Aabb const* pPrimitiveBounds) -> void;
+		auto clear() -> void;
+
+		auto nodeCount() const -> uint32_t { return static_cast<uint32_t>(m_nodes.size()); }
+		auto primitiveCount() const -> uint32_t { return static_cast<uint32_t>(m_primitiveIndices.size()); }
+		auto nodes() const -> BvhNode const* { return m_nodes.data(); }
+		auto primitiveIndices() const -> uint32_t const* { return m_primitiveIndices.data(); }
+		auto depth() const -> uint32_t { return m_depth; }
+		auto buildMilliseconds() const -> float { return m_buildMilliseconds; }
+		auto refitMilliseconds() const -> float { return m_refitMilliseconds; }
+
+		// expected cost of a ray hitting the root, as the sum over nodes of the probability of hitting them, their surface area
+		// relative to the root, times the traversal cost of interior nodes or the primitive count of leaves
+		auto sahCost() const -> float { return m_sahCost; }
+		// refits loosen the boxes of a tree split for other positions, past BvhBuildOptions::rebuildCostRatio of the built cost the
+		// traversal loses more than a build costs
+		auto needsRebuild() const -> bool { return m_sahCost > m_options.rebuildCostRatio * m_builtSahCost; }
+
+	private:
+		std::vector<BvhNode> m_nodes;
+		std::vector<uint32_t> m_primitiveIndices;
+		BvhBuildOptions m_options;
+		uint32_t m_depth = 0;
+		float m_buildMilliseconds = 0.f;
+		float m_refitMilliseconds = 0.f;
+		float m_sahCost = 0.f;
+		float m_builtSahCost = 0.f;
+	};
+
+	// Bottom level BVHs of the instanced meshes of a scene, one per mesh however many instances it has, built in object space and
+	// concatenated: interior offsets and leaf ranges are relative to the start of the arrays. Leaves refer to triangles of the mesh
+	// streams, the top level BVH over computePrimitiveBounds refers to instances
+	class MeshBvhs
+	{
+	public:
+		auto build(ThreadPool& pool, Scene const& scene, BvhBuildOptions const& options = {}) -> void;
+		auto clear() -> void;
+
+		auto nodeCount() const -> uint32_t { return static_cast<uint32_t>(m_nodes.size()); }
+		auto primitiveCount() const -> uint32_t { return static_cast<uint32_t>(m_primitiveIndices.size()); }
+		auto nodes() const -> BvhNode const* { return m_nodes.data(); }
+		auto primitiveIndices() const -> uint32_t const* { return m_primitiveIndices.data(); }
+		auto root(uint32_t meshIndex) const -> uint32_t { return m_roots[meshIndex]; }
+		auto depth() const -> uint32_t { return m_depth; } // of the deepest mesh
+
+	private:
+		std::vector<BvhNode> m_nodes;
+		std::vector<uint32_t> m_primitiveIndices;
+		std::vector<uint32_t> m_roots;
+		uint32_t m_depth = 0;
+	};
+
+	// bounds of the primitives of a scene, numbered as in the shaders: spheres first, then triangles, then instances
+	auto computePrimitiveBounds(Scene const& scene, std::vector<Aabb>* pOutBounds) -> void;
+
+	// Rays traced and nodes visited by the traversal in the accumulation shader since creation, as two 64 bit counters split in
+	// 32 bit words, incremented once per wave
+	class TraversalCounters
+	{
+	public:
+		auto create(VulkanContext* ctx) -> bool;
+		auto destroy(VulkanContext* ctx) -> void;
+
+		auto descriptor() const -> DescriptorInfo;
+
+		// blocking, the device has to be idle
+		auto read(VulkanContext* ctx, uint64_t* pOutRayCount, uint64_t* pOutStepCount) -> void;
+
+	private:
+		Buffer m_buffer{4 * sizeof(uint32_t), BufferType_v::STORAGE};
+	};
+}
+
+#endif // MXC_BVH_H
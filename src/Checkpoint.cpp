@@ -0,0 +1,199 @@
+#include "Checkpoint.h"
+#include "MappedFile.h"
+#include "Buffer.h"
+#include "CommandBuffer.h"
+#include "VulkanContext.inl"
+#include "logging.h"
+
+#include <cstring>
+#include <string>
+#include <filesystem>
+#include <algorithm>
+
+namespace mxc
+{
+    static char constexpr CHECKPOINT_MAGIC[8] { 'M', 'X', 'C', 'C', 'K', 'P', 'T', '\0' };
+    static uint32_t constexpr CHECKPOINT_VERSION = 1;
+    static uint64_t constexpr CHECKPOINT_ALIGNMENT = 4096; // image data starts on page boundaries
+
+    struct CheckpointImageHeader
+    {
+        uint32_t width;
+        uint32_t height;
+        uint32_t format; // VkFormat
+        uint32_t bytesPerPixel;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    struct CheckpointHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t image_count;
+        CheckpointState state;
+        CheckpointImageHeader images[CHECKPOINT_MAX_IMAGE_COUNT];
+    };
+
+    static auto imageBytes(CheckpointImage const& image) -> uint64_t
+    {
+        return static_cast<uint64_t>(image.extent.width) * image.extent.height * image.extent.depth * image.bytesPerPixel;
+    }
+
+    static auto copyRegion(CheckpointImage const& image) -> VkBufferImageCopy
+    {
+        return {
+            .bufferOffset = 0,
+            .bufferRowLength = 0,
+            .bufferImageHeight = 0,
+            .imageSubresource = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .mipLevel = 0, .baseArrayLayer = 0, .layerCount = 1},
+            .imageOffset = {0, 0, 0},
+            .imageExtent = image.extent
+        };
+    }
+
+    auto saveCheckpoint(VulkanContext* ctx, char const* filename, CheckpointImage const* pImages, uint32_t image_count,
+                        CheckpointState const& state) -> bool
+    {
+        MXC_ASSERT(image_count <= CHECKPOINT_MAX_IMAGE_COUNT, "saveCheckpoint: at most %u images", CHECKPOINT_MAX_IMAGE_COUNT);
+
+        CheckpointHeader header{};
+        memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+        header.version = CHECKPOINT_VERSION;
+        header.image_count = image_count;
+        header.state = state;
+
+        uint64_t offset = CHECKPOINT_ALIGNMENT;
+        uint64_t maxImageBytes = 0;
+        for (uint32_t i = 0; i != image_count; ++i)
+        {
+            uint64_t const size = imageBytes(pImages[i]);
+            header.images[i] = {
+                .width = pImages[i].extent.width,
+                .height = pImages[i].extent.height,
+                .format = static_cast<uint32_t>(pImages[i].format),
+                .bytesPerPixel = pImages[i].bytesPerPixel,
+                .offset = offset,
+                .size = size
+            };
+            offset = (offset + size + CHECKPOINT_ALIGNMENT - 1) & ~(CHECKPOINT_ALIGNMENT - 1);
+            maxImageBytes = std::max(maxImageBytes, size);
+        }
+
+        std::string const temporaryFilename = std::string(filename) + ".tmp";
+        MappedFile file;
+        if (!file.open(temporaryFilename.c_str(), MappingMode::READ_WRITE, offset))
+            return false;
+
+        // one image at a time, such that the host visible memory needed stays bounded by the largest
+        Buffer readback{maxImageBytes, BufferType_v::READBACK};
+        ctx->device.createBuffer(&readback);
+        for (uint32_t i = 0; i != image_count; ++i)
+        {
+            CommandBuffer cmdBuf;
+            cmdBuf.allocate(ctx, CommandType::COMPUTE);
+            cmdBuf.begin();
+            // also orders the copy after the passes submitted before on the same queue
+            ctx->device.insertMemoryBarrier(cmdBuf.handle, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+                                            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+            VkBufferImageCopy const region = copyRegion(pImages[i]);
+            vkCmdCopyImageToBuffer(cmdBuf.handle, pImages[i].image, VK_IMAGE_LAYOUT_GENERAL, readback.handle, 1, &region);
+            ctx->device.insertMemoryBarrier(cmdBuf.handle, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT,
+                                            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT);
+            cmdBuf.end();
+            ctx->device.flushCommandBuffer(&cmdBuf, CommandType::COMPUTE);
+            cmdBuf.free(ctx);
+
+            memcpy(file.data() + header.images[i].offset, readback.mapped, header.images[i].size);
+        }
+        ctx->device.destroyBuffer(&readback);
+
+        memcpy(file.data(), &header, sizeof(header));
+        bool const flushed = file.flush();
+        file.close();
+        if (!flushed)
+        {
+            MXC_ERROR("couldn't write checkpoint %s to disk", temporaryFilename.c_str());
+            return false;
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temporaryFilename, filename, error);
+        if (error)
+        {
+            MXC_ERROR("couldn't rename %s to %s: %s", temporaryFilename.c_str(), filename, error.message().c_str());
+            return false;
+        }
+
+        MXC_INFO("checkpoint %s saved at pass %u", filename, state.sampleIndex);
+        return true;
+    }
+
+    auto loadCheckpoint(VulkanContext* ctx, char const* filename, CheckpointImage const* pImages, uint32_t image_count,
+                        CheckpointState* pOutState) -> bool
+    {
+        MappedFile file;
+        if (!file.open(filename, MappingMode::READ))
+            return false;
+
+        CheckpointHeader header;
+        if (file.size() < sizeof(header))
+        {
+            MXC_ERROR("%s is too small to be a checkpoint", filename);
+            return false;
+        }
+        memcpy(&header, file.data(), sizeof(header));
+        if (memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0 || header.version != CHECKPOINT_VERSION)
+        {
+            MXC_ERROR("%s isn't a checkpoint of version %u", filename, CHECKPOINT_VERSION);
+            return false;
+        }
+        if (header.image_count != image_count)
+        {
+            MXC_ERROR("checkpoint %s has %u images, %u expected", filename, header.image_count, image_count);
+            return false;
+        }
+
+        uint64_t maxImageBytes = 0;
+        for (uint32_t i = 0; i != image_count; ++i)
+        {
+            CheckpointImageHeader const& saved = header.images[i];
+            if (saved.width != pImages[i].extent.width || saved.height != pImages[i].extent.height
+                || saved.format != static_cast<uint32_t>(pImages[i].format) || saved.size != imageBytes(pImages[i])
+                || saved.offset + saved.size > file.size())
+            {
+                MXC_ERROR("image %u of checkpoint %s is %ux%u, doesn't match the film (%ux%u) or is truncated",
+                          i, filename, saved.width, saved.height, pImages[i].extent.width, pImages[i].extent.height);
+                return false;
+            }
+            maxImageBytes = std::max(maxImageBytes, saved.size);
+        }
+
+        Buffer staging{maxImageBytes, BufferType_v::STAGING};
+        ctx->device.createBuffer(&staging, BufferMemoryOptions::SYSTEM_MEMORY);
+        for (uint32_t i = 0; i != image_count; ++i)
+        {
+            ctx->device.copyToBuffer(file.data() + header.images[i].offset, header.images[i].size, &staging);
+
+            CommandBuffer cmdBuf;
+            cmdBuf.allocate(ctx, CommandType::COMPUTE);
+            cmdBuf.begin();
+            ctx->device.insertMemoryBarrier(cmdBuf.handle, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                                            VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                            VK_PIPELINE_STAGE_TRANSFER_BIT);
+            VkBufferImageCopy const region = copyRegion(pImages[i]);
+            vkCmdCopyBufferToImage(cmdBuf.handle, staging.handle, pImages[i].image, VK_IMAGE_LAYOUT_GENERAL, 1, &region);
+            ctx->device.insertMemoryBarrier(cmdBuf.handle, VK_ACCESS_TRANSFER_WRITE_BIT,
+                                            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                                            VK_PIPELINE_STAGE_TRANSFER_BIT);
+            cmdBuf.end();
+            ctx->device.flushCommandBuffer(&cmdBuf, CommandType::COMPUTE);
+            cmdBuf.free(ctx);
+        }
+        ctx->device.destroyBuffer(&staging);
+
+        *pOutState = header.state;
+        MXC_INFO("resumed %s at pass %u", filename, header.state.sampleIndex);
+        return true;
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef MXC_CHECKPOINT_H
+#define MXC_CHECKPOINT_H
+
+#include <vulkan/vulkan.h>
+#include "VulkanCommon.h"
+
+#include <cstdint>
+
+namespace mxc
+{
+	// a storage image whose content is part of the render state, in VK_IMAGE_LAYOUT_GENERAL with transfer source and destination usage
+	struct CheckpointImage
+	{
+		VkImage image;
+		VkExtent3D extent;
+		VkFormat format;
+		uint32_t bytesPerPixel;
+	};
+
+	// host side state needed to continue a render exactly where it stopped
+	struct CheckpointState
+	{
+		uint64_t rngSeed;
+		uint32_t sampleIndex; // next pass to render
+	};
+
+	static uint32_t constexpr CHECKPOINT_MAX_IMAGE_COUNT = 8;
+
+	// Copies the images back one at a time through a host visible buffer, then into a memory mapped file, next to a header with the
+	// state and the layout of each image. The file is written under filename.tmp and renamed once flushed to disk, so a crash while
+	// saving leaves the previous checkpoint intact. Blocking, meant to be called every few minutes between two passes
+	auto saveCheckpoint(VulkanContext* ctx, char const* filename, CheckpointImage const* pImages, uint32_t image_count,
+	                    CheckpointState const& state) -> bool;
+
+	// uploads the images saved by saveCheckpoint, which have to match the given ones in count, extent and format
+	auto loadCheckpoint(VulkanContext* ctx, char const* filename, CheckpointImage const* pImages, uint32_t image_count,
+	                    CheckpointState* pOutState) -> bool;
+}
+
+#endif // MXC_CHECKPOINT_H
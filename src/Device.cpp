@@ -17,6 +17,7 @@
 #pragma clang diagnostic pop
 
 #include <array>
+#include <algorithm>
 #include <utility>
 
 namespace mxc
@@ -37,6 +38,14 @@ namespace mxc
         // Iterate physical devices to find one that fits the bill.
         VkPhysicalDevice physicalDevices[32];
         VK_CHECK(vkEnumeratePhysicalDevices(ctx->instance, &physicalDevice_count, physicalDevices));
+
+        // evaluate discrete GPUs first, such that a relaxed requirement on the device type still picks them when present
+        std::stable_partition(physicalDevices, physicalDevices + physicalDevice_count, [](VkPhysicalDevice physicalDevice) {
+            VkPhysicalDeviceProperties properties;
+            vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+            return properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU;
+        });
+
         for (uint32_t i = 0; i < physicalDevice_count; ++i) 
         {
             VkPhysicalDeviceProperties properties;
@@ -212,8 +221,14 @@ namespace mxc
         VkPhysicalDeviceVulkan13Features features13{};
         features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
         features13.synchronization2 = VK_TRUE;
+
+        // timeline semaphores track asynchronous readbacks, mandatory since Vulkan 1.2
+        VkPhysicalDeviceVulkan12Features features12{};
+        features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        features12.timelineSemaphore = VK_TRUE;
+        features12.pNext = &features13;
         
-        features2.pNext = &features13;
+        features2.pNext = &features12;
 
         VkDeviceCreateInfo deviceCreateInfo = {};
         deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -274,7 +289,7 @@ namespace mxc
         PhysicalDeviceQueueFamiliesSupport* outFamilySupport, SwapchainSupport* outSwapchainSupport) const -> bool
     {
         // Discrete GPU?
-        if (properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) 
+        if (requirements.discreteGPU && properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) 
         {
                 MXC_INFO("Device is not a discrete GPU, and one is required. Skipping.");
                 return false;
@@ -302,8 +317,11 @@ namespace mxc
 
                 // If also a present queue, this prioritizes grouping of the 2.
                 VkBool32 supportsPresent = VK_FALSE;
-                assert(ctx->swapchain.fpGetPhysicalDeviceSurfaceSupportKHR);
-                VK_CHECK(ctx->swapchain.fpGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &supportsPresent));
+                if (requirements.presentation)
+                {
+                    assert(ctx->swapchain.fpGetPhysicalDeviceSurfaceSupportKHR);
+                    VK_CHECK(ctx->swapchain.fpGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &supportsPresent));
+                }
                 if (supportsPresent) 
                 {
                     outFamilySupport->presentFamily = i;
@@ -334,7 +352,12 @@ namespace mxc
         // If a present queue hasn't been found, iterate again and take the first one.
         // This should only happen if there is a queue that supports graphics but NOT
         // present.
-        if (outFamilySupport->presentFamily == -1) 
+        if (!requirements.presentation)
+        {
+            // nothing is ever presented. Alias the graphics family so that queue and command pool creation stay uniform
+            outFamilySupport->presentFamily = outFamilySupport->graphicsFamily;
+        }
+        else if (outFamilySupport->presentFamily == -1) 
         {
             for (uint32_t i = 0; i < queueFamilyProp_count; ++i) 
             {
@@ -379,12 +402,15 @@ namespace mxc
         MXC_TRACE("Compute Family Index:  %i", outFamilySupport->computeFamily);
 
         // Query swapchain support.
-        querySwapchainSupport(ctx, physicalDevice, surface, outSwapchainSupport);
-
-        if (outSwapchainSupport->formats.size() < 1 || outSwapchainSupport->presentModes.size() < 1) 
+        if (requirements.presentation)
         {
-            MXC_INFO("Required swapchain support not present, skipping device.");
-            return false;
+            querySwapchainSupport(ctx, physicalDevice, surface, outSwapchainSupport);
+
+            if (outSwapchainSupport->formats.size() < 1 || outSwapchainSupport->presentModes.size() < 1) 
+            {
+                MXC_INFO("Required swapchain support not present, skipping device.");
+                return false;
+            }
         }
 
         // Device extensions.
@@ -427,8 +453,12 @@ namespace mxc
 
         VkPhysicalDeviceVulkan13Features features13{};
         features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+
+        VkPhysicalDeviceVulkan12Features features12{};
+        features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        features12.pNext = &features13;
         
-        features2.pNext = &features13;
+        features2.pNext = &features12;
         vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
 
         if (features13.synchronization2 != VK_TRUE)
@@ -437,6 +467,12 @@ namespace mxc
             return false;
         }
 
+        if (features12.timelineSemaphore != VK_TRUE)
+        {
+            MXC_TRACE("device doesn't support timelineSemaphore feature, skipping device...");
+            return false;
+        }
+
         // Device meets all requirements.
         return true;
     }
@@ -567,6 +603,11 @@ namespace mxc
             MXC_ASSERT((inOutBuffer->memoryPropertyFlags & (VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) != 0,
                        "Staging buffer memory property flags set uncorrectly!");
         }
+        else if ((inOutBuffer->type & BufferType_v::READBACK) == BufferType_v::READBACK)
+        {
+            bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+            inOutBuffer->memoryPropertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        }
 
         // buffers can be read-write too, therefore no else if here
         if ((inOutBuffer->type & BufferType_v::STORAGE) == BufferType_v::STORAGE)
@@ -590,7 +631,7 @@ namespace mxc
         VmaAllocation allocation;
         VmaAllocationInfo allocationInfo;
         VK_CHECK(vmaCreateBuffer(vmaAllocator, &bufferCreateInfo, &allocationCreateInfo, &inOutBuffer->handle, &allocation, &allocationInfo));
-        if ((inOutBuffer->type & BufferType_v::STAGING) == BufferType_v::STAGING) 
+        if ((inOutBuffer->type & (BufferType_v::STAGING | BufferType_v::READBACK)) != 0) 
         {
             inOutBuffer->mapped = allocationInfo.pMappedData;
             MXC_TRACE("Mapping staging buffer to %p", inOutBuffer->mapped);
@@ -682,7 +723,8 @@ namespace mxc
             MXC_WARN("the source buffer you are trying to copy from is bigger (%zu) than the destination buffer (%zu)", src->size, dst->size);
     #endif
         CommandBuffer copyCmdBuf;
-        MXC_ASSERT(copyCmdBuf.allocate(ctx, CommandType::TRANSFER), "couldn't allocate copy Command Buffer");
+        [[maybe_unused]] bool const allocated = copyCmdBuf.allocate(ctx, CommandType::TRANSFER);
+        MXC_ASSERT(allocated, "couldn't allocate copy Command Buffer");
         VkBufferCopy2 bufferCopy {
             .sType = VK_STRUCTURE_TYPE_BUFFER_COPY_2,
             .pNext = nullptr,
@@ -702,7 +744,8 @@ namespace mxc
         copyCmdBuf.begin();
         MXC_ASSERT(copyCmdBuf.canRecord(), "Copy Command Buffer is not in recording state");
         vkCmdCopyBuffer2(copyCmdBuf.handle, &copyBufferInfo);
-        MXC_ASSERT(copyCmdBuf.end(), "Couldn't end recording of copy Command Buffer");
+        [[maybe_unused]] bool const ended = copyCmdBuf.end();
+        MXC_ASSERT(ended, "Couldn't end recording of copy Command Buffer");
 
         flushCommandBuffer(&copyCmdBuf, CommandType::TRANSFER);
         copyCmdBuf.free(ctx);
@@ -759,14 +802,16 @@ namespace mxc
             MXC_TRACE("Target Layout given to image Creation, performing memory barrier operation");
 
             CommandBuffer cmdBuf;
-            MXC_ASSERT(cmdBuf.allocate(ctx, cmdType), "Couldn't allocate image memory barrier command buffer");
+            [[maybe_unused]] bool const allocated = cmdBuf.allocate(ctx, cmdType);
+            MXC_ASSERT(allocated, "Couldn't allocate image memory barrier command buffer");
 
             cmdBuf.begin();
             MXC_ASSERT(cmdBuf.canRecord(), "Image memory barrier Command Buffer is not in recording state");
 
             insertImageMemoryBarrier(cmdBuf.handle, inOutImage->handle, VK_IMAGE_LAYOUT_UNDEFINED, *targetLayout, inOutView->aspectMask);
 
-            MXC_ASSERT(cmdBuf.end(), "Couldn't end recording of image memory barrier Command Buffer");
+            [[maybe_unused]] bool const ended = cmdBuf.end();
+            MXC_ASSERT(ended, "Couldn't end recording of image memory barrier Command Buffer");
 
             flushCommandBuffer(&cmdBuf, cmdType);
             cmdBuf.free(ctx);
@@ -1012,6 +1057,22 @@ namespace mxc
             1, &imageMemoryBarrier);
     }
 
+    auto Device::insertMemoryBarrier(
+        VkCommandBuffer cmdBuf,
+        VkAccessFlags srcAccessMask,
+        VkAccessFlags dstAccessMask,
+        VkPipelineStageFlags srcStageMask,
+        VkPipelineStageFlags dstStageMask) -> void
+    {
+        VkMemoryBarrier const memoryBarrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .pNext = nullptr,
+            .srcAccessMask = srcAccessMask,
+            .dstAccessMask = dstAccessMask
+        };
+        vkCmdPipelineBarrier(cmdBuf, srcStageMask, dstStageMask, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+    }
+
     constexpr auto chooseMemoryPropertyFlags(BufferMemoryOptions options) -> VkMemoryPropertyFlags
     {
         switch (options)
@@ -1052,6 +1113,14 @@ namespace mxc
         {
             res.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
         }
+        else if ((type & BufferType_v::READBACK) == BufferType_v::READBACK)
+        {
+            // read back by the CPU with memcpy or in place, cached memory avoids uncached reads over the bus
+            res.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+            res.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+            res.preferredFlags = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+            return res;
+        }
 
         // buffers can be read-write too, therefore no else if here
         if ((type & BufferType_v::STORAGE) == BufferType_v::STORAGE)
@@ -39,6 +39,11 @@ namespace mxc
 		// required extensions
 		std::vector<char const*> extensions;
 
+		// queue family with present support and swapchain formats/present modes for the context surface
+		bool presentation = true;
+		// when false, integrated, virtual and CPU (e.g. lavapipe) devices are accepted too, discrete GPUs are still preferred
+		bool discreteGPU = true;
+
 		// required features TODO 
 		// bool samplerAnisotropy ...
 	};
@@ -134,6 +139,13 @@ namespace mxc
 			VkImageAspectFlags imageAspectMask,
             VkPipelineStageFlags srcStageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
             VkPipelineStageFlags dstStageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT) -> void;
+		// global memory dependency, e.g. between two dispatches reading and writing the same storage images
+		auto insertMemoryBarrier(
+			VkCommandBuffer cmdBuf,
+			VkAccessFlags srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+			VkAccessFlags dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+			VkPipelineStageFlags srcStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VkPipelineStageFlags dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT) -> void;
 		auto destroyImage(Image* inOutImage) -> void;
 
 		auto createImageView(Image const* pImage, ImageView* pOutView) -> bool;
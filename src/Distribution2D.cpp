@@ -0,0 +1,36 @@
+#include "Distribution2D.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace mxc
+{
+    // count + 1 values from 0 to 1, summed in double such that small values far in a large row still count
+    static auto buildCdf(float const* pFunction, uint32_t count, float* pOut) -> double
+    {
+        double sum = 0.0;
+        for (uint32_t i = 0; i != count; ++i)
+            sum += pFunction[i];
+        double running = 0.0;
+        pOut[0] = 0.f;
+        for (uint32_t i = 0; i != count; ++i)
+        {
+            running += pFunction[i];
+            pOut[i + 1] = sum > 0.0 ? static_cast<float>(running / sum) : static_cast<float>(i + 1) / count;
+        }
+        pOut[count] = 1.f;
+        return sum / count;
+    }
+
+    auto buildDistribution2D(float const* pFunction, uint32_t width, uint32_t height, float* pOutCdfs, float* pOutIntegral) -> void
+    {
+        std::vector<float> rowIntegrals(height);
+        float* pConditional = pOutCdfs + height + 1;
+        for (uint32_t y = 0; y != height; ++y)
+        {
+            float const* pRow = pFunction + static_cast<size_t>(y) * width;
+            rowIntegrals[y] = static_cast<float>(buildCdf(pRow, width, pConditional + static_cast<size_t>(y) * (width + 1)));
+        }
+        *pOutIntegral = static_cast<float>(buildCdf(rowIntegrals.data(), height, pOutCdfs));
+    }
+}
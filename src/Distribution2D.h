@@ -0,0 +1,22 @@
+#ifndef MXC_DISTRIBUTION_2D_H
+#define MXC_DISTRIBUTION_2D_H
+
+#include <cstdint>
+
+namespace mxc
+{
+	// floats written by buildDistribution2D for a width x height function
+	constexpr auto distribution2DSize(uint32_t width, uint32_t height) -> uint64_t
+	{
+		return (height + 1) + static_cast<uint64_t>(height) * (width + 1);
+	}
+
+	// Piecewise constant distribution over [0, 1)^2 of a non negative width x height function, rows first, as pbrt's
+	// PiecewiseConstant2D: the CDF of the marginal distribution of the rows, height + 1 values, then the CDF of the conditional
+	// distribution of each row, width + 1 values each. A point is drawn with a binary search in each, in time logarithmic in the
+	// resolution, and its density is the value of the function over pOutIntegral, the average of the function. Rows summing to 0
+	// and a function which is 0 everywhere get uniform CDFs
+	auto buildDistribution2D(float const* pFunction, uint32_t width, uint32_t height, float* pOutCdfs, float* pOutIntegral) -> void;
+}
+
+#endif // MXC_DISTRIBUTION_2D_H
@@ -0,0 +1,199 @@
+#include "Film.h"
+#include "CommandBuffer.h"
+#include "logging.h"
+
+#include <string>
+#include <initializer_list>
+
+namespace mxc
+{
+    auto Film::create(VulkanContext* ctx, uint32_t width, uint32_t height, wchar_t const* shaderDir) -> bool
+    {
+        if (!createImages(ctx, width, height))
+            return false;
+
+        // resolve shader: display, sum, compensation, sample count, moments, resolved
+        static uint32_t constexpr POOLSIZES_COUNT = 1;
+        VkDescriptorPoolSize const poolSizes[POOLSIZES_COUNT] {
+            {.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .descriptorCount = RESOLVE_BINDING_COUNT}
+        };
+        uint32_t const bindingNumbers_counts[POOLSIZES_COUNT] { RESOLVE_BINDING_COUNT };
+        uint32_t const bindingNumbers[RESOLVE_BINDING_COUNT] { 0, 1, 2, 3, 4, 5 };
+
+        ResourceConfiguration const resConfig {
+            .pPoolSizes = poolSizes,
+            .pBindingNumbers = bindingNumbers,
+            .pBindingNumbers_counts = bindingNumbers_counts,
+            .poolSizes_count = POOLSIZES_COUNT,
+            .usePushDescriptors = false
+        };
+
+        std::wstring const filename = std::wstring(shaderDir) + L"/resolve.comp";
+        wchar_t const* filenames[] { filename.c_str() };
+        VkShaderStageFlagBits const stageFlags[] { VK_SHADER_STAGE_COMPUTE_BIT };
+        ShaderConfiguration shaderConfig{};
+        shaderConfig.filenames = filenames;
+        shaderConfig.stageFlags = stageFlags;
+        shaderConfig.shaderDir = shaderDir;
+        shaderConfig.stage_count = 1;
+
+        if (!m_resolveShader.create(ctx, shaderConfig, resConfig))
+        {
+            MXC_ERROR("Film: couldn't create the resolve shader");
+            return false;
+        }
+
+        if (!m_resolvePipeline.create(ctx, m_resolveShader, width, height))
+        {
+            MXC_ERROR("Film: couldn't create the resolve pipeline");
+            return false;
+        }
+
+        uint32_t strides[POOLSIZES_COUNT] { sizeof(float) * 4 };
+        m_resolveShader.resources.createUpdateTemplate(ctx, VK_PIPELINE_BIND_POINT_COMPUTE, m_resolvePipeline.layout, strides);
+
+        clear(ctx);
+        return true;
+    }
+
+    auto Film::destroy(VulkanContext* ctx) -> void
+    {
+        m_resolvePipeline.destroy(ctx);
+        m_resolveShader.destroy(ctx);
+        destroyImages(ctx);
+    }
+
+    auto Film::resize(VulkanContext* ctx, uint32_t width, uint32_t height) -> bool
+    {
+        MXC_DEBUG("Film: resizing to %ux%u, accumulated samples are discarded", width, height);
+        destroyImages(ctx);
+        if (!createImages(ctx, width, height))
+            return false;
+
+        clear(ctx);
+        return true;
+    }
+
+    auto Film::clear(VulkanContext* ctx) -> void
+    {
+        CommandBuffer cmdBuf;
+        cmdBuf.allocate(ctx, CommandType::COMPUTE);
+        cmdBuf.begin();
+        recordClear(cmdBuf.handle);
+        cmdBuf.end();
+        ctx->device.flushCommandBuffer(&cmdBuf, CommandType::COMPUTE);
+        cmdBuf.free(ctx);
+    }
+
+    auto Film::recordClear(VkCommandBuffer cmdBuf) -> void
+    {
+        static VkClearColorValue constexpr zero { .uint32 = {0, 0, 0, 0} };
+        static VkImageSubresourceRange constexpr range {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .baseMipLevel = 0,
+            .levelCount = 1,
+            .baseArrayLayer = 0,
+            .layerCount = 1
+        };
+
+        // all zero bits are 0.f too, so the same clear value works for float and uint images
+        for (Image const* image : {&m_sum, &m_compensation, &m_sampleCount, &m_moments})
+            vkCmdClearColorImage(cmdBuf, image->handle, VK_IMAGE_LAYOUT_GENERAL, &zero, 1, &range);
+
+        VkMemoryBarrier const barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .pNext = nullptr,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+        };
+        vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier,
+                             0, nullptr, 0, nullptr);
+    }
+
+    auto Film::recordResolve(VulkanContext* ctx, VkCommandBuffer cmdBuf, VkImageView displayView, uint32_t imageIndex) -> void
+    {
+        // accumulation writes -> resolve reads
+        ctx->device.insertMemoryBarrier(cmdBuf);
+
+        DescriptorInfo infos[RESOLVE_BINDING_COUNT];
+        infos[0].image = { .sampler = VK_NULL_HANDLE, .imageView = displayView, .imageLayout = VK_IMAGE_LAYOUT_GENERAL };
+        accumulationDescriptors(&infos[1]);
+        infos[RESOLVE_BINDING_COUNT - 1].image = { .sampler = VK_NULL_HANDLE, .imageView = m_resolvedView.handle, 
+                                                   .imageLayout = VK_IMAGE_LAYOUT_GENERAL };
+
+        m_resolveShader.resources.update(ctx, imageIndex, infos);
+        vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_resolvePipeline.layout, 0, 1,
+                                &m_resolveShader.resources.descriptorSets[imageIndex], 0, nullptr);
+        vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_resolvePipeline.handle);
+        vkCmdDispatch(cmdBuf, (width() + RESOLVE_GROUP_SIZE - 1) / RESOLVE_GROUP_SIZE, (height() + RESOLVE_GROUP_SIZE - 1) / RESOLVE_GROUP_SIZE, 1);
+
+        // resolve reads -> next accumulation writes
+        ctx->device.insertMemoryBarrier(cmdBuf, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    }
+
+    auto Film::accumulationDescriptors(DescriptorInfo* pOutInfos) const -> void
+    {
+        pOutInfos[0].image = { .sampler = VK_NULL_HANDLE, .imageView = m_sumView.handle, .imageLayout = VK_IMAGE_LAYOUT_GENERAL };
+        pOutInfos[1].image = { .sampler = VK_NULL_HANDLE, .imageView = m_compensationView.handle, .imageLayout = VK_IMAGE_LAYOUT_GENERAL };
+        pOutInfos[2] = sampleCountDescriptor();
+        pOutInfos[3] = momentsDescriptor();
+    }
+
+    auto Film::sampleCountDescriptor() const -> DescriptorInfo
+    {
+        DescriptorInfo info;
+        info.image = { .sampler = VK_NULL_HANDLE, .imageView = m_sampleCountView.handle, .imageLayout = VK_IMAGE_LAYOUT_GENERAL };
+        return info;
+    }
+
+    auto Film::momentsDescriptor() const -> DescriptorInfo
+    {
+        DescriptorInfo info;
+        info.image = { .sampler = VK_NULL_HANDLE, .imageView = m_momentsView.handle, .imageLayout = VK_IMAGE_LAYOUT_GENERAL };
+        return info;
+    }
+
+    auto Film::checkpointImages(CheckpointImage* pOutImages) const -> void
+    {
+        uint32_t constexpr sumBytes = 4 * sizeof(float);
+        pOutImages[0] = {.image = m_sum.handle, .extent = m_sum.extent, .format = SUM_FORMAT, .bytesPerPixel = sumBytes};
+        pOutImages[1] = {.image = m_compensation.handle, .extent = m_compensation.extent, .format = SUM_FORMAT, .bytesPerPixel = sumBytes};
+        pOutImages[2] = {.image = m_sampleCount.handle, .extent = m_sampleCount.extent, .format = COUNT_FORMAT, .bytesPerPixel = sizeof(uint32_t)};
+        pOutImages[3] = {.image = m_moments.handle, .extent = m_moments.extent, .format = SUM_FORMAT, .bytesPerPixel = sumBytes};
+    }
+
+    auto Film::createImages(VulkanContext* ctx, uint32_t width, uint32_t height) -> bool
+    {
+        VkImageLayout constexpr targetLayout = VK_IMAGE_LAYOUT_GENERAL;
+        VkExtent3D const extent {.width = width, .height = height, .depth = 1};
+        m_sum.extent = m_compensation.extent = m_sampleCount.extent = m_moments.extent = m_resolved.extent = extent;
+
+        bool res = ctx->device.createImage(ctx, VK_IMAGE_TILING_OPTIMAL, &m_sum, &targetLayout, &m_sumView, CommandType::COMPUTE);
+        res = res && ctx->device.createImage(ctx, VK_IMAGE_TILING_OPTIMAL, &m_compensation, &targetLayout, &m_compensationView,
+                                             CommandType::COMPUTE);
+        res = res && ctx->device.createImage(ctx, VK_IMAGE_TILING_OPTIMAL, &m_sampleCount, &targetLayout, &m_sampleCountView,
+                                             CommandType::COMPUTE);
+        res = res && ctx->device.createImage(ctx, VK_IMAGE_TILING_OPTIMAL, &m_moments, &targetLayout, &m_momentsView,
+                                             CommandType::COMPUTE);
+        res = res && ctx->device.createImage(ctx, VK_IMAGE_TILING_OPTIMAL, &m_resolved, &targetLayout, &m_resolvedView,
+                                             CommandType::COMPUTE);
+        if (!res)
+            MXC_ERROR("Film: couldn't create %ux%u accumulation images", width, height);
+
+        return res;
+    }
+
+    auto Film::destroyImages(VulkanContext* ctx) -> void
+    {
+        for (ImageView* view : {&m_sumView, &m_compensationView, &m_sampleCountView, &m_momentsView, &m_resolvedView})
+        {
+            if (view->isValid())
+                ctx->device.destroyImageView(view);
+            view->handle = VK_NULL_HANDLE;
+        }
+
+        for (Image* image : {&m_sum, &m_compensation, &m_sampleCount, &m_moments, &m_resolved})
+            if (image->handle != VK_NULL_HANDLE)
+                ctx->device.destroyImage(image);
+    }
+}
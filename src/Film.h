@@ -0,0 +1,87 @@
+#ifndef MXC_FILM_H
+#define MXC_FILM_H
+
+#include <vulkan/vulkan.h>
+#include "VulkanCommon.h"
+#include "Image.h"
+#include "Shader.h"
+#include "Pipeline.h"
+#include "Checkpoint.h"
+#include "VulkanContext.inl"
+
+#include <cstdint>
+
+namespace mxc
+{
+	// Accumulation target for progressive compute renderers. Radiance is summed in float32, with a second float32 image holding the
+	// Kahan compensation term (the low order bits lost by each addition), and a per pixel sample count. Nothing is averaged in place,
+	// such that the estimate keeps converging for as many samples as the budget allows. A resolve pass divides sum by count and writes
+	// the result to the display image (swapchain or offscreen output), in whatever format that has, and unclamped to an RGBA32F resolved
+	// image, which is the one to read back for HDR output. Next to it, Welford running mean and
+	// M2 of the sample luminance are kept, from which the variance of each pixel estimate is known at any time (see AdaptiveSampler.h)
+	// Accumulation shaders bind, in order, sum (float4), compensation (float4), sample count (uint), moments (float4, x = mean, y = M2),
+	// see shaders/spectrumTest/film.comp
+	class Film
+	{
+	public:
+		static VkFormat constexpr SUM_FORMAT = VK_FORMAT_R32G32B32A32_SFLOAT;
+		static VkFormat constexpr COUNT_FORMAT = VK_FORMAT_R32_UINT;
+		static uint32_t constexpr ACCUMULATION_BINDING_COUNT = 4;
+		static uint32_t constexpr CHECKPOINT_IMAGE_COUNT = 4; // sum, compensation, sample count, moments
+		static uint32_t constexpr RESOLVE_GROUP_SIZE = 16; // numthreads of resolve.comp
+
+	public:
+		auto create(VulkanContext* ctx, uint32_t width, uint32_t height, wchar_t const* shaderDir) -> bool;
+		auto destroy(VulkanContext* ctx) -> void;
+
+		// recreates the accumulation images, discarding every sample
+		auto resize(VulkanContext* ctx, uint32_t width, uint32_t height) -> bool;
+
+		// zeroes sum, compensation, sample count and moments. Blocking version submits and waits on its own command buffer
+		auto clear(VulkanContext* ctx) -> void;
+		auto recordClear(VkCommandBuffer cmdBuf) -> void;
+
+		// to be recorded after the accumulation dispatch, inserts the barrier between the two. displayView has to be a storage image
+		// in VK_IMAGE_LAYOUT_GENERAL, imageIndex selects which resolve descriptor set gets updated
+		auto recordResolve(VulkanContext* ctx, VkCommandBuffer cmdBuf, VkImageView displayView, uint32_t imageIndex) -> void;
+
+		// writes ACCUMULATION_BINDING_COUNT descriptors, to be used for the bindings of the accumulation shader
+		auto accumulationDescriptors(DescriptorInfo* pOutInfos) const -> void;
+		auto sampleCountDescriptor() const -> DescriptorInfo;
+		auto momentsDescriptor() const -> DescriptorInfo;
+
+		// writes CHECKPOINT_IMAGE_COUNT images, everything needed to continue accumulating
+		auto checkpointImages(CheckpointImage* pOutImages) const -> void;
+
+		// RGBA32F average written by the last resolve, in VK_IMAGE_LAYOUT_GENERAL with transfer source usage
+		auto resolvedImage() const -> VkImage { return m_resolved.handle; }
+
+		auto width() const -> uint32_t { return m_sum.extent.width; }
+		auto height() const -> uint32_t { return m_sum.extent.height; }
+
+	private:
+		auto createImages(VulkanContext* ctx, uint32_t width, uint32_t height) -> bool;
+		auto destroyImages(VulkanContext* ctx) -> void;
+
+	private:
+		static uint32_t constexpr RESOLVE_BINDING_COUNT = ACCUMULATION_BINDING_COUNT + 2; // display and resolved
+		static VkImageUsageFlags constexpr IMAGE_USAGE = VK_IMAGE_USAGE_STORAGE_BIT
+			| VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+
+		Image m_sum{VK_IMAGE_TYPE_2D, {0, 0, 1}, SUM_FORMAT, IMAGE_USAGE};
+		Image m_compensation{VK_IMAGE_TYPE_2D, {0, 0, 1}, SUM_FORMAT, IMAGE_USAGE};
+		Image m_sampleCount{VK_IMAGE_TYPE_2D, {0, 0, 1}, COUNT_FORMAT, IMAGE_USAGE};
+		Image m_moments{VK_IMAGE_TYPE_2D, {0, 0, 1}, SUM_FORMAT, IMAGE_USAGE}; // RG32F storage isn't guaranteed
+		Image m_resolved{VK_IMAGE_TYPE_2D, {0, 0, 1}, SUM_FORMAT, IMAGE_USAGE};
+		ImageView m_sumView{VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT};
+		ImageView m_compensationView{VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT};
+		ImageView m_sampleCountView{VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT};
+		ImageView m_momentsView{VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT};
+		ImageView m_resolvedView{VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT};
+
+		ShaderSet m_resolveShader;
+		Pipeline m_resolvePipeline;
+	};
+}
+
+#endif // MXC_FILM_H
@@ -0,0 +1,292 @@
+#include "GeometryPager.h"
+#include "Scene.h"
+#include "CommandBuffer.h"
+#include "logging.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+namespace mxc
+{
+    static VkDeviceSize constexpr PAGE_SIZE = static_cast<VkDeviceSize>(GeometryPager::CLUSTER_SIZE) * GeometryPager::RECORD_SIZE;
+
+    auto GeometryPager::create(VulkanContext* ctx) -> bool
+    {
+        m_stamp = 0;
+        m_pagePool = Buffer(4 * sizeof(float), BufferType_v::STORAGE);
+        m_pageTable = Buffer(sizeof(uint32_t), BufferType_v::STORAGE);
+        m_clusterStamps = Buffer(sizeof(uint32_t), BufferType_v::STORAGE);
+        m_deferredPaths = Buffer(sizeof(uint32_t), BufferType_v::STORAGE);
+        if (!ctx->device.createBuffer(&m_pagePool) || !ctx->device.createBuffer(&m_pageTable) || !ctx->device.createBuffer(&m_clusterStamps)
+            || !ctx->device.createBuffer(&m_deferredPaths))
+        {
+            MXC_ERROR("GeometryPager: couldn't create the buffers");
+            return false;
+        }
+        return true;
+    }
+
+    auto GeometryPager::create(VulkanContext* ctx, GeometryPagerConfig const& config, Scene const& scene, uint32_t const* pPrimitiveIndices,
+                               uint32_t filmWidth, uint32_t filmHeight) -> bool
+    {
+        uint32_t const primitive_count = scene.sphereCount() + scene.triangleCount() + scene.instanceCount();
+        uint32_t const cluster_count = std::max(1u, (primitive_count + CLUSTER_SIZE - 1) / CLUSTER_SIZE);
+        uint32_t const slot_count = static_cast<uint32_t>(std::min<uint64_t>(config.cacheBytes / PAGE_SIZE, cluster_count));
+        if (slot_count == 0)
+        {
+            MXC_ERROR("GeometryPager: a cache of %llu bytes doesn't hold a single page of %llu bytes",
+                      static_cast<unsigned long long>(config.cacheBytes), static_cast<unsigned long long>(PAGE_SIZE));
+            return false;
+        }
+
+        // records of the world triangles, the leaves of spheres and instances have none and stay zero in the pages
+        static_assert(CLUSTER_SIZE <= 65536, "GeometryPager: leaf positions in a page are 16 bits");
+        m_records.clear();
+        m_records.reserve(static_cast<size_t>(scene.triangleCount()) * RECORD_SIZE);
+        m_recordLeaves.clear();
+        m_recordLeaves.reserve(scene.triangleCount());
+        m_clusterRecords.assign(cluster_count + 1, 0);
+        for (uint32_t leaf = 0; leaf != primitive_count; ++leaf)
+        {
+            uint32_t const triangle = pPrimitiveIndices[leaf] - scene.sphereCount();
+            if (pPrimitiveIndices[leaf] < scene.sphereCount() || triangle >= scene.triangleCount())
+                continue;
+
+            float record[RECORD_SIZE / sizeof(float)] {};
+            for (uint32_t v = 0; v != 3; ++v)
+                std::copy_n(scene.vertexPositions() + 3 * scene.triangleIndices()[3 * triangle + v], 3, record + 4 * v);
+            memcpy(&record[3], &scene.triangleMaterials()[triangle], sizeof(uint32_t));
+            m_records.insert(m_records.end(), reinterpret_cast<uint8_t const*>(record), reinterpret_cast<uint8_t const*>(record) + RECORD_SIZE);
+            m_recordLeaves.push_back(static_cast<uint16_t>(leaf % CLUSTER_SIZE));
+            ++m_clusterRecords[leaf / CLUSTER_SIZE + 1];
+        }
+        std::partial_sum(m_clusterRecords.begin(), m_clusterRecords.end(), m_clusterRecords.begin());
+
+        m_clusterSlots.assign(cluster_count, NOT_RESIDENT);
+        m_slotClusters.assign(slot_count, NOT_RESIDENT);
+        m_slotLastUse.assign(slot_count, 0);
+        m_maxUploadsPerUpdate = std::max(1u, config.maxUploadsPerUpdate);
+        m_stamp = 1;
+        m_uploadCount = m_evictionCount = m_makeUpPassCount = 0;
+
+        VkDeviceSize const tableSize = cluster_count * sizeof(uint32_t);
+        m_pagePool = Buffer(slot_count * PAGE_SIZE, BufferType_v::STORAGE);
+        m_pageTable = Buffer(tableSize, BufferType_v::STORAGE);
+        m_clusterStamps = Buffer(tableSize, BufferType_v::STORAGE);
+        m_staging = Buffer(m_maxUploadsPerUpdate * PAGE_SIZE + tableSize, BufferType_v::STAGING);
+        m_stampReadback = Buffer(tableSize, BufferType_v::READBACK);
+        if (!ctx->device.createBuffer(&m_pagePool) || !ctx->device.createBuffer(&m_pageTable) || !ctx->device.createBuffer(&m_clusterStamps)
+            || !ctx->device.createBuffer(&m_staging, BufferMemoryOptions::SYSTEM_MEMORY) || !ctx->device.createBuffer(&m_stampReadback))
+        {
+            MXC_ERROR("GeometryPager: couldn't create the buffers of a %u pages cache over %u clusters", slot_count, cluster_count);
+            return false;
+        }
+
+        CommandBuffer cmdBuf;
+        cmdBuf.allocate(ctx, CommandType::COMPUTE);
+        cmdBuf.begin();
+        vkCmdFillBuffer(cmdBuf.handle, m_clusterStamps.handle, 0, VK_WHOLE_SIZE, 0);
+        cmdBuf.end();
+        bool const cleared = ctx->device.flushCommandBuffer(&cmdBuf, CommandType::COMPUTE);
+        cmdBuf.free(ctx);
+        if (!cleared || !createDeferredPaths(ctx, filmWidth, filmHeight))
+            return false;
+
+        // warm start with as many clusters as fit, in leaf order, skipping those without world triangles
+        std::vector<uint32_t> slots;
+        for (uint32_t cluster = 0; cluster != cluster_count && slots.size() != slot_count; ++cluster)
+        {
+            if (m_clusterRecords[cluster] == m_clusterRecords[cluster + 1])
+                continue;
+            uint32_t const slot = static_cast<uint32_t>(slots.size());
+            m_slotClusters[slot] = cluster;
+            m_clusterSlots[cluster] = slot;
+            slots.push_back(slot);
+        }
+        for (size_t first = 0; first < std::max<size_t>(slots.size(), 1); first += m_maxUploadsPerUpdate)
+        {
+            uint32_t const count = static_cast<uint32_t>(std::min<size_t>(slots.size() - first, m_maxUploadsPerUpdate));
+            if (!uploadPages(ctx, slots.data() + first, count))
+                return false;
+        }
+
+        MXC_INFO("geometry pager: %u clusters of %u primitives, %u resident pages of %llu KiB (%.1f MiB of %.1f MiB), %.1f MiB on the host",
+                 cluster_count, CLUSTER_SIZE, slot_count, static_cast<unsigned long long>(PAGE_SIZE >> 10), slot_count * PAGE_SIZE / 1048576.f,
+                 cluster_count * PAGE_SIZE / 1048576.f, (m_records.size() + m_recordLeaves.size() * sizeof(uint16_t)) / 1048576.f);
+        return true;
+    }
+
+    auto GeometryPager::destroy(VulkanContext* ctx) -> void
+    {
+        for (Buffer* pBuffer : { &m_pagePool, &m_pageTable, &m_clusterStamps, &m_staging, &m_stampReadback, &m_deferredPaths, &m_deferredReadback })
+            if (pBuffer->handle != VK_NULL_HANDLE)
+                ctx->device.destroyBuffer(pBuffer);
+        m_pagePool = Buffer(0, BufferType_v::STORAGE);
+        m_pageTable = Buffer(0, BufferType_v::STORAGE);
+        m_clusterStamps = Buffer(0, BufferType_v::STORAGE);
+        m_staging = Buffer(0, BufferType_v::STAGING);
+        m_stampReadback = Buffer(0, BufferType_v::READBACK);
+        m_deferredPaths = Buffer(0, BufferType_v::STORAGE);
+        m_deferredReadback = Buffer(0, BufferType_v::READBACK);
+        m_deferredPixelCount = 0;
+        m_records.clear();
+        m_recordLeaves.clear();
+        m_clusterRecords.clear();
+        m_clusterSlots.clear();
+        m_slotClusters.clear();
+        m_slotLastUse.clear();
+        m_stamp = 0;
+    }
+
+    auto GeometryPager::resize(VulkanContext* ctx, uint32_t filmWidth, uint32_t filmHeight) -> bool
+    {
+        if (!isEnabled())
+            return true;
+        for (Buffer* pBuffer : { &m_deferredPaths, &m_deferredReadback })
+            if (pBuffer->handle != VK_NULL_HANDLE)
+                ctx->device.destroyBuffer(pBuffer);
+        return createDeferredPaths(ctx, filmWidth, filmHeight);
+    }
+
+    auto GeometryPager::createDeferredPaths(VulkanContext* ctx, uint32_t filmWidth, uint32_t filmHeight) -> bool
+    {
+        m_deferredPixelCount = 0;
+        m_deferredPaths = Buffer((1 + static_cast<VkDeviceSize>(filmWidth) * filmHeight) * sizeof(uint32_t), BufferType_v::STORAGE);
+        m_deferredReadback = Buffer(sizeof(uint32_t), BufferType_v::READBACK);
+        if (!ctx->device.createBuffer(&m_deferredPaths) || !ctx->device.createBuffer(&m_deferredReadback))
+        {
+            MXC_ERROR("GeometryPager: couldn't create the deferred paths of a %ux%u film", filmWidth, filmHeight);
+            return false;
+        }
+
+        CommandBuffer cmdBuf;
+        cmdBuf.allocate(ctx, CommandType::COMPUTE);
+        cmdBuf.begin();
+        vkCmdFillBuffer(cmdBuf.handle, m_deferredPaths.handle, 0, VK_WHOLE_SIZE, 0);
+        cmdBuf.end();
+        bool const cleared = ctx->device.flushCommandBuffer(&cmdBuf, CommandType::COMPUTE);
+        cmdBuf.free(ctx);
+        return cleared;
+    }
+
+    auto GeometryPager::update(VulkanContext* ctx) -> bool
+    {
+        if (!isEnabled())
+            return true;
+
+        // clusters read during the pass carry its stamp, resident ones were used and the others were missed
+        if (!ctx->device.copyBuffer(ctx, &m_clusterStamps, &m_stampReadback))
+            return false;
+        uint32_t const* stamps = static_cast<uint32_t const*>(m_stampReadback.mapped);
+        for (uint32_t slot = 0; slot != slotCount(); ++slot)
+            if (m_slotClusters[slot] != NOT_RESIDENT && stamps[m_slotClusters[slot]] == m_stamp)
+                m_slotLastUse[slot] = m_stamp;
+        std::vector<uint32_t> requests;
+        for (uint32_t cluster = 0; cluster != clusterCount(); ++cluster)
+            if (stamps[cluster] == m_stamp && m_clusterSlots[cluster] == NOT_RESIDENT)
+                requests.push_back(cluster);
+
+        // least recently used slots first, free ones have never been used. Slots read during the pass go last, they are only
+        // evicted when the clusters the pass touched don't fit in the cache, such that the missed ones still make progress
+        std::vector<uint32_t> victims;
+        if (!requests.empty())
+        {
+            victims.resize(slotCount());
+            std::iota(victims.begin(), victims.end(), 0u);
+            uint32_t const upload_count = std::min({ static_cast<uint32_t>(requests.size()), static_cast<uint32_t>(victims.size()),
+                                                     m_maxUploadsPerUpdate });
+            std::partial_sort(victims.begin(), victims.begin() + upload_count, victims.end(),
+                              [this](uint32_t a, uint32_t b) { return m_slotLastUse[a] < m_slotLastUse[b]; });
+            victims.resize(upload_count);
+            for (uint32_t i = 0; i != upload_count; ++i)
+            {
+                uint32_t const slot = victims[i];
+                if (m_slotClusters[slot] != NOT_RESIDENT)
+                {
+                    m_clusterSlots[m_slotClusters[slot]] = NOT_RESIDENT;
+                    ++m_evictionCount;
+                }
+                m_slotClusters[slot] = requests[i];
+                m_clusterSlots[requests[i]] = slot;
+                m_slotLastUse[slot] = m_stamp;
+            }
+            MXC_DEBUG("geometry pager: pass %u missed %zu clusters, %u uploaded", m_stamp, requests.size(), upload_count);
+        }
+
+        if (!victims.empty() && !uploadPages(ctx, victims.data(), static_cast<uint32_t>(victims.size())))
+            return false;
+
+        // pixels left with deferred paths get a make-up pass, which clears their entries. The count restarts from zero
+        if (!ctx->device.copyBuffer(ctx, &m_deferredPaths, &m_deferredReadback))
+            return false;
+        m_deferredPixelCount = *static_cast<uint32_t const*>(m_deferredReadback.mapped);
+        if (m_deferredPixelCount != 0)
+            ++m_makeUpPassCount;
+
+        // stamps wrap to 1, the stamps of earlier passes would read as requests of the next ones
+        bool const wraps = m_stamp == ~0u;
+        if (m_deferredPixelCount != 0 || wraps)
+        {
+            CommandBuffer cmdBuf;
+            cmdBuf.allocate(ctx, CommandType::COMPUTE);
+            cmdBuf.begin();
+            if (m_deferredPixelCount != 0)
+                vkCmdFillBuffer(cmdBuf.handle, m_deferredPaths.handle, 0, sizeof(uint32_t), 0);
+            if (wraps)
+                vkCmdFillBuffer(cmdBuf.handle, m_clusterStamps.handle, 0, VK_WHOLE_SIZE, 0);
+            ctx->device.insertMemoryBarrier(cmdBuf.handle, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                                            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+            cmdBuf.end();
+            bool const cleared = ctx->device.flushCommandBuffer(&cmdBuf, CommandType::COMPUTE);
+            cmdBuf.free(ctx);
+            if (!cleared)
+                return false;
+        }
+        if (wraps)
+            std::fill(m_slotLastUse.begin(), m_slotLastUse.end(), 0u);
+        m_stamp = wraps ? 1 : m_stamp + 1;
+        return true;
+    }
+
+    // pages of the given slots, then the whole page table, go through the staging buffer in one submission
+    auto GeometryPager::uploadPages(VulkanContext* ctx, uint32_t const* pSlots, uint32_t slot_count) -> bool
+    {
+        MXC_ASSERT(slot_count <= m_maxUploadsPerUpdate, "GeometryPager: %u pages don't fit in the staging buffer", slot_count);
+        uint8_t* staging = static_cast<uint8_t*>(m_staging.mapped);
+        std::vector<VkBufferCopy> regions(slot_count);
+        for (uint32_t i = 0; i != slot_count; ++i)
+        {
+            uint8_t* page = staging + i * PAGE_SIZE;
+            uint32_t const cluster = m_slotClusters[pSlots[i]];
+            memset(page, 0, PAGE_SIZE);
+            for (uint32_t record = m_clusterRecords[cluster]; record != m_clusterRecords[cluster + 1]; ++record)
+                memcpy(page + m_recordLeaves[record] * RECORD_SIZE, m_records.data() + static_cast<size_t>(record) * RECORD_SIZE, RECORD_SIZE);
+            regions[i] = { .srcOffset = i * PAGE_SIZE, .dstOffset = pSlots[i] * PAGE_SIZE, .size = PAGE_SIZE };
+        }
+        VkDeviceSize const tableOffset = m_maxUploadsPerUpdate * PAGE_SIZE;
+        memcpy(staging + tableOffset, m_clusterSlots.data(), m_clusterSlots.size() * sizeof(uint32_t));
+        VkBufferCopy const tableRegion { .srcOffset = tableOffset, .dstOffset = 0, .size = m_clusterSlots.size() * sizeof(uint32_t) };
+
+        CommandBuffer cmdBuf;
+        cmdBuf.allocate(ctx, CommandType::COMPUTE);
+        cmdBuf.begin();
+        if (slot_count != 0)
+            vkCmdCopyBuffer(cmdBuf.handle, m_staging.handle, m_pagePool.handle, slot_count, regions.data());
+        vkCmdCopyBuffer(cmdBuf.handle, m_staging.handle, m_pageTable.handle, 1, &tableRegion);
+        ctx->device.insertMemoryBarrier(cmdBuf.handle, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+                                        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        cmdBuf.end();
+        bool const uploaded = ctx->device.flushCommandBuffer(&cmdBuf, CommandType::COMPUTE);
+        cmdBuf.free(ctx);
+        m_uploadCount += slot_count;
+        return uploaded;
+    }
+
+    auto GeometryPager::descriptors(DescriptorInfo* pOutInfos) const -> void
+    {
+        Buffer const* buffers[BINDING_COUNT] { &m_pagePool, &m_pageTable, &m_clusterStamps, &m_deferredPaths };
+        for (uint32_t i = 0; i != BINDING_COUNT; ++i)
+            pOutInfos[i].buffer = { .buffer = buffers[i]->handle, .offset = 0, .range = VK_WHOLE_SIZE };
+    }
+}
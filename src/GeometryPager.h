@@ -0,0 +1,94 @@
+#ifndef MXC_GEOMETRY_PAGER_H
+#define MXC_GEOMETRY_PAGER_H
+
+#include <vulkan/vulkan.h>
+#include "VulkanCommon.h"
+#include "Buffer.h"
+#include "Shader.h"
+#include "VulkanContext.inl"
+
+#include <cstdint>
+#include <vector>
+
+namespace mxc
+{
+	class Scene;
+
+	struct GeometryPagerConfig
+	{
+		uint64_t cacheBytes = 256ull << 20;    // device memory of the page pool, rounded down to whole pages
+		uint32_t maxUploadsPerUpdate = 64;      // pages uploaded between two passes, the others wait for the next one
+	};
+
+	// Out of core world triangles. The leaf order of the top level BVH is cut in clusters of CLUSTER_SIZE consecutive primitive
+	// indices, such that a cluster covers a few neighbouring subtrees, and the world triangles of every cluster are kept on the host,
+	// which can release those of the Scene. Pages are laid out at upload, one record per leaf of the cluster. A fixed number of pages are resident in a device pool, found through a page table with one slot per
+	// cluster. Paths whose rays reach a cluster that isn't resident are deferred, with those after them in the pixel, and stamp it
+	// in clusterStamps; update reads the stamps back between passes and uploads the requested pages over the least recently used
+	// ones. Make-up passes of the same sample index then draw the deferred paths, until a pass ends with none deferred. Spheres, instanced meshes and the BVH stay in SceneBuffers, which leaves the world
+	// triangles out, see SceneBuffers::gather
+	class GeometryPager
+	{
+	public:
+		static uint32_t constexpr CLUSTER_SIZE = 1024;  // GEOMETRY_CLUSTER_SIZE in shaders/spectrumTest/spectrumTest.comp
+		static uint32_t constexpr RECORD_SIZE = 48;    // float4 p0 and material bits, float4 p1, float4 p2
+		static uint32_t constexpr BINDING_COUNT = 4;
+		static uint32_t constexpr NOT_RESIDENT = ~0u;
+
+	public:
+		// paging disabled, only creates the buffers to bind
+		auto create(VulkanContext* ctx) -> bool;
+		// pPrimitiveIndices are the primitive indices sorted by leaf of the BVH uploaded to SceneBuffers, over the primitives of
+		// scene. The pool starts with the first clusters, in leaf order, resident
+		auto create(VulkanContext* ctx, GeometryPagerConfig const& config, Scene const& scene, uint32_t const* pPrimitiveIndices,
+		            uint32_t filmWidth, uint32_t filmHeight) -> bool;
+		auto destroy(VulkanContext* ctx) -> void;
+		// the deferred paths belong to the old extent
+		auto resize(VulkanContext* ctx, uint32_t filmWidth, uint32_t filmHeight) -> bool;
+
+		// evicts and uploads pages for the requests of the pass or make-up pass which ended, then starts the next one. Blocking,
+		// the device has to be done with the pass
+		auto update(VulkanContext* ctx) -> bool;
+
+		// writes BINDING_COUNT descriptors: page pool, page table, cluster stamps, deferred paths
+		auto descriptors(DescriptorInfo* pOutInfos) const -> void;
+
+		auto isEnabled() const -> bool { return m_stamp != 0; }
+		// of the current pass, pushed to the accumulation shader. 0 = paging disabled
+		auto stamp() const -> uint32_t { return m_stamp; }
+		auto clusterCount() const -> uint32_t { return static_cast<uint32_t>(m_clusterSlots.size()); }
+		auto slotCount() const -> uint32_t { return static_cast<uint32_t>(m_slotClusters.size()); }
+		auto uploadCount() const -> uint64_t { return m_uploadCount; }
+		auto evictionCount() const -> uint64_t { return m_evictionCount; }
+		// pixels which deferred paths in the pass that ended, the pass is over once a make-up pass leaves none
+		auto deferredPixelCount() const -> uint32_t { return m_deferredPixelCount; }
+		auto makeUpPassCount() const -> uint64_t { return m_makeUpPassCount; }
+
+	private:
+		auto uploadPages(VulkanContext* ctx, uint32_t const* pSlots, uint32_t slot_count) -> bool;
+		auto createDeferredPaths(VulkanContext* ctx, uint32_t filmWidth, uint32_t filmHeight) -> bool;
+
+	private:
+		Buffer m_pagePool{0, BufferType_v::STORAGE};
+		Buffer m_pageTable{0, BufferType_v::STORAGE};
+		Buffer m_clusterStamps{0, BufferType_v::STORAGE};
+		Buffer m_staging{0, BufferType_v::STAGING};    // maxUploadsPerUpdate pages, then the page table
+		Buffer m_stampReadback{0, BufferType_v::READBACK};
+		Buffer m_deferredPaths{0, BufferType_v::STORAGE};     // count of pixels, then the first deferred path + 1 of each pixel
+		Buffer m_deferredReadback{0, BufferType_v::READBACK}; // the count
+		std::vector<uint8_t> m_records;         // of the world triangles only, in leaf order
+		std::vector<uint16_t> m_recordLeaves;   // position of each record in the page of its cluster
+		std::vector<uint32_t> m_clusterRecords; // first record of each cluster, then the record count
+		std::vector<uint32_t> m_clusterSlots;  // slot of each cluster, NOT_RESIDENT, uploaded as the page table
+		std::vector<uint32_t> m_slotClusters;  // cluster of each slot, NOT_RESIDENT when free
+		std::vector<uint32_t> m_slotLastUse;   // stamp of the last pass which read the slot
+		uint32_t m_maxUploadsPerUpdate = 0;
+		uint32_t m_stamp = 0;
+		uint64_t m_uploadCount = 0;
+		uint64_t m_evictionCount = 0;
+		uint32_t m_deferredPixelCount = 0;
+		uint64_t m_makeUpPassCount = 0;
+	};
+}
+
+#endif // MXC_GEOMETRY_PAGER_H
@@ -11,14 +11,14 @@ namespace mxc
 	// created From a device
 	struct Image
 	{
-		constexpr Image(VkImageType type, VkExtent3D extent,VkFormat format, VkImageUsageFlagBits usage, uint8_t mipLevels = 1, uint8_t arrayLayers= 1) 
+		constexpr Image(VkImageType type, VkExtent3D extent,VkFormat format, VkImageUsageFlags usage, uint8_t mipLevels = 1, uint8_t arrayLayers= 1) 
 			: extent(extent), type(type), format(format), usage(usage), mipLevels(mipLevels), arrayLayers(arrayLayers) {}
 
         VkExtent3D extent;
 		VkImage handle = VK_NULL_HANDLE;
 		VkImageType type;
 		VkFormat format;
-		VkImageUsageFlagBits usage;
+		VkImageUsageFlags usage;
 
 		uint32_t memoryIndex = UINT32_MAX;
 		uint32_t allocationIndex = UINT32_MAX;
@@ -0,0 +1,190 @@
+#include "ImageReader.h"
+#include "MappedFile.h"
+#include "logging.h"
+
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+
+namespace mxc
+{
+    // reads a line of a text header, without its newline. False past the end of the file
+    static auto readLine(uint8_t const* data, size_t size, size_t* pOffset, std::string* pOut) -> bool
+    {
+        if (*pOffset >= size)
+            return false;
+        uint8_t const* begin = data + *pOffset;
+        uint8_t const* end = static_cast<uint8_t const*>(memchr(begin, '\n', size - *pOffset));
+        if (!end)
+            return false;
+        pOut->assign(reinterpret_cast<char const*>(begin), end - begin);
+        *pOffset = end - data + 1;
+        return true;
+    }
+
+    // Radiance RGBE --------------------------------------------------------------------------------------------------------------
+    static auto rgbeToFloat(uint8_t const rgbe[4], float* pOut) -> void
+    {
+        float const scale = rgbe[3] != 0 ? std::ldexp(1.f, rgbe[3] - (128 + 8)) : 0.f;
+        for (uint32_t c = 0; c != 3; ++c)
+            pOut[c] = rgbe[c] * scale;
+    }
+
+    // A scanline of the new run length encoding starts with 2, 2 and its width, then each of the 4 components follows in runs: a
+    // count above 128 repeats the next byte count - 128 times, otherwise count bytes are copied
+    static auto decodeRleScanline(uint8_t const* data, size_t size, size_t* pOffset, uint32_t width, uint8_t* pOut) -> bool
+    {
+        size_t offset = *pOffset + 4;
+        for (uint32_t c = 0; c != 4; ++c)
+        {
+            uint32_t x = 0;
+            while (x != width)
+            {
+                if (offset >= size)
+                    return false;
+                uint32_t count = data[offset++];
+                bool const run = count > 128;
+                if (run)
+                    count -= 128;
+                if (count == 0 || count > width - x || offset + (run ? 1 : count) > size)
+                    return false;
+                for (uint32_t i = 0; i != count; ++i)
+                    pOut[4 * (x + i) + c] = data[run ? offset : offset + i];
+                offset += run ? 1 : count;
+                x += count;
+            }
+        }
+        *pOffset = offset;
+        return true;
+    }
+
+    static auto readRadiance(char const* filename, uint8_t const* data, size_t size, HdrImage* pOut) -> bool
+    {
+        size_t offset = 0;
+        std::string line;
+        if (!readLine(data, size, &offset, &line) || (line != "#?RADIANCE" && line != "#?RGBE"))
+        {
+            MXC_ERROR("%s isn't a Radiance HDR file", filename);
+            return false;
+        }
+        // variables up to an empty line, the exposure and color corrections are ignored as by most readers
+        while (readLine(data, size, &offset, &line) && !line.empty())
+            if (line.starts_with("FORMAT=") && line != "FORMAT=32-bit_rle_rgbe")
+            {
+                MXC_ERROR("%s: unsupported %s, expected 32-bit_rle_rgbe", filename, line.c_str());
+                return false;
+            }
+
+        uint32_t width = 0, height = 0;
+        if (!readLine(data, size, &offset, &line) || sscanf(line.c_str(), "-Y %u +X %u", &height, &width) != 2 || width == 0 || height == 0)
+        {
+            MXC_ERROR("%s: unsupported resolution line \"%s\", expected -Y <height> +X <width>", filename, line.c_str());
+            return false;
+        }
+
+        pOut->width = width;
+        pOut->height = height;
+        pOut->pixels.resize(3 * static_cast<size_t>(width) * height);
+        std::vector<uint8_t> scanline(4 * static_cast<size_t>(width));
+        for (uint32_t y = 0; y != height; ++y)
+        {
+            bool const rle = width >= 8 && width < 0x8000 && offset + 4 <= size && data[offset] == 2 && data[offset + 1] == 2
+                             && (static_cast<uint32_t>(data[offset + 2]) << 8 | data[offset + 3]) == width;
+            if (rle)
+            {
+                if (!decodeRleScanline(data, size, &offset, width, scanline.data()))
+                {
+                    MXC_ERROR("%s: corrupt run length encoded scanline %u", filename, y);
+                    return false;
+                }
+            }
+            else
+            {
+                if (size - offset < scanline.size())
+                {
+                    MXC_ERROR("%s: truncated at scanline %u", filename, y);
+                    return false;
+                }
+                memcpy(scanline.data(), data + offset, scanline.size());
+                offset += scanline.size();
+            }
+            float* pRow = pOut->pixels.data() + 3 * static_cast<size_t>(y) * width;
+            for (uint32_t x = 0; x != width; ++x)
+                rgbeToFloat(&scanline[4 * x], pRow + 3 * x);
+        }
+        return true;
+    }
+
+    // PFM ------------------------------------------------------------------------------------------------------------------------
+    static auto byteSwap32(uint32_t value) -> uint32_t
+    {
+        return value >> 24 | (value >> 8 & 0xff00u) | (value << 8 & 0xff'0000u) | value << 24;
+    }
+
+    static auto readPfm(char const* filename, uint8_t const* data, size_t size, HdrImage* pOut) -> bool
+    {
+        size_t offset = 0;
+        std::string type, dimensions, scaleLine;
+        uint32_t width = 0, height = 0;
+        float scale = 0.f;
+        if (!readLine(data, size, &offset, &type) || (type != "PF" && type != "Pf") || !readLine(data, size, &offset, &dimensions)
+            || sscanf(dimensions.c_str(), "%u %u", &width, &height) != 2 || width == 0 || height == 0
+            || !readLine(data, size, &offset, &scaleLine) || sscanf(scaleLine.c_str(), "%f", &scale) != 1 || scale == 0.f)
+        {
+            MXC_ERROR("%s isn't a PFM file", filename);
+            return false;
+        }
+
+        uint32_t const channel_count = type == "PF" ? 3 : 1;
+        size_t const value_count = static_cast<size_t>(width) * height * channel_count;
+        if ((size - offset) / sizeof(float) < value_count)
+        {
+            MXC_ERROR("%s: truncated, expected %ux%u pixels", filename, width, height);
+            return false;
+        }
+
+        // a negative scale means little endian, rows go from bottom to top
+        bool const swap = (scale < 0.f) != (std::endian::native == std::endian::little);
+        pOut->width = width;
+        pOut->height = height;
+        pOut->pixels.resize(3 * static_cast<size_t>(width) * height);
+        for (uint32_t y = 0; y != height; ++y)
+        {
+            uint8_t const* pSource = data + offset + sizeof(float) * channel_count * width * (height - 1 - static_cast<size_t>(y));
+            float* pRow = pOut->pixels.data() + 3 * static_cast<size_t>(y) * width;
+            for (uint32_t x = 0; x != width; ++x)
+                for (uint32_t c = 0; c != 3; ++c)
+                {
+                    uint32_t bits;
+                    memcpy(&bits, pSource + sizeof(float) * (channel_count * x + (channel_count == 3 ? c : 0)), sizeof(bits));
+                    pRow[3 * x + c] = std::bit_cast<float>(swap ? byteSwap32(bits) : bits);
+                }
+        }
+        return true;
+    }
+
+    auto readHdrImage(char const* filename, HdrImage* pOut) -> bool
+    {
+        std::string extension = std::filesystem::path(filename).extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(tolower(c)); });
+        if (extension != ".hdr" && extension != ".pfm")
+        {
+            MXC_ERROR("%s: unknown image format, expected .hdr or .pfm", filename);
+            return false;
+        }
+
+        MappedFile file;
+        if (!file.open(filename, MappingMode::READ))
+            return false;
+        bool const read = extension == ".hdr" ? readRadiance(filename, file.data(), file.size(), pOut)
+                                              : readPfm(filename, file.data(), file.size(), pOut);
+        if (read)
+            MXC_INFO("read %s: %ux%u", filename, pOut->width, pOut->height);
+        return read;
+    }
+}
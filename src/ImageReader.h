@@ -0,0 +1,22 @@
+#ifndef MXC_IMAGE_READER_H
+#define MXC_IMAGE_READER_H
+
+#include <cstdint>
+#include <vector>
+
+namespace mxc
+{
+	// linear RGB radiance, rows from the top of the image
+	struct HdrImage
+	{
+		std::vector<float> pixels;
+		uint32_t width = 0;
+		uint32_t height = 0;
+	};
+
+	// Deduces the format from the extension of filename: .hdr (Radiance RGBE, flat or run length encoded scanlines, top to bottom
+	// left to right only) or .pfm (RGB or grey, either byte order). The file is mapped and decoded in one pass
+	auto readHdrImage(char const* filename, HdrImage* pOut) -> bool;
+}
+
+#endif // MXC_IMAGE_READER_H
@@ -0,0 +1,497 @@
+#include "ImageWriter.h"
+#include "ThreadPool.h"
+#include "logging.h"
+
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+
+namespace mxc
+{
+    static_assert(std::endian::native == std::endian::little, "PFM and EXR are written little endian with plain memcpy");
+
+    // raw bytes encoded per chunk of PNG rows or PFM rows, small enough to spread 1080p over a few threads
+    static uint32_t constexpr ROW_BAND_BYTES = 1u << 20;
+
+    // helpers --------------------------------------------------------------------------------------------------------------------
+    static auto storeLE32(uint8_t* p, uint32_t value) -> void { memcpy(p, &value, sizeof(value)); }
+    static auto storeLE64(uint8_t* p, uint64_t value) -> void { memcpy(p, &value, sizeof(value)); }
+    static auto storeBE32(uint8_t* p, uint32_t value) -> void
+    {
+        p[0] = static_cast<uint8_t>(value >> 24);
+        p[1] = static_cast<uint8_t>(value >> 16);
+        p[2] = static_cast<uint8_t>(value >> 8);
+        p[3] = static_cast<uint8_t>(value);
+    }
+
+    static auto append(std::vector<uint8_t>& out, void const* data, size_t size) -> void
+    {
+        auto const* bytes = static_cast<uint8_t const*>(data);
+        out.insert(out.end(), bytes, bytes + size);
+    }
+
+    static auto appendLE32(std::vector<uint8_t>& out, uint32_t value) -> void { append(out, &value, sizeof(value)); }
+
+    static auto writeFile(char const* filename, std::vector<uint8_t> const& bytes) -> bool
+    {
+        FILE* file = fopen(filename, "wb");
+        if (!file)
+        {
+            MXC_ERROR("couldn't open %s for writing", filename);
+            return false;
+        }
+
+        size_t const written = fwrite(bytes.data(), 1, bytes.size(), file);
+        bool const closed = fclose(file) == 0;
+        if (written != bytes.size() || !closed)
+        {
+            MXC_ERROR("couldn't write %zu bytes to %s", bytes.size(), filename);
+            return false;
+        }
+        return true;
+    }
+
+    // round to nearest even, overflow to infinity, NaN kept quiet
+    static auto floatToHalf(float value) -> uint16_t
+    {
+        uint32_t const bits = std::bit_cast<uint32_t>(value);
+        uint32_t const sign = (bits >> 16) & 0x8000u;
+        uint32_t const absBits = bits & 0x7fff'ffffu;
+
+        if (absBits >= 0x7f80'0000u)
+            return static_cast<uint16_t>(sign | 0x7c00u | (absBits > 0x7f80'0000u ? 0x200u : 0u));
+        if (absBits >= 0x477f'f000u) // halfway between 65504 and 65536 and above
+            return static_cast<uint16_t>(sign | 0x7c00u);
+        if (absBits < 0x3880'0000u) // below 2^-14, half subnormal or zero
+        {
+            if (absBits < 0x3300'0000u) // below 2^-25
+                return static_cast<uint16_t>(sign);
+            uint32_t const shift = 126 - (absBits >> 23);
+            uint32_t const mantissa = (absBits & 0x7f'ffffu) | 0x80'0000u;
+            uint32_t half = mantissa >> shift;
+            uint32_t const rest = mantissa & ((1u << shift) - 1);
+            uint32_t const halfway = 1u << (shift - 1);
+            if (rest > halfway || (rest == halfway && (half & 1)))
+                ++half;
+            return static_cast<uint16_t>(sign | half);
+        }
+
+        // rebias the exponent, a mantissa carry correctly increments it
+        uint32_t half = (absBits - 0x3800'0000u) >> 13;
+        uint32_t const rest = absBits & 0x1fffu;
+        if (rest > 0x1000u || (rest == 0x1000u && (half & 1)))
+            ++half;
+        return static_cast<uint16_t>(sign | half);
+    }
+
+    static auto linearToSRGB8(float linear) -> uint8_t
+    {
+        if (!(linear > 0.f)) // NaN too
+            return 0;
+        if (linear >= 1.f)
+            return 255;
+        float const encoded = linear <= 0.0031308f ? 12.92f * linear : 1.055f * std::pow(linear, 1.f / 2.4f) - 0.055f;
+        return static_cast<uint8_t>(encoded * 255.f + 0.5f);
+    }
+
+    static auto makeCrcTable() -> std::array<uint32_t, 256>
+    {
+        std::array<uint32_t, 256> table{};
+        for (uint32_t n = 0; n != 256; ++n)
+        {
+            uint32_t c = n;
+            for (uint32_t k = 0; k != 8; ++k)
+                c = (c & 1) ? 0xedb8'8320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        return table;
+    }
+
+    static auto crc32(uint8_t const* data, size_t size) -> uint32_t
+    {
+        static std::array<uint32_t, 256> const table = makeCrcTable();
+        uint32_t c = 0xffff'ffffu;
+        for (size_t i = 0; i != size; ++i)
+            c = table[(c ^ data[i]) & 0xff] ^ (c >> 8);
+        return c ^ 0xffff'ffffu;
+    }
+
+    static uint32_t constexpr ADLER_BASE = 65521;
+
+    static auto adler32(uint8_t const* data, size_t size) -> uint32_t
+    {
+        uint32_t a = 1, b = 0;
+        while (size != 0)
+        {
+            size_t const n = std::min<size_t>(size, 5552); // largest n such that b can't overflow before the modulo
+            for (size_t i = 0; i != n; ++i)
+            {
+                a += data[i];
+                b += a;
+            }
+            a %= ADLER_BASE;
+            b %= ADLER_BASE;
+            data += n;
+            size -= n;
+        }
+        return (b << 16) | a;
+    }
+
+    // checksum of the concatenation of two sequences, given their checksums and the length of the second (as zlib's adler32_combine)
+    static auto adler32Combine(uint32_t adler1, uint32_t adler2, uint64_t size2) -> uint32_t
+    {
+        uint32_t const rem = static_cast<uint32_t>(size2 % ADLER_BASE);
+        uint32_t sum1 = adler1 & 0xffff;
+        uint32_t sum2 = static_cast<uint32_t>((static_cast<uint64_t>(rem) * sum1) % ADLER_BASE);
+        sum1 += (adler2 & 0xffff) + ADLER_BASE - 1;
+        sum2 += (adler1 >> 16) + (adler2 >> 16) + ADLER_BASE - rem;
+        if (sum1 >= ADLER_BASE) sum1 -= ADLER_BASE;
+        if (sum1 >= ADLER_BASE) sum1 -= ADLER_BASE;
+        if (sum2 >= (ADLER_BASE << 1)) sum2 -= (ADLER_BASE << 1);
+        if (sum2 >= ADLER_BASE) sum2 -= ADLER_BASE;
+        return sum1 | (sum2 << 16);
+    }
+
+    static auto bandRowCount(uint32_t rowBytes) -> uint32_t { return std::max(1u, ROW_BAND_BYTES / rowBytes); }
+
+    // PFM ------------------------------------------------------------------------------------------------------------------------
+    static auto encodePFM(ThreadPool& pool, ImageData const& image, std::vector<uint8_t>& out) -> void
+    {
+        char header[64];
+        int const headerSize = snprintf(header, sizeof(header), "PF\n%u %u\n-1.0\n", image.width, image.height); // negative = little endian
+        size_t const rowBytes = 3 * sizeof(float) * image.width;
+        out.resize(headerSize + rowBytes * image.height);
+        memcpy(out.data(), header, headerSize);
+
+        uint8_t* const pBody = out.data() + headerSize;
+        pool.parallelFor(image.height, bandRowCount(static_cast<uint32_t>(rowBytes)), [&](uint32_t begin, uint32_t end) {
+            for (uint32_t y = begin; y != end; ++y)
+            {
+                // rows go from bottom to top
+                auto* pRow = reinterpret_cast<float*>(pBody + rowBytes * (image.height - 1 - y));
+                float const* pSource = image.pPixels + static_cast<size_t>(y) * image.width * image.channel_count;
+                for (uint32_t x = 0; x != image.width; ++x)
+                    memcpy(pRow + 3 * x, pSource + image.channel_count * x, 3 * sizeof(float));
+            }
+        });
+    }
+
+    // OpenEXR --------------------------------------------------------------------------------------------------------------------
+    // channels are stored in alphabetical order
+    static uint32_t constexpr EXR_CHANNEL_COUNT = 3;
+    static char const* const EXR_CHANNEL_NAMES[EXR_CHANNEL_COUNT] { "B", "G", "R" };
+    static uint32_t constexpr EXR_SOURCE_CHANNEL[EXR_CHANNEL_COUNT] { 2, 1, 0 };
+
+    static auto appendExrAttribute(std::vector<uint8_t>& out, char const* name, char const* type, uint32_t size) -> void
+    {
+        append(out, name, strlen(name) + 1);
+        append(out, type, strlen(type) + 1);
+        appendLE32(out, size);
+    }
+
+    static auto exrHeader(ImageData const& image, ImageWriteOptions const& options, bool tiled) -> std::vector<uint8_t>
+    {
+        std::vector<uint8_t> header;
+        appendLE32(header, 20000630); // magic number
+        appendLE32(header, 2 | (tiled ? 0x200 : 0)); // version 2, single part
+
+        appendExrAttribute(header, "channels", "chlist", EXR_CHANNEL_COUNT * (2 + 16) + 1);
+        for (char const* name : EXR_CHANNEL_NAMES)
+        {
+            append(header, name, 2);
+            appendLE32(header, static_cast<uint32_t>(options.exrPixelType));
+            appendLE32(header, 0); // pLinear and reserved
+            appendLE32(header, 1); // x sampling
+            appendLE32(header, 1); // y sampling
+        }
+        header.push_back(0);
+
+        appendExrAttribute(header, "compression", "compression", 1);
+        header.push_back(0); // NO_COMPRESSION
+
+        int32_t const window[4] { 0, 0, static_cast<int32_t>(image.width) - 1, static_cast<int32_t>(image.height) - 1 };
+        appendExrAttribute(header, "dataWindow", "box2i", sizeof(window));
+        append(header, window, sizeof(window));
+        appendExrAttribute(header, "displayWindow", "box2i", sizeof(window));
+        append(header, window, sizeof(window));
+
+        appendExrAttribute(header, "lineOrder", "lineOrder", 1);
+        header.push_back(0); // INCREASING_Y
+
+        float const one = 1.f;
+        float const center[2] { 0.f, 0.f };
+        appendExrAttribute(header, "pixelAspectRatio", "float", sizeof(one));
+        append(header, &one, sizeof(one));
+        appendExrAttribute(header, "screenWindowCenter", "v2f", sizeof(center));
+        append(header, center, sizeof(center));
+        appendExrAttribute(header, "screenWindowWidth", "float", sizeof(one));
+        append(header, &one, sizeof(one));
+
+        if (tiled)
+        {
+            appendExrAttribute(header, "tiles", "tiledesc", 9);
+            appendLE32(header, options.exrTileSize);
+            appendLE32(header, options.exrTileSize);
+            header.push_back(0); // ONE_LEVEL, ROUND_DOWN
+        }
+
+        header.push_back(0);
+        return header;
+    }
+
+    // one row of pixels of a chunk, channel by channel
+    static auto writeExrRow(uint8_t* p, ImageData const& image, ExrPixelType pixelType, uint32_t x, uint32_t y, uint32_t width) -> uint8_t*
+    {
+        float const* pSource = image.pPixels + (static_cast<size_t>(y) * image.width + x) * image.channel_count;
+        for (uint32_t c = 0; c != EXR_CHANNEL_COUNT; ++c)
+        {
+            uint32_t const channel = EXR_SOURCE_CHANNEL[c];
+            if (pixelType == ExrPixelType::HALF)
+            {
+                for (uint32_t i = 0; i != width; ++i, p += sizeof(uint16_t))
+                {
+                    uint16_t const half = floatToHalf(pSource[i * image.channel_count + channel]);
+                    memcpy(p, &half, sizeof(half));
+                }
+            }
+            else
+            {
+                for (uint32_t i = 0; i != width; ++i, p += sizeof(float))
+                    memcpy(p, &pSource[i * image.channel_count + channel], sizeof(float));
+            }
+        }
+        return p;
+    }
+
+    static auto encodeEXR(ThreadPool& pool, ImageData const& image, ImageWriteOptions const& options, bool tiled,
+                          std::vector<uint8_t>& out) -> void
+    {
+        std::vector<uint8_t> const header = exrHeader(image, options, tiled);
+        uint32_t const valueBytes = options.exrPixelType == ExrPixelType::HALF ? sizeof(uint16_t) : sizeof(float);
+        uint32_t const tileSize = options.exrTileSize;
+        uint32_t const tilesX = (image.width + tileSize - 1) / tileSize;
+        uint32_t const tilesY = (image.height + tileSize - 1) / tileSize;
+
+        // without compression every block is a scanline, or a tile
+        uint32_t const chunk_count = tiled ? tilesX * tilesY : image.height;
+        auto chunkExtent = [&](uint32_t chunk, uint32_t* pX, uint32_t* pY, uint32_t* pWidth, uint32_t* pHeight) {
+            if (!tiled)
+            {
+                *pX = 0; *pY = chunk; *pWidth = image.width; *pHeight = 1;
+                return;
+            }
+            *pX = (chunk % tilesX) * tileSize;
+            *pY = (chunk / tilesX) * tileSize;
+            *pWidth = std::min(tileSize, image.width - *pX);
+            *pHeight = std::min(tileSize, image.height - *pY);
+        };
+        uint32_t const chunkHeaderBytes = tiled ? 5 * sizeof(int32_t) : 2 * sizeof(int32_t);
+
+        std::vector<uint64_t> offsets(chunk_count);
+        uint64_t offset = header.size() + chunk_count * sizeof(uint64_t);
+        for (uint32_t i = 0; i != chunk_count; ++i)
+        {
+            uint32_t x, y, width, height;
+            chunkExtent(i, &x, &y, &width, &height);
+            offsets[i] = offset;
+            offset += chunkHeaderBytes + static_cast<uint64_t>(height) * width * EXR_CHANNEL_COUNT * valueBytes;
+        }
+
+        out.resize(offset);
+        memcpy(out.data(), header.data(), header.size());
+        for (uint32_t i = 0; i != chunk_count; ++i)
+            storeLE64(out.data() + header.size() + i * sizeof(uint64_t), offsets[i]);
+
+        uint32_t const grainSize = tiled ? 1 : bandRowCount(image.width * EXR_CHANNEL_COUNT * valueBytes);
+        pool.parallelFor(chunk_count, grainSize, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i != end; ++i)
+            {
+                uint32_t x, y, width, height;
+                chunkExtent(i, &x, &y, &width, &height);
+                uint8_t* p = out.data() + offsets[i];
+                uint32_t const dataBytes = height * width * EXR_CHANNEL_COUNT * valueBytes;
+                if (tiled)
+                {
+                    storeLE32(p, x / tileSize);
+                    storeLE32(p + 4, y / tileSize);
+                    storeLE32(p + 8, 0); // level
+                    storeLE32(p + 12, 0);
+                    storeLE32(p + 16, dataBytes);
+                }
+                else
+                {
+                    storeLE32(p, y);
+                    storeLE32(p + 4, dataBytes);
+                }
+                p += chunkHeaderBytes;
+
+                for (uint32_t row = 0; row != height; ++row)
+                    p = writeExrRow(p, image, options.exrPixelType, x, y + row, width);
+            }
+        });
+    }
+
+    // PNG ------------------------------------------------------------------------------------------------------------------------
+    // Rows are deflated with stored (uncompressed) blocks, so no compression library is needed and bands of rows can be encoded
+    // independently: each band becomes an IDAT chunk of its own, with its CRC, and the adler32 checksums of the bands are combined
+    // at the end. The zlib trailer goes in a last IDAT chunk, since decoders concatenate all of them
+    static uint32_t constexpr STORED_BLOCK_MAX = 65535;
+
+    static auto appendPngChunk(std::vector<uint8_t>& out, char const* type, uint8_t const* data, uint32_t size) -> void
+    {
+        size_t const start = out.size();
+        out.resize(start + 12 + size);
+        uint8_t* p = out.data() + start;
+        storeBE32(p, size);
+        memcpy(p + 4, type, 4);
+        if (size != 0)
+            memcpy(p + 8, data, size);
+        storeBE32(p + 8 + size, crc32(p + 4, 4 + size));
+    }
+
+    static auto encodePNG(ThreadPool& pool, ImageData const& image, ImageWriteOptions const& options, std::vector<uint8_t>& out) -> void
+    {
+        uint32_t const rowBytes = 1 + 3 * image.width; // filter type byte, then RGB
+        uint32_t const rowsPerBand = bandRowCount(rowBytes);
+        uint32_t const band_count = (image.height + rowsPerBand - 1) / rowsPerBand;
+
+        uint8_t constexpr signature[8] { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+        append(out, signature, sizeof(signature));
+
+        uint8_t ihdr[13];
+        storeBE32(ihdr, image.width);
+        storeBE32(ihdr + 4, image.height);
+        ihdr[8] = 8;  // bit depth
+        ihdr[9] = 2;  // truecolor
+        ihdr[10] = 0; // deflate
+        ihdr[11] = 0; // adaptive filtering, every row uses None
+        ihdr[12] = 0; // no interlace
+        appendPngChunk(out, "IHDR", ihdr, sizeof(ihdr));
+        uint8_t const renderingIntent = 0; // perceptual
+        appendPngChunk(out, "sRGB", &renderingIntent, 1);
+
+        // layout of the band chunks
+        struct Band { size_t offset; uint32_t rawBytes; uint32_t dataBytes; uint32_t adler; };
+        std::vector<Band> bands(band_count);
+        size_t offset = out.size();
+        for (uint32_t b = 0; b != band_count; ++b)
+        {
+            uint32_t const rows = std::min(rowsPerBand, image.height - b * rowsPerBand);
+            uint32_t const rawBytes = rows * rowBytes;
+            uint32_t const block_count = (rawBytes + STORED_BLOCK_MAX - 1) / STORED_BLOCK_MAX;
+            bands[b] = {
+                .offset = offset,
+                .rawBytes = rawBytes,
+                .dataBytes = (b == 0 ? 2 : 0) + rawBytes + 5 * block_count,
+                .adler = 1
+            };
+            offset += 12 + bands[b].dataBytes;
+        }
+        out.resize(offset);
+
+        float const exposure = options.exposure;
+        pool.parallelFor(band_count, 1, [&](uint32_t begin, uint32_t end) {
+            std::vector<uint8_t> raw;
+            for (uint32_t b = begin; b != end; ++b)
+            {
+                Band& band = bands[b];
+                raw.resize(band.rawBytes);
+                uint32_t const firstRow = b * rowsPerBand;
+                for (uint32_t r = 0; r != band.rawBytes / rowBytes; ++r)
+                {
+                    uint8_t* pRow = raw.data() + r * rowBytes;
+                    float const* pSource = image.pPixels + static_cast<size_t>(firstRow + r) * image.width * image.channel_count;
+                    *pRow++ = 0;
+                    for (uint32_t x = 0; x != image.width; ++x)
+                        for (uint32_t c = 0; c != 3; ++c)
+                            *pRow++ = linearToSRGB8(exposure * pSource[x * image.channel_count + c]);
+                }
+                band.adler = adler32(raw.data(), raw.size());
+
+                uint8_t* const pChunk = out.data() + band.offset;
+                storeBE32(pChunk, band.dataBytes);
+                memcpy(pChunk + 4, "IDAT", 4);
+                uint8_t* p = pChunk + 8;
+                if (b == 0)
+                {
+                    *p++ = 0x78; // deflate, 32K window
+                    *p++ = 0x01; // no preset dictionary, fastest, header multiple of 31
+                }
+                for (uint32_t consumed = 0; consumed != band.rawBytes;)
+                {
+                    uint32_t const length = std::min(STORED_BLOCK_MAX, band.rawBytes - consumed);
+                    bool const last = b + 1 == band_count && consumed + length == band.rawBytes;
+                    *p++ = last ? 1 : 0; // BFINAL, BTYPE = 00, padded to the byte boundary
+                    *p++ = static_cast<uint8_t>(length);
+                    *p++ = static_cast<uint8_t>(length >> 8);
+                    *p++ = static_cast<uint8_t>(~length);
+                    *p++ = static_cast<uint8_t>(~length >> 8);
+                    memcpy(p, raw.data() + consumed, length);
+                    p += length;
+                    consumed += length;
+                }
+                storeBE32(p, crc32(pChunk + 4, 4 + band.dataBytes));
+            }
+        });
+
+        uint32_t adler = 1;
+        for (Band const& band : bands)
+            adler = adler32Combine(adler, band.adler, band.rawBytes);
+        uint8_t trailer[4];
+        storeBE32(trailer, adler);
+        appendPngChunk(out, "IDAT", trailer, sizeof(trailer));
+        appendPngChunk(out, "IEND", nullptr, 0);
+    }
+
+    // interface ------------------------------------------------------------------------------------------------------------------
+    auto imageFileFormatFromName(char const* filename, ImageFileFormat* pOutFormat) -> bool
+    {
+        char const* extension = strrchr(filename, '.');
+        if (!extension)
+            return false;
+
+        if (strcmp(extension, ".pfm") == 0)      *pOutFormat = ImageFileFormat::PFM;
+        else if (strcmp(extension, ".exr") == 0) *pOutFormat = ImageFileFormat::EXR;
+        else if (strcmp(extension, ".png") == 0) *pOutFormat = ImageFileFormat::PNG;
+        else return false;
+        return true;
+    }
+
+    auto imageFileFormatExtension(ImageFileFormat format) -> char const*
+    {
+        switch (format)
+        {
+        case ImageFileFormat::PFM: return "pfm";
+        case ImageFileFormat::EXR: [[fallthrough]];
+        case ImageFileFormat::EXR_TILED: return "exr";
+        case ImageFileFormat::PNG: return "png";
+        }
+        return "";
+    }
+
+    auto writeImage(ThreadPool& pool, char const* filename, ImageData const& image, ImageWriteOptions const& options) -> bool
+    {
+        MXC_ASSERT(image.pPixels && image.width != 0 && image.height != 0 && (image.channel_count == 3 || image.channel_count == 4),
+                   "writeImage: invalid image");
+        MXC_ASSERT(options.exrTileSize != 0, "writeImage: EXR tile size can't be 0");
+
+        std::vector<uint8_t> bytes;
+        switch (options.format)
+        {
+        case ImageFileFormat::PFM:       encodePFM(pool, image, bytes); break;
+        case ImageFileFormat::EXR:       encodeEXR(pool, image, options, false, bytes); break;
+        case ImageFileFormat::EXR_TILED: encodeEXR(pool, image, options, true, bytes); break;
+        case ImageFileFormat::PNG:       encodePNG(pool, image, options, bytes); break;
+        }
+
+        if (!writeFile(filename, bytes))
+            return false;
+
+        MXC_INFO("wrote %s, %ux%u", filename, image.width, image.height);
+        return true;
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef MXC_IMAGE_WRITER_H
+#define MXC_IMAGE_WRITER_H
+
+#include <cstdint>
+
+namespace mxc
+{
+	class ThreadPool;
+
+	enum class ImageFileFormat : uint8_t
+	{
+		PFM,       // float RGB, no compression
+		EXR,       // OpenEXR scanline, no compression
+		EXR_TILED, // OpenEXR tiled, single level, no compression
+		PNG        // 8 bit sRGB, stored deflate blocks
+	};
+
+	enum class ExrPixelType : uint8_t
+	{
+		HALF = 1, FLOAT = 2 // values of the OpenEXR pixel type enumeration
+	};
+
+	struct ImageWriteOptions
+	{
+		ImageFileFormat format = ImageFileFormat::EXR;
+		ExrPixelType exrPixelType = ExrPixelType::HALF;
+		uint32_t exrTileSize = 64;
+		float exposure = 1.f; // scales the radiance before quantization, LDR formats only
+	};
+
+	// linear radiance, as read back from the film's resolved image
+	struct ImageData
+	{
+		float const* pPixels;
+		uint32_t width;
+		uint32_t height;
+		uint32_t channel_count; // 3 (RGB) or 4 (RGBA, alpha is ignored)
+	};
+
+	// deduces the format from the extension of filename (.pfm, .exr, .png), returns false if unknown
+	auto imageFileFormatFromName(char const* filename, ImageFileFormat* pOutFormat) -> bool;
+	auto imageFileFormatExtension(ImageFileFormat format) -> char const*;
+
+	// Encodes the whole file in memory, in chunks of rows or tiles whose size is known upfront, such that each one is written at its
+	// final offset by any thread of the pool, then writes it with a single call. Blocks the caller, which takes part in the encoding
+	auto writeImage(ThreadPool& pool, char const* filename, ImageData const& image, ImageWriteOptions const& options) -> bool;
+}
+
+#endif // MXC_IMAGE_WRITER_H
@@ -0,0 +1,322 @@
+#include "Json.h"
+#include "logging.h"
+
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+
+namespace mxc
+{
+    static uint32_t constexpr JSON_MAX_DEPTH = 256;
+
+    auto JsonValue::find(char const* key) const -> JsonValue const*
+    {
+        for (auto const& [name, value] : m_members)
+            if (name == key)
+                return &value;
+        return nullptr;
+    }
+
+    // recursive descent over the text, which doesn't have to be null terminated
+    class JsonParser
+    {
+    public:
+        JsonParser(char const* text, size_t size) : m_pos(text), m_begin(text), m_end(text + size) {}
+
+        auto parse(JsonValue* pOut, std::string* pOutError) -> bool
+        {
+            bool ok = parseValue(pOut, 0);
+            if (ok)
+            {
+                skipWhitespace();
+                if (m_pos != m_end)
+                    ok = fail("unexpected characters after the document");
+            }
+            if (!ok && pOutError)
+                *pOutError = m_error;
+            return ok;
+        }
+
+    private:
+        auto fail(char const* what) -> bool
+        {
+            if (!m_error.empty())
+                return false;
+            char const* lineStart = m_pos;
+            while (lineStart != m_begin && lineStart[-1] != '\n')
+                --lineStart;
+            m_error = std::to_string(m_line) + ":" + std::to_string(m_pos - lineStart + 1) + ": " + what;
+            return false;
+        }
+
+        // strings can't hold raw line breaks, only whitespace counts lines
+        auto skipWhitespace() -> void
+        {
+            while (m_pos != m_end && (*m_pos == ' ' || *m_pos == '\t' || *m_pos == '\n' || *m_pos == '\r'))
+                m_line += *m_pos++ == '\n' ? 1 : 0;
+        }
+
+        auto consumeLiteral(char const* literal) -> bool
+        {
+            size_t const length = strlen(literal);
+            if (static_cast<size_t>(m_end - m_pos) < length || memcmp(m_pos, literal, length) != 0)
+                return false;
+            m_pos += length;
+            return true;
+        }
+
+        auto parseValue(JsonValue* pOut, uint32_t depth) -> bool
+        {
+            skipWhitespace();
+            if (m_pos == m_end)
+                return fail("unexpected end of the document");
+            if (depth == JSON_MAX_DEPTH)
+                return fail("too deeply nested");
+
+            pOut->m_line = m_line;
+            switch (*m_pos)
+            {
+                case '{': return parseObject(pOut, depth);
+                case '[': return parseArray(pOut, depth);
+                case '"': pOut->m_type = JsonType::STRING; return parseString(&pOut->m_string);
+                case 't': case 'f':
+                    pOut->m_type = JsonType::BOOLEAN;
+                    pOut->m_boolean = *m_pos == 't';
+                    return consumeLiteral(pOut->m_boolean ? "true" : "false") || fail("invalid literal");
+                case 'n':
+                    pOut->m_type = JsonType::NUL;
+                    return consumeLiteral("null") || fail("invalid literal");
+                default:
+                    pOut->m_type = JsonType::NUMBER;
+                    return parseNumber(&pOut->m_number);
+            }
+        }
+
+        auto parseObject(JsonValue* pOut, uint32_t depth) -> bool
+        {
+            pOut->m_type = JsonType::OBJECT;
+            ++m_pos;
+            skipWhitespace();
+            if (m_pos != m_end && *m_pos == '}')
+            {
+                ++m_pos;
+                return true;
+            }
+            for (;;)
+            {
+                skipWhitespace();
+                if (m_pos == m_end || *m_pos != '"')
+                    return fail("expected a member name");
+                auto& member = pOut->m_members.emplace_back();
+                if (!parseString(&member.first))
+                    return false;
+                skipWhitespace();
+                if (m_pos == m_end || *m_pos != ':')
+                    return fail("expected ':' after a member name");
+                ++m_pos;
+                if (!parseValue(&member.second, depth + 1))
+                    return false;
+                skipWhitespace();
+                if (m_pos != m_end && *m_pos == ',')
+                {
+                    ++m_pos;
+                    continue;
+                }
+                if (m_pos != m_end && *m_pos == '}')
+                {
+                    ++m_pos;
+                    return true;
+                }
+                return fail("expected ',' or '}' in an object");
+            }
+        }
+
+        auto parseArray(JsonValue* pOut, uint32_t depth) -> bool
+        {
+            pOut->m_type = JsonType::ARRAY;
+            ++m_pos;
+            skipWhitespace();
+            if (m_pos != m_end && *m_pos == ']')
+            {
+                ++m_pos;
+                return true;
+            }
+            for (;;)
+            {
+                if (!parseValue(&pOut->m_elements.emplace_back(), depth + 1))
+                    return false;
+                skipWhitespace();
+                if (m_pos != m_end && *m_pos == ',')
+                {
+                    ++m_pos;
+                    continue;
+                }
+                if (m_pos != m_end && *m_pos == ']')
+                {
+                    ++m_pos;
+                    return true;
+                }
+                return fail("expected ',' or ']' in an array");
+            }
+        }
+
+        auto parseHex4(uint32_t* pOut) -> bool
+        {
+            if (m_end - m_pos < 4)
+                return fail("truncated \\u escape");
+            auto const [end, error] = std::from_chars(m_pos, m_pos + 4, *pOut, 16);
+            if (error != std::errc() || end != m_pos + 4)
+                return fail("invalid \\u escape");
+            m_pos += 4;
+            return true;
+        }
+
+        static auto appendUtf8(uint32_t codePoint, std::string* pOut) -> void
+        {
+            if (codePoint < 0x80)
+                pOut->push_back(static_cast<char>(codePoint));
+            else if (codePoint < 0x800)
+            {
+                pOut->push_back(static_cast<char>(0xc0 | (codePoint >> 6)));
+                pOut->push_back(static_cast<char>(0x80 | (codePoint & 0x3f)));
+            }
+            else if (codePoint < 0x10000)
+            {
+                pOut->push_back(static_cast<char>(0xe0 | (codePoint >> 12)));
+                pOut->push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3f)));
+                pOut->push_back(static_cast<char>(0x80 | (codePoint & 0x3f)));
+            }
+            else
+            {
+                pOut->push_back(static_cast<char>(0xf0 | (codePoint >> 18)));
+                pOut->push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3f)));
+                pOut->push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3f)));
+                pOut->push_back(static_cast<char>(0x80 | (codePoint & 0x3f)));
+            }
+        }
+
+        auto parseString(std::string* pOut) -> bool
+        {
+            ++m_pos; // opening quote
+            for (;;)
+            {
+                char const* run = m_pos;
+                while (m_pos != m_end && *m_pos != '"' && *m_pos != '\\' && static_cast<unsigned char>(*m_pos) >= 0x20)
+                    ++m_pos;
+                pOut->append(run, m_pos);
+                if (m_pos == m_end)
+                    return fail("unterminated string");
+                if (*m_pos == '"')
+                {
+                    ++m_pos;
+                    return true;
+                }
+                if (*m_pos != '\\')
+                    return fail("control character in a string");
+
+                if (++m_pos == m_end)
+                    return fail("unterminated string");
+                char const escape = *m_pos++;
+                switch (escape)
+                {
+                    case '"': case '\\': case '/': pOut->push_back(escape); break;
+                    case 'b': pOut->push_back('\b'); break;
+                    case 'f': pOut->push_back('\f'); break;
+                    case 'n': pOut->push_back('\n'); break;
+                    case 'r': pOut->push_back('\r'); break;
+                    case 't': pOut->push_back('\t'); break;
+                    case 'u':
+                    {
+                        uint32_t codePoint;
+                        if (!parseHex4(&codePoint))
+                            return false;
+                        // characters past the basic plane come as a surrogate pair
+                        if (codePoint >= 0xd800 && codePoint < 0xdc00)
+                        {
+                            uint32_t low;
+                            if (!consumeLiteral("\\u") || !parseHex4(&low) || low < 0xdc00 || low >= 0xe000)
+                                return fail("unpaired surrogate in a \\u escape");
+                            codePoint = 0x10000 + ((codePoint - 0xd800) << 10) + (low - 0xdc00);
+                        }
+                        appendUtf8(codePoint, pOut);
+                        break;
+                    }
+                    default: return fail("invalid escape sequence");
+                }
+            }
+        }
+
+        // the grammar is checked here, from_chars would accept a leading '+', leading zeros and a missing integer part
+        auto parseNumber(double* pOut) -> bool
+        {
+            char const* start = m_pos;
+            auto const digits = [this] {
+                char const* first = m_pos;
+                while (m_pos != m_end && *m_pos >= '0' && *m_pos <= '9')
+                    ++m_pos;
+                return m_pos != first;
+            };
+            if (m_pos != m_end && *m_pos == '-')
+                ++m_pos;
+            if (m_pos != m_end && *m_pos == '0')
+                ++m_pos;
+            else if (!digits())
+                return fail("invalid value");
+            if (m_pos != m_end && *m_pos == '.')
+            {
+                ++m_pos;
+                if (!digits())
+                    return fail("expected digits after the decimal point");
+            }
+            if (m_pos != m_end && (*m_pos == 'e' || *m_pos == 'E'))
+            {
+                ++m_pos;
+                if (m_pos != m_end && (*m_pos == '+' || *m_pos == '-'))
+                    ++m_pos;
+                if (!digits())
+                    return fail("expected digits in the exponent");
+            }
+
+            auto const [end, error] = std::from_chars(start, m_pos, *pOut);
+            if (error == std::errc::result_out_of_range)
+                return fail("number out of the range of a double");
+            return end == m_pos || fail("invalid number");
+        }
+
+    private:
+        char const* m_pos;
+        char const* m_begin;
+        char const* m_end;
+        uint32_t m_line = 1;
+        std::string m_error;
+    };
+
+    auto parseJson(char const* text, size_t size, JsonValue* pOut, std::string* pOutError) -> bool
+    {
+        *pOut = JsonValue{};
+        return JsonParser(text, size).parse(pOut, pOutError);
+    }
+
+    auto parseJsonFile(char const* filename, JsonValue* pOut) -> bool
+    {
+        FILE* file = fopen(filename, "rb");
+        if (!file)
+        {
+            MXC_ERROR("couldn't open %s", filename);
+            return false;
+        }
+        std::string text;
+        char buffer[65536];
+        for (size_t read; (read = fread(buffer, 1, sizeof(buffer), file)) != 0;)
+            text.append(buffer, read);
+        fclose(file);
+
+        std::string error;
+        if (!parseJson(text.data(), text.size(), pOut, &error))
+        {
+            MXC_ERROR("%s:%s", filename, error.c_str());
+            return false;
+        }
+        return true;
+    }
+}
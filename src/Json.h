@@ -0,0 +1,60 @@
+#ifndef MXC_JSON_H
+#define MXC_JSON_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mxc
+{
+	enum class JsonType : uint8_t
+	{
+		NUL, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT
+	};
+
+	// Document tree of a parsed JSON text. Members of objects keep the order of the text, such that what a scene declares is
+	// added in that order whatever the keys are
+	class JsonValue
+	{
+	public:
+		auto type() const -> JsonType { return m_type; }
+		auto isNumber() const -> bool { return m_type == JsonType::NUMBER; }
+		auto isString() const -> bool { return m_type == JsonType::STRING; }
+		auto isArray() const -> bool { return m_type == JsonType::ARRAY; }
+		auto isObject() const -> bool { return m_type == JsonType::OBJECT; }
+
+		auto boolean() const -> bool { return m_boolean; }
+		auto number() const -> double { return m_number; }
+		auto string() const -> std::string const& { return m_string; }
+
+		// elements of an array, members of an object
+		auto size() const -> size_t { return m_type == JsonType::OBJECT ? m_members.size() : m_elements.size(); }
+		auto operator[](size_t i) const -> JsonValue const& { return m_elements[i]; }
+		auto member(size_t i) const -> std::pair<std::string, JsonValue> const& { return m_members[i]; }
+		// nullptr if there is no such member or this isn't an object. The first one of duplicated keys
+		auto find(char const* key) const -> JsonValue const*;
+
+		// line of the text the value starts on, for error messages
+		auto line() const -> uint32_t { return m_line; }
+
+	private:
+		friend class JsonParser;
+
+		JsonType m_type = JsonType::NUL;
+		bool m_boolean = false;
+		double m_number = 0.;
+		uint32_t m_line = 0;
+		std::string m_string;
+		std::vector<JsonValue> m_elements;
+		std::vector<std::pair<std::string, JsonValue>> m_members;
+	};
+
+	// RFC 8259, with a nesting limit. pOutError receives "line:column: what" when it fails
+	auto parseJson(char const* text, size_t size, JsonValue* pOut, std::string* pOutError) -> bool;
+	// reads the whole file first
+	auto parseJsonFile(char const* filename, JsonValue* pOut) -> bool;
+}
+
+#endif // MXC_JSON_H
@@ -0,0 +1,270 @@
+#include "Lbvh.h"
+#include "Bvh.h"
+#include "Scene.h"
+#include "CommandBuffer.h"
+#include "logging.h"
+
+#include <string>
+
+namespace mxc
+{
+    // matches LbvhConstants in lbvh.comp
+    struct LbvhPushConstants
+    {
+        uint32_t primitiveCount;
+        uint32_t sphereCount;
+        uint32_t triangleCount;
+        uint32_t radixShift;
+        uint32_t radixGroupCount;
+    };
+
+    // indices of m_scratch
+    enum LbvhScratch : uint32_t
+    {
+        PRIMITIVE_BOUNDS, GLOBALS, KEYS, KEYS_ALT, VALUES_ALT, DIGIT_OFFSETS, RADIX_NODES, PARENTS, NODE_BOUNDS, ARRIVALS
+    };
+
+    static uint32_t constexpr LBVH_AABB_SIZE = 8 * sizeof(float);      // LbvhAabb, float3 and padding twice
+    static uint32_t constexpr LBVH_NODE_SIZE = 4 * sizeof(uint32_t);   // LbvhNode
+    static uint32_t constexpr LBVH_GLOBALS_COUNT = 8;                  // ordered centroid min xyz, max xyz, deepest leaf, padding
+    static uint32_t constexpr LBVH_DEPTH_OFFSET = 6 * sizeof(uint32_t);
+
+    auto LbvhBuilder::create(VulkanContext* ctx, wchar_t const* shaderDir) -> bool
+    {
+        wchar_t const* const names[PASS_COUNT] {
+            L"/lbvhBounds.comp", L"/lbvhMorton.comp", L"/lbvhRadixHistogram.comp", L"/lbvhRadixScan.comp", L"/lbvhRadixScatter.comp",
+            L"/lbvhHierarchy.comp", L"/lbvhFit.comp", L"/lbvhFlatten.comp"
+        };
+        for (uint32_t pass = 0; pass != PASS_COUNT; ++pass)
+            if (!createPass(ctx, shaderDir, names[pass], static_cast<Pass>(pass)))
+                return false;
+
+        ctx->device.createBuffer(&m_readback);
+
+        // timestamps are written from the graphics queue, which is used for compute work too
+        if (ctx->device.properties.limits.timestampComputeAndGraphics)
+        {
+            m_timestampPeriodNs = ctx->device.properties.limits.timestampPeriod;
+            VkQueryPoolCreateInfo const createInfo {
+                .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+                .queryType = VK_QUERY_TYPE_TIMESTAMP,
+                .queryCount = QUERY_COUNT,
+                .pipelineStatistics = 0
+            };
+            VK_CHECK(vkCreateQueryPool(ctx->device.logical, &createInfo, nullptr, &m_queryPool));
+        }
+        return true;
+    }
+
+    auto LbvhBuilder::destroy(VulkanContext* ctx) -> void
+    {
+        if (m_queryPool != VK_NULL_HANDLE)
+            vkDestroyQueryPool(ctx->device.logical, m_queryPool, nullptr);
+        m_queryPool = VK_NULL_HANDLE;
+
+        for (Buffer& buffer : m_scratch)
+            if (buffer.handle != VK_NULL_HANDLE)
+                ctx->device.destroyBuffer(&buffer);
+        m_capacity = 0;
+        if (m_readback.handle != VK_NULL_HANDLE)
+            ctx->device.destroyBuffer(&m_readback);
+
+        for (uint32_t pass = 0; pass != PASS_COUNT; ++pass)
+        {
+            m_pipelines[pass].destroy(ctx);
+            m_shaders[pass].destroy(ctx);
+        }
+    }
+
+    auto LbvhBuilder::build(VulkanContext* ctx, SceneBuffers const& sceneBuffers) -> bool
+    {
+        m_depth = 0;
+        m_buildMilliseconds = 0.f;
+        uint32_t const primitive_count = sceneBuffers.sphereCount() + sceneBuffers.triangleCount() + sceneBuffers.instanceCount();
+        if (primitive_count == 0)
+            return true;
+
+        uint32_t const groupCount = (primitive_count + GROUP_SIZE - 1) / GROUP_SIZE;
+        uint32_t const nodeGroupCount = (2 * primitive_count - 1 + GROUP_SIZE - 1) / GROUP_SIZE;
+        if (nodeGroupCount > ctx->device.properties.limits.maxComputeWorkGroupCount[0])
+        {
+            MXC_ERROR("LbvhBuilder: %u primitives need more workgroups than the device can dispatch", primitive_count);
+            return false;
+        }
+        if (!reserve(ctx, primitive_count))
+            return false;
+
+        // sphere geometry, vertex positions, triangle indices, BVH primitive indices, BVH nodes and instances come from the scene
+        DescriptorInfo sceneInfos[SceneBuffers::BINDING_COUNT];
+        sceneBuffers.descriptors(sceneInfos);
+        auto const scratchInfo = [this](LbvhScratch scratch) {
+            DescriptorInfo info;
+            info.buffer = { .buffer = m_scratch[scratch].handle, .offset = 0, .range = VK_WHOLE_SIZE };
+            return info;
+        };
+        DescriptorInfo const infos[BINDING_COUNT] {
+            sceneInfos[0], sceneInfos[5], sceneInfos[6], scratchInfo(PRIMITIVE_BOUNDS), scratchInfo(GLOBALS), scratchInfo(KEYS),
+            sceneInfos[9], scratchInfo(KEYS_ALT), scratchInfo(VALUES_ALT), scratchInfo(DIGIT_OFFSETS), scratchInfo(RADIX_NODES),
+            scratchInfo(PARENTS), scratchInfo(NODE_BOUNDS), scratchInfo(ARRIVALS), sceneInfos[8], sceneInfos[11]
+        };
+        for (ShaderSet& shader : m_shaders)
+            shader.resources.updateAll(ctx, infos);
+
+        CommandBuffer cmdBuf;
+        cmdBuf.allocate(ctx, CommandType::COMPUTE);
+        cmdBuf.begin();
+        if (m_queryPool != VK_NULL_HANDLE)
+        {
+            vkCmdResetQueryPool(cmdBuf.handle, m_queryPool, 0, QUERY_COUNT);
+            vkCmdWriteTimestamp(cmdBuf.handle, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_queryPool, 0);
+        }
+
+        // empty centroid bounds, no leaf, no parent of the root, no arrival
+        Buffer const& globals = m_scratch[GLOBALS];
+        vkCmdFillBuffer(cmdBuf.handle, globals.handle, 0, 3 * sizeof(uint32_t), UINT32_MAX);
+        vkCmdFillBuffer(cmdBuf.handle, globals.handle, 3 * sizeof(uint32_t), VK_WHOLE_SIZE, 0);
+        vkCmdFillBuffer(cmdBuf.handle, m_scratch[PARENTS].handle, 0, VK_WHOLE_SIZE, UINT32_MAX);
+        vkCmdFillBuffer(cmdBuf.handle, m_scratch[ARRIVALS].handle, 0, VK_WHOLE_SIZE, 0);
+        ctx->device.insertMemoryBarrier(cmdBuf.handle, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                                        VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+        LbvhPushConstants constants {
+            .primitiveCount = primitive_count,
+            .sphereCount = sceneBuffers.sphereCount(),
+            .triangleCount = sceneBuffers.triangleCount(),
+            .radixShift = 0,
+            .radixGroupCount = groupCount
+        };
+        recordDispatch(ctx, cmdBuf.handle, BOUNDS, groupCount, &constants);
+        recordDispatch(ctx, cmdBuf.handle, MORTON, groupCount, &constants);
+        for (uint32_t radixPass = 0; radixPass != RADIX_PASS_COUNT; ++radixPass)
+        {
+            constants.radixShift = radixPass * RADIX_BITS;
+            recordDispatch(ctx, cmdBuf.handle, RADIX_HISTOGRAM, groupCount, &constants);
+            recordDispatch(ctx, cmdBuf.handle, RADIX_SCAN, 1, &constants);
+            recordDispatch(ctx, cmdBuf.handle, RADIX_SCATTER, groupCount, &constants);
+        }
+        recordDispatch(ctx, cmdBuf.handle, HIERARCHY, groupCount, &constants);
+        recordDispatch(ctx, cmdBuf.handle, FIT, groupCount, &constants);
+        recordDispatch(ctx, cmdBuf.handle, FLATTEN, nodeGroupCount, &constants);
+
+        // BVH writes -> depth readback and the accumulation shader in later submissions
+        ctx->device.insertMemoryBarrier(cmdBuf.handle, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_SHADER_READ_BIT,
+                                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                        VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        VkBufferCopy const depthCopy { .srcOffset = LBVH_DEPTH_OFFSET, .dstOffset = 0, .size = sizeof(uint32_t) };
+        vkCmdCopyBuffer(cmdBuf.handle, globals.handle, m_readback.handle, 1, &depthCopy);
+        if (m_queryPool != VK_NULL_HANDLE)
+            vkCmdWriteTimestamp(cmdBuf.handle, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPool, 1);
+        cmdBuf.end();
+        bool const submitted = ctx->device.flushCommandBuffer(&cmdBuf, CommandType::COMPUTE);
+        cmdBuf.free(ctx);
+        if (!submitted)
+        {
+            MXC_ERROR("LbvhBuilder: couldn't submit the build of %u primitives", primitive_count);
+            return false;
+        }
+
+        m_depth = *static_cast<uint32_t const*>(m_readback.mapped);
+        uint64_t timestamps[QUERY_COUNT] {};
+        if (m_queryPool != VK_NULL_HANDLE
+            && vkGetQueryPoolResults(ctx->device.logical, m_queryPool, 0, QUERY_COUNT, sizeof(timestamps), timestamps, sizeof(uint64_t),
+                                     VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) == VK_SUCCESS)
+            m_buildMilliseconds = static_cast<float>(timestamps[1] - timestamps[0]) * m_timestampPeriodNs * 1e-6f;
+
+        MXC_INFO("LbvhBuilder: %u primitives, %u nodes, depth %u, built in %.2f ms on the device", primitive_count,
+                 2 * primitive_count - 1, m_depth, m_buildMilliseconds);
+
+        // duplicate Morton codes are split by index, which clusters of many coincident centroids can push past the traversal stack
+        if (m_depth > BVH_MAX_DEPTH)
+        {
+            MXC_ERROR("LbvhBuilder: depth %u exceeds the traversal stack of %u entries", m_depth, BVH_MAX_DEPTH);
+            return false;
+        }
+        return true;
+    }
+
+    auto LbvhBuilder::createPass(VulkanContext* ctx, wchar_t const* shaderDir, wchar_t const* name, Pass pass) -> bool
+    {
+        static uint32_t constexpr POOLSIZES_COUNT = 1;
+        VkDescriptorPoolSize const poolSizes[POOLSIZES_COUNT] {
+            {.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = BINDING_COUNT}
+        };
+        uint32_t const bindingNumbers_counts[POOLSIZES_COUNT] { BINDING_COUNT };
+        uint32_t const bindingNumbers[BINDING_COUNT] { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+        ResourceConfiguration const resConfig {
+            .pPoolSizes = poolSizes,
+            .pBindingNumbers = bindingNumbers,
+            .pBindingNumbers_counts = bindingNumbers_counts,
+            .poolSizes_count = POOLSIZES_COUNT,
+            .usePushDescriptors = false
+        };
+
+        std::wstring const filename = std::wstring(shaderDir) + name;
+        wchar_t const* filenames[] { filename.c_str() };
+        VkShaderStageFlagBits const stageFlags[] { VK_SHADER_STAGE_COMPUTE_BIT };
+        ShaderConfiguration shaderConfig{};
+        shaderConfig.filenames = filenames;
+        shaderConfig.stageFlags = stageFlags;
+        shaderConfig.shaderDir = shaderDir;
+        shaderConfig.stage_count = 1;
+
+        VkPushConstantRange const pushConstantRange {
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT, .offset = 0, .size = sizeof(LbvhPushConstants)
+        };
+        if (!m_shaders[pass].create(ctx, shaderConfig, resConfig)
+            || !m_pipelines[pass].create(ctx, m_shaders[pass], 0, 0, VK_NULL_HANDLE, &pushConstantRange, 1))
+        {
+            MXC_ERROR("LbvhBuilder: couldn't create the pipeline of an LBVH build pass");
+            return false;
+        }
+
+        uint32_t strides[POOLSIZES_COUNT] { sizeof(uint32_t) };
+        m_shaders[pass].resources.createUpdateTemplate(ctx, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelines[pass].layout, strides);
+        return true;
+    }
+
+    auto LbvhBuilder::reserve(VulkanContext* ctx, uint32_t primitive_count) -> bool
+    {
+        if (primitive_count <= m_capacity)
+            return true;
+
+        for (Buffer& buffer : m_scratch)
+            if (buffer.handle != VK_NULL_HANDLE)
+                ctx->device.destroyBuffer(&buffer);
+        m_capacity = 0;
+
+        VkDeviceSize const n = primitive_count;
+        VkDeviceSize const groupCount = (n + GROUP_SIZE - 1) / GROUP_SIZE;
+        VkDeviceSize const internalCount = n > 1 ? n - 1 : 1;
+        VkDeviceSize const sizes[SCRATCH_COUNT] {
+            n * LBVH_AABB_SIZE, LBVH_GLOBALS_COUNT * sizeof(uint32_t), n * sizeof(uint32_t), n * sizeof(uint32_t), n * sizeof(uint32_t),
+            (1u << RADIX_BITS) * groupCount * sizeof(uint32_t), internalCount * LBVH_NODE_SIZE, (2 * n - 1) * sizeof(uint32_t),
+            (2 * n - 1) * LBVH_AABB_SIZE, internalCount * sizeof(uint32_t)
+        };
+        for (uint32_t i = 0; i != SCRATCH_COUNT; ++i)
+        {
+            m_scratch[i] = Buffer(sizes[i], BufferType_v::STORAGE);
+            if (!ctx->device.createBuffer(&m_scratch[i]))
+            {
+                MXC_ERROR("LbvhBuilder: couldn't create a scratch buffer of %zu bytes", static_cast<size_t>(sizes[i]));
+                return false;
+            }
+        }
+        m_capacity = primitive_count;
+        return true;
+    }
+
+    auto LbvhBuilder::recordDispatch(VulkanContext* ctx, VkCommandBuffer cmdBuf, Pass pass, uint32_t groupCount, void const* pConstants) -> void
+    {
+        Pipeline const& pipeline = m_pipelines[pass];
+        vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.layout, 0, 1,
+                                &m_shaders[pass].resources.descriptorSets[0], 0, nullptr);
+        vkCmdPushConstants(cmdBuf, pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(LbvhPushConstants), pConstants);
+        vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.handle);
+        vkCmdDispatch(cmdBuf, groupCount, 1, 1);
+        ctx->device.insertMemoryBarrier(cmdBuf);
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef MXC_LBVH_H
+#define MXC_LBVH_H
+
+#include <vulkan/vulkan.h>
+#include "VulkanCommon.h"
+#include "Buffer.h"
+#include "Shader.h"
+#include "Pipeline.h"
+#include "VulkanContext.inl"
+
+#include <cstdint>
+
+namespace mxc
+{
+	class SceneBuffers;
+
+	// Linear BVH built on the device over the primitives of SceneBuffers, with no CPU work but recording the passes (see
+	// shaders/spectrumTest/lbvh.comp): primitive boxes, 30 bit Morton codes of their centroids, an 8 pass radix sort of 4 bit digits,
+	// Karras' radix tree over the sorted codes, boxes fitted bottom up and a depth first flattening into BvhNode, such that the
+	// accumulation shader traverses it as the one built by Bvh. Leaves hold a single primitive and splits follow the Morton order
+	// rather than the SAH, trading some traversal speed for build times of a few milliseconds on millions of primitives
+	class LbvhBuilder
+	{
+		static uint32_t constexpr GROUP_SIZE = 256;    // LBVH_GROUP_SIZE in lbvh.comp
+		static uint32_t constexpr RADIX_BITS = 4;      // LBVH_RADIX_BITS
+		static uint32_t constexpr RADIX_PASS_COUNT = 8; // even, the sorted keys end where the Morton codes started
+		static uint32_t constexpr BINDING_COUNT = 16;
+		static uint32_t constexpr SCRATCH_COUNT = 10;
+		static uint32_t constexpr QUERY_COUNT = 2;
+
+		enum Pass : uint32_t { BOUNDS, MORTON, RADIX_HISTOGRAM, RADIX_SCAN, RADIX_SCATTER, HIERARCHY, FIT, FLATTEN, PASS_COUNT };
+
+	public:
+		auto create(VulkanContext* ctx, wchar_t const* shaderDir) -> bool;
+		auto destroy(VulkanContext* ctx) -> void;
+
+		// writes the top level BVH nodes and primitive indices of sceneBuffers, which have to be created without a host BVH. The bottom
+		// level BVHs of instanced meshes come from MeshBvhs, built on the host once per mesh. Blocking
+		auto build(VulkanContext* ctx, SceneBuffers const& sceneBuffers) -> bool;
+
+		auto depth() const -> uint32_t { return m_depth; }
+		auto buildMilliseconds() const -> float { return m_buildMilliseconds; } // device time, 0 without timestamp support
+
+	private:
+		auto createPass(VulkanContext* ctx, wchar_t const* shaderDir, wchar_t const* name, Pass pass) -> bool;
+		auto reserve(VulkanContext* ctx, uint32_t primitive_count) -> bool;
+		auto recordDispatch(VulkanContext* ctx, VkCommandBuffer cmdBuf, Pass pass, uint32_t groupCount, void const* pConstants) -> void;
+
+	private:
+		ShaderSet m_shaders[PASS_COUNT];
+		Pipeline m_pipelines[PASS_COUNT];
+
+		// primitive bounds, globals, keys, alternate keys, alternate values, digit offsets, radix tree nodes, parents, node bounds,
+		// arrivals. Grown to the largest primitive count built so far
+		Buffer m_scratch[SCRATCH_COUNT] {
+			{0, BufferType_v::STORAGE}, {0, BufferType_v::STORAGE}, {0, BufferType_v::STORAGE}, {0, BufferType_v::STORAGE},
+			{0, BufferType_v::STORAGE}, {0, BufferType_v::STORAGE}, {0, BufferType_v::STORAGE}, {0, BufferType_v::STORAGE},
+			{0, BufferType_v::STORAGE}, {0, BufferType_v::STORAGE}
+		};
+		Buffer m_readback{sizeof(uint32_t), BufferType_v::READBACK}; // deepest leaf
+		uint32_t m_capacity = 0;
+
+		VkQueryPool m_queryPool = VK_NULL_HANDLE;
+		float m_timestampPeriodNs = 0.f;
+		uint32_t m_depth = 0;
+		float m_buildMilliseconds = 0.f;
+	};
+}
+
+#endif // MXC_LBVH_H
@@ -0,0 +1,284 @@
+#include "LightBvh.h"
+#include "logging.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numbers>
+
+namespace mxc
+{
+    static uint32_t constexpr BUCKET_COUNT = 12;
+    // past this depth splits are medians, which bounds the depth of the recursion by the logarithm of the light count
+    static uint32_t constexpr MEDIAN_SPLIT_DEPTH = 48;
+    static float constexpr PI = std::numbers::pi_v<float>;
+
+    static auto emptyAabb() -> Aabb
+    {
+        float constexpr inf = std::numeric_limits<float>::infinity();
+        return { { inf, inf, inf }, { -inf, -inf, -inf } };
+    }
+
+    static auto grow(Aabb* pBounds, Aabb const& other) -> void
+    {
+        for (uint32_t a = 0; a != 3; ++a)
+        {
+            pBounds->min[a] = std::min(pBounds->min[a], other.min[a]);
+            pBounds->max[a] = std::max(pBounds->max[a], other.max[a]);
+        }
+    }
+
+    static auto surfaceArea(Aabb const& bounds) -> float
+    {
+        float const dx = bounds.max[0] - bounds.min[0];
+        float const dy = bounds.max[1] - bounds.min[1];
+        float const dz = bounds.max[2] - bounds.min[2];
+        return dx < 0.f ? 0.f : 2.f * (dx * dy + dy * dz + dz * dx);
+    }
+
+    static auto centroid(Aabb const& bounds, uint32_t axis) -> float
+    {
+        return 0.5f * (bounds.min[axis] + bounds.max[axis]);
+    }
+
+    static auto safeAcos(float x) -> float
+    {
+        return std::acos(std::clamp(x, -1.f, 1.f));
+    }
+
+    auto sphereLightBounds(float const center[3], float radius, float const emission[3]) -> LightBounds
+    {
+        float const area = 4.f * PI * radius * radius;
+        return {
+            .bounds = { { center[0] - radius, center[1] - radius, center[2] - radius },
+                        { center[0] + radius, center[1] + radius, center[2] + radius } },
+            .w = { 0.f, 0.f, 1.f },
+            .phi = std::max({ emission[0], emission[1], emission[2] }) * area * PI,
+            .cosTheta_o = -1.f,
+            .cosTheta_e = 0.f,
+            .twoSided = false
+        };
+    }
+
+    auto triangleLightBounds(float const p0[3], float const p1[3], float const p2[3], float const emission[3]) -> LightBounds
+    {
+        float const e1[3] { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+        float const e2[3] { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+        float n[3] { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+        float const length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length == 0.f)
+            return LightBounds{};
+        for (float& a : n)
+            a /= length;
+        float const area = 0.5f * length;
+        return {
+            .bounds = { { std::min({ p0[0], p1[0], p2[0] }), std::min({ p0[1], p1[1], p2[1] }), std::min({ p0[2], p1[2], p2[2] }) },
+                        { std::max({ p0[0], p1[0], p2[0] }), std::max({ p0[1], p1[1], p2[1] }), std::max({ p0[2], p1[2], p2[2] }) } },
+            .w = { n[0], n[1], n[2] },
+            .phi = std::max({ emission[0], emission[1], emission[2] }) * area * 2.f * PI,
+            .cosTheta_o = 1.f,
+            .cosTheta_e = 0.f,
+            .twoSided = true
+        };
+    }
+
+    // smallest cone holding the cones of directions a and b, pbrt-v4's Union(DirectionCone, DirectionCone)
+    static auto coneUnion(float const wa[3], float cosThetaA, float const wb[3], float cosThetaB, float outW[3]) -> float
+    {
+        float const thetaA = safeAcos(cosThetaA);
+        float const thetaB = safeAcos(cosThetaB);
+        float const thetaD = safeAcos(wa[0] * wb[0] + wa[1] * wb[1] + wa[2] * wb[2]);
+        if (std::min(thetaD + thetaB, PI) <= thetaA)
+        {
+            std::copy_n(wa, 3, outW);
+            return cosThetaA;
+        }
+        if (std::min(thetaD + thetaA, PI) <= thetaB)
+        {
+            std::copy_n(wb, 3, outW);
+            return cosThetaB;
+        }
+
+        // a rotated towards b, around their cross product, until its cone touches the far side of b's
+        float const thetaO = 0.5f * (thetaA + thetaD + thetaB);
+        float axis[3] { wa[1] * wb[2] - wa[2] * wb[1], wa[2] * wb[0] - wa[0] * wb[2], wa[0] * wb[1] - wa[1] * wb[0] };
+        float const axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+        if (thetaO >= PI || axisLength == 0.f)
+        {
+            outW[0] = 0.f;
+            outW[1] = 0.f;
+            outW[2] = 1.f;
+            return -1.f;
+        }
+        for (float& a : axis)
+            a /= axisLength;
+        float const thetaR = thetaO - thetaA;
+        float const cosR = std::cos(thetaR), sinR = std::sin(thetaR);
+        float const axisCrossA[3] {
+            axis[1] * wa[2] - axis[2] * wa[1], axis[2] * wa[0] - axis[0] * wa[2], axis[0] * wa[1] - axis[1] * wa[0]
+        };
+        // the axis is orthogonal to a, Rodrigues' formula loses its last term
+        for (uint32_t a = 0; a != 3; ++a)
+            outW[a] = wa[a] * cosR + axisCrossA[a] * sinR;
+        return std::cos(thetaO);
+    }
+
+    auto unionLightBounds(LightBounds const& a, LightBounds const& b) -> LightBounds
+    {
+        if (a.phi == 0.f)
+            return b;
+        if (b.phi == 0.f)
+            return a;
+
+        LightBounds result;
+        result.bounds = a.bounds;
+        grow(&result.bounds, b.bounds);
+        result.cosTheta_o = coneUnion(a.w, a.cosTheta_o, b.w, b.cosTheta_o, result.w);
+        result.phi = a.phi + b.phi;
+        result.cosTheta_e = std::min(a.cosTheta_e, b.cosTheta_e);
+        result.twoSided = a.twoSided || b.twoSided;
+        return result;
+    }
+
+    // power times the solid angle it is emitted in times the surface area, stretched along the other axes than the split one for
+    // the children not to come out as thin slabs, as pbrt-v4's BVHLightSampler::EvaluateCost
+    static auto splitCost(LightBounds const& b, Aabb const& parentBounds, uint32_t axis) -> float
+    {
+        if (b.phi == 0.f)
+            return 0.f;
+        float const thetaO = safeAcos(b.cosTheta_o);
+        float const thetaE = safeAcos(b.cosTheta_e);
+        float const thetaW = std::min(thetaO + thetaE, PI);
+        float const sinThetaO = std::sqrt(std::max(0.f, 1.f - b.cosTheta_o * b.cosTheta_o));
+        float const solidAngle = 2.f * PI * (1.f - b.cosTheta_o)
+                               + PI / 2.f * (2.f * thetaW * sinThetaO - std::cos(thetaO - 2.f * thetaW) - 2.f * thetaO * sinThetaO
+                                             + b.cosTheta_o);
+        float const extents[3] {
+            parentBounds.max[0] - parentBounds.min[0], parentBounds.max[1] - parentBounds.min[1], parentBounds.max[2] - parentBounds.min[2]
+        };
+        float const regularity = std::max({ extents[0], extents[1], extents[2] }) / extents[axis];
+        return b.phi * solidAngle * regularity * surfaceArea(b.bounds);
+    }
+
+    auto LightBvh::build(LightBounds const* pLightBounds, uint32_t light_count) -> void
+    {
+        clear();
+        m_leaves.assign(light_count, LIGHT_BVH_NONE);
+        std::vector<uint32_t> lights;
+        lights.reserve(light_count);
+        for (uint32_t i = 0; i != light_count; ++i)
+            if (pLightBounds[i].phi > 0.f)
+                lights.push_back(i);
+        if (lights.size() != light_count)
+            MXC_WARN("LightBvh: %zu lights emit nothing, left out", light_count - lights.size());
+        if (lights.empty())
+            return;
+
+        m_nodes.reserve(2 * lights.size() - 1);
+        buildRecursive(pLightBounds, lights.data(), static_cast<uint32_t>(lights.size()), LIGHT_BVH_NONE, 0);
+        MXC_DEBUG("LightBvh: %zu lights, %u nodes, depth %u", lights.size(), nodeCount(), m_depth);
+    }
+
+    auto LightBvh::buildRecursive(LightBounds const* pLightBounds, uint32_t* pLights, uint32_t light_count, uint32_t parent,
+                                  uint32_t depth) -> uint32_t
+    {
+        uint32_t const nodeIndex = nodeCount();
+        m_nodes.emplace_back();
+        m_depth = std::max(m_depth, depth + 1);
+
+        LightBounds total = pLightBounds[pLights[0]];
+        Aabb centroidBounds = emptyAabb();
+        for (uint32_t i = 0; i != light_count; ++i)
+        {
+            Aabb const& bounds = pLightBounds[pLights[i]].bounds;
+            if (i != 0)
+                total = unionLightBounds(total, pLightBounds[pLights[i]]);
+            float const c[3] { centroid(bounds, 0), centroid(bounds, 1), centroid(bounds, 2) };
+            grow(&centroidBounds, Aabb{ { c[0], c[1], c[2] }, { c[0], c[1], c[2] } });
+        }
+
+        uint32_t offset = pLights[0];
+        uint32_t flags = LIGHT_BVH_LEAF;
+        if (light_count == 1)
+            m_leaves[pLights[0]] = nodeIndex;
+        else
+        {
+            // cheapest boundary between buckets of centroids, along any axis
+            float bestCost = std::numeric_limits<float>::infinity();
+            uint32_t bestAxis = 3, bestBucket = 0;
+            auto const bucketOf = [&](uint32_t light, uint32_t axis) {
+                float const extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+                float const t = (centroid(pLightBounds[light].bounds, axis) - centroidBounds.min[axis]) / extent;
+                return std::min(static_cast<uint32_t>(BUCKET_COUNT * t), BUCKET_COUNT - 1);
+            };
+            for (uint32_t axis = 0; depth < MEDIAN_SPLIT_DEPTH && axis != 3; ++axis)
+            {
+                if (centroidBounds.max[axis] == centroidBounds.min[axis])
+                    continue;
+                LightBounds buckets[BUCKET_COUNT] {};
+                for (uint32_t i = 0; i != light_count; ++i)
+                {
+                    uint32_t const bucket = bucketOf(pLights[i], axis);
+                    buckets[bucket] = unionLightBounds(buckets[bucket], pLightBounds[pLights[i]]);
+                }
+                for (uint32_t split = 0; split != BUCKET_COUNT - 1; ++split)
+                {
+                    LightBounds below {}, above {};
+                    for (uint32_t b = 0; b <= split; ++b)
+                        below = unionLightBounds(below, buckets[b]);
+                    for (uint32_t b = split + 1; b != BUCKET_COUNT; ++b)
+                        above = unionLightBounds(above, buckets[b]);
+                    float const cost = splitCost(below, total.bounds, axis) + splitCost(above, total.bounds, axis);
+                    if (cost > 0.f && cost < bestCost)
+                    {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestBucket = split;
+                    }
+                }
+            }
+
+            uint32_t mid = 0;
+            if (bestAxis != 3)
+                mid = static_cast<uint32_t>(std::partition(pLights, pLights + light_count, [&](uint32_t light) {
+                    return bucketOf(light, bestAxis) <= bestBucket;
+                }) - pLights);
+            if (mid == 0 || mid == light_count)
+            {
+                // lights on top of each other, or too deep: halves along the widest axis of the centroids
+                uint32_t axis = 0;
+                for (uint32_t a = 1; a != 3; ++a)
+                    if (centroidBounds.max[a] - centroidBounds.min[a] > centroidBounds.max[axis] - centroidBounds.min[axis])
+                        axis = a;
+                mid = light_count / 2;
+                std::nth_element(pLights, pLights + mid, pLights + light_count, [&](uint32_t a, uint32_t b) {
+                    return centroid(pLightBounds[a].bounds, axis) < centroid(pLightBounds[b].bounds, axis);
+                });
+            }
+
+            buildRecursive(pLightBounds, pLights, mid, nodeIndex, depth + 1);
+            offset = buildRecursive(pLightBounds, pLights + mid, light_count - mid, nodeIndex, depth + 1);
+            flags = 0;
+        }
+
+        LightBvhNode& node = m_nodes[nodeIndex];
+        std::copy_n(total.bounds.min, 3, node.boundsMin);
+        std::copy_n(total.bounds.max, 3, node.boundsMax);
+        std::copy_n(total.w, 3, node.w);
+        node.phi = total.phi;
+        node.cosTheta_o = total.cosTheta_o;
+        node.cosTheta_e = total.cosTheta_e;
+        node.offset = offset;
+        node.parent = parent;
+        node.flags = flags | (total.twoSided ? LIGHT_BVH_TWO_SIDED : 0);
+        node.pad = 0;
+        return nodeIndex;
+    }
+
+    auto LightBvh::clear() -> void
+    {
+        m_nodes.clear();
+        m_leaves.clear();
+        m_depth = 0;
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef MXC_LIGHT_BVH_H
+#define MXC_LIGHT_BVH_H
+
+#include "Bvh.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace mxc
+{
+	// What a light, or a cluster of lights, can emit towards a point, as pbrt-v4's LightBounds: the box of its surface, its power,
+	// and the cone of its normals, of axis w and half angle theta_o, past which it emits up to theta_e
+	struct LightBounds
+	{
+		Aabb bounds;
+		float w[3];
+		float phi;        // power, 0 for lights which emit nothing
+		float cosTheta_o;
+		float cosTheta_e;
+		bool twoSided;
+	};
+
+	// a sphere emits all around, up to the horizon of each point of its surface
+	auto sphereLightBounds(float const center[3], float radius, float const emission[3]) -> LightBounds;
+	// triangles emit on both sides, as they are shaded, up to the horizon of their plane
+	auto triangleLightBounds(float const p0[3], float const p1[3], float const p2[3], float const emission[3]) -> LightBounds;
+	// bounds of the light of both, lights which emit nothing don't count
+	auto unionLightBounds(LightBounds const& a, LightBounds const& b) -> LightBounds;
+
+	// 64 bytes, LightBvhNode in shaders/spectrumTest/lightBvh.comp
+	struct LightBvhNode
+	{
+		float boundsMin[3];
+		float phi;
+		float boundsMax[3];
+		float cosTheta_o;
+		float w[3];
+		float cosTheta_e;
+		uint32_t offset; // leaf: the light, interior: second child, the first one is the next node
+		uint32_t parent; // LIGHT_BVH_NONE for the root
+		uint32_t flags;  // LIGHT_BVH_LEAF, LIGHT_BVH_TWO_SIDED
+		uint32_t pad;
+	};
+	static_assert(sizeof(LightBvhNode) == 64);
+
+	static uint32_t constexpr LIGHT_BVH_NONE = 0xffffffff;
+	static uint32_t constexpr LIGHT_BVH_LEAF = 1;
+	static uint32_t constexpr LIGHT_BVH_TWO_SIDED = 2;
+
+	// Binary BVH over the lights of a scene, one light per leaf, of which the shaders sample a light in time logarithmic in their
+	// count: from the root, each step picks a child with probability proportional to the power it may send to the shaded point,
+	// bounded from the LightBounds of the node (Conty Estevez and Kulla, Importance Sampling of Many Lights with Adaptive Tree
+	// Splitting, 2018, as in pbrt-v4). Splits minimize the power times the solid angle of emission times the surface area of the
+	// children. Each light knows its leaf and each node its parent, such that the probability of a light hit by a BSDF sample is
+	// found walking up the tree, for the MIS weight
+	class LightBvh
+	{
+	public:
+		// light i is referred to by index i, lights which emit nothing are left out
+		auto build(LightBounds const* pLightBounds, uint32_t light_count) -> void;
+		auto clear() -> void;
+
+		auto nodeCount() const -> uint32_t { return static_cast<uint32_t>(m_nodes.size()); }
+		auto lightCount() const -> uint32_t { return static_cast<uint32_t>(m_leaves.size()); }
+		auto nodes() const -> LightBvhNode const* { return m_nodes.data(); }
+		auto leaves() const -> uint32_t const* { return m_leaves.data(); } // of each light, LIGHT_BVH_NONE if left out
+		auto depth() const -> uint32_t { return m_depth; }
+
+	private:
+		auto buildRecursive(LightBounds const* pLightBounds, uint32_t* pLights, uint32_t light_count, uint32_t parent, uint32_t depth)
+			-> uint32_t;
+
+	private:
+		std::vector<LightBvhNode> m_nodes;
+		std::vector<uint32_t> m_leaves;
+		uint32_t m_depth = 0;
+	};
+}
+
+#endif // MXC_LIGHT_BVH_H
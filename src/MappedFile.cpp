@@ -0,0 +1,148 @@
+#include "MappedFile.h"
+#include "logging.h"
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace mxc
+{
+#if defined(_WIN32)
+    auto MappedFile::open(char const* filename, MappingMode mode, size_t size) -> bool
+    {
+        MXC_ASSERT(!isOpen(), "MappedFile already open");
+        bool const writable = mode == MappingMode::READ_WRITE;
+
+        HANDLE file = CreateFileA(filename, writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                  writable ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            MXC_ERROR("couldn't open %s, error %lu", filename, GetLastError());
+            return false;
+        }
+
+        if (!writable)
+        {
+            LARGE_INTEGER fileSize;
+            GetFileSizeEx(file, &fileSize);
+            size = static_cast<size_t>(fileSize.QuadPart);
+        }
+        if (size == 0)
+        {
+            MXC_ERROR("can't map %s, it's empty", filename);
+            CloseHandle(file);
+            return false;
+        }
+
+        // a writable mapping of the requested size extends the file
+        DWORD const sizeHigh = static_cast<DWORD>(static_cast<uint64_t>(size) >> 32);
+        DWORD const sizeLow = static_cast<DWORD>(size);
+        HANDLE mapping = CreateFileMappingA(file, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY, sizeHigh, sizeLow, nullptr);
+        void* view = mapping ? MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size) : nullptr;
+        if (!view)
+        {
+            MXC_ERROR("couldn't map %zu bytes of %s, error %lu", size, filename, GetLastError());
+            if (mapping)
+                CloseHandle(mapping);
+            CloseHandle(file);
+            return false;
+        }
+
+        m_file = file;
+        m_mapping = mapping;
+        m_data = static_cast<uint8_t*>(view);
+        m_size = size;
+        return true;
+    }
+
+    auto MappedFile::close() -> void
+    {
+        if (m_data)
+            UnmapViewOfFile(m_data);
+        if (m_mapping)
+            CloseHandle(m_mapping);
+        if (m_file)
+            CloseHandle(m_file);
+        m_data = nullptr;
+        m_mapping = nullptr;
+        m_file = nullptr;
+        m_size = 0;
+    }
+
+    auto MappedFile::flush() -> bool
+    {
+        return FlushViewOfFile(m_data, m_size) && FlushFileBuffers(m_file);
+    }
+#else
+    auto MappedFile::open(char const* filename, MappingMode mode, size_t size) -> bool
+    {
+        MXC_ASSERT(!isOpen(), "MappedFile already open");
+        bool const writable = mode == MappingMode::READ_WRITE;
+
+        int const fd = ::open(filename, writable ? O_RDWR | O_CREAT | O_TRUNC : O_RDONLY, 0644);
+        if (fd < 0)
+        {
+            MXC_ERROR("couldn't open %s", filename);
+            return false;
+        }
+
+        if (writable)
+        {
+            if (ftruncate(fd, static_cast<off_t>(size)) != 0)
+            {
+                MXC_ERROR("couldn't resize %s to %zu bytes", filename, size);
+                ::close(fd);
+                return false;
+            }
+        }
+        else
+        {
+            struct stat fileStat;
+            fstat(fd, &fileStat);
+            size = static_cast<size_t>(fileStat.st_size);
+        }
+        if (size == 0)
+        {
+            MXC_ERROR("can't map %s, it's empty", filename);
+            ::close(fd);
+            return false;
+        }
+
+        void* view = mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+        if (view == MAP_FAILED)
+        {
+            MXC_ERROR("couldn't map %zu bytes of %s", size, filename);
+            ::close(fd);
+            return false;
+        }
+
+        m_fd = fd;
+        m_data = static_cast<uint8_t*>(view);
+        m_size = size;
+        return true;
+    }
+
+    auto MappedFile::close() -> void
+    {
+        if (m_data)
+            munmap(m_data, m_size);
+        if (m_fd >= 0)
+            ::close(m_fd);
+        m_data = nullptr;
+        m_fd = -1;
+        m_size = 0;
+    }
+
+    auto MappedFile::flush() -> bool
+    {
+        return msync(m_data, m_size, MS_SYNC) == 0 && fsync(m_fd) == 0;
+    }
+#endif
+}
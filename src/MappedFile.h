@@ -0,0 +1,48 @@
+#ifndef MXC_MAPPED_FILE_H
+#define MXC_MAPPED_FILE_H
+
+#include <cstdint>
+#include <cstddef>
+
+namespace mxc
+{
+	enum class MappingMode : uint8_t
+	{
+		READ,      // existing file, read only
+		READ_WRITE // file created, or truncated, to the requested size
+	};
+
+	// whole file memory mapping, POSIX mmap or Win32 file mapping
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		MappedFile(MappedFile const&) = delete;
+		MappedFile& operator=(MappedFile const&) = delete;
+		~MappedFile() { close(); }
+
+		// size is ignored for READ, where the size of the existing file is taken
+		auto open(char const* filename, MappingMode mode, size_t size = 0) -> bool;
+		auto close() -> void;
+
+		// writes the dirty pages back and waits for the OS to complete the write
+		auto flush() -> bool;
+
+		auto data() -> uint8_t* { return m_data; }
+		auto data() const -> uint8_t const* { return m_data; }
+		auto size() const -> size_t { return m_size; }
+		auto isOpen() const -> bool { return m_data != nullptr; }
+
+	private:
+		uint8_t* m_data = nullptr;
+		size_t m_size = 0;
+#if defined(_WIN32)
+		void* m_file = nullptr;    // HANDLE
+		void* m_mapping = nullptr; // HANDLE
+#else
+		int m_fd = -1;
+#endif
+	};
+}
+
+#endif // MXC_MAPPED_FILE_H
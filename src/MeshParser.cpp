@@ -0,0 +1,836 @@
+#include "MeshParser.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include "logging.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+
+namespace mxc
+{
+    static uint64_t constexpr MAX_CHUNK_SIZE = 4ull << 20;
+    static uint64_t constexpr MIN_CHUNK_SIZE = 64ull << 10;
+    static uint32_t constexpr PLY_BLOCK_SIZE = 1u << 16; // records per task of the binary PLY passes
+    static uint64_t constexpr NO_ERROR = ~0ull;
+
+    // negative OBJ index, which can only be resolved once the vertex count of the previous chunks is known
+    struct RelativeIndex
+    {
+        uint64_t position; // in the indices of the chunk
+        int64_t vertex;    // relative to the first vertex of the chunk, negative for vertices of previous chunks
+    };
+
+    struct MaterialRun
+    {
+        uint32_t firstTriangle; // of the chunk
+        uint32_t material;      // in the material names of the chunk
+    };
+
+    // what a worker parses out of one chunk, before the merge
+    struct ParseChunk
+    {
+        std::vector<float> positions;
+        std::vector<uint32_t> indices;
+        std::vector<RelativeIndex> relativeIndices;
+        std::vector<MaterialRun> materialRuns;
+        std::vector<std::string> materialNames;
+        std::vector<std::string> materialLibraries;
+        std::vector<uint32_t> quads; // first of the two triangles of each quad, fanned until the merge splits it
+        uint64_t errorOffset = NO_ERROR; // in the file, of the first line which couldn't be parsed
+    };
+
+    static auto isSpace(char c) -> bool
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    static auto skipSpaces(char const* p, char const* end) -> char const*
+    {
+        while (p != end && isSpace(*p))
+            ++p;
+        return p;
+    }
+
+    static auto skipToken(char const* p, char const* end) -> char const*
+    {
+        while (p != end && !isSpace(*p))
+            ++p;
+        return p;
+    }
+
+    // nullptr when there is no number at p
+    static auto parseFloat(char const* p, char const* end, float* pOut) -> char const*
+    {
+        p = skipSpaces(p, end);
+        if (p != end && *p == '+')
+            ++p;
+        auto const [next, error] = std::from_chars(p, end, *pOut);
+        return error == std::errc() ? next : nullptr;
+    }
+
+    static auto parseInteger(char const* p, char const* end, int64_t* pOut) -> char const*
+    {
+        p = skipSpaces(p, end);
+        if (p != end && *p == '+')
+            ++p;
+        auto const [next, error] = std::from_chars(p, end, *pOut);
+        return error == std::errc() ? next : nullptr;
+    }
+
+    static auto isKeyword(char const* p, char const* end, char const* keyword) -> bool
+    {
+        size_t const length = strlen(keyword);
+        return static_cast<size_t>(end - p) > length && memcmp(p, keyword, length) == 0 && isSpace(p[length]);
+    }
+
+    // starts of chunks of about chunkSize bytes, each but the first starting a line, followed by size
+    static auto splitLines(char const* data, uint64_t size, uint64_t chunkSize) -> std::vector<uint64_t>
+    {
+        std::vector<uint64_t> starts { 0 };
+        for (uint64_t position = chunkSize; position < size;)
+        {
+            void const* lineEnd = memchr(data + position, '\n', size - position);
+            if (!lineEnd)
+                break;
+            uint64_t const start = static_cast<char const*>(lineEnd) - data + 1;
+            if (start >= size)
+                break;
+            starts.push_back(start);
+            position = start + chunkSize;
+        }
+        starts.push_back(size);
+        return starts;
+    }
+
+    // enough chunks to keep every thread busy on small files, and bounded ones such that the load balances on large ones
+    static auto chunkSize(ThreadPool& pool, uint64_t size) -> uint64_t
+    {
+        return std::clamp(size / (4 * (pool.threadCount() + 1)), MIN_CHUNK_SIZE, MAX_CHUNK_SIZE);
+    }
+
+    // tinyobjloader splits quads along their shorter diagonal, the same files give the same triangles. pIndices is the fan of the
+    // quad, (0 1 2) (0 2 3), which becomes (0 1 3) (1 2 3) unless the diagonal 0 2 is the shorter
+    static auto splitQuad(float const* pPositions, uint32_t* pIndices) -> void
+    {
+        uint32_t const quad[4] { pIndices[0], pIndices[1], pIndices[2], pIndices[5] };
+        float diagonals[2];
+        for (uint32_t d = 0; d != 2; ++d)
+        {
+            float const* p0 = pPositions + 3 * quad[d];
+            float const* p1 = pPositions + 3 * quad[d + 2];
+            float const e[3] { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+            diagonals[d] = e[0] * e[0] + e[1] * e[1] + e[2] * e[2];
+        }
+        if (!(diagonals[0] < diagonals[1]))
+        {
+            uint32_t const split[6] { quad[0], quad[1], quad[3], quad[1], quad[2], quad[3] };
+            std::copy_n(split, 6, pIndices);
+        }
+    }
+
+    // other polygons are fanned, as tinyobjloader does without earcut
+    static auto emitPolygon(ParseChunk* pChunk, int64_t const* pVertices, uint8_t const* pRelative, uint32_t vertex_count) -> void
+    {
+        if (vertex_count == 4)
+            pChunk->quads.push_back(static_cast<uint32_t>(pChunk->indices.size() / 3));
+        for (uint32_t k = 1; k + 1 < vertex_count; ++k)
+        {
+            uint32_t const corners[3] { 0, k, k + 1 };
+            for (uint32_t corner : corners)
+            {
+                if (pRelative[corner])
+                    pChunk->relativeIndices.push_back({ .position = pChunk->indices.size(), .vertex = pVertices[corner] });
+                pChunk->indices.push_back(pRelative[corner] ? 0 : static_cast<uint32_t>(pVertices[corner]));
+            }
+        }
+    }
+
+    static auto parseObjChunk(char const* data, uint64_t begin, uint64_t end, ParseChunk* pChunk) -> void
+    {
+        std::vector<int64_t> polygon;
+        std::vector<uint8_t> relative;
+        char const* const chunkEnd = data + end;
+        uint32_t triangle_count = 0;
+        for (char const* line = data + begin; line < chunkEnd;)
+        {
+            char const* lineEnd = static_cast<char const*>(memchr(line, '\n', chunkEnd - line));
+            if (!lineEnd)
+                lineEnd = chunkEnd;
+            char const* p = skipSpaces(line, lineEnd);
+            bool valid = true;
+            if (isKeyword(p, lineEnd, "v"))
+            {
+                float position[3];
+                p += 1;
+                for (uint32_t a = 0; valid && a != 3; ++a)
+                    valid = (p = parseFloat(p, lineEnd, &position[a])) != nullptr;
+                if (valid)
+                    pChunk->positions.insert(pChunk->positions.end(), position, position + 3);
+            }
+            else if (isKeyword(p, lineEnd, "f"))
+            {
+                polygon.clear();
+                relative.clear();
+                int64_t const localVertex_count = static_cast<int64_t>(pChunk->positions.size() / 3);
+                for (p = skipSpaces(p + 1, lineEnd); valid && p != lineEnd; p = skipSpaces(p, lineEnd))
+                {
+                    // v, v/vt, v//vn or v/vt/vn, only v matters
+                    int64_t index;
+                    valid = (p = parseInteger(p, lineEnd, &index)) != nullptr && index != 0
+                            && index <= static_cast<int64_t>(std::numeric_limits<uint32_t>::max());
+                    if (valid)
+                    {
+                        polygon.push_back(index > 0 ? index - 1 : localVertex_count + index);
+                        relative.push_back(index < 0);
+                        p = skipToken(p, lineEnd);
+                    }
+                }
+                valid = valid && polygon.size() >= 3;
+                if (valid)
+                {
+                    emitPolygon(pChunk, polygon.data(), relative.data(), static_cast<uint32_t>(polygon.size()));
+                    triangle_count += static_cast<uint32_t>(polygon.size()) - 2;
+                }
+            }
+            else if (isKeyword(p, lineEnd, "usemtl"))
+            {
+                char const* nameEnd = lineEnd;
+                while (nameEnd != p && isSpace(nameEnd[-1]))
+                    --nameEnd;
+                std::string const name(skipSpaces(p + 6, nameEnd), nameEnd);
+                uint32_t const material = static_cast<uint32_t>(
+                    std::find(pChunk->materialNames.begin(), pChunk->materialNames.end(), name) - pChunk->materialNames.begin());
+                if (material == pChunk->materialNames.size())
+                    pChunk->materialNames.push_back(name);
+                if (!pChunk->materialRuns.empty() && pChunk->materialRuns.back().firstTriangle == triangle_count)
+                    pChunk->materialRuns.back().material = material;
+                else
+                    pChunk->materialRuns.push_back({ .firstTriangle = triangle_count, .material = material });
+            }
+            else if (isKeyword(p, lineEnd, "mtllib"))
+            {
+                for (p = skipSpaces(p + 6, lineEnd); p != lineEnd; p = skipSpaces(p, lineEnd))
+                {
+                    char const* nameEnd = skipToken(p, lineEnd);
+                    pChunk->materialLibraries.emplace_back(p, nameEnd);
+                    p = nameEnd;
+                }
+            }
+
+            if (!valid)
+            {
+                pChunk->errorOffset = line - data;
+                return;
+            }
+            line = lineEnd + 1;
+        }
+    }
+
+    // places the faces of every chunk after the ones of the previous chunks, resolves the relative indices with the vertex count
+    // before each chunk, splits the quads and merges the material names. Positions have to be merged already. Fails on indices out
+    // of [0, vertex_count)
+    static auto mergeFaces(ThreadPool& pool, std::vector<ParseChunk> const& chunks, std::vector<uint64_t> const& vertexBases,
+                           uint64_t vertex_count, ParsedMesh* pOut) -> bool
+    {
+        uint32_t const chunk_count = static_cast<uint32_t>(chunks.size());
+        std::vector<uint64_t> triangleBases(chunk_count + 1, 0);
+        for (uint32_t i = 0; i != chunk_count; ++i)
+            triangleBases[i + 1] = triangleBases[i] + chunks[i].indices.size() / 3;
+        if (3 * triangleBases[chunk_count] > std::numeric_limits<uint32_t>::max())
+        {
+            MXC_ERROR("ParsedMesh: %llu triangles, indices don't fit 32 bits", static_cast<unsigned long long>(triangleBases[chunk_count]));
+            return false;
+        }
+
+        // material names in order of first use, the material of the last run of a chunk carries to the next ones
+        std::vector<std::vector<uint32_t>> materialMaps(chunk_count);
+        std::vector<uint32_t> firstMaterials(chunk_count);
+        uint32_t carried = ParsedMesh::NO_MATERIAL;
+        for (uint32_t i = 0; i != chunk_count; ++i)
+        {
+            for (std::string const& name : chunks[i].materialNames)
+            {
+                auto const found = std::find(pOut->materialNames.begin(), pOut->materialNames.end(), name);
+                materialMaps[i].push_back(static_cast<uint32_t>(found - pOut->materialNames.begin()));
+                if (found == pOut->materialNames.end())
+                    pOut->materialNames.push_back(name);
+            }
+            for (std::string const& library : chunks[i].materialLibraries)
+                if (std::find(pOut->materialLibraries.begin(), pOut->materialLibraries.end(), library) == pOut->materialLibraries.end())
+                    pOut->materialLibraries.push_back(library);
+            firstMaterials[i] = carried;
+            if (!chunks[i].materialRuns.empty())
+                carried = materialMaps[i][chunks[i].materialRuns.back().material];
+        }
+
+        pOut->indices.resize(3 * triangleBases[chunk_count]);
+        pOut->materials.resize(triangleBases[chunk_count]);
+        std::atomic<bool> inRange = true;
+        pool.parallelFor(chunk_count, 1, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i != end; ++i)
+            {
+                ParseChunk const& chunk = chunks[i];
+                uint32_t* pIndices = pOut->indices.data() + 3 * triangleBases[i];
+                std::copy(chunk.indices.begin(), chunk.indices.end(), pIndices);
+                for (RelativeIndex const& index : chunk.relativeIndices)
+                {
+                    int64_t const vertex = static_cast<int64_t>(vertexBases[i]) + index.vertex;
+                    pIndices[index.position] = vertex >= 0 ? static_cast<uint32_t>(vertex) : std::numeric_limits<uint32_t>::max();
+                }
+                bool const valid = std::all_of(pIndices, pIndices + chunk.indices.size(), [&](uint32_t index) { return index < vertex_count; });
+                if (!valid)
+                    inRange.store(false, std::memory_order_relaxed);
+                else
+                {
+                    for (uint32_t quad : chunk.quads)
+                        splitQuad(pOut->positions.data(), pIndices + 3 * quad);
+                }
+
+                uint32_t* pMaterials = pOut->materials.data() + triangleBases[i];
+                uint32_t const triangle_count = static_cast<uint32_t>(chunk.indices.size() / 3);
+                uint32_t material = firstMaterials[i];
+                uint32_t triangle = 0;
+                for (MaterialRun const& run : chunk.materialRuns)
+                {
+                    std::fill(pMaterials + triangle, pMaterials + run.firstTriangle, material);
+                    triangle = run.firstTriangle;
+                    material = materialMaps[i][run.material];
+                }
+                std::fill(pMaterials + triangle, pMaterials + triangle_count, material);
+            }
+        });
+        if (!inRange)
+        {
+            MXC_ERROR("ParsedMesh: faces reference vertices out of the %llu declared", static_cast<unsigned long long>(vertex_count));
+            return false;
+        }
+        return true;
+    }
+
+    static auto reportThroughput(ThreadPool& pool, char const* filename, std::chrono::steady_clock::time_point start, ParsedMesh* pOut)
+        -> void
+    {
+        pOut->parseMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+        double const gigabytesPerSecond = pOut->byteCount / (1e6 * std::max(pOut->parseMilliseconds, 1e-3f));
+        MXC_INFO("parsed %s: %.1f MiB in %.1f ms, %.2f GB/s on %u threads, %u vertices, %u triangles", filename,
+                 pOut->byteCount / 1048576.0, pOut->parseMilliseconds, gigabytesPerSecond, pool.threadCount() + 1, pOut->vertexCount(),
+                 pOut->triangleCount());
+    }
+
+    static auto openMeshFile(char const* filename, MappedFile* pFile, ParsedMesh* pOut) -> bool
+    {
+        *pOut = {};
+        // empty files can't be mapped, they are valid empty meshes for OBJ though
+        std::error_code error;
+        uintmax_t const size = std::filesystem::file_size(filename, error);
+        if (error)
+        {
+            MXC_ERROR("couldn't open %s: %s", filename, error.message().c_str());
+            return false;
+        }
+        if (size == 0)
+            return true;
+        if (!pFile->open(filename, MappingMode::READ))
+            return false;
+        pOut->byteCount = pFile->size();
+        return true;
+    }
+
+    auto parseObj(ThreadPool& pool, char const* filename, ParsedMesh* pOut) -> bool
+    {
+        auto const start = std::chrono::steady_clock::now();
+        MappedFile file;
+        if (!openMeshFile(filename, &file, pOut))
+            return false;
+        if (!file.isOpen())
+            return true;
+
+        char const* data = reinterpret_cast<char const*>(file.data());
+        std::vector<uint64_t> const starts = splitLines(data, file.size(), chunkSize(pool, file.size()));
+        uint32_t const chunk_count = static_cast<uint32_t>(starts.size() - 1);
+        std::vector<ParseChunk> chunks(chunk_count);
+        pool.parallelFor(chunk_count, 1, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i != end; ++i)
+                parseObjChunk(data, starts[i], starts[i + 1], &chunks[i]);
+        });
+        for (ParseChunk const& chunk : chunks)
+        {
+            if (chunk.errorOffset != NO_ERROR)
+            {
+                MXC_ERROR("%s: can't parse the line at byte %llu", filename, static_cast<unsigned long long>(chunk.errorOffset));
+                return false;
+            }
+        }
+
+        std::vector<uint64_t> vertexBases(chunk_count + 1, 0);
+        for (uint32_t i = 0; i != chunk_count; ++i)
+            vertexBases[i + 1] = vertexBases[i] + chunks[i].positions.size() / 3;
+        uint64_t const vertex_count = vertexBases[chunk_count];
+        if (vertex_count > std::numeric_limits<uint32_t>::max())
+        {
+            MXC_ERROR("%s: %llu vertices, indices don't fit 32 bits", filename, static_cast<unsigned long long>(vertex_count));
+            return false;
+        }
+        pOut->positions.resize(3 * vertex_count);
+        pool.parallelFor(chunk_count, 1, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i != end; ++i)
+                std::copy(chunks[i].positions.begin(), chunks[i].positions.end(), pOut->positions.begin() + 3 * vertexBases[i]);
+        });
+        if (!mergeFaces(pool, chunks, vertexBases, vertex_count, pOut))
+            return false;
+
+        reportThroughput(pool, filename, start, pOut);
+        return true;
+    }
+
+    enum class PlyType : uint8_t { INT8, UINT8, INT16, UINT16, INT32, UINT32, FLOAT32, FLOAT64, NONE };
+
+    struct PlyProperty
+    {
+        std::string name;
+        PlyType type;
+        PlyType countType; // NONE for scalar properties
+    };
+
+    struct PlyElement
+    {
+        std::string name;
+        uint64_t count;
+        std::vector<PlyProperty> properties;
+    };
+
+    static auto plyTypeFromName(std::string const& name) -> PlyType
+    {
+        static struct { char const* name; PlyType type; } constexpr names[] {
+            { "char", PlyType::INT8 }, { "int8", PlyType::INT8 }, { "uchar", PlyType::UINT8 }, { "uint8", PlyType::UINT8 },
+            { "short", PlyType::INT16 }, { "int16", PlyType::INT16 }, { "ushort", PlyType::UINT16 }, { "uint16", PlyType::UINT16 },
+            { "int", PlyType::INT32 }, { "int32", PlyType::INT32 }, { "uint", PlyType::UINT32 }, { "uint32", PlyType::UINT32 },
+            { "float", PlyType::FLOAT32 }, { "float32", PlyType::FLOAT32 }, { "double", PlyType::FLOAT64 }, { "float64", PlyType::FLOAT64 }
+        };
+        for (auto const& entry : names)
+            if (name == entry.name)
+                return entry.type;
+        return PlyType::NONE;
+    }
+
+    static auto plyTypeSize(PlyType type) -> uint32_t
+    {
+        switch (type)
+        {
+            case PlyType::INT8: case PlyType::UINT8:   return 1;
+            case PlyType::INT16: case PlyType::UINT16: return 2;
+            case PlyType::INT32: case PlyType::UINT32: case PlyType::FLOAT32: return 4;
+            case PlyType::FLOAT64:                     return 8;
+            default:                                   return 0;
+        }
+    }
+
+    template<typename T>
+    static auto loadPlyValue(uint8_t const* p, bool swap) -> T
+    {
+        uint8_t bytes[sizeof(T)];
+        memcpy(bytes, p, sizeof(T));
+        if (swap)
+            std::reverse(bytes, bytes + sizeof(T));
+        return std::bit_cast<T>(bytes);
+    }
+
+    static auto readPlyValue(uint8_t const* p, PlyType type, bool swap) -> double
+    {
+        switch (type)
+        {
+            case PlyType::INT8:    return loadPlyValue<int8_t>(p, swap);
+            case PlyType::UINT8:   return loadPlyValue<uint8_t>(p, swap);
+            case PlyType::INT16:   return loadPlyValue<int16_t>(p, swap);
+            case PlyType::UINT16:  return loadPlyValue<uint16_t>(p, swap);
+            case PlyType::INT32:   return loadPlyValue<int32_t>(p, swap);
+            case PlyType::UINT32:  return loadPlyValue<uint32_t>(p, swap);
+            case PlyType::FLOAT32: return loadPlyValue<float>(p, swap);
+            case PlyType::FLOAT64: return loadPlyValue<double>(p, swap);
+            default:               return 0.0;
+        }
+    }
+
+    // the element of a face with its vertex index list, of a vertex with x y z
+    struct PlyLayout
+    {
+        uint32_t vertexElement;
+        uint32_t faceElement;
+        uint32_t positionProperties[3];
+        uint32_t indexProperty;
+    };
+
+    static auto findPlyLayout(std::vector<PlyElement> const& elements, PlyLayout* pOut) -> bool
+    {
+        *pOut = { .vertexElement = ~0u, .faceElement = ~0u, .positionProperties = { ~0u, ~0u, ~0u }, .indexProperty = ~0u };
+        for (uint32_t e = 0; e != elements.size(); ++e)
+        {
+            std::vector<PlyProperty> const& properties = elements[e].properties;
+            if (elements[e].name == "vertex")
+            {
+                pOut->vertexElement = e;
+                for (uint32_t p = 0; p != properties.size(); ++p)
+                    for (uint32_t a = 0; a != 3; ++a)
+                        if (properties[p].name == std::string(1, static_cast<char>('x' + a)) && properties[p].countType == PlyType::NONE)
+                            pOut->positionProperties[a] = p;
+            }
+            else if (elements[e].name == "face")
+            {
+                pOut->faceElement = e;
+                for (uint32_t p = 0; p != properties.size(); ++p)
+                    if ((properties[p].name == "vertex_indices" || properties[p].name == "vertex_index")
+                        && properties[p].countType != PlyType::NONE)
+                        pOut->indexProperty = p;
+            }
+        }
+        return pOut->vertexElement != ~0u && pOut->positionProperties[0] != ~0u && pOut->positionProperties[1] != ~0u
+               && pOut->positionProperties[2] != ~0u && (pOut->faceElement == ~0u || pOut->indexProperty != ~0u);
+    }
+
+    static auto parsePlyBinary(ThreadPool& pool, uint8_t const* p, uint8_t const* end, std::vector<PlyElement> const& elements,
+                               PlyLayout const& layout, bool swap, ParsedMesh* pOut) -> bool
+    {
+        PlyElement const& vertexElement = elements[layout.vertexElement];
+        uint32_t vertexStride = 0, positionOffsets[3] {};
+        for (uint32_t i = 0; i != vertexElement.properties.size(); ++i)
+        {
+            if (vertexElement.properties[i].countType != PlyType::NONE)
+            {
+                MXC_ERROR("PLY: lists in the vertex element aren't supported");
+                return false;
+            }
+            for (uint32_t a = 0; a != 3; ++a)
+                if (i == layout.positionProperties[a])
+                    positionOffsets[a] = vertexStride;
+            vertexStride += plyTypeSize(vertexElement.properties[i].type);
+        }
+
+        // lists make records variable in size: a sequential pass only reads the list counts, to find where the vertices start,
+        // where blocks of faces start and where their triangles go. Then vertices, and faces, are read in parallel from there
+        uint8_t const* vertices = nullptr;
+        std::vector<uint8_t const*> blockStarts;
+        std::vector<uint64_t> triangleBases;
+        uint64_t triangle_count = 0;
+        for (uint32_t e = 0; e != elements.size(); ++e)
+        {
+            PlyElement const& element = elements[e];
+            if (e == layout.vertexElement)
+                vertices = p;
+            uint64_t stride = 0;
+            bool fixed = true;
+            for (PlyProperty const& property : element.properties)
+            {
+                fixed = fixed && property.countType == PlyType::NONE;
+                stride += plyTypeSize(property.type);
+            }
+            if (fixed && e != layout.faceElement)
+            {
+                if (stride != 0 && static_cast<uint64_t>(end - p) / stride < element.count)
+                    return false;
+                p += element.count * stride;
+                continue;
+            }
+
+            for (uint64_t r = 0; r != element.count; ++r)
+            {
+                if (e == layout.faceElement && r % PLY_BLOCK_SIZE == 0)
+                {
+                    blockStarts.push_back(p);
+                    triangleBases.push_back(triangle_count);
+                }
+                for (uint32_t i = 0; i != element.properties.size(); ++i)
+                {
+                    PlyProperty const& property = element.properties[i];
+                    uint64_t size = plyTypeSize(property.type);
+                    if (property.countType != PlyType::NONE)
+                    {
+                        if (static_cast<uint64_t>(end - p) < plyTypeSize(property.countType))
+                            return false;
+                        uint64_t const count = static_cast<uint64_t>(readPlyValue(p, property.countType, swap));
+                        if (e == layout.faceElement && i == layout.indexProperty && count >= 3)
+                            triangle_count += count - 2;
+                        size *= count;
+                        p += plyTypeSize(property.countType);
+                    }
+                    if (static_cast<uint64_t>(end - p) < size)
+                        return false;
+                    p += size;
+                }
+            }
+        }
+        triangleBases.push_back(triangle_count);
+        if (3 * triangle_count > std::numeric_limits<uint32_t>::max())
+        {
+            MXC_ERROR("PLY: %llu triangles, indices don't fit 32 bits", static_cast<unsigned long long>(triangle_count));
+            return false;
+        }
+
+        uint64_t const vertex_count = vertexElement.count;
+        pOut->positions.resize(3 * vertex_count);
+        uint32_t const vertexBlock_count = static_cast<uint32_t>((vertex_count + PLY_BLOCK_SIZE - 1) / PLY_BLOCK_SIZE);
+        pool.parallelFor(vertexBlock_count, 1, [&](uint32_t begin, uint32_t blockEnd) {
+            uint64_t const last = std::min<uint64_t>(vertex_count, static_cast<uint64_t>(blockEnd) * PLY_BLOCK_SIZE);
+            for (uint64_t v = static_cast<uint64_t>(begin) * PLY_BLOCK_SIZE; v != last; ++v)
+            {
+                for (uint32_t a = 0; a != 3; ++a)
+                {
+                    PlyType const type = vertexElement.properties[layout.positionProperties[a]].type;
+                    pOut->positions[3 * v + a] = static_cast<float>(readPlyValue(vertices + v * vertexStride + positionOffsets[a], type, swap));
+                }
+            }
+        });
+
+        pOut->indices.resize(3 * triangle_count);
+        pOut->materials.assign(triangle_count, ParsedMesh::NO_MATERIAL);
+        if (layout.faceElement == ~0u)
+            return true;
+        PlyElement const& faceElement = elements[layout.faceElement];
+        PlyProperty const& indexProperty = faceElement.properties[layout.indexProperty];
+        uint32_t const indexSize = plyTypeSize(indexProperty.type);
+        std::atomic<bool> inRange = true;
+        pool.parallelFor(static_cast<uint32_t>(blockStarts.size()), 1, [&](uint32_t begin, uint32_t blockEnd) {
+            for (uint32_t b = begin; b != blockEnd; ++b)
+            {
+                uint8_t const* record = blockStarts[b];
+                uint32_t* pIndices = pOut->indices.data() + 3 * triangleBases[b];
+                uint64_t const last = std::min<uint64_t>(faceElement.count, static_cast<uint64_t>(b + 1) * PLY_BLOCK_SIZE);
+                bool valid = true;
+                for (uint64_t f = static_cast<uint64_t>(b) * PLY_BLOCK_SIZE; f != last; ++f)
+                {
+                    for (uint32_t i = 0; i != faceElement.properties.size(); ++i)
+                    {
+                        PlyProperty const& property = faceElement.properties[i];
+                        uint64_t count = 1;
+                        if (property.countType != PlyType::NONE)
+                        {
+                            count = static_cast<uint64_t>(readPlyValue(record, property.countType, swap));
+                            record += plyTypeSize(property.countType);
+                        }
+                        if (i == layout.indexProperty && count >= 3)
+                        {
+                            uint32_t* pPolygon = pIndices;
+                            double const first = readPlyValue(record, indexProperty.type, swap);
+                            for (uint64_t k = 1; k + 1 < count; ++k)
+                            {
+                                double const corners[3] {
+                                    first, readPlyValue(record + k * indexSize, indexProperty.type, swap),
+                                    readPlyValue(record + (k + 1) * indexSize, indexProperty.type, swap)
+                                };
+                                for (double corner : corners)
+                                {
+                                    valid = valid && corner >= 0.0 && corner < static_cast<double>(vertex_count);
+                                    *pIndices++ = valid ? static_cast<uint32_t>(corner) : 0;
+                                }
+                            }
+                            if (count == 4)
+                                splitQuad(pOut->positions.data(), pPolygon);
+                        }
+                        record += count * plyTypeSize(property.type);
+                    }
+                }
+                if (!valid)
+                    inRange.store(false, std::memory_order_relaxed);
+            }
+        });
+        if (!inRange)
+        {
+            MXC_ERROR("PLY: faces reference vertices out of the %llu declared", static_cast<unsigned long long>(vertex_count));
+            return false;
+        }
+        return true;
+    }
+
+    // element records are lines, which chunks count first such that each knows the records it starts with
+    static auto parsePlyAscii(ThreadPool& pool, char const* data, uint64_t begin, uint64_t size, std::vector<PlyElement> const& elements,
+                              PlyLayout const& layout, ParsedMesh* pOut) -> bool
+    {
+        std::vector<uint64_t> starts = splitLines(data + begin, size - begin, chunkSize(pool, size - begin));
+        for (uint64_t& start : starts)
+            start += begin;
+        uint32_t const chunk_count = static_cast<uint32_t>(starts.size() - 1);
+        std::vector<uint64_t> firstLines(chunk_count + 1, 0);
+        pool.parallelFor(chunk_count, 1, [&](uint32_t chunkBegin, uint32_t chunkEnd) {
+            for (uint32_t i = chunkBegin; i != chunkEnd; ++i)
+                firstLines[i + 1] = std::count(data + starts[i], data + starts[i + 1], '\n');
+        });
+        for (uint32_t i = 0; i != chunk_count; ++i)
+            firstLines[i + 1] += firstLines[i];
+
+        std::vector<uint64_t> elementFirstLines(elements.size() + 1, 0);
+        for (uint32_t e = 0; e != elements.size(); ++e)
+            elementFirstLines[e + 1] = elementFirstLines[e] + elements[e].count;
+        uint64_t const vertex_count = elements[layout.vertexElement].count;
+        pOut->positions.resize(3 * vertex_count);
+
+        std::vector<ParseChunk> chunks(chunk_count);
+        pool.parallelFor(chunk_count, 1, [&](uint32_t chunkBegin, uint32_t chunkEnd) {
+            std::vector<int64_t> polygon;
+            std::vector<uint8_t> relative;
+            for (uint32_t i = chunkBegin; i != chunkEnd; ++i)
+            {
+                ParseChunk& chunk = chunks[i];
+                char const* const end = data + starts[i + 1];
+                uint64_t lineIndex = firstLines[i];
+                uint32_t e = static_cast<uint32_t>(std::upper_bound(elementFirstLines.begin(), elementFirstLines.end(), lineIndex)
+                                                   - elementFirstLines.begin()) - 1;
+                for (char const* line = data + starts[i]; line < end && e < elements.size(); ++lineIndex)
+                {
+                    char const* lineEnd = static_cast<char const*>(memchr(line, '\n', end - line));
+                    if (!lineEnd)
+                        lineEnd = end;
+                    while (e < elements.size() && lineIndex >= elementFirstLines[e + 1])
+                        ++e;
+                    if (e == elements.size())
+                        break;
+
+                    bool valid = true;
+                    char const* p = line;
+                    polygon.clear();
+                    for (uint32_t j = 0; valid && j != elements[e].properties.size(); ++j)
+                    {
+                        PlyProperty const& property = elements[e].properties[j];
+                        int64_t count = 1;
+                        if (property.countType != PlyType::NONE)
+                            valid = (p = parseInteger(p, lineEnd, &count)) != nullptr && count >= 0;
+                        bool const indices = e == layout.faceElement && j == layout.indexProperty;
+                        for (int64_t k = 0; valid && k != count; ++k)
+                        {
+                            float value;
+                            int64_t index;
+                            if (indices)
+                            {
+                                valid = (p = parseInteger(p, lineEnd, &index)) != nullptr && index >= 0;
+                                polygon.push_back(index);
+                            }
+                            else if ((valid = (p = parseFloat(p, lineEnd, &value)) != nullptr) && e == layout.vertexElement)
+                            {
+                                for (uint32_t a = 0; a != 3; ++a)
+                                    if (j == layout.positionProperties[a])
+                                        pOut->positions[3 * (lineIndex - elementFirstLines[e]) + a] = value;
+                            }
+                        }
+                    }
+                    if (valid && polygon.size() >= 3)
+                    {
+                        relative.assign(polygon.size(), 0);
+                        emitPolygon(&chunk, polygon.data(), relative.data(), static_cast<uint32_t>(polygon.size()));
+                    }
+                    if (!valid)
+                    {
+                        chunk.errorOffset = line - data;
+                        break;
+                    }
+                    line = lineEnd + 1;
+                }
+            }
+        });
+        for (ParseChunk const& chunk : chunks)
+        {
+            if (chunk.errorOffset != NO_ERROR)
+            {
+                MXC_ERROR("PLY: can't parse the line at byte %llu", static_cast<unsigned long long>(chunk.errorOffset));
+                return false;
+            }
+        }
+        if (firstLines[chunk_count] + (data[size - 1] != '\n') < elementFirstLines[elements.size()])
+        {
+            MXC_ERROR("PLY: %llu element lines expected", static_cast<unsigned long long>(elementFirstLines[elements.size()]));
+            return false;
+        }
+        return mergeFaces(pool, chunks, std::vector<uint64_t>(chunk_count + 1, 0), vertex_count, pOut);
+    }
+
+    auto parsePly(ThreadPool& pool, char const* filename, ParsedMesh* pOut) -> bool
+    {
+        auto const start = std::chrono::steady_clock::now();
+        MappedFile file;
+        if (!openMeshFile(filename, &file, pOut))
+            return false;
+        char const* data = reinterpret_cast<char const*>(file.data());
+        uint64_t const size = file.size();
+        if (size < 4 || memcmp(data, "ply", 3) != 0 || (data[3] != '\n' && data[3] != '\r'))
+        {
+            MXC_ERROR("%s isn't a PLY file", filename);
+            return false;
+        }
+
+        // header, one keyword per line up to end_header
+        enum class Format { ASCII, BINARY_LITTLE_ENDIAN, BINARY_BIG_ENDIAN } format = Format::ASCII;
+        std::vector<PlyElement> elements;
+        uint64_t body = 0;
+        bool valid = true;
+        for (char const* line = data; valid && body == 0 && line < data + size;)
+        {
+            char const* lineEnd = static_cast<char const*>(memchr(line, '\n', data + size - line));
+            if (!lineEnd)
+                break;
+            std::vector<std::string> words;
+            for (char const* p = skipSpaces(line, lineEnd); p != lineEnd; p = skipSpaces(p, lineEnd))
+            {
+                char const* wordEnd = skipToken(p, lineEnd);
+                words.emplace_back(p, wordEnd);
+                p = wordEnd;
+            }
+            line = lineEnd + 1;
+            if (words.empty() || words[0] == "ply" || words[0] == "comment" || words[0] == "obj_info")
+                continue;
+
+            if (words[0] == "format" && words.size() >= 2)
+            {
+                if (words[1] == "ascii")                     format = Format::ASCII;
+                else if (words[1] == "binary_little_endian") format = Format::BINARY_LITTLE_ENDIAN;
+                else if (words[1] == "binary_big_endian")    format = Format::BINARY_BIG_ENDIAN;
+                else valid = false;
+            }
+            else if (words[0] == "element" && words.size() == 3)
+                elements.push_back({ .name = words[1], .count = strtoull(words[2].c_str(), nullptr, 10), .properties = {} });
+            else if (words[0] == "property" && words.size() == 3 && !elements.empty())
+                elements.back().properties.push_back({ .name = words[2], .type = plyTypeFromName(words[1]), .countType = PlyType::NONE });
+            else if (words[0] == "property" && words.size() == 5 && words[1] == "list" && !elements.empty())
+                elements.back().properties.push_back({ .name = words[4], .type = plyTypeFromName(words[3]),
+                                                       .countType = plyTypeFromName(words[2]) });
+            else if (words[0] == "end_header")
+                body = lineEnd + 1 - data;
+            else
+                valid = false;
+        }
+        for (PlyElement const& element : elements)
+            for (PlyProperty const& property : element.properties)
+                valid = valid && property.type != PlyType::NONE;
+
+        PlyLayout layout;
+        if (!valid || body == 0 || !findPlyLayout(elements, &layout))
+        {
+            MXC_ERROR("%s: unsupported PLY header, a vertex element with x y z and a face element with vertex_indices are expected", filename);
+            return false;
+        }
+        if (elements[layout.vertexElement].count > std::numeric_limits<uint32_t>::max())
+        {
+            MXC_ERROR("%s: %llu vertices, indices don't fit 32 bits", filename,
+                      static_cast<unsigned long long>(elements[layout.vertexElement].count));
+            return false;
+        }
+
+        if (format == Format::ASCII)
+            valid = body < size && parsePlyAscii(pool, data, body, size, elements, layout, pOut);
+        else
+        {
+            bool const swap = (format == Format::BINARY_BIG_ENDIAN) != (std::endian::native == std::endian::big);
+            valid = parsePlyBinary(pool, file.data() + body, file.data() + size, elements, layout, swap, pOut);
+        }
+        if (!valid)
+        {
+            MXC_ERROR("%s: PLY body truncated or invalid", filename);
+            return false;
+        }
+
+        reportThroughput(pool, filename, start, pOut);
+        return true;
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef MXC_MESH_PARSER_H
+#define MXC_MESH_PARSER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace mxc
+{
+	class ThreadPool;
+
+	// triangle soup parsed from a mesh file, as the structure of arrays Scene::addTriangleMesh takes
+	struct ParsedMesh
+	{
+		std::vector<float> positions;              // packed float3
+		std::vector<uint32_t> indices;             // packed uint3, polygons are fanned
+		std::vector<uint32_t> materials;           // per triangle, index in materialNames, NO_MATERIAL before the first usemtl
+		std::vector<std::string> materialNames;    // usemtl names, in order of first use
+		std::vector<std::string> materialLibraries; // mtllib file names, relative to the mesh file
+		uint64_t byteCount;                        // of the file
+		float parseMilliseconds;
+
+		static uint32_t constexpr NO_MATERIAL = ~0u;
+
+		auto vertexCount() const -> uint32_t { return static_cast<uint32_t>(positions.size() / 3); }
+		auto triangleCount() const -> uint32_t { return static_cast<uint32_t>(materials.size()); }
+	};
+
+	// Parsers of large scanned meshes. The file is memory mapped and split in chunks of a few MiB at line boundaries, each parsed on
+	// a worker into its own arrays with std::from_chars, then prefix sums of the per chunk counts give where every chunk lands in
+	// the final arrays, which the workers fill in parallel again. Only positions and faces are read: texture coordinates and normals
+	// are skipped, as they aren't used by the renderer
+
+	// v, f (v, v/vt, v//vn, v/vt/vn, negative indices), usemtl and mtllib lines. Other lines are ignored
+	auto parseObj(ThreadPool& pool, char const* filename, ParsedMesh* pOut) -> bool;
+
+	// ascii, binary_little_endian and binary_big_endian. Reads x y z of the vertex element and the vertex_indices (or vertex_index)
+	// list of the face element, other properties and elements are skipped
+	auto parsePly(ThreadPool& pool, char const* filename, ParsedMesh* pOut) -> bool;
+}
+
+#endif // MXC_MESH_PARSER_H
@@ -0,0 +1,88 @@
+#include "Scene.h"
+#include "MeshParser.h"
+#include "logging.h"
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader.h>
+
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace mxc
+{
+    static auto materialTypeFromIllum(int illum) -> MaterialType
+    {
+        switch (illum)
+        {
+            case 3: case 5: case 8:         return MaterialType::SPECULAR;
+            case 4: case 6: case 7: case 9: return MaterialType::REFRACTIVE;
+            default:                        return MaterialType::DIFFUSE;
+        }
+    }
+
+    // geometry from the parallel parser, mtl libraries, small next to it, from tinyobjloader
+    auto readObj(ThreadPool& pool, char const* filename, MeshAsset* pOut) -> bool
+    {
+        pOut->filename = filename;
+        pOut->materials.clear();
+        pOut->dependencies.clear();
+        ParsedMesh& mesh = pOut->mesh;
+        if (!parseObj(pool, filename, &mesh))
+            return false;
+        pOut->dependencies.emplace_back(filename);
+
+        std::vector<tinyobj::material_t> materials;
+        std::map<std::string, int> materialIds;
+        for (std::string const& library : mesh.materialLibraries)
+        {
+            std::string const libraryPath = (std::filesystem::path(filename).parent_path() / library).string();
+            std::ifstream stream(libraryPath);
+            if (!stream)
+            {
+                MXC_WARN("%s: material library %s not found", filename, libraryPath.c_str());
+                continue;
+            }
+            pOut->dependencies.push_back(libraryPath);
+            std::string warning, error;
+            tinyobj::LoadMtl(&materialIds, &materials, &stream, &warning, &error);
+            if (!warning.empty())
+                MXC_WARN("%s: %s", libraryPath.c_str(), warning.c_str());
+        }
+
+        pOut->materials.resize(materials.size());
+        for (size_t i = 0; i != materials.size(); ++i)
+        {
+            tinyobj::material_t const& mtl = materials[i];
+            pOut->materials[i] = {
+                .albedo = { mtl.diffuse[0], mtl.diffuse[1], mtl.diffuse[2] },
+                .emission = { mtl.emission[0], mtl.emission[1], mtl.emission[2] },
+                .type = materialTypeFromIllum(mtl.illum)
+            };
+        }
+
+        // usemtl names to materials of the libraries, faces naming an unknown material use the default one
+        std::vector<uint32_t> usedMaterials(mesh.materialNames.size(), ParsedMesh::NO_MATERIAL);
+        for (size_t i = 0; i != mesh.materialNames.size(); ++i)
+        {
+            auto const found = materialIds.find(mesh.materialNames[i]);
+            if (found != materialIds.end())
+                usedMaterials[i] = static_cast<uint32_t>(found->second);
+            else
+                MXC_WARN("%s: material %s not found in the mtl libraries", filename, mesh.materialNames[i].c_str());
+        }
+        for (uint32_t& material : mesh.materials)
+            if (material != ParsedMesh::NO_MATERIAL)
+                material = usedMaterials[material];
+        return true;
+    }
+
+    auto loadObj(ThreadPool& pool, char const* filename, uint32_t defaultMaterialIndex, Scene* pScene, uint32_t* pOutMeshIndex,
+                 std::vector<std::string>* pOutDependencies) -> bool
+    {
+        MeshAsset asset;
+        return readObj(pool, filename, &asset) && addMeshAsset(asset, defaultMaterialIndex, pScene, pOutMeshIndex, pOutDependencies);
+    }
+}
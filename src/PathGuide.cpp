@@ -0,0 +1,492 @@
+#include "PathGuide.h"
+#include "CommandBuffer.h"
+#include "MappedFile.h"
+#include "logging.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <utility>
+
+namespace mxc
+{
+    static uint32_t constexpr MAX_SPATIAL_DEPTH = 48;
+
+    // (re)creates pBuffer at the size of the data when it changed, then a blocking copy through a staging buffer
+    static auto uploadBuffer(VulkanContext* ctx, void const* data, VkDeviceSize size, Buffer* pBuffer) -> bool
+    {
+        if (pBuffer->size != size)
+        {
+            if (pBuffer->handle != VK_NULL_HANDLE)
+                ctx->device.destroyBuffer(pBuffer);
+            *pBuffer = Buffer(size, BufferType_v::STORAGE);
+            if (!ctx->device.createBuffer(pBuffer))
+                return false;
+        }
+        Buffer staging{size, BufferType_v::STAGING};
+        ctx->device.createBuffer(&staging, BufferMemoryOptions::SYSTEM_MEMORY);
+        ctx->device.copyToBuffer(data, size, &staging);
+        bool const copied = ctx->device.copyBuffer(ctx, &staging, pBuffer);
+        ctx->device.destroyBuffer(&staging);
+        return copied;
+    }
+
+    // quadtree of a single node, which records go to until the first refinement
+    static auto emptyQuadtree() -> std::vector<GuideQuadNode>
+    {
+        return std::vector<GuideQuadNode>(1, GuideQuadNode{});
+    }
+
+    // Nodes of sampling whose quadrants hold more than threshold of the energy of the tree keep them subdivided, or subdivide
+    // them one more level; the others are merged. Energies start over
+    static auto restructureQuadtree(std::vector<GuideQuadNode> const& sampling, uint32_t node, float total, float threshold,
+                                    uint32_t depth, std::vector<GuideQuadNode>* pOut) -> uint32_t
+    {
+        uint32_t const index = static_cast<uint32_t>(pOut->size());
+        pOut->push_back({});
+        if (depth == GUIDE_MAX_DIRECTIONAL_DEPTH)
+            return index;
+        for (uint32_t i = 0; i != 4; ++i)
+        {
+            if (sampling[node].energy[i] <= threshold * total)
+                continue;
+            uint32_t child = static_cast<uint32_t>(pOut->size());
+            if (sampling[node].child[i] != 0)
+                child = restructureQuadtree(sampling, sampling[node].child[i], total, threshold, depth + 1, pOut);
+            else
+                pOut->push_back({});
+            (*pOut)[index].child[i] = child;
+        }
+        return index;
+    }
+
+    auto PathGuide::create(VulkanContext* ctx) -> bool
+    {
+        m_enabled = false;
+        // strides of the records and the quadtree nodes are above 16 bytes, the shader sees none
+        m_spatialNodes = Buffer(sizeof(GuideSpatialNode), BufferType_v::STORAGE);
+        m_quadNodes = Buffer(4 * sizeof(float), BufferType_v::STORAGE);
+        m_records = Buffer(4 * sizeof(float), BufferType_v::STORAGE);
+        m_recordCount = Buffer(2 * sizeof(uint32_t), BufferType_v::STORAGE);
+        if (!ctx->device.createBuffer(&m_spatialNodes) || !ctx->device.createBuffer(&m_quadNodes) || !ctx->device.createBuffer(&m_records)
+            || !ctx->device.createBuffer(&m_recordCount))
+        {
+            MXC_ERROR("PathGuide: couldn't create the buffers");
+            return false;
+        }
+        return true;
+    }
+
+    auto PathGuide::create(VulkanContext* ctx, PathGuideConfig const& config) -> bool
+    {
+        if (!create(ctx))
+            return false;
+
+        m_config = config;
+        m_config.recordCapacity = std::max(1u, config.recordCapacity);
+        m_nodes.clear();
+        m_leaves.clear();
+        m_iteration = 0;
+        m_iterationPass = 0;
+        m_enabled = m_config.trainingIterations != 0;
+        if (!m_enabled)
+            return true;
+
+        VkDeviceSize const recordBytes = static_cast<VkDeviceSize>(m_config.recordCapacity) * sizeof(GuideRecord);
+        ctx->device.destroyBuffer(&m_records);
+        m_records = Buffer(recordBytes, BufferType_v::STORAGE);
+        m_readback = Buffer(recordBytes, BufferType_v::READBACK);
+        if (!ctx->device.createBuffer(&m_records) || !ctx->device.createBuffer(&m_readback))
+        {
+            MXC_ERROR("PathGuide: couldn't create the buffers of %u records", m_config.recordCapacity);
+            return false;
+        }
+        if (!resetRecords(ctx, m_config.recordCapacity))
+            return false;
+
+        MXC_INFO("path guide: %u training iterations, %u records per pass (%.1f MiB)", m_config.trainingIterations,
+                 m_config.recordCapacity, recordBytes / 1048576.f);
+        return true;
+    }
+
+    auto PathGuide::destroy(VulkanContext* ctx) -> void
+    {
+        for (Buffer* pBuffer : { &m_spatialNodes, &m_quadNodes, &m_records, &m_recordCount, &m_readback })
+            if (pBuffer->handle != VK_NULL_HANDLE)
+                ctx->device.destroyBuffer(pBuffer);
+        m_spatialNodes = Buffer(0, BufferType_v::STORAGE);
+        m_quadNodes = Buffer(0, BufferType_v::STORAGE);
+        m_records = Buffer(0, BufferType_v::STORAGE);
+        m_recordCount = Buffer(0, BufferType_v::STORAGE);
+        m_readback = Buffer(0, BufferType_v::READBACK);
+        m_nodes.clear();
+        m_leaves.clear();
+        m_enabled = false;
+    }
+
+    auto PathGuide::update(VulkanContext* ctx) -> bool
+    {
+        if (!isEnabled() || m_iteration == m_config.trainingIterations)
+            return true;
+
+        // the counter keeps going past the capacity, the records past it were dropped
+        uint32_t record_count = 0;
+        {
+            Buffer countReadback{m_recordCount.size, BufferType_v::READBACK};
+            if (!ctx->device.createBuffer(&countReadback))
+                return false;
+            bool const copied = ctx->device.copyBuffer(ctx, &m_recordCount, &countReadback);
+            memcpy(&record_count, countReadback.mapped, sizeof(record_count));
+            ctx->device.destroyBuffer(&countReadback);
+            if (!copied)
+                return false;
+        }
+        record_count = std::min(record_count, m_config.recordCapacity);
+
+        if (record_count != 0)
+        {
+            VkBufferCopy const region { .srcOffset = 0, .dstOffset = 0, .size = record_count * sizeof(GuideRecord) };
+            CommandBuffer cmdBuf;
+            cmdBuf.allocate(ctx, CommandType::COMPUTE);
+            cmdBuf.begin();
+            vkCmdCopyBuffer(cmdBuf.handle, m_records.handle, m_readback.handle, 1, &region);
+            ctx->device.insertMemoryBarrier(cmdBuf.handle, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT,
+                                            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT);
+            cmdBuf.end();
+            bool const copied = ctx->device.flushCommandBuffer(&cmdBuf, CommandType::COMPUTE);
+            cmdBuf.free(ctx);
+            if (!copied)
+                return false;
+        }
+        GuideRecord const* records = static_cast<GuideRecord const*>(m_readback.mapped);
+
+        // the root covers the points of the first pass
+        if (m_nodes.empty() && record_count != 0)
+        {
+            Aabb bounds { { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX } };
+            for (uint32_t r = 0; r != record_count; ++r)
+                for (uint32_t a = 0; a != 3; ++a)
+                    if (std::isfinite(records[r].p[a]))
+                    {
+                        bounds.min[a] = std::min(bounds.min[a], records[r].p[a]);
+                        bounds.max[a] = std::max(bounds.max[a], records[r].p[a]);
+                    }
+            for (uint32_t a = 0; a != 3; ++a)
+                if (bounds.min[a] > bounds.max[a])
+                    bounds.min[a] = bounds.max[a] = 0.f;
+            m_nodes.push_back({ .bounds = bounds, .child = 0, .axis = GUIDE_LEAF, .depth = 0 });
+            m_leaves.push_back({ .sampling = emptyQuadtree(), .building = emptyQuadtree(), .recordCount = 0 });
+        }
+        // iterations start with the first pass which recorded anything
+        if (m_nodes.empty())
+            return resetRecords(ctx, m_config.recordCapacity);
+        for (uint32_t r = 0; r != record_count; ++r)
+            splat(records[r]);
+
+        ++m_iterationPass;
+        if (m_iterationPass == 1u << std::min(m_iteration, 31u))
+        {
+            refine();
+            if (!upload(ctx))
+                return false;
+            MXC_DEBUG("path guide: iteration %u over after %u passes, %u spatial leaves", m_iteration, m_iterationPass,
+                      spatialLeafCount());
+            ++m_iteration;
+            m_iterationPass = 0;
+            if (m_iteration == m_config.trainingIterations)
+                MXC_INFO("path guide: trained, %u spatial leaves", spatialLeafCount());
+        }
+        return resetRecords(ctx, m_iteration == m_config.trainingIterations ? 0 : m_config.recordCapacity);
+    }
+
+    auto PathGuide::splat(GuideRecord const& record) -> void
+    {
+        if (!(record.value >= 0.f) || !std::isfinite(record.value))
+            return;
+
+        uint32_t node = 0;
+        while (m_nodes[node].axis != GUIDE_LEAF)
+            node = m_nodes[node].child + (record.p[m_nodes[node].axis] < m_nodes[m_nodes[node].child].bounds.max[m_nodes[node].axis] ? 0 : 1);
+        Leaf& leaf = m_leaves[m_nodes[node].child];
+        ++leaf.recordCount;
+
+        // to the quadrant at each level down to a leaf of the quadtree
+        float u = std::clamp(record.uv[0], 0.f, 1.f), v = std::clamp(record.uv[1], 0.f, 1.f);
+        uint32_t quad = 0;
+        while (true)
+        {
+            uint32_t const x = u >= 0.5f ? 1 : 0, y = v >= 0.5f ? 1 : 0;
+            uint32_t const i = x | y << 1;
+            leaf.building[quad].energy[i] += record.value;
+            if (leaf.building[quad].child[i] == 0)
+                break;
+            quad = leaf.building[quad].child[i];
+            u = 2.f * u - static_cast<float>(x);
+            v = 2.f * v - static_cast<float>(y);
+        }
+    }
+
+    auto PathGuide::refine() -> void
+    {
+        // the trees built during the iteration are sampled from during the next one
+        for (Leaf& leaf : m_leaves)
+            leaf.sampling = std::move(leaf.building);
+
+        // leaves split in halves until each would have received fewer records than the threshold, assuming they spread evenly
+        float const splitThreshold = m_config.spatialThreshold * std::sqrt(std::ldexp(1.f, static_cast<int32_t>(m_iteration)));
+        for (uint32_t node = 0; node != m_nodes.size(); ++node)
+        {
+            SpatialNode const parent = m_nodes[node];
+            if (parent.axis != GUIDE_LEAF || parent.depth == MAX_SPATIAL_DEPTH
+                || static_cast<float>(m_leaves[parent.child].recordCount) <= splitThreshold)
+                continue;
+
+            uint32_t const axis = parent.depth % 3;
+            float const split = 0.5f * (parent.bounds.min[axis] + parent.bounds.max[axis]);
+            uint32_t const first = static_cast<uint32_t>(m_nodes.size());
+            SpatialNode child { .bounds = parent.bounds, .child = parent.child, .axis = GUIDE_LEAF, .depth = parent.depth + 1 };
+            child.bounds.max[axis] = split;
+            m_nodes.push_back(child);
+            child.bounds.min[axis] = split;
+            child.bounds.max[axis] = parent.bounds.max[axis];
+            child.child = static_cast<uint32_t>(m_leaves.size());
+            m_nodes.push_back(child);
+            m_nodes[node].child = first;
+            m_nodes[node].axis = axis;
+
+            m_leaves[parent.child].recordCount /= 2;
+            Leaf copy = m_leaves[parent.child];
+            m_leaves.push_back(std::move(copy));
+        }
+
+        for (Leaf& leaf : m_leaves)
+        {
+            GuideQuadNode const& root = leaf.sampling[0];
+            float const total = root.energy[0] + root.energy[1] + root.energy[2] + root.energy[3];
+            leaf.building.clear();
+            restructureQuadtree(leaf.sampling, 0, total, m_config.directionalThreshold, 1, &leaf.building);
+            leaf.recordCount = 0;
+        }
+    }
+
+    // the spatial nodes as they are, with the quadtrees of the leaves one after the other, their children offset accordingly
+    auto PathGuide::upload(VulkanContext* ctx) -> bool
+    {
+        std::vector<GuideQuadNode> quadNodes;
+        std::vector<uint32_t> roots(m_leaves.size());
+        for (uint32_t l = 0; l != m_leaves.size(); ++l)
+        {
+            uint32_t const offset = static_cast<uint32_t>(quadNodes.size());
+            roots[l] = offset;
+            for (GuideQuadNode node : m_leaves[l].sampling)
+            {
+                for (uint32_t& child : node.child)
+                    child = child != 0 ? child + offset : 0;
+                quadNodes.push_back(node);
+            }
+        }
+        std::vector<GuideSpatialNode> spatialNodes(m_nodes.size());
+        for (uint32_t n = 0; n != m_nodes.size(); ++n)
+        {
+            SpatialNode const& node = m_nodes[n];
+            bool const leaf = node.axis == GUIDE_LEAF;
+            spatialNodes[n] = {
+                .child = leaf ? roots[node.child] : node.child,
+                .axis = node.axis,
+                .split = leaf ? 0.f : m_nodes[node.child].bounds.max[node.axis],
+                .pad = 0
+            };
+        }
+
+        if (!uploadBuffer(ctx, spatialNodes.data(), spatialNodes.size() * sizeof(GuideSpatialNode), &m_spatialNodes)
+            || !uploadBuffer(ctx, quadNodes.data(), quadNodes.size() * sizeof(GuideQuadNode), &m_quadNodes))
+        {
+            MXC_ERROR("PathGuide: couldn't upload %zu spatial nodes and %zu quadtree nodes", spatialNodes.size(), quadNodes.size());
+            return false;
+        }
+        return true;
+    }
+
+    static char constexpr GUIDE_FILE_MAGIC[8] { 'M', 'X', 'C', 'G', 'U', 'I', 'D', 'E' };
+    static uint32_t constexpr GUIDE_FILE_VERSION = 1;
+
+    // followed by the spatial nodes, a GuideFileLeaf per leaf, then the sampling and building quadtree nodes of each leaf in turn
+    struct GuideFileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t sampleIndex;
+        uint32_t trainingIterations;
+        uint32_t iteration;
+        uint32_t iterationPass;
+        uint32_t node_count;
+        uint32_t leaf_count;
+        uint32_t pad;
+    };
+
+    struct GuideFileLeaf
+    {
+        uint64_t recordCount;
+        uint32_t sampling_count;
+        uint32_t building_count;
+    };
+
+    auto PathGuide::save(char const* filename, uint32_t sampleIndex) const -> bool
+    {
+        GuideFileHeader header{};
+        memcpy(header.magic, GUIDE_FILE_MAGIC, sizeof(GUIDE_FILE_MAGIC));
+        header.version = GUIDE_FILE_VERSION;
+        header.sampleIndex = sampleIndex;
+        header.trainingIterations = m_config.trainingIterations;
+        header.iteration = m_iteration;
+        header.iterationPass = m_iterationPass;
+        header.node_count = static_cast<uint32_t>(m_nodes.size());
+        header.leaf_count = static_cast<uint32_t>(m_leaves.size());
+
+        uint64_t size = sizeof(header) + m_nodes.size() * sizeof(SpatialNode) + m_leaves.size() * sizeof(GuideFileLeaf);
+        for (Leaf const& leaf : m_leaves)
+            size += (leaf.sampling.size() + leaf.building.size()) * sizeof(GuideQuadNode);
+
+        std::string const temporaryFilename = std::string(filename) + ".tmp";
+        MappedFile file;
+        if (!file.open(temporaryFilename.c_str(), MappingMode::READ_WRITE, size))
+            return false;
+
+        uint8_t* pData = file.data();
+        memcpy(pData, &header, sizeof(header));
+        pData += sizeof(header);
+        memcpy(pData, m_nodes.data(), m_nodes.size() * sizeof(SpatialNode));
+        pData += m_nodes.size() * sizeof(SpatialNode);
+        for (Leaf const& leaf : m_leaves)
+        {
+            GuideFileLeaf const saved {
+                .recordCount = leaf.recordCount,
+                .sampling_count = static_cast<uint32_t>(leaf.sampling.size()),
+                .building_count = static_cast<uint32_t>(leaf.building.size())
+            };
+            memcpy(pData, &saved, sizeof(saved));
+            pData += sizeof(saved);
+        }
+        for (Leaf const& leaf : m_leaves)
+            for (std::vector<GuideQuadNode> const* pTree : { &leaf.sampling, &leaf.building })
+            {
+                memcpy(pData, pTree->data(), pTree->size() * sizeof(GuideQuadNode));
+                pData += pTree->size() * sizeof(GuideQuadNode);
+            }
+
+        bool const flushed = file.flush();
+        file.close();
+        if (!flushed)
+        {
+            MXC_ERROR("couldn't write path guide %s to disk", temporaryFilename.c_str());
+            return false;
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temporaryFilename, filename, error);
+        if (error)
+        {
+            MXC_ERROR("couldn't rename %s to %s: %s", temporaryFilename.c_str(), filename, error.message().c_str());
+            return false;
+        }
+        return true;
+    }
+
+    auto PathGuide::load(VulkanContext* ctx, char const* filename, uint32_t sampleIndex) -> bool
+    {
+        MXC_ASSERT(isEnabled(), "PathGuide: load with guiding disabled");
+        MappedFile file;
+        if (!file.open(filename, MappingMode::READ))
+            return false;
+
+        GuideFileHeader header;
+        if (file.size() < sizeof(header))
+        {
+            MXC_ERROR("%s is too small to be a path guide", filename);
+            return false;
+        }
+        memcpy(&header, file.data(), sizeof(header));
+        if (memcmp(header.magic, GUIDE_FILE_MAGIC, sizeof(GUIDE_FILE_MAGIC)) != 0 || header.version != GUIDE_FILE_VERSION)
+        {
+            MXC_ERROR("%s isn't a path guide of version %u", filename, GUIDE_FILE_VERSION);
+            return false;
+        }
+        if (header.sampleIndex != sampleIndex || header.trainingIterations != m_config.trainingIterations)
+        {
+            MXC_ERROR("path guide %s was saved at pass %u with %u training iterations, the checkpoint is at pass %u with %u",
+                      filename, header.sampleIndex, header.trainingIterations, sampleIndex, m_config.trainingIterations);
+            return false;
+        }
+
+        uint8_t const* pData = file.data() + sizeof(header);
+        uint8_t const* pEnd = file.data() + file.size();
+        uint64_t const tableBytes = static_cast<uint64_t>(header.node_count) * sizeof(SpatialNode)
+                                  + static_cast<uint64_t>(header.leaf_count) * sizeof(GuideFileLeaf);
+        if (tableBytes > static_cast<uint64_t>(pEnd - pData))
+        {
+            MXC_ERROR("path guide %s is truncated", filename);
+            return false;
+        }
+        std::vector<SpatialNode> nodes(header.node_count);
+        memcpy(nodes.data(), pData, nodes.size() * sizeof(SpatialNode));
+        pData += nodes.size() * sizeof(SpatialNode);
+        std::vector<GuideFileLeaf> savedLeaves(header.leaf_count);
+        memcpy(savedLeaves.data(), pData, savedLeaves.size() * sizeof(GuideFileLeaf));
+        pData += savedLeaves.size() * sizeof(GuideFileLeaf);
+
+        std::vector<Leaf> leaves(header.leaf_count);
+        for (uint32_t l = 0; l != leaves.size(); ++l)
+        {
+            leaves[l].recordCount = savedLeaves[l].recordCount;
+            for (auto [pTree, count] : { std::pair{ &leaves[l].sampling, savedLeaves[l].sampling_count },
+                                         std::pair{ &leaves[l].building, savedLeaves[l].building_count } })
+            {
+                if (count == 0 || static_cast<uint64_t>(count) * sizeof(GuideQuadNode) > static_cast<uint64_t>(pEnd - pData))
+                {
+                    MXC_ERROR("path guide %s is truncated", filename);
+                    return false;
+                }
+                pTree->resize(count);
+                memcpy(pTree->data(), pData, count * sizeof(GuideQuadNode));
+                pData += count * sizeof(GuideQuadNode);
+            }
+        }
+
+        m_nodes = std::move(nodes);
+        m_leaves = std::move(leaves);
+        m_iteration = std::min(header.iteration, m_config.trainingIterations);
+        m_iterationPass = header.iterationPass;
+        // before the first iteration ends the device trees are the empty ones of create
+        if (m_iteration != 0 && !upload(ctx))
+            return false;
+
+        MXC_INFO("path guide %s resumed at iteration %u, %u spatial leaves", filename, m_iteration, spatialLeafCount());
+        return resetRecords(ctx, m_iteration == m_config.trainingIterations ? 0 : m_config.recordCapacity);
+    }
+
+    // no records, and capacity more of them for the next pass
+    auto PathGuide::resetRecords(VulkanContext* ctx, uint32_t capacity) -> bool
+    {
+        CommandBuffer cmdBuf;
+        cmdBuf.allocate(ctx, CommandType::COMPUTE);
+        cmdBuf.begin();
+        vkCmdFillBuffer(cmdBuf.handle, m_recordCount.handle, 0, sizeof(uint32_t), 0);
+        vkCmdFillBuffer(cmdBuf.handle, m_recordCount.handle, sizeof(uint32_t), sizeof(uint32_t), capacity);
+        ctx->device.insertMemoryBarrier(cmdBuf.handle, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                                        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        cmdBuf.end();
+        bool const reset = ctx->device.flushCommandBuffer(&cmdBuf, CommandType::COMPUTE);
+        cmdBuf.free(ctx);
+        return reset;
+    }
+
+    auto PathGuide::descriptors(DescriptorInfo* pOutInfos) const -> void
+    {
+        Buffer const* buffers[BINDING_COUNT] { &m_spatialNodes, &m_quadNodes, &m_records, &m_recordCount };
+        for (uint32_t i = 0; i != BINDING_COUNT; ++i)
+            pOutInfos[i].buffer = { .buffer = buffers[i]->handle, .offset = 0, .range = VK_WHOLE_SIZE };
+    }
+}
@@ -0,0 +1,126 @@
+#ifndef MXC_PATH_GUIDE_H
+#define MXC_PATH_GUIDE_H
+
+#include <vulkan/vulkan.h>
+#include "VulkanCommon.h"
+#include "Buffer.h"
+#include "Shader.h"
+#include "VulkanContext.inl"
+#include "Bvh.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace mxc
+{
+	struct PathGuideConfig
+	{
+		uint32_t recordCapacity = 1u << 20;  // radiance records kept per pass, the paths past it aren't recorded
+		uint32_t trainingIterations = 9;     // iteration k lasts 2^k passes, the tree is frozen after them
+		float spatialThreshold = 12000.f;    // records of a leaf of iteration k past which it splits, times sqrt(2^k)
+		float directionalThreshold = 0.01f;  // share of the energy of a leaf past which a quadrant is subdivided
+	};
+
+	// 16 bytes, GuideSpatialNode in shaders/spectrumTest/pathGuide.comp
+	struct GuideSpatialNode
+	{
+		uint32_t child;  // leaf: root of its quadtree in the quadtree nodes, interior: first child, the second one follows it
+		uint32_t axis;   // of the split, GUIDE_LEAF for leaves
+		float split;     // points below it go to the first child
+		uint32_t pad;
+	};
+	static_assert(sizeof(GuideSpatialNode) == 16);
+
+	// 32 bytes, GuideQuadNode in shaders/spectrumTest/pathGuide.comp. Quadrant i covers [x, x + 1/2) x [y, y + 1/2) of the node,
+	// x = (i & 1) / 2, y = (i >> 1) / 2, of the square of cylindrical coordinates (cos theta + 1) / 2, phi / 2pi
+	struct GuideQuadNode
+	{
+		float energy[4];    // of the radiance recorded in each quadrant
+		uint32_t child[4];  // 0 for quadrants which aren't subdivided, the root of a quadtree is never a child
+	};
+	static_assert(sizeof(GuideQuadNode) == 32);
+
+	static uint32_t constexpr GUIDE_LEAF = 3;
+	static uint32_t constexpr GUIDE_MAX_DIRECTIONAL_DEPTH = 20; // GUIDE_MAX_DEPTH in shaders/spectrumTest/pathGuide.comp
+
+	// 32 bytes, GuideRecord in shaders/spectrumTest/pathGuide.comp
+	struct GuideRecord
+	{
+		float p[3];
+		float value;  // luminance of the incident radiance over the probability of the sampled direction
+		float uv[2];  // cylindrical coordinates of the direction
+		float pad[2];
+	};
+	static_assert(sizeof(GuideRecord) == 32);
+
+	// Practical Path Guiding (Muller, Gross and Novak, 2017). Diffuse vertices sample their next direction from a distribution of
+	// the incident radiance learnt from the previous paths, or from the BSDF, and weigh both by their one sample MIS pdf. The
+	// distribution is an SD-tree: a binary tree over space, splitting x, y and z in turn at the middle of the node, whose leaves
+	// hold a quadtree over the cylindrical coordinates of the sphere of directions. Paths append a record per diffuse vertex to a
+	// device buffer; update reads them back between passes and splats them into the trees being built. Iterations double in
+	// length, after each one the trees being built replace those sampled from: spatial leaves which received many records split,
+	// quadrants which hold a large share of the energy are subdivided and the others merged. The film keeps every pass
+	class PathGuide
+	{
+	public:
+		static uint32_t constexpr BINDING_COUNT = 4;
+
+	public:
+		// guiding disabled, only creates the buffers to bind
+		auto create(VulkanContext* ctx) -> bool;
+		auto create(VulkanContext* ctx, PathGuideConfig const& config) -> bool;
+		auto destroy(VulkanContext* ctx) -> void;
+
+		// splats the records of the pass which ended, and uploads new trees at the end of an iteration. Blocking, the device has
+		// to be done with the pass
+		auto update(VulkanContext* ctx) -> bool;
+
+		// The SD-trees and the iteration they are at, next to a checkpoint of the film taken at pass sampleIndex. Written under
+		// filename.tmp then renamed, as saveCheckpoint does. load expects the same pass, and uploads the trees sampled from
+		auto save(char const* filename, uint32_t sampleIndex) const -> bool;
+		auto load(VulkanContext* ctx, char const* filename, uint32_t sampleIndex) -> bool;
+
+		// writes BINDING_COUNT descriptors: spatial nodes, quadtree nodes, records, record count and capacity
+		auto descriptors(DescriptorInfo* pOutInfos) const -> void;
+
+		auto isEnabled() const -> bool { return m_enabled; }
+		auto iteration() const -> uint32_t { return m_iteration; }
+		auto spatialLeafCount() const -> uint32_t { return static_cast<uint32_t>(m_leaves.size()); }
+
+	private:
+		struct SpatialNode
+		{
+			Aabb bounds;
+			uint32_t child; // leaf: in m_leaves, interior: first child
+			uint32_t axis;  // GUIDE_LEAF for leaves
+			uint32_t depth;
+		};
+
+		struct Leaf
+		{
+			std::vector<GuideQuadNode> sampling; // of the previous iteration, uploaded
+			std::vector<GuideQuadNode> building; // receives the records of the current one
+			uint64_t recordCount;
+		};
+
+		auto splat(GuideRecord const& record) -> void;
+		auto refine() -> void;
+		auto upload(VulkanContext* ctx) -> bool;
+		auto resetRecords(VulkanContext* ctx, uint32_t capacity) -> bool;
+
+	private:
+		Buffer m_spatialNodes{0, BufferType_v::STORAGE};
+		Buffer m_quadNodes{0, BufferType_v::STORAGE};
+		Buffer m_records{0, BufferType_v::STORAGE};
+		Buffer m_recordCount{0, BufferType_v::STORAGE};  // appended records then capacity, 0 once training is over
+		Buffer m_readback{0, BufferType_v::READBACK};
+		PathGuideConfig m_config;
+		std::vector<SpatialNode> m_nodes;
+		std::vector<Leaf> m_leaves;
+		uint32_t m_iteration = 0;
+		uint32_t m_iterationPass = 0;  // passes of the current iteration which ended
+		bool m_enabled = false;
+	};
+}
+
+#endif // MXC_PATH_GUIDE_H
@@ -0,0 +1,27 @@
+#include "Scene.h"
+#include "MeshParser.h"
+#include "logging.h"
+
+#include <algorithm>
+
+namespace mxc
+{
+    auto readPly(ThreadPool& pool, char const* filename, MeshAsset* pOut) -> bool
+    {
+        pOut->filename = filename;
+        pOut->materials.clear();
+        pOut->dependencies.clear();
+        if (!parsePly(pool, filename, &pOut->mesh))
+            return false;
+        pOut->dependencies.emplace_back(filename);
+        std::fill(pOut->mesh.materials.begin(), pOut->mesh.materials.end(), ParsedMesh::NO_MATERIAL);
+        return true;
+    }
+
+    auto loadPly(ThreadPool& pool, char const* filename, uint32_t materialIndex, Scene* pScene, uint32_t* pOutMeshIndex,
+                 std::vector<std::string>* pOutDependencies) -> bool
+    {
+        MeshAsset asset;
+        return readPly(pool, filename, &asset) && addMeshAsset(asset, materialIndex, pScene, pOutMeshIndex, pOutDependencies);
+    }
+}
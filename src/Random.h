@@ -0,0 +1,113 @@
+#ifndef MXC_RANDOM_H
+#define MXC_RANDOM_H
+
+#include <cstdint>
+
+namespace mxc
+{
+	// Host side of the counter based generator of shaders/spectrumTest/random.comp, bit for bit: a number is a hash of the pixel, the
+	// pass, the path of the pixel in the pass and the dimension of the path, under the seed of the render
+
+	// 4D to 4D hash of Jarzynski and Olano, Hash Functions for GPU Rendering (JCGT 2020), in place
+	constexpr auto pcg4d(uint32_t v[4]) -> void
+	{
+		for (uint32_t i = 0; i != 4; ++i)
+			v[i] = v[i] * 1664525u + 1013904223u;
+		v[0] += v[1] * v[3];
+		v[1] += v[2] * v[0];
+		v[2] += v[0] * v[1];
+		v[3] += v[1] * v[2];
+		for (uint32_t i = 0; i != 4; ++i)
+			v[i] ^= v[i] >> 16;
+		v[0] += v[1] * v[3];
+		v[1] += v[2] * v[0];
+		v[2] += v[0] * v[1];
+		v[3] += v[1] * v[2];
+	}
+
+	struct Rng
+	{
+		uint32_t key[4];    // of the path
+		uint32_t dimension; // numbers drawn so far, the counter
+	};
+
+	constexpr auto makeRng(uint32_t pixelX, uint32_t pixelY, uint32_t pass, uint32_t path, uint32_t seed) -> Rng
+	{
+		Rng rng { .key = { pixelX ^ seed, pixelY, pass, path }, .dimension = 0 };
+		pcg4d(rng.key);
+		return rng;
+	}
+
+	// 4 independent words of a dimension, whatever the counter
+	constexpr auto randomAt(Rng const& rng, uint32_t dimension, uint32_t pOut[4]) -> void
+	{
+		pOut[0] = rng.key[0];
+		pOut[1] = rng.key[1];
+		pOut[2] = rng.key[2];
+		pOut[3] = rng.key[3] + dimension;
+		pcg4d(pOut);
+	}
+
+	// 4 independent words of the next dimension
+	constexpr auto nextRandom(Rng* pRng, uint32_t pOut[4]) -> void
+	{
+		randomAt(*pRng, pRng->dimension++, pOut);
+	}
+
+	// [0, 1) from the 24 high bits, exact in float
+	constexpr auto uintToUnitFloat(uint32_t u) -> float
+	{
+		return static_cast<float>(u >> 8) * 0x1p-24f;
+	}
+
+	constexpr auto random1D(Rng* pRng) -> float
+	{
+		uint32_t bits[4] {};
+		nextRandom(pRng, bits);
+		return uintToUnitFloat(bits[0]);
+	}
+
+	// both numbers come from one dimension
+	constexpr auto random2D(Rng* pRng, float pOut[2]) -> void
+	{
+		uint32_t bits[4] {};
+		nextRandom(pRng, bits);
+		pOut[0] = uintToUnitFloat(bits[0]);
+		pOut[1] = uintToUnitFloat(bits[1]);
+	}
+
+	// splitmix64 finalizer folding the seed of a render to the 32 bits the shaders hash with
+	constexpr auto shaderSeed(uint64_t seed) -> uint32_t
+	{
+		seed = (seed ^ (seed >> 30)) * 0xbf58476d1ce4e5b9ull;
+		seed = (seed ^ (seed >> 27)) * 0x94d049bb133111ebull;
+		return static_cast<uint32_t>(seed ^ (seed >> 31));
+	}
+
+	// known answers of shaders/spectrumTest/random.comp, evaluated apart from this file with 32 bit wrapping arithmetic. A change
+	// of the constants on either side has to update them
+	constexpr auto pcg4dMatches(uint32_t x, uint32_t y, uint32_t z, uint32_t w, uint32_t const (&expected)[4]) -> bool
+	{
+		uint32_t v[4] { x, y, z, w };
+		pcg4d(v);
+		return v[0] == expected[0] && v[1] == expected[1] && v[2] == expected[2] && v[3] == expected[3];
+	}
+
+	constexpr auto rngMatches(Rng const& rng, uint32_t dimension, uint32_t const (&expectedKey)[4], uint32_t const (&expected)[4]) -> bool
+	{
+		uint32_t bits[4] {};
+		randomAt(rng, dimension, bits);
+		for (uint32_t i = 0; i != 4; ++i)
+			if (rng.key[i] != expectedKey[i] || bits[i] != expected[i])
+				return false;
+		return true;
+	}
+
+	static_assert(pcg4dMatches(0, 0, 0, 0, { 0x0f02f829u, 0x2d568769u, 0x32b0c43bu, 0xd32548eau }), "pcg4d differs from the shader");
+	static_assert(pcg4dMatches(1, 2, 3, 4, { 0x3622cd16u, 0xf11471d8u, 0xe1109b3fu, 0x02b94c2fu }), "pcg4d differs from the shader");
+	static_assert(rngMatches(makeRng(7, 11, 3, 5, 0x9e3779b9u), 2, { 0x36cb470fu, 0x98511030u, 0x100c604du, 0xac9e83c2u },
+	                         { 0xff6ed3e7u, 0xf3ec9ef0u, 0x56fe3a6bu, 0xd8ce69efu }), "makeRng or randomAt differs from the shader");
+	static_assert(shaderSeed(1) == 0x100b05e5u, "shaderSeed changed, the seeds of renders would too");
+}
+
+#endif // MXC_RANDOM_H
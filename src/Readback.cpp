@@ -0,0 +1,260 @@
+#include "Readback.h"
+#include "VulkanContext.inl"
+#include "logging.h"
+
+namespace mxc
+{
+    auto Readback::create(VulkanContext* ctx, uint32_t width, uint32_t height, VkFormat format, uint32_t bytesPerPixel,
+                          ReadbackCallback callback, uint32_t slotCount) -> bool
+    {
+        MXC_ASSERT(slotCount != 0 && bytesPerPixel != 0 && callback, "Readback: invalid configuration");
+        m_width = width;
+        m_height = height;
+        m_format = format;
+        m_bytesPerPixel = bytesPerPixel;
+        m_callback = std::move(callback);
+
+        VkSemaphoreTypeCreateInfo const timelineInfo {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+            .pNext = nullptr,
+            .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+            .initialValue = 0
+        };
+        VkSemaphoreCreateInfo const semaphoreInfo {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            .pNext = &timelineInfo,
+            .flags = 0
+        };
+        if (vkCreateSemaphore(ctx->device.logical, &semaphoreInfo, nullptr, &m_timeline) != VK_SUCCESS)
+        {
+            MXC_ERROR("Readback: couldn't create the timeline semaphore");
+            return false;
+        }
+        m_nextTimelineValue = 1;
+
+        createSlots(ctx, slotCount);
+
+        m_stop = false;
+        m_writer = std::thread(&Readback::writerLoop, this, ctx->device.logical);
+        MXC_INFO("Readback: %u staging buffers of %ux%u, %u bytes per pixel", slotCount, width, height, bytesPerPixel);
+        return true;
+    }
+
+    auto Readback::destroy(VulkanContext* ctx) -> void
+    {
+        if (m_writer.joinable())
+        {
+            drain();
+            {
+                std::lock_guard lock(m_mutex);
+                m_stop = true;
+            }
+            m_cv.notify_all();
+            m_writer.join();
+        }
+
+        destroySlots(ctx);
+        if (m_timeline != VK_NULL_HANDLE)
+            vkDestroySemaphore(ctx->device.logical, m_timeline, nullptr);
+        m_timeline = VK_NULL_HANDLE;
+    }
+
+    auto Readback::resize(VulkanContext* ctx, uint32_t width, uint32_t height) -> bool
+    {
+        // the writer thread keeps running, but every buffer it could be reading from has to be released first
+        drain();
+        MXC_ASSERT(m_recordedSlot == UINT32_MAX, "Readback: resize between recordCopy and submit");
+
+        uint32_t const slotCount = static_cast<uint32_t>(m_slots.size());
+        destroySlots(ctx);
+        m_width = width;
+        m_height = height;
+        createSlots(ctx, slotCount);
+        return true;
+    }
+
+    auto Readback::recordCopy(VulkanContext* ctx, VkCommandBuffer cmdBuf, VkImage image, uint64_t frameId) -> bool
+    {
+        MXC_ASSERT(m_recordedSlot == UINT32_MAX, "Readback: previous recordCopy wasn't followed by submit");
+
+        uint32_t slotIndex = UINT32_MAX;
+        {
+            std::lock_guard lock(m_mutex);
+            for (uint32_t i = 0; i != m_slots.size(); ++i)
+            {
+                if (!m_slots[i].inFlight)
+                {
+                    slotIndex = i;
+                    break;
+                }
+            }
+            if (slotIndex == UINT32_MAX)
+            {
+                MXC_DEBUG("Readback: every staging buffer is in flight, skipping frame %llu", static_cast<unsigned long long>(frameId));
+                return false;
+            }
+            m_slots[slotIndex].inFlight = true;
+            m_slots[slotIndex].frameId = frameId;
+        }
+        m_recordedSlot = slotIndex;
+
+        // compute shader writes -> copy
+        ctx->device.insertMemoryBarrier(cmdBuf, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+                                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+        VkBufferImageCopy const region {
+            .bufferOffset = 0,
+            .bufferRowLength = 0, // tightly packed
+            .bufferImageHeight = 0,
+            .imageSubresource = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .mipLevel = 0,
+                .baseArrayLayer = 0,
+                .layerCount = 1
+            },
+            .imageOffset = {0, 0, 0},
+            .imageExtent = {m_width, m_height, 1}
+        };
+        vkCmdCopyImageToBuffer(cmdBuf, image, VK_IMAGE_LAYOUT_GENERAL, m_slots[slotIndex].buffer.handle, 1, &region);
+
+        // copy -> host reads, made available by the semaphore signal operation following the submission
+        ctx->device.insertMemoryBarrier(cmdBuf, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT,
+                                        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT);
+        return true;
+    }
+
+    auto Readback::submit(VulkanContext* ctx, VkQueue queue) -> bool
+    {
+        (void)ctx;
+        if (m_recordedSlot == UINT32_MAX)
+            return true;
+
+        // submissions on the same queue start in order, and a signal operation waits for every command submitted before it, hence
+        // an empty submission is enough to know when the copy is done, without touching the renderer's own submit
+        uint64_t const value = m_nextTimelineValue++;
+        VkSemaphoreSubmitInfo const signalInfo {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+            .pNext = nullptr,
+            .semaphore = m_timeline,
+            .value = value,
+            .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+            .deviceIndex = 0
+        };
+        VkSubmitInfo2 const submitInfo {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+            .pNext = nullptr,
+            .flags = 0,
+            .waitSemaphoreInfoCount = 0,
+            .pWaitSemaphoreInfos = nullptr,
+            .commandBufferInfoCount = 0,
+            .pCommandBufferInfos = nullptr,
+            .signalSemaphoreInfoCount = 1,
+            .pSignalSemaphoreInfos = &signalInfo
+        };
+        if (vkQueueSubmit2(queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+        {
+            MXC_ERROR("Readback: couldn't submit the timeline semaphore signal");
+            std::lock_guard lock(m_mutex);
+            m_slots[m_recordedSlot].inFlight = false;
+            m_recordedSlot = UINT32_MAX;
+            return false;
+        }
+
+        {
+            std::lock_guard lock(m_mutex);
+            m_slots[m_recordedSlot].timelineValue = value;
+            m_pending.push_back(m_recordedSlot);
+        }
+        m_cv.notify_all();
+        m_recordedSlot = UINT32_MAX;
+        return true;
+    }
+
+    auto Readback::drain() -> void
+    {
+        std::unique_lock lock(m_mutex);
+        m_cv.wait(lock, [this] {
+            for (Slot const& slot : m_slots)
+                if (slot.inFlight && slot.timelineValue != 0)
+                    return false;
+            return m_pending.empty();
+        });
+    }
+
+    auto Readback::pendingCount() -> uint32_t
+    {
+        std::lock_guard lock(m_mutex);
+        uint32_t count = 0;
+        for (Slot const& slot : m_slots)
+            count += slot.inFlight ? 1 : 0;
+        return count;
+    }
+
+    auto Readback::createSlots(VulkanContext* ctx, uint32_t slotCount) -> void
+    {
+        VkDeviceSize const size = static_cast<VkDeviceSize>(m_width) * m_height * m_bytesPerPixel;
+        m_slots.reserve(slotCount);
+        for (uint32_t i = 0; i != slotCount; ++i)
+        {
+            m_slots.push_back({.buffer = Buffer(size, BufferType_v::READBACK), .timelineValue = 0, .frameId = 0, .inFlight = false});
+            ctx->device.createBuffer(&m_slots.back().buffer);
+        }
+    }
+
+    auto Readback::destroySlots(VulkanContext* ctx) -> void
+    {
+        for (Slot& slot : m_slots)
+            if (slot.buffer.handle != VK_NULL_HANDLE)
+                ctx->device.destroyBuffer(&slot.buffer);
+        m_slots.clear();
+    }
+
+    auto Readback::writerLoop(VkDevice device) -> void
+    {
+        for (;;)
+        {
+            uint32_t slotIndex;
+            {
+                std::unique_lock lock(m_mutex);
+                m_cv.wait(lock, [this] { return m_stop || !m_pending.empty(); });
+                if (m_pending.empty())
+                    return;
+                slotIndex = m_pending.front();
+                m_pending.pop_front();
+            }
+
+            // slots aren't destroyed while in flight, no need to hold the lock while waiting and writing
+            Slot& slot = m_slots[slotIndex];
+            VkSemaphoreWaitInfo const waitInfo {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+                .semaphoreCount = 1,
+                .pSemaphores = &m_timeline,
+                .pValues = &slot.timelineValue
+            };
+            if (vkWaitSemaphores(device, &waitInfo, UINT64_MAX) == VK_SUCCESS)
+            {
+                // the memory is host coherent, no invalidation needed
+                ReadbackFrame const frame {
+                    .pData = slot.buffer.mapped,
+                    .frameId = slot.frameId,
+                    .width = m_width,
+                    .height = m_height,
+                    .bytesPerPixel = m_bytesPerPixel,
+                    .format = m_format
+                };
+                m_callback(frame);
+            }
+            else
+                MXC_ERROR("Readback: failed waiting for frame %llu, dropping it", static_cast<unsigned long long>(slot.frameId));
+
+            {
+                std::lock_guard lock(m_mutex);
+                slot.inFlight = false;
+                slot.timelineValue = 0;
+            }
+            m_cv.notify_all();
+        }
+    }
+}
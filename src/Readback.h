@@ -0,0 +1,93 @@
+#ifndef MXC_READBACK_H
+#define MXC_READBACK_H
+
+#include <vulkan/vulkan.h>
+#include "VulkanCommon.h"
+#include "Buffer.h"
+
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mxc
+{
+	// a frame copied back to host memory. pData is only valid for the duration of the callback
+	struct ReadbackFrame
+	{
+		void const* pData;
+		uint64_t frameId;
+		uint32_t width;
+		uint32_t height;
+		uint32_t bytesPerPixel;
+		VkFormat format;
+	};
+
+	// invoked on the writer thread, one frame at a time and in submission order
+	using ReadbackCallback = std::function<void(ReadbackFrame const&)>;
+
+	// Asynchronous device to host copies of an image. The image is copied into a ring of persistently mapped buffers, and every copy
+	// gets a value of a timeline semaphore, signaled on the queue right after the submission containing it. A writer thread waits on
+	// those values and hands the mapped memory to the callback, such that the render loop never waits on the GPU nor on the disk.
+	// When every buffer of the ring is still in flight, recordCopy skips the frame instead of stalling
+	class Readback
+	{
+	public:
+		static uint32_t constexpr DEFAULT_SLOT_COUNT = 3;
+
+	public:
+		auto create(VulkanContext* ctx, uint32_t width, uint32_t height, VkFormat format, uint32_t bytesPerPixel,
+		            ReadbackCallback callback, uint32_t slotCount = DEFAULT_SLOT_COUNT) -> bool;
+		// waits for every pending frame to be written
+		auto destroy(VulkanContext* ctx) -> void;
+		auto resize(VulkanContext* ctx, uint32_t width, uint32_t height) -> bool;
+
+		// records the copy of image (VK_IMAGE_LAYOUT_GENERAL, last written by a compute shader) into a free buffer of the ring.
+		// Returns false, recording nothing, if there is none. A successful recordCopy has to be followed by submit
+		auto recordCopy(VulkanContext* ctx, VkCommandBuffer cmdBuf, VkImage image, uint64_t frameId) -> bool;
+		// to be called after the submission of the command buffer given to recordCopy, on the same queue
+		auto submit(VulkanContext* ctx, VkQueue queue) -> bool;
+
+		// blocks until the writer thread has consumed every submitted frame
+		auto drain() -> void;
+
+		auto pendingCount() -> uint32_t;
+
+	private:
+		struct Slot
+		{
+			Buffer buffer;
+			uint64_t timelineValue;
+			uint64_t frameId;
+			bool inFlight; // from recordCopy until the callback returned
+		};
+
+		auto createSlots(VulkanContext* ctx, uint32_t slotCount) -> void;
+		auto destroySlots(VulkanContext* ctx) -> void;
+		auto writerLoop(VkDevice device) -> void;
+
+	private:
+		std::vector<Slot> m_slots;
+		VkSemaphore m_timeline = VK_NULL_HANDLE;
+		uint64_t m_nextTimelineValue = 1;
+		uint32_t m_recordedSlot = UINT32_MAX; // recorded and not yet submitted
+
+		ReadbackCallback m_callback;
+		uint32_t m_width = 0;
+		uint32_t m_height = 0;
+		uint32_t m_bytesPerPixel = 0;
+		VkFormat m_format = VK_FORMAT_UNDEFINED;
+
+		// shared with the writer thread
+		std::thread m_writer;
+		std::mutex m_mutex;
+		std::condition_variable m_cv;
+		std::deque<uint32_t> m_pending; // submitted slots, in submission order
+		bool m_stop = false;
+	};
+}
+
+#endif // MXC_READBACK_H
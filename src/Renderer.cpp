@@ -75,8 +75,12 @@ namespace mxc
 
         // Obtain a list of required extensions
         std::vector<char const*> requiredExtensions;
-        requiredExtensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME); // VK_KHR_surface
-        requiredExtensions.push_back(config.platformSurfaceExtensionName); // Generic surface extension
+        m_ctx.headless = config.headless;
+        if (!m_ctx.headless)
+        {
+            requiredExtensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME); // VK_KHR_surface
+            requiredExtensions.push_back(config.platformSurfaceExtensionName); // Generic surface extension
+        }
 #if defined(_DEBUG)
         requiredExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 
@@ -214,31 +218,46 @@ namespace mxc
 #endif
 
         // Surface
-        MXC_INFO("Creating Vulkan surface...");
-        if (!
+        if (m_ctx.headless)
+        {
+            MXC_INFO("Headless mode, skipping Vulkan surface creation");
+        }
+        else
+        {
+            MXC_INFO("Creating Vulkan surface...");
+            if (!
 #if defined(VK_USE_PLATFORM_WIN32_KHR)
-            m_ctx.swapchain.initSurface(&m_ctx, config.platformHandle, config.platformWindow)
+                m_ctx.swapchain.initSurface(&m_ctx, config.platformHandle, config.platformWindow)
 #elif defined(VK_USE_PLATFORM_WAYLAND_KHR)
-            m_ctx.swapchain.initSurface(&m_ctx, config.display, config.window)
+                m_ctx.swapchain.initSurface(&m_ctx, config.display, config.window)
 #elif defined(VK_USE_PLATFORM_XCB_KHR)
-            m_ctx.swapchain.initSurface(&m_ctx, config.connection, config.window)
+                m_ctx.swapchain.initSurface(&m_ctx, config.connection, config.window)
 #elif defined(VK_USE_PLATFORM_MACOS_MVK)
-            m_ctx.swapchain.initSurface(&m_ctx, config.view)
+                m_ctx.swapchain.initSurface(&m_ctx, config.view)
 #else
     #error "shouldn't be here"
 #endif 
-        ) {
-            MXC_ERROR("Failed to create platform surface!");
-            return false;
-        }
-        MXC_INFO("Vulkan surface created.");
+            ) {
+                MXC_ERROR("Failed to create platform surface!");
+                return false;
+            }
+            MXC_INFO("Vulkan surface created.");
 
-        // initialize swapchain extension function pointers for instance level functions
-        m_ctx.swapchain.initInstanceFunctionPointers(&m_ctx);
+            // initialize swapchain extension function pointers for instance level functions
+            m_ctx.swapchain.initInstanceFunctionPointers(&m_ctx);
+        }
 
         // Device creation
         PhysicalDeviceRequirements requirements;
-        requirements.extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+        if (m_ctx.headless)
+        {
+            requirements.presentation = false;
+            requirements.discreteGPU = false;
+        }
+        else
+        {
+            requirements.extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+        }
         requirements.extensions.push_back(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
         MXC_INFO("required device extensions:");
         for (uint32_t i = 0; i != requirements.extensions.size(); ++i)
@@ -262,11 +281,24 @@ namespace mxc
             return false;
         }
 
-        // Swapchain
-        m_ctx.swapchain.initDeviceFunctionPointers(&m_ctx);
         m_ctx.framebufferWidth = config.windowWidth;
         m_ctx.framebufferHeight = config.windowHeight;
-        m_ctx.swapchain.create(&m_ctx, m_ctx.framebufferWidth, m_ctx.framebufferHeight, /*vsync*/true);
+        if (m_ctx.headless)
+        {
+            // Offscreen images standing in for the swapchain
+            if (!createOffscreenImages())
+            {
+                MXC_ERROR("failed to create offscreen images");
+                return false;
+            }
+            MXC_DEBUG("Created offscreen images");
+        }
+        else
+        {
+            // Swapchain
+            m_ctx.swapchain.initDeviceFunctionPointers(&m_ctx);
+            m_ctx.swapchain.create(&m_ctx, m_ctx.framebufferWidth, m_ctx.framebufferHeight, /*vsync*/true);
+        }
 
         // Query for depth format and create depth image TODO: do it and make it configurable
         DepthFormatProperties_t formatProperties;
@@ -279,28 +311,32 @@ namespace mxc
         createSynchronizationPrimitives();
         MXC_DEBUG("Created Vulkan Synchronization primitives");
         
-        // Create Depth Images (logging is in there)
-        if (!createDepthImages(formatProperties))
+        // graphics path (depth images, renderpass, framebuffers) needs the swapchain
+        if (!m_ctx.headless)
         {
-            MXC_ERROR("failed to create depth images");
-            return false;
-        }
-        MXC_DEBUG("Created Depth Images");
+            // Create Depth Images (logging is in there)
+            if (!createDepthImages(formatProperties))
+            {
+                MXC_ERROR("failed to create depth images");
+                return false;
+            }
+            MXC_DEBUG("Created Depth Images");
 
-        // create renderpass
-        if (!createRenderPass())
-        {
-            MXC_ERROR("failed to create renderPass");
-            return false;
-        }
-        MXC_DEBUG("Created default renderPass");
+            // create renderpass
+            if (!createRenderPass())
+            {
+                MXC_ERROR("failed to create renderPass");
+                return false;
+            }
+            MXC_DEBUG("Created default renderPass");
 
-        // create framebuffers
-        if (!createPresentFramebuffers())
-        {
-            MXC_ERROR("failed to create present framebuffers!");
+            // create framebuffers
+            if (!createPresentFramebuffers())
+            {
+                MXC_ERROR("failed to create present framebuffers!");
+            }
+            MXC_DEBUG("creates present framebuffers");
         }
-        MXC_DEBUG("creates present framebuffers");
         
         m_prepared = true;
 
@@ -334,14 +370,22 @@ namespace mxc
         m_computePostPresentationCmdBuf.free(&m_ctx);
         vkDestroyFence(m_ctx.device.logical, m_computeFence, nullptr);
         
-        // TODO move elsewhere: Renderpass and framebuffers
-        MXC_DEBUG("Destroying Framebuffers and RenderPass...");
-        destroyPresentFramebuffers();
-        destroyRenderPass();
-
-        // Destroy Depth Images
-        MXC_DEBUG("Destroying Depth images");
-        destroyDepthImages();
+        if (m_ctx.headless)
+        {
+            MXC_DEBUG("Destroying offscreen images");
+            destroyOffscreenImages();
+        }
+        else
+        {
+            // TODO move elsewhere: Renderpass and framebuffers
+            MXC_DEBUG("Destroying Framebuffers and RenderPass...");
+            destroyPresentFramebuffers();
+            destroyRenderPass();
+
+            // Destroy Depth Images
+            MXC_DEBUG("Destroying Depth images");
+            destroyDepthImages();
+        }
 
         // Sync objects
         MXC_DEBUG("Destroying Vulkan Synchronization Primitives...");
@@ -353,8 +397,11 @@ namespace mxc
         m_ctx.computeCommandBuffer.free(&m_ctx);
 
         // Swapchain
-        MXC_DEBUG("Destroying the Swapchain...");
-        m_ctx.swapchain.destroy(&m_ctx);
+        if (!m_ctx.headless)
+        {
+            MXC_DEBUG("Destroying the Swapchain...");
+            m_ctx.swapchain.destroy(&m_ctx);
+        }
 
         MXC_DEBUG("Destroying Vulkan device...");
         m_ctx.device.destroy(&m_ctx);
@@ -538,6 +585,9 @@ namespace mxc
 
     [[nodiscard]] auto Renderer::submitCompute(bool present) -> RendererStatus
     {
+        if (m_ctx.headless)
+            return submitOffscreen();
+
         uint32_t i = m_ctx.currentFramebufferIndex;
         VkImage swapchainImage = m_ctx.swapchain.images[i].handle;
         mxc::CommandBuffer& cmdBuf2 = m_computePostPresentationCmdBuf;
@@ -592,6 +642,30 @@ namespace mxc
         }
     }
 
+    // headless counterpart of submitCompute: nothing to wait on nor to present, offscreen images stay in VK_IMAGE_LAYOUT_GENERAL
+    [[nodiscard]] auto Renderer::submitOffscreen() -> RendererStatus
+    {
+        auto commandBufferInfo = commandBufferSubmitInfo(m_ctx.computeCommandBuffer.handle);
+        VkSubmitInfo2 const submitInfo {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+            .pNext = nullptr,
+            .flags = 0,
+            .waitSemaphoreInfoCount = 0,
+            .pWaitSemaphoreInfos = nullptr,
+            .commandBufferInfoCount = 1,
+            .pCommandBufferInfos = &commandBufferInfo,
+            .signalSemaphoreInfoCount = 0,
+            .pSignalSemaphoreInfos = nullptr
+        };
+
+        VK_CHECK(vkResetFences(m_ctx.device.logical, 1, &m_computeFence));
+        VK_CHECK(vkQueueSubmit2(m_ctx.device.computeQueue, 1, &submitInfo, m_computeFence));
+        m_ctx.computeCommandBuffer.signalSubmit();
+
+        m_ctx.currentFramebufferIndex = (m_ctx.currentFramebufferIndex + 1) % m_ctx.outputImageCount();
+        return RendererStatus::OK;
+    }
+
     [[nodiscard]] auto Renderer::transitionAndPresentFrame(VkSemaphoreSubmitInfo const* pWaitSemaphoreInfo) -> RendererStatus
     {
         MXC_ASSERT(pWaitSemaphoreInfo, "pWaitSemaphoreInfo cannot be nullptr");
@@ -711,6 +785,40 @@ namespace mxc
         MXC_DEBUG("Vulkan depth images destroyed");
     }
 
+    auto Renderer::createOffscreenImages() -> bool
+    {
+        m_ctx.offscreenImages.reserve(OFFSCREEN_IMAGE_COUNT);
+        for (uint32_t i = 0; i != OFFSCREEN_IMAGE_COUNT; ++i)
+        {
+            // transfer source such that results can be read back to the host
+            Image image(
+                VK_IMAGE_TYPE_2D,
+                {.width = m_ctx.framebufferWidth, .height = m_ctx.framebufferHeight, .depth = 1},
+                m_ctx.offscreenFormat,
+                VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+            ImageView view(VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
+            VkImageLayout targetLayout = VK_IMAGE_LAYOUT_GENERAL;
+            if (!m_ctx.device.createImage(&m_ctx, VK_IMAGE_TILING_OPTIMAL, &image, &targetLayout, &view, CommandType::COMPUTE))
+                return false;
+            m_ctx.offscreenImages.push_back({image, view});
+            MXC_TRACE("created offscreen image %p and view %p", image.handle, view.handle);
+        }
+
+        MXC_DEBUG("Vulkan offscreen images %ux%u created", m_ctx.framebufferWidth, m_ctx.framebufferHeight);
+        return true;
+    }
+
+    auto Renderer::destroyOffscreenImages() -> void
+    {
+        for (uint32_t i = 0; i != m_ctx.offscreenImages.size(); ++i)
+        {   
+            m_ctx.device.destroyImageView(&m_ctx.offscreenImages[i].view);
+            m_ctx.device.destroyImage(&m_ctx.offscreenImages[i].image);
+        }
+        m_ctx.offscreenImages.clear();
+        MXC_DEBUG("Vulkan offscreen images destroyed");
+    }
+
     auto Renderer::resetComputeCommandBuffer() -> void
     {   
         m_ctx.computeCommandBuffer.reset();
@@ -767,6 +875,18 @@ namespace mxc
         vkDeviceWaitIdle(m_ctx.device.logical);
         MXC_DEBUG("Resizing the Renderer...");
 
+        if (m_ctx.headless)
+        {
+            m_ctx.framebufferWidth = newWidth; 
+            m_ctx.framebufferHeight = newHeight;
+            destroyOffscreenImages();
+            createOffscreenImages();
+            m_ctx.currentFramebufferIndex = 0;
+            MXC_DEBUG("Resized the offscreen images");
+            m_prepared = true;
+            return;
+        }
+
         // recreate swapchain
         MXC_DEBUG("Recreating the swapchain with extent %u x %u...", newWidth, newHeight);
         m_ctx.swapchain.create(&m_ctx, newWidth, newHeight);
@@ -815,7 +935,7 @@ namespace mxc
     
     auto Renderer::createSynchronizationPrimitives() -> bool
     {
-        m_ctx.syncObjs.reserve(m_ctx.swapchain.images.size());
+        m_ctx.syncObjs.reserve(m_ctx.outputImageCount());
 
         VkSemaphoreTypeCreateInfo const semaphoreTypeCI {
             .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
@@ -833,7 +953,7 @@ namespace mxc
             .pNext = nullptr,
             .flags = VK_FENCE_CREATE_SIGNALED_BIT
         };
-        for (uint8_t i = 0; i != m_ctx.swapchain.images.size(); ++i)
+        for (uint8_t i = 0; i != m_ctx.outputImageCount(); ++i)
         {
             VkSemaphore semaphore[2];
             VK_CHECK(vkCreateSemaphore(m_ctx.device.logical, &semaphoreCI, nullptr, &semaphore[0]));
@@ -869,7 +989,7 @@ namespace mxc
 
     auto createCommandBuffers(VulkanContext* ctx) -> void
     {
-        uint32_t const count = static_cast<uint32_t>(ctx->swapchain.images.size());
+        uint32_t const count = ctx->outputImageCount();
         ctx->commandBuffers.resize(count);
         CommandBuffer::allocateMany(ctx, CommandType::GRAPHICS, ctx->commandBuffers.data(), count);
         ctx->computeCommandBuffer.allocate(ctx, CommandType::COMPUTE);
@@ -976,7 +1096,7 @@ namespace mxc
 
     auto previousFrameIndex(VulkanContext const* ctx) -> uint32_t
     {
-        uint32_t swapchainImagesCount = static_cast<uint32_t>(ctx->swapchain.images.size());
+        uint32_t swapchainImagesCount = ctx->outputImageCount();
         return (ctx->currentFramebufferIndex + swapchainImagesCount - 1) % swapchainImagesCount;
     }
 } // namespace mxc
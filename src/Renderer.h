@@ -31,6 +31,10 @@ namespace mxc
         uint32_t windowWidth;
         uint32_t windowHeight;
 
+        // no surface nor swapchain: compute commands write into offscreen storage images of windowWidth x windowHeight and the
+        // platform fields below are ignored. Any device (including CPU implementations like lavapipe) can be selected
+        bool headless;
+
 #if defined(VK_USE_PLATFORM_WIN32_KHR)
         void* platformHandle; 
         void* platformWindow;
@@ -48,6 +52,7 @@ namespace mxc
     class Renderer
     {
         static uint32_t constexpr OUT_ATTACHMENT_COUNT = 2;
+        static uint32_t constexpr OFFSCREEN_IMAGE_COUNT = 1;
     public:
         auto init(RendererConfig const&) -> bool;
         auto cleanup() -> void;
@@ -55,6 +60,7 @@ namespace mxc
         // TODO cleanup
         auto getContextPointer() -> VulkanContext* { return &m_ctx; }
         auto getRenderPass() -> VkRenderPass { return m_ctx.renderPass; }
+        auto isHeadless() const -> bool { return m_ctx.headless; }
 
         template <typename F> requires std::is_invocable_r<VkResult, F, VkCommandBuffer>::value
         auto recordGraphicsCommands(F&& func) -> RendererStatus;
@@ -105,11 +111,15 @@ namespace mxc
         auto createPresentFramebuffers() -> bool;
         auto destroyPresentFramebuffers() -> void;
 
+        auto createOffscreenImages() -> bool;
+        auto destroyOffscreenImages() -> void;
+
         auto createSynchronizationPrimitives() -> bool;
         auto destroySynchronizationPrimitives() -> void;
 
         auto getFramebufferSizes() -> VkExtent2D;
 
+        auto submitOffscreen() -> RendererStatus;
         auto transitionAndPresentFrame(VkSemaphoreSubmitInfo const* pWaitSemaphoreInfo) -> RendererStatus;
         auto presentFrame(VkSemaphore waitSemaphore) -> RendererStatus;
     };
@@ -118,6 +128,7 @@ namespace mxc
     template <typename F> requires std::is_invocable_r<VkResult, F, VkCommandBuffer>::value
     auto Renderer::recordGraphicsCommands(F&& func) -> RendererStatus
     {
+        MXC_ASSERT(!m_ctx.headless, "graphics commands need a swapchain, not supported in headless mode");
         uint32_t i = m_ctx.currentFramebufferIndex;
         SwapchainStatus acquireImageStatus = m_ctx.swapchain.acquireNextImage(
             &m_ctx, 
@@ -189,17 +200,20 @@ namespace mxc
     {
         uint32_t i = m_ctx.currentFramebufferIndex;
         m_ctx.device.computeQueue = m_ctx.device.graphicsQueue;
-        SwapchainStatus acquireImageStatus = m_ctx.swapchain.acquireNextImage(&m_ctx, m_ctx.syncObjs[i].presentCompleteSemaphore, 
-                                                                              UINT32_MAX, VK_NULL_HANDLE, nullptr);
-        if (acquireImageStatus == SwapchainStatus::WINDOW_RESIZED)
+        if (!m_ctx.headless) // offscreen images are owned by the renderer, nothing to acquire
         {
-            MXC_WARN("Window Resizing BEFORE swapchain image acquisition");
-            onResize();
-            m_ctx.currentFramebufferIndex = m_ctx.swapchain.currentImageIndex;
-            return RendererStatus::WINDOW_RESIZED;
+            SwapchainStatus acquireImageStatus = m_ctx.swapchain.acquireNextImage(&m_ctx, m_ctx.syncObjs[i].presentCompleteSemaphore, 
+                                                                                  UINT32_MAX, VK_NULL_HANDLE, nullptr);
+            if (acquireImageStatus == SwapchainStatus::WINDOW_RESIZED)
+            {
+                MXC_WARN("Window Resizing BEFORE swapchain image acquisition");
+                onResize();
+                m_ctx.currentFramebufferIndex = m_ctx.swapchain.currentImageIndex;
+                return RendererStatus::WINDOW_RESIZED;
+            }
+            else if (acquireImageStatus == SwapchainStatus::FATAL)
+                return RendererStatus::FATAL;
         }
-        else if (acquireImageStatus == SwapchainStatus::FATAL)
-            return RendererStatus::FATAL;
 
         //switch(vkGetFenceStatus(m_ctx.device.logical, m_computeFence))
         //{
@@ -221,9 +235,11 @@ namespace mxc
         // MXC_ASSERT(m_ctx.computeCommandBuffers.size() == m_ctx.presentFramebuffers.size(), 
         // "assuming framebuffer number = graphics command buffer number");
         // begin command buffer
-        MXC_ASSERT(m_ctx.computeCommandBuffer.begin(), "failed to begin compute command buffer");
+        [[maybe_unused]] bool const begun = m_ctx.computeCommandBuffer.begin();
+        MXC_ASSERT(begun, "failed to begin compute command buffer");
         
-        VkResult res = func(m_ctx.computeCommandBuffer.handle, m_ctx.swapchain.images[i].handle, m_ctx.swapchain.images[i].view, i);
+        SwapchainImage const outputImage = m_ctx.outputImage(i);
+        VkResult res = func(m_ctx.computeCommandBuffer.handle, outputImage.handle, outputImage.view, i);
 
         MXC_WARN("before end");
         bool succ = m_ctx.computeCommandBuffer.end();
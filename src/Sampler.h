@@ -0,0 +1,90 @@
+#ifndef MXC_SAMPLER_H
+#define MXC_SAMPLER_H
+
+#include <vulkan/vulkan.h>
+#include "VulkanCommon.h"
+#include "Buffer.h"
+#include "Shader.h"
+#include "VulkanContext.inl"
+
+#include <cstdint>
+
+namespace mxc
+{
+	// how a path draws its numbers, SAMPLER_* in shaders/spectrumTest/sampler.comp
+	enum class SamplerType : uint32_t
+	{
+		RANDOM = 0, // counter based hash of src/Random.h
+		SOBOL = 1,  // Owen scrambled Sobol points, in the dimensions of the Sobol table, RANDOM past them
+		BLUE_NOISE = 2 // one Owen scrambled Sobol sequence for all pixels, shifted in each pixel by the blue noise ranks
+	};
+
+	static uint32_t constexpr SOBOL_DIMENSIONS = 128; // SOBOL_DIMENSIONS in sampler.comp
+	static uint32_t constexpr SOBOL_BITS = 32;
+
+	// SOBOL_BITS direction numbers for each of the SOBOL_DIMENSIONS dimensions, dimension major. The first dimension is the van der
+	// Corput sequence, the others come from the primitive polynomials and initial numbers of Joe and Kuo, Constructing Sobol
+	// sequences with better two-dimensional projections (2008)
+	auto sobolDirections(uint32_t* pOut) -> void;
+
+	static uint32_t constexpr BLUE_NOISE_SIZE = 64; // BLUE_NOISE_SIZE in sampler.comp, a power of 2
+
+	// Ranks of a BLUE_NOISE_SIZE x BLUE_NOISE_SIZE dither array which tiles the plane, row major, by the void and cluster method
+	// of Ulichney (1993): the pixels whose rank is under any threshold are spread as evenly as they can be. The pattern only
+	// depends on seed
+	auto blueNoiseRanks(uint32_t seed, uint32_t* pOut) -> void;
+
+	// Host side of sampler.comp, bit for bit
+
+	constexpr auto reverseBits(uint32_t x) -> uint32_t
+	{
+		x = (x << 16) | (x >> 16);
+		x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+		x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+		x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+		return ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+	}
+
+	// Owen scrambling of the bits of x, most significant first, from a hash in which every bit only depends on the bits below it
+	// (Laine and Karras 2011) applied to the reversed bits, with the constants of Burley, Practical Hash-based Owen Scrambling (2020)
+	constexpr auto nestedUniformScramble(uint32_t x, uint32_t seed) -> uint32_t
+	{
+		x = reverseBits(x);
+		x += seed;
+		x ^= x * 0x6c50b47cu;
+		x ^= x * 0xb82f1e52u;
+		x ^= x * 0xc7afe638u;
+		x ^= x * 0x8d22f6e6u;
+		return reverseBits(x);
+	}
+
+	// point index of a dimension of the Sobol sequence, as 32 bits of fraction
+	constexpr auto sobolSample(uint32_t const* pDirections, uint32_t index, uint32_t dimension) -> uint32_t
+	{
+		uint32_t x = 0;
+		for (uint32_t bit = 0; index != 0; index >>= 1, ++bit)
+			if (index & 1)
+				x ^= pDirections[SOBOL_BITS * dimension + bit];
+		return x;
+	}
+
+	// Device tables of the samplers, bound by the accumulation shader
+	class SamplerTables
+	{
+	public:
+		static uint32_t constexpr BINDING_COUNT = 2;
+
+	public:
+		auto create(VulkanContext* ctx) -> bool;
+		auto destroy(VulkanContext* ctx) -> void;
+
+		// writes BINDING_COUNT descriptors: Sobol directions, blue noise ranks
+		auto descriptors(DescriptorInfo* pOutInfos) const -> void;
+
+	private:
+		Buffer m_sobolDirections{SOBOL_DIMENSIONS * SOBOL_BITS * sizeof(uint32_t), BufferType_v::STORAGE};
+		Buffer m_blueNoiseRanks{BLUE_NOISE_SIZE * BLUE_NOISE_SIZE * sizeof(uint32_t), BufferType_v::STORAGE};
+	};
+}
+
+#endif // MXC_SAMPLER_H
@@ -0,0 +1,899 @@
+#include "Scene.h"
+#include "AliasTable.h"
+#include "Bvh.h"
+#include "Distribution2D.h"
+#include "ImageReader.h"
+#include "LightBvh.h"
+#include "WideBvh.h"
+#include "logging.h"
+
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <filesystem>
+#include <limits>
+#include <cmath>
+#include <numbers>
+
+namespace mxc
+{
+    auto Scene::addMaterial(Material const& material) -> uint32_t
+    {
+        uint32_t const index = materialCount();
+        m_materialAlbedos.insert(m_materialAlbedos.end(), {
+            material.albedo[0], material.albedo[1], material.albedo[2], std::bit_cast<float>(static_cast<uint32_t>(material.type))
+        });
+        m_materialEmissions.insert(m_materialEmissions.end(), { material.emission[0], material.emission[1], material.emission[2], 0.f });
+        return index;
+    }
+
+    auto Scene::addSphere(float const center[3], float radius, uint32_t materialIndex) -> uint32_t
+    {
+        MXC_ASSERT(materialIndex < materialCount(), "Scene: sphere using material %u, there are %u", materialIndex, materialCount());
+        uint32_t const index = sphereCount();
+        m_sphereGeometry.insert(m_sphereGeometry.end(), { center[0], center[1], center[2], radius });
+        m_sphereMaterials.push_back(materialIndex);
+
+        float const* emission = &m_materialEmissions[4 * materialIndex];
+        if (emission[0] > 0.f || emission[1] > 0.f || emission[2] > 0.f)
+            m_lights.push_back(index);
+        return index;
+    }
+
+    auto Scene::addTriangleMesh(float const* pPositions, uint32_t vertex_count, uint32_t const* pIndices,
+                                uint32_t const* pMaterialIndices, uint32_t triangle_count) -> uint32_t
+    {
+        uint32_t const firstVertex = vertexCount();
+        uint32_t const firstTriangle = triangleCount();
+        m_vertexPositions.insert(m_vertexPositions.end(), pPositions, pPositions + 3 * vertex_count);
+        m_triangleIndices.reserve(m_triangleIndices.size() + 3 * triangle_count);
+        for (uint32_t i = 0; i != 3 * triangle_count; ++i)
+        {
+            MXC_ASSERT(pIndices[i] < vertex_count, "Scene: triangle %u using vertex %u, there are %u", i / 3, pIndices[i], vertex_count);
+            m_triangleIndices.push_back(firstVertex + pIndices[i]);
+        }
+        for (uint32_t i = 0; i != triangle_count; ++i)
+            MXC_ASSERT(pMaterialIndices[i] < materialCount(), "Scene: triangle using material %u, there are %u", pMaterialIndices[i],
+                       materialCount());
+        m_triangleMaterials.insert(m_triangleMaterials.end(), pMaterialIndices, pMaterialIndices + triangle_count);
+        return firstTriangle;
+    }
+
+    auto Scene::addMesh(float const* pPositions, uint32_t vertex_count, uint32_t const* pIndices, uint32_t const* pMaterialIndices,
+                        uint32_t triangle_count) -> uint32_t
+    {
+        MXC_ASSERT(triangle_count != 0, "Scene: instanced meshes need at least one triangle");
+        uint32_t const index = meshCount();
+        uint32_t const firstVertex = meshVertexCount();
+        Mesh mesh{ .firstTriangle = meshTriangleCount(), .triangleCount = triangle_count, .boundsMin = {}, .boundsMax = {} };
+        for (uint32_t a = 0; a != 3; ++a)
+        {
+            mesh.boundsMin[a] = std::numeric_limits<float>::max();
+            mesh.boundsMax[a] = -std::numeric_limits<float>::max();
+        }
+
+        m_meshVertexPositions.insert(m_meshVertexPositions.end(), pPositions, pPositions + 3 * vertex_count);
+        m_meshTriangleIndices.reserve(m_meshTriangleIndices.size() + 3 * triangle_count);
+        for (uint32_t i = 0; i != 3 * triangle_count; ++i)
+        {
+            MXC_ASSERT(pIndices[i] < vertex_count, "Scene: triangle %u using vertex %u, there are %u", i / 3, pIndices[i], vertex_count);
+            m_meshTriangleIndices.push_back(firstVertex + pIndices[i]);
+            for (uint32_t a = 0; a != 3; ++a)
+            {
+                mesh.boundsMin[a] = std::min(mesh.boundsMin[a], pPositions[3 * pIndices[i] + a]);
+                mesh.boundsMax[a] = std::max(mesh.boundsMax[a], pPositions[3 * pIndices[i] + a]);
+            }
+        }
+        for (uint32_t i = 0; i != triangle_count; ++i)
+            MXC_ASSERT(pMaterialIndices[i] < materialCount(), "Scene: triangle using material %u, there are %u", pMaterialIndices[i],
+                       materialCount());
+        m_meshTriangleMaterials.insert(m_meshTriangleMaterials.end(), pMaterialIndices, pMaterialIndices + triangle_count);
+        m_meshes.push_back(mesh);
+        return index;
+    }
+
+    auto Scene::addInstance(uint32_t meshIndex, float const objectToWorld[12]) -> uint32_t
+    {
+        MXC_ASSERT(meshIndex < meshCount(), "Scene: instance of mesh %u, there are %u", meshIndex, meshCount());
+        uint32_t const index = instanceCount();
+        m_instanceMeshes.push_back(meshIndex);
+        m_instanceTransforms.resize(m_instanceTransforms.size() + 24);
+        m_instanceBounds.resize(m_instanceBounds.size() + 6);
+        setInstanceTransform(index, objectToWorld);
+        return index;
+    }
+
+    auto Scene::setInstanceTransform(uint32_t instanceIndex, float const objectToWorld[12]) -> void
+    {
+        MXC_ASSERT(instanceIndex < instanceCount(), "Scene: transform of instance %u, there are %u", instanceIndex, instanceCount());
+        float const* m = objectToWorld;
+
+        // inverse of the linear part from its adjugate, the translation is undone after it
+        float const adjugate[9] {
+            m[5] * m[10] - m[6] * m[9], m[2] * m[9] - m[1] * m[10], m[1] * m[6] - m[2] * m[5],
+            m[6] * m[8] - m[4] * m[10], m[0] * m[10] - m[2] * m[8], m[2] * m[4] - m[0] * m[6],
+            m[4] * m[9] - m[5] * m[8], m[1] * m[8] - m[0] * m[9], m[0] * m[5] - m[1] * m[4]
+        };
+        float const determinant = m[0] * adjugate[0] + m[1] * adjugate[3] + m[2] * adjugate[6];
+        MXC_ASSERT(determinant != 0.f, "Scene: instance transform isn't invertible");
+        float worldToObject[12];
+        for (uint32_t row = 0; row != 3; ++row)
+        {
+            for (uint32_t column = 0; column != 3; ++column)
+                worldToObject[4 * row + column] = adjugate[3 * row + column] / determinant;
+            worldToObject[4 * row + 3] = -(worldToObject[4 * row] * m[3] + worldToObject[4 * row + 1] * m[7]
+                                           + worldToObject[4 * row + 2] * m[11]);
+        }
+
+        // world bounds of the 8 transformed corners of the object bounds
+        Mesh const& mesh = m_meshes[m_instanceMeshes[instanceIndex]];
+        float bounds[6] {
+            std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+            -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max()
+        };
+        for (uint32_t corner = 0; corner != 8; ++corner)
+        {
+            float const p[3] {
+                corner & 1 ? mesh.boundsMax[0] : mesh.boundsMin[0],
+                corner & 2 ? mesh.boundsMax[1] : mesh.boundsMin[1],
+                corner & 4 ? mesh.boundsMax[2] : mesh.boundsMin[2]
+            };
+            for (uint32_t a = 0; a != 3; ++a)
+            {
+                float const world = m[4 * a] * p[0] + m[4 * a + 1] * p[1] + m[4 * a + 2] * p[2] + m[4 * a + 3];
+                bounds[a] = std::min(bounds[a], world);
+                bounds[3 + a] = std::max(bounds[3 + a], world);
+            }
+        }
+
+        std::copy_n(objectToWorld, 12, &m_instanceTransforms[24 * instanceIndex]);
+        std::copy_n(worldToObject, 12, &m_instanceTransforms[24 * instanceIndex + 12]);
+        std::copy_n(bounds, 6, &m_instanceBounds[6 * instanceIndex]);
+    }
+
+    auto Scene::clear() -> void
+    {
+        m_sphereGeometry.clear();
+        m_sphereMaterials.clear();
+        m_materialAlbedos.clear();
+        m_materialEmissions.clear();
+        m_lights.clear();
+        m_vertexPositions.clear();
+        m_triangleIndices.clear();
+        m_triangleMaterials.clear();
+        m_meshes.clear();
+        m_meshVertexPositions.clear();
+        m_meshTriangleIndices.clear();
+        m_meshTriangleMaterials.clear();
+        m_instanceMeshes.clear();
+        m_instanceTransforms.clear();
+        m_instanceBounds.clear();
+        m_camera = {};
+        m_environment = {};
+    }
+
+    auto Scene::releaseTriangles() -> void
+    {
+        std::vector<float>().swap(m_vertexPositions);
+        std::vector<uint32_t>().swap(m_triangleIndices);
+        std::vector<uint32_t>().swap(m_triangleMaterials);
+    }
+
+    auto loadEnvironment(char const* filename, float scale, Environment* pOut) -> bool
+    {
+        HdrImage image;
+        if (!readHdrImage(filename, &image))
+            return false;
+        for (float& value : image.pixels)
+            value *= scale;
+        pOut->radiance = std::move(image.pixels);
+        pOut->width = image.width;
+        pOut->height = image.height;
+        return true;
+    }
+
+    auto makeCornellBoxScene(Scene* pOutScene) -> void
+    {
+        pOutScene->clear();
+        uint32_t const red   = pOutScene->addMaterial({{0.63f, 0.065f, 0.05f}, {0, 0, 0}, MaterialType::DIFFUSE});
+        uint32_t const blue  = pOutScene->addMaterial({{0.25f, 0.25f, 0.75f}, {0, 0, 0}, MaterialType::DIFFUSE});
+        uint32_t const white = pOutScene->addMaterial({{0.75f, 0.75f, 0.75f}, {0, 0, 0}, MaterialType::DIFFUSE});
+        uint32_t const pink  = pOutScene->addMaterial({{0.4f, 0.2f, 0.2f}, {0, 0, 0}, MaterialType::DIFFUSE});
+        uint32_t const green = pOutScene->addMaterial({{0.14f, 0.45f, 0.091f}, {0, 0, 0}, MaterialType::DIFFUSE});
+        uint32_t const light = pOutScene->addMaterial({{0, 0, 0}, {8.f, 8.f, 8.f}, MaterialType::DIFFUSE});
+
+        // walls are huge spheres
+        struct { float center[3]; float radius; uint32_t material; } const spheres[] {
+            {{ 1e5f + 1, 0, 0},     1e5f, red},   // left
+            {{-1e5f - 1, 0, 0},     1e5f, blue},  // right
+            {{0, 0, -1e5f - 1},     1e5f, white}, // back
+            {{0, 0, 1e5f + 2.15f},  1e5f, white}, // front
+            {{0, -1e5f - 1, 0},     1e5f, white}, // bottom
+            {{0, 1e5f + 1, 0},      1e5f, white}, // top
+            {{-0.5f, 1 - 0.33f, 1.2f}, 0.33f, pink},
+            {{0.35f, 1 - 0.45f, 1.5f}, 0.45f, green},
+            {{0, -1.9f, 1.5f},      1.f,  light}
+        };
+        for (auto const& sphere : spheres)
+            pOutScene->addSphere(sphere.center, sphere.radius, sphere.material);
+    }
+
+    static auto findName(std::vector<std::string> const& names, char const* name) -> uint32_t
+    {
+        uint32_t index = 0;
+        while (index != names.size() && names[index] != name)
+            ++index;
+        return index;
+    }
+
+    auto readMeshFile(ThreadPool& pool, char const* filename, MeshAsset* pOut) -> bool
+    {
+        std::string extension = std::filesystem::path(filename).extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(tolower(c)); });
+        if (extension == ".ply")
+            return readPly(pool, filename, pOut);
+        return readObj(pool, filename, pOut);
+    }
+
+    auto addMeshAsset(MeshAsset& asset, uint32_t defaultMaterialIndex, Scene* pScene, uint32_t* pOutMeshIndex,
+                      std::vector<std::string>* pOutDependencies) -> bool
+    {
+        ParsedMesh& mesh = asset.mesh;
+        uint32_t const firstMaterial = pScene->materialCount();
+        for (Material const& material : asset.materials)
+            pScene->addMaterial(material);
+        for (uint32_t& material : mesh.materials)
+            material = material != ParsedMesh::NO_MATERIAL ? firstMaterial + material : defaultMaterialIndex;
+        if (pOutDependencies)
+            pOutDependencies->insert(pOutDependencies->end(), asset.dependencies.begin(), asset.dependencies.end());
+
+        uint32_t const vertex_count = mesh.vertexCount();
+        uint32_t const triangle_count = mesh.triangleCount();
+        if (pOutMeshIndex)
+        {
+            if (triangle_count == 0)
+            {
+                MXC_ERROR("%s has no faces to instance", asset.filename.c_str());
+                return false;
+            }
+            *pOutMeshIndex = pScene->addMesh(mesh.positions.data(), vertex_count, mesh.indices.data(), mesh.materials.data(), triangle_count);
+        }
+        else
+            pScene->addTriangleMesh(mesh.positions.data(), vertex_count, mesh.indices.data(), mesh.materials.data(), triangle_count);
+        MXC_INFO("loaded %s: %u vertices, %u triangles, %zu materials", asset.filename.c_str(), vertex_count, triangle_count,
+                 asset.materials.size());
+        return true;
+    }
+
+    auto hasJsonExtension(char const* filename) -> bool
+    {
+        std::string extension = std::filesystem::path(filename).extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(tolower(c)); });
+        return extension == ".json";
+    }
+
+    // readMeshFile then addMeshAsset
+    static auto loadMeshFile(ThreadPool& pool, char const* filename, uint32_t materialIndex, Scene* pScene, uint32_t* pOutMeshIndex,
+                             std::vector<std::string>* pOutDependencies) -> bool
+    {
+        MeshAsset asset;
+        return readMeshFile(pool, filename, &asset) && addMeshAsset(asset, materialIndex, pScene, pOutMeshIndex, pOutDependencies);
+    }
+
+    auto loadScene(ThreadPool& pool, char const* filename, Scene* pOutScene, std::vector<std::string>* pOutDependencies) -> bool
+    {
+        if (hasJsonExtension(filename))
+            return loadJsonScene(pool, filename, pOutScene, pOutDependencies);
+
+        FILE* file = fopen(filename, "r");
+        if (!file)
+        {
+            MXC_ERROR("couldn't open scene %s", filename);
+            return false;
+        }
+        if (pOutDependencies)
+            pOutDependencies->emplace_back(filename);
+
+        pOutScene->clear();
+        std::vector<std::string> materialNames;
+        std::vector<std::string> objectNames; // indexed by mesh
+        char line[512];
+        uint32_t lineNumber = 0;
+        bool ok = true;
+        while (ok && fgets(line, sizeof(line), file))
+        {
+            ++lineNumber;
+            if (char* comment = strchr(line, '#'))
+                *comment = '\0';
+
+            char keyword[16], name[64], type[16];
+            if (sscanf(line, "%15s", keyword) != 1)
+                continue; // blank line
+
+            if (strcmp(keyword, "material") == 0)
+            {
+                Material material{};
+                int consumed = 0;
+                if (sscanf(line, "%*s %63s %15s %f %f %f%n", name, type, &material.albedo[0], &material.albedo[1], &material.albedo[2],
+                           &consumed) != 5)
+                {
+                    MXC_ERROR("%s:%u: expected material <name> <type> <r> <g> <b>", filename, lineNumber);
+                    ok = false;
+                    break;
+                }
+                char emissionKeyword[16];
+                if (sscanf(line + consumed, "%15s %f %f %f", emissionKeyword, &material.emission[0], &material.emission[1],
+                           &material.emission[2]) == 4 && strcmp(emissionKeyword, "emission") != 0)
+                {
+                    MXC_ERROR("%s:%u: unexpected %s after the material albedo", filename, lineNumber, emissionKeyword);
+                    ok = false;
+                    break;
+                }
+
+                if (strcmp(type, "diffuse") == 0)         material.type = MaterialType::DIFFUSE;
+                else if (strcmp(type, "specular") == 0)   material.type = MaterialType::SPECULAR;
+                else if (strcmp(type, "refractive") == 0) material.type = MaterialType::REFRACTIVE;
+                else
+                {
+                    MXC_ERROR("%s:%u: unknown material type %s", filename, lineNumber, type);
+                    ok = false;
+                    break;
+                }
+
+                materialNames.emplace_back(name);
+                pOutScene->addMaterial(material);
+            }
+            else if (strcmp(keyword, "sphere") == 0)
+            {
+                float radius, center[3];
+                if (sscanf(line, "%*s %f %f %f %f %63s", &radius, &center[0], &center[1], &center[2], name) != 5)
+                {
+                    MXC_ERROR("%s:%u: expected sphere <radius> <x> <y> <z> <material>", filename, lineNumber);
+                    ok = false;
+                    break;
+                }
+
+                uint32_t const materialIndex = findName(materialNames, name);
+                if (materialIndex == materialNames.size())
+                {
+                    MXC_ERROR("%s:%u: material %s not declared", filename, lineNumber, name);
+                    ok = false;
+                    break;
+                }
+                pOutScene->addSphere(center, radius, materialIndex);
+            }
+            else if (strcmp(keyword, "mesh") == 0)
+            {
+                char meshFilename[256];
+                if (sscanf(line, "%*s %255s %63s", meshFilename, name) != 2)
+                {
+                    MXC_ERROR("%s:%u: expected mesh <obj or ply file> <material>", filename, lineNumber);
+                    ok = false;
+                    break;
+                }
+
+                uint32_t const materialIndex = findName(materialNames, name);
+                if (materialIndex == materialNames.size())
+                {
+                    MXC_ERROR("%s:%u: material %s not declared", filename, lineNumber, name);
+                    ok = false;
+                    break;
+                }
+
+                // materials of the mtl library are appended to the scene too, they can't be referenced by name, keep the indices aligned
+                uint32_t const materialCount = pOutScene->materialCount();
+                std::string const meshPath = (std::filesystem::path(filename).parent_path() / meshFilename).string();
+                ok = loadMeshFile(pool, meshPath.c_str(), materialIndex, pOutScene, nullptr, pOutDependencies);
+                for (uint32_t i = materialCount; i != pOutScene->materialCount(); ++i)
+                    materialNames.emplace_back();
+            }
+            else if (strcmp(keyword, "object") == 0)
+            {
+                char objectName[64], meshFilename[256];
+                if (sscanf(line, "%*s %63s %255s %63s", objectName, meshFilename, name) != 3)
+                {
+                    MXC_ERROR("%s:%u: expected object <name> <obj or ply file> <material>", filename, lineNumber);
+                    ok = false;
+                    break;
+                }
+
+                uint32_t const materialIndex = findName(materialNames, name);
+                if (materialIndex == materialNames.size())
+                {
+                    MXC_ERROR("%s:%u: material %s not declared", filename, lineNumber, name);
+                    ok = false;
+                    break;
+                }
+
+                uint32_t const materialCount = pOutScene->materialCount();
+                std::string const meshPath = (std::filesystem::path(filename).parent_path() / meshFilename).string();
+                uint32_t meshIndex = 0;
+                ok = loadMeshFile(pool, meshPath.c_str(), materialIndex, pOutScene, &meshIndex, pOutDependencies);
+                for (uint32_t i = materialCount; i != pOutScene->materialCount(); ++i)
+                    materialNames.emplace_back();
+                if (ok)
+                {
+                    objectNames.resize(meshIndex + 1);
+                    objectNames[meshIndex] = objectName;
+                }
+            }
+            else if (strcmp(keyword, "instance") == 0)
+            {
+                float objectToWorld[12];
+                if (sscanf(line, "%*s %63s %f %f %f %f %f %f %f %f %f %f %f %f", name, &objectToWorld[0], &objectToWorld[1],
+                           &objectToWorld[2], &objectToWorld[3], &objectToWorld[4], &objectToWorld[5], &objectToWorld[6],
+                           &objectToWorld[7], &objectToWorld[8], &objectToWorld[9], &objectToWorld[10], &objectToWorld[11]) != 13)
+                {
+                    MXC_ERROR("%s:%u: expected instance <object> <12 numbers of a row major 3x4 transform>", filename, lineNumber);
+                    ok = false;
+                    break;
+                }
+
+                uint32_t const meshIndex = findName(objectNames, name);
+                if (meshIndex == objectNames.size())
+                {
+                    MXC_ERROR("%s:%u: object %s not declared", filename, lineNumber, name);
+                    ok = false;
+                    break;
+                }
+                float const determinant =
+                    objectToWorld[0] * (objectToWorld[5] * objectToWorld[10] - objectToWorld[6] * objectToWorld[9])
+                    - objectToWorld[1] * (objectToWorld[4] * objectToWorld[10] - objectToWorld[6] * objectToWorld[8])
+                    + objectToWorld[2] * (objectToWorld[4] * objectToWorld[9] - objectToWorld[5] * objectToWorld[8]);
+                if (determinant == 0.f)
+                {
+                    MXC_ERROR("%s:%u: instance transform isn't invertible", filename, lineNumber);
+                    ok = false;
+                    break;
+                }
+                pOutScene->addInstance(meshIndex, objectToWorld);
+            }
+            else if (strcmp(keyword, "environment") == 0)
+            {
+                char imageFilename[256];
+                float scale = 1.f, rotation = 0.f, up[3] { 0.f, 1.f, 0.f };
+                int const read = sscanf(line, "%*s %255s %f %f %f %f %f", imageFilename, &scale, &rotation, &up[0], &up[1], &up[2]);
+                if (read < 1 || read == 4 || read == 5 || (up[0] == 0.f && up[1] == 0.f && up[2] == 0.f))
+                {
+                    MXC_ERROR("%s:%u: expected environment <hdr or pfm file> [<scale> [<rotation> [<up x> <up y> <up z>]]]", filename,
+                              lineNumber);
+                    ok = false;
+                    break;
+                }
+
+                std::string const imagePath = (std::filesystem::path(filename).parent_path() / imageFilename).string();
+                Environment environment;
+                ok = loadEnvironment(imagePath.c_str(), scale, &environment);
+                if (ok)
+                {
+                    std::copy_n(up, 3, environment.up);
+                    environment.rotation = rotation;
+                    pOutScene->setEnvironment(std::move(environment));
+                    if (pOutDependencies)
+                        pOutDependencies->push_back(imagePath);
+                }
+            }
+            else
+            {
+                MXC_ERROR("%s:%u: unknown entity %s", filename, lineNumber, keyword);
+                ok = false;
+            }
+        }
+        fclose(file);
+
+        if (ok)
+            MXC_INFO("loaded scene %s: %u spheres, %u triangles, %u instances of %u meshes, %u materials, %u lights", filename,
+                     pOutScene->sphereCount(), pOutScene->triangleCount(), pOutScene->instanceCount(), pOutScene->meshCount(),
+                     pOutScene->materialCount(), pOutScene->lightCount());
+        return ok;
+    }
+
+    // 128 bytes, Instance in shaders/spectrumTest/bvh.comp
+    struct DeviceInstance
+    {
+        float objectToWorld[12];
+        float worldToObject[12];
+        float boundsMin[3];
+        uint32_t blasRoot;
+        float boundsMax[3];
+        uint32_t pad;
+    };
+    static_assert(sizeof(DeviceInstance) == 128);
+
+    // 64 bytes, Camera in shaders/spectrumTest/spectrumTest.comp. The primary ray of the film point xy in [-aspect, aspect]x[-1, 1]
+    // is forward + tanHalfFov * (x * right + y * down)
+    struct DeviceCamera
+    {
+        float position[3];
+        float tanHalfFov;
+        float forward[4];
+        float right[4];
+        float down[4];
+    };
+    static_assert(sizeof(DeviceCamera) == 64);
+
+    // 48 bytes, TriangleLight in shaders/spectrumTest/lightBvh.comp: an emissive world triangle, and its bin of the alias table
+    // over the power of all of them
+    struct DeviceTriangleLight
+    {
+        float p0[3];
+        uint32_t material;
+        float p1[3];
+        float q;
+        float p2[3];
+        uint32_t alias;
+    };
+    static_assert(sizeof(DeviceTriangleLight) == 48);
+
+    // 48 bytes, Environment in shaders/spectrumTest/environment.comp: the frame of the map, z along its up direction, x where its
+    // columns start
+    struct DeviceEnvironment
+    {
+        float x[3];
+        uint32_t width;
+        float y[3];
+        uint32_t height;
+        float z[3];
+        uint32_t pad;
+    };
+    static_assert(sizeof(DeviceEnvironment) == 48);
+
+    static auto normalize3(float v[3]) -> void
+    {
+        float const length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        for (uint32_t a = 0; a != 3; ++a)
+            v[a] /= length;
+    }
+
+    static auto cross3(float const a[3], float const b[3], float out[3]) -> void
+    {
+        out[0] = a[1] * b[2] - a[2] * b[1];
+        out[1] = a[2] * b[0] - a[0] * b[2];
+        out[2] = a[0] * b[1] - a[1] * b[0];
+    }
+
+    // storage for count elements of a stream gathered in pContents
+    template<typename T>
+    static auto allocateStream(SceneBuffers::Contents* pContents, uint32_t binding, size_t count) -> T*
+    {
+        pContents->storage[binding].resize(count * sizeof(T));
+        pContents->pData[binding] = pContents->storage[binding].data();
+        pContents->sizes[binding] = count * sizeof(T);
+        return reinterpret_cast<T*>(pContents->storage[binding].data());
+    }
+
+    static auto viewStream(SceneBuffers::Contents* pContents, uint32_t binding, void const* data, VkDeviceSize size) -> void
+    {
+        pContents->storage[binding].clear();
+        pContents->pData[binding] = data;
+        pContents->sizes[binding] = size;
+    }
+
+    auto SceneBuffers::gather(Scene const& scene, MeshBvhs const& meshBvhs, Bvh const* pBvh, WideBvh const* pWideBvh, Contents* pOut,
+                              bool pagedTriangles) -> void
+    {
+        gatherStreams(scene, pagedTriangles, pOut);
+        gatherBvh(scene, meshBvhs, pBvh, pWideBvh, pOut);
+    }
+
+    auto SceneBuffers::gatherStreams(Scene const& scene, bool pagedTriangles, Contents* pOut) -> void
+    {
+        pOut->sphereCount = scene.sphereCount();
+        pOut->lightCount = scene.lightCount();
+        pOut->triangleCount = scene.triangleCount();
+        VkDeviceSize const float4Size = 4 * sizeof(float);
+        viewStream(pOut, 0, scene.sphereGeometry(), scene.sphereCount() * float4Size);
+        viewStream(pOut, 1, scene.sphereMaterials(), scene.sphereCount() * sizeof(uint32_t));
+        viewStream(pOut, 2, scene.materialAlbedos(), scene.materialCount() * float4Size);
+        viewStream(pOut, 3, scene.materialEmissions(), scene.materialCount() * float4Size);
+        viewStream(pOut, 4, scene.lights(), scene.lightCount() * sizeof(uint32_t));
+
+        // instanced meshes are appended to the triangle streams, leaves of their BVHs refer to triangles of the appended streams.
+        // Paged world triangles aren't in the streams, which start with the instanced meshes at firstStreamTriangle
+        uint32_t const worldVertex_count = pagedTriangles ? 0 : scene.vertexCount();
+        uint32_t const worldTriangle_count = pagedTriangles ? 0 : scene.triangleCount();
+        pOut->firstStreamTriangle = scene.triangleCount() - worldTriangle_count;
+        uint32_t const vertex_count = worldVertex_count + scene.meshVertexCount();
+        uint32_t const triangle_count = worldTriangle_count + scene.meshTriangleCount();
+        float* pPositions = allocateStream<float>(pOut, 5, 3 * static_cast<size_t>(vertex_count));
+        std::copy_n(scene.vertexPositions(), 3 * worldVertex_count, pPositions);
+        std::copy_n(scene.meshVertexPositions(), 3 * scene.meshVertexCount(), pPositions + 3 * worldVertex_count);
+        uint32_t* pIndices = allocateStream<uint32_t>(pOut, 6, 3 * static_cast<size_t>(triangle_count));
+        std::copy_n(scene.triangleIndices(), 3 * worldTriangle_count, pIndices);
+        for (uint32_t i = 0; i != 3 * scene.meshTriangleCount(); ++i)
+            pIndices[3 * worldTriangle_count + i] = worldVertex_count + scene.meshTriangleIndices()[i];
+        uint32_t* pMaterials = allocateStream<uint32_t>(pOut, 7, triangle_count);
+        std::copy_n(scene.triangleMaterials(), worldTriangle_count, pMaterials);
+        std::copy_n(scene.meshTriangleMaterials(), scene.meshTriangleCount(), pMaterials + worldTriangle_count);
+
+        Camera const& camera = scene.camera();
+        DeviceCamera* pCamera = allocateStream<DeviceCamera>(pOut, CAMERA_BINDING, 1);
+        *pCamera = {};
+        std::copy_n(camera.position, 3, pCamera->position);
+        pCamera->tanHalfFov = std::tan(camera.verticalFov * std::numbers::pi_v<float> / 360.f);
+        for (uint32_t a = 0; a != 3; ++a)
+            pCamera->forward[a] = camera.lookAt[a] - camera.position[a];
+        normalize3(pCamera->forward);
+        cross3(pCamera->forward, camera.up, pCamera->right);
+        normalize3(pCamera->right);
+        cross3(pCamera->forward, pCamera->right, pCamera->down);
+
+        gatherLights(scene, pOut);
+        gatherEnvironment(scene.environment(), pOut);
+    }
+
+    auto SceneBuffers::gatherLights(Scene const& scene, Contents* pOut) -> void
+    {
+        // Emissive triangles, kept out of the paged streams such that a light sample never misses, those of instanced meshes once
+        // per instance in world space. They are a single light of the light BVH, within which the alias table picks one in
+        // proportion of its power
+        std::vector<DeviceTriangleLight> triangleLights;
+        std::vector<float> trianglePowers;
+        LightBounds triangleBounds {};
+        auto const addTriangleLight = [&](float const p0[3], float const p1[3], float const p2[3], uint32_t material)
+        {
+            LightBounds const bounds = triangleLightBounds(p0, p1, p2, scene.materialEmissions() + 4 * material);
+            if (bounds.phi == 0.f)
+                return;
+            DeviceTriangleLight& light = triangleLights.emplace_back();
+            std::copy_n(p0, 3, light.p0);
+            std::copy_n(p1, 3, light.p1);
+            std::copy_n(p2, 3, light.p2);
+            light.material = material;
+            trianglePowers.push_back(bounds.phi);
+            triangleBounds = unionLightBounds(triangleBounds, bounds);
+        };
+        for (uint32_t i = 0; i != scene.triangleCount(); ++i)
+        {
+            uint32_t const* v = scene.triangleIndices() + 3 * i;
+            addTriangleLight(scene.vertexPositions() + 3 * v[0], scene.vertexPositions() + 3 * v[1], scene.vertexPositions() + 3 * v[2],
+                             scene.triangleMaterials()[i]);
+        }
+        for (uint32_t i = 0; i != scene.instanceCount(); ++i)
+        {
+            Mesh const& mesh = scene.meshes()[scene.instanceMeshes()[i]];
+            float const* m = scene.instanceTransforms() + 24 * i;
+            for (uint32_t t = mesh.firstTriangle; t != mesh.firstTriangle + mesh.triangleCount; ++t)
+            {
+                uint32_t const material = scene.meshTriangleMaterials()[t];
+                float const* emission = scene.materialEmissions() + 4 * material;
+                if (emission[0] == 0.f && emission[1] == 0.f && emission[2] == 0.f)
+                    continue;
+                float p[3][3];
+                for (uint32_t v = 0; v != 3; ++v)
+                {
+                    float const* o = scene.meshVertexPositions() + 3 * scene.meshTriangleIndices()[3 * t + v];
+                    for (uint32_t r = 0; r != 3; ++r)
+                        p[v][r] = m[4 * r] * o[0] + m[4 * r + 1] * o[1] + m[4 * r + 2] * o[2] + m[4 * r + 3];
+                }
+                addTriangleLight(p[0], p[1], p[2], material);
+            }
+        }
+        uint32_t const triangleLight_count = static_cast<uint32_t>(triangleLights.size());
+        std::vector<AliasBin> aliasTable(triangleLight_count);
+        buildAliasTable(trianglePowers.data(), triangleLight_count, aliasTable.data());
+        DeviceTriangleLight* pTriangleLights = allocateStream<DeviceTriangleLight>(pOut, LIGHT_BVH_BINDING + 2, triangleLight_count);
+        for (uint32_t i = 0; i != triangleLight_count; ++i)
+        {
+            pTriangleLights[i] = triangleLights[i];
+            pTriangleLights[i].q = aliasTable[i].q;
+            pTriangleLights[i].alias = aliasTable[i].alias;
+        }
+
+        // the light BVH refers to lights by their index in the lights stream, the emissive triangles come last. A sphere or a
+        // triangle hit by a BSDF sample finds its leaf
+        std::vector<LightBounds> lightBounds(scene.lightCount() + 1);
+        for (uint32_t i = 0; i != scene.lightCount(); ++i)
+        {
+            uint32_t const sphere = scene.lights()[i];
+            float const* geometry = scene.sphereGeometry() + 4 * sphere;
+            float const* emission = scene.materialEmissions() + 4 * scene.sphereMaterials()[sphere];
+            lightBounds[i] = sphereLightBounds(geometry, geometry[3], emission);
+        }
+        lightBounds[scene.lightCount()] = triangleBounds;
+        LightBvh lightBvh;
+        lightBvh.build(lightBounds.data(), scene.lightCount() + (triangleLight_count != 0 ? 1 : 0));
+        LightBvhNode* pLightNodes = allocateStream<LightBvhNode>(pOut, LIGHT_BVH_BINDING, lightBvh.nodeCount());
+        std::copy_n(lightBvh.nodes(), lightBvh.nodeCount(), pLightNodes);
+        uint32_t* pLeaves = allocateStream<uint32_t>(pOut, LIGHT_BVH_BINDING + 1, scene.sphereCount() + 1);
+        std::fill_n(pLeaves, scene.sphereCount() + 1, LIGHT_BVH_NONE);
+        for (uint32_t i = 0; i != scene.lightCount(); ++i)
+            pLeaves[scene.lights()[i]] = lightBvh.leaves()[i];
+        if (triangleLight_count != 0)
+            pLeaves[scene.sphereCount()] = lightBvh.leaves()[scene.lightCount()];
+    }
+
+    auto SceneBuffers::gatherEnvironment(Environment const& environment, Contents* pOut) -> void
+    {
+        // no element at all when there is no environment, as the shaders tell
+        uint32_t const width = environment.width;
+        uint32_t const height = environment.height;
+        DeviceEnvironment* pEnvironment = allocateStream<DeviceEnvironment>(pOut, ENVIRONMENT_BINDING, width != 0 ? 1 : 0);
+        size_t const texel_count = static_cast<size_t>(width) * height;
+        float* pTexels = allocateStream<float>(pOut, ENVIRONMENT_BINDING + 1, 4 * texel_count);
+        float* pCdfs = allocateStream<float>(pOut, ENVIRONMENT_BINDING + 2, distribution2DSize(width, height));
+        if (width == 0)
+            return;
+
+        DeviceEnvironment& device = *pEnvironment;
+        device = {};
+        device.width = width;
+        device.height = height;
+        std::copy_n(environment.up, 3, device.z);
+        normalize3(device.z);
+        float const reference[3] { std::abs(device.z[0]) < 0.9f ? 1.f : 0.f, 0.f, std::abs(device.z[0]) < 0.9f ? 0.f : 1.f };
+        float const along = reference[0] * device.z[0] + reference[2] * device.z[2];
+        float x[3], y[3];
+        for (uint32_t a = 0; a != 3; ++a)
+            x[a] = reference[a] - along * device.z[a];
+        normalize3(x);
+        cross3(device.z, x, y);
+        float const rotation = environment.rotation * std::numbers::pi_v<float> / 180.f;
+        for (uint32_t a = 0; a != 3; ++a)
+        {
+            device.x[a] = std::cos(rotation) * x[a] + std::sin(rotation) * y[a];
+            device.y[a] = std::cos(rotation) * y[a] - std::sin(rotation) * x[a];
+        }
+
+        // texels are drawn in proportion of their average radiance times the area they cover on the sphere of directions
+        std::vector<float> function(texel_count);
+        for (uint32_t row = 0; row != height; ++row)
+        {
+            float const sinTheta = std::sin(std::numbers::pi_v<float> * (row + 0.5f) / height);
+            for (uint32_t column = 0; column != width; ++column)
+            {
+                float const* rgb = environment.radiance.data() + 3 * (static_cast<size_t>(row) * width + column);
+                function[static_cast<size_t>(row) * width + column] = std::max(0.f, (rgb[0] + rgb[1] + rgb[2]) / 3.f) * sinTheta;
+            }
+        }
+        float integral = 0.f;
+        buildDistribution2D(function.data(), width, height, pCdfs, &integral);
+        for (size_t i = 0; i != texel_count; ++i)
+        {
+            std::copy_n(environment.radiance.data() + 3 * i, 3, pTexels + 4 * i);
+            pTexels[4 * i + 3] = integral > 0.f ? function[i] / integral : 1.f;
+        }
+    }
+
+    auto SceneBuffers::gatherBvh(Scene const& scene, MeshBvhs const& meshBvhs, Bvh const* pBvh, WideBvh const* pWideBvh, Contents* pOut)
+        -> void
+    {
+        uint32_t const primitive_count = scene.sphereCount() + scene.triangleCount() + scene.instanceCount();
+        MXC_ASSERT(!pBvh || pBvh->primitiveCount() == primitive_count, "SceneBuffers: BVH built over %u primitives, the scene has %u",
+                   pBvh ? pBvh->primitiveCount() : 0, primitive_count);
+        MXC_ASSERT(pBvh || !pWideBvh, "SceneBuffers: a wide BVH is collapsed from a host BVH");
+        MXC_ASSERT(meshBvhs.primitiveCount() == scene.meshTriangleCount(), "SceneBuffers: mesh BVHs built over %u triangles, the scene has %u",
+                   meshBvhs.primitiveCount(), scene.meshTriangleCount());
+        pOut->instanceCount = scene.instanceCount();
+        pOut->wideBvh = pWideBvh != nullptr;
+
+        // a binary tree of single primitive leaves, as built by LbvhBuilder, has 2n - 1 nodes
+        uint32_t topNode_count = 0;
+        if (pBvh && !pOut->wideBvh)
+            topNode_count = pBvh->nodeCount();
+        else if (!pBvh && primitive_count != 0)
+            topNode_count = 2 * primitive_count - 1;
+        uint32_t const* pPrimitiveIndices = pOut->wideBvh ? pWideBvh->primitiveIndices() : pBvh ? pBvh->primitiveIndices() : nullptr;
+
+        // BVHs of instanced meshes follow the top level one, which LbvhBuilder writes in place
+        BvhNode* pNodes = allocateStream<BvhNode>(pOut, 8, topNode_count + meshBvhs.nodeCount());
+        if (pBvh && !pOut->wideBvh)
+            std::copy_n(pBvh->nodes(), topNode_count, pNodes);
+        for (uint32_t i = 0; i != meshBvhs.nodeCount(); ++i)
+        {
+            BvhNode node = meshBvhs.nodes()[i];
+            node.offset += (node.info & 0xffff) != 0 ? primitive_count : topNode_count;
+            pNodes[topNode_count + i] = node;
+        }
+        uint32_t* pIndices = allocateStream<uint32_t>(pOut, 9, primitive_count + meshBvhs.primitiveCount());
+        if (pPrimitiveIndices)
+            std::copy_n(pPrimitiveIndices, primitive_count, pIndices);
+        for (uint32_t i = 0; i != meshBvhs.primitiveCount(); ++i)
+            pIndices[primitive_count + i] = scene.triangleCount() + meshBvhs.primitiveIndices()[i];
+
+        // the top level of a BVH written on the device isn't uploaded, unless bottom levels follow it
+        if (!pBvh && meshBvhs.nodeCount() == 0)
+            pOut->pData[8] = pOut->pData[9] = nullptr;
+        if (pOut->wideBvh)
+            viewStream(pOut, 10, pWideBvh->nodes(), pWideBvh->nodeCount() * sizeof(WideBvhNode));
+        else
+            viewStream(pOut, 10, nullptr, 0);
+
+        DeviceInstance* pInstances = allocateStream<DeviceInstance>(pOut, 11, scene.instanceCount());
+        for (uint32_t i = 0; i != scene.instanceCount(); ++i)
+        {
+            float const* transforms = scene.instanceTransforms() + 24 * i;
+            float const* bounds = scene.instanceBounds() + 6 * i;
+            DeviceInstance& instance = pInstances[i];
+            std::copy_n(transforms, 12, instance.objectToWorld);
+            std::copy_n(transforms + 12, 12, instance.worldToObject);
+            std::copy_n(bounds, 3, instance.boundsMin);
+            std::copy_n(bounds + 3, 3, instance.boundsMax);
+            instance.blasRoot = topNode_count + meshBvhs.root(scene.instanceMeshes()[i]);
+            instance.pad = 0;
+        }
+    }
+
+    auto SceneBuffers::create(VulkanContext* ctx, Contents const& contents) -> bool
+    {
+        m_sphereCount = contents.sphereCount;
+        m_lightCount = contents.lightCount;
+        m_triangleCount = contents.triangleCount;
+        m_firstStreamTriangle = contents.firstStreamTriangle;
+        m_instanceCount = contents.instanceCount;
+        m_wideBvh = contents.wideBvh;
+        for (uint32_t i = 0; i != BINDING_COUNT; ++i)
+            if (!upload(ctx, contents.pData[i], contents.sizes[i], &m_buffers[i]))
+                return false;
+        return true;
+    }
+
+    auto SceneBuffers::create(VulkanContext* ctx, Scene const& scene, MeshBvhs const& meshBvhs, Bvh const* pBvh, WideBvh const* pWideBvh)
+        -> bool
+    {
+        Contents contents;
+        gather(scene, meshBvhs, pBvh, pWideBvh, &contents);
+        return create(ctx, contents);
+    }
+
+    auto SceneBuffers::update(VulkanContext* ctx, Scene const& scene, MeshBvhs const& meshBvhs, Bvh const* pBvh, WideBvh const* pWideBvh)
+        -> bool
+    {
+        Contents contents;
+        gatherBvh(scene, meshBvhs, pBvh, pWideBvh, &contents);
+        m_instanceCount = contents.instanceCount;
+        m_wideBvh = contents.wideBvh;
+        // the emissive triangles of instanced meshes moved with their instances, the light BVH over them too
+        if (scene.instanceCount() != 0)
+            gatherLights(scene, &contents);
+        uint32_t const last = scene.instanceCount() != 0 ? LIGHT_BVH_BINDING + 3 : CAMERA_BINDING;
+        for (uint32_t i = BVH_FIRST_BINDING; i != last; ++i)
+        {
+            if (i == CAMERA_BINDING)
+                continue;
+            if (m_buffers[i].handle != VK_NULL_HANDLE)
+                ctx->device.destroyBuffer(&m_buffers[i]);
+            m_buffers[i] = Buffer(0, BufferType_v::STORAGE);
+            if (!upload(ctx, contents.pData[i], contents.sizes[i], &m_buffers[i]))
+                return false;
+        }
+        return true;
+    }
+
+    auto SceneBuffers::destroy(VulkanContext* ctx) -> void
+    {
+        for (Buffer& buffer : m_buffers)
+            if (buffer.handle != VK_NULL_HANDLE)
+                ctx->device.destroyBuffer(&buffer);
+    }
+
+    auto SceneBuffers::descriptors(DescriptorInfo* pOutInfos) const -> void
+    {
+        for (uint32_t i = 0; i != BINDING_COUNT; ++i)
+            pOutInfos[i].buffer = { .buffer = m_buffers[i].handle, .offset = 0, .range = VK_WHOLE_SIZE };
+    }
+
+    auto SceneBuffers::upload(VulkanContext* ctx, void const* data, VkDeviceSize size, Buffer* pBuffer) -> bool
+    {
+        // empty streams still need a valid buffer to bind, streams without data are written on the device
+        VkDeviceSize const bufferSize = size != 0 ? size : 4 * sizeof(float);
+        *pBuffer = Buffer(bufferSize, BufferType_v::STORAGE);
+        if (!ctx->device.createBuffer(pBuffer))
+        {
+            MXC_ERROR("SceneBuffers: couldn't create a storage buffer of %zu bytes", static_cast<size_t>(bufferSize));
+            return false;
+        }
+        if (size == 0 || !data)
+            return true;
+
+        Buffer staging{size, BufferType_v::STAGING};
+        ctx->device.createBuffer(&staging, BufferMemoryOptions::SYSTEM_MEMORY);
+        ctx->device.copyToBuffer(data, size, &staging);
+        bool const copied = ctx->device.copyBuffer(ctx, &staging, pBuffer);
+        ctx->device.destroyBuffer(&staging);
+        return copied;
+    }
+}
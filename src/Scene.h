@@ -0,0 +1,307 @@
+#ifndef MXC_SCENE_H
+#define MXC_SCENE_H
+
+#include <vulkan/vulkan.h>
+#include "VulkanCommon.h"
+#include "Buffer.h"
+#include "Shader.h"
+#include "VulkanContext.inl"
+#include "MeshParser.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mxc
+{
+	enum class MaterialType : uint32_t
+	{
+		DIFFUSE = 0, SPECULAR = 1, REFRACTIVE = 2 // Refl_t in shaders/spectrumTest/shapes.comp
+	};
+
+	struct Material
+	{
+		float albedo[3];
+		float emission[3]; // non zero makes every sphere and triangle using it a light, instanced ones once per instance
+		MaterialType type;
+	};
+
+	// Pinhole camera, the vertical extent of the film spans verticalFov. The default one is the camera spectrumTest.comp had
+	// hardcoded, whose pixel rows go along +y
+	struct Camera
+	{
+		float position[3] { 0.f, 0.f, 0.f };
+		float lookAt[3] { 0.f, 0.f, 1.f };
+		float up[3] { 0.f, -1.f, 0.f };
+		float verticalFov = 90.f; // degrees
+	};
+
+	// Equirectangular map of the radiance coming from infinitely far, which the rays leaving the scene see. Rows go from the up
+	// direction down to its opposite, columns turn around up from the world x axis, or z when up is x, projected on the horizon
+	// and turned by rotation, towards up cross that axis
+	struct Environment
+	{
+		std::vector<float> radiance; // RGB, width x height, top row first
+		uint32_t width = 0;          // 0 = no environment
+		uint32_t height = 0;
+		float up[3] { 0.f, 1.f, 0.f };
+		float rotation = 0.f;        // degrees around up
+	};
+
+	// reads the radiance of an environment from a .hdr or .pfm file, scaled, see readHdrImage in src/ImageReader.h
+	auto loadEnvironment(char const* filename, float scale, Environment* pOut) -> bool;
+
+	// object space triangles [firstTriangle, firstTriangle + triangleCount) of the mesh streams of a Scene, placed by instances
+	struct Mesh
+	{
+		uint32_t firstTriangle;
+		uint32_t triangleCount;
+		float boundsMin[3];
+		float boundsMax[3];
+	};
+
+	// Host side scene description, kept as the structure of arrays uploaded by SceneBuffers, one stream per attribute, such that
+	// the intersection loop on the GPU only touches the geometry stream, read with consecutive threads on consecutive elements
+	class Scene
+	{
+	public:
+		auto addMaterial(Material const& material) -> uint32_t;
+		// spheres with an emissive material are appended to the lights too
+		auto addSphere(float const center[3], float radius, uint32_t materialIndex) -> uint32_t;
+		// indices are relative to the first of the given vertices, one material per triangle. Returns the index of the first triangle
+		auto addTriangleMesh(float const* pPositions, uint32_t vertex_count, uint32_t const* pIndices, uint32_t const* pMaterialIndices,
+		                     uint32_t triangle_count) -> uint32_t;
+		// same as addTriangleMesh, but the triangles are in object space and only rendered through instances. Returns the mesh index
+		auto addMesh(float const* pPositions, uint32_t vertex_count, uint32_t const* pIndices, uint32_t const* pMaterialIndices,
+		             uint32_t triangle_count) -> uint32_t;
+		// objectToWorld is a row major 3x4 affine transform, which has to be invertible. Memory doesn't grow with the mesh size
+		auto addInstance(uint32_t meshIndex, float const objectToWorld[12]) -> uint32_t;
+		// moves an instance, its world bounds follow. The BVH over the scene has to be refit or rebuilt
+		auto setInstanceTransform(uint32_t instanceIndex, float const objectToWorld[12]) -> void;
+		auto setCamera(Camera const& camera) -> void { m_camera = camera; }
+		auto setEnvironment(Environment environment) -> void { m_environment = std::move(environment); }
+		auto clear() -> void;
+		// frees the world triangles and their vertices, once the device or a GeometryPager holds a copy. triangleCount reads 0 after
+		auto releaseTriangles() -> void;
+
+		auto sphereCount() const -> uint32_t { return static_cast<uint32_t>(m_sphereMaterials.size()); }
+		auto materialCount() const -> uint32_t { return static_cast<uint32_t>(m_materialEmissions.size() / 4); }
+		auto lightCount() const -> uint32_t { return static_cast<uint32_t>(m_lights.size()); }
+		auto vertexCount() const -> uint32_t { return static_cast<uint32_t>(m_vertexPositions.size() / 3); }
+		auto triangleCount() const -> uint32_t { return static_cast<uint32_t>(m_triangleMaterials.size()); }
+
+		auto sphereGeometry() const -> float const* { return m_sphereGeometry.data(); }         // float4, xyz center, w radius
+		auto sphereMaterials() const -> uint32_t const* { return m_sphereMaterials.data(); }    // material index
+		auto materialAlbedos() const -> float const* { return m_materialAlbedos.data(); }       // float4, xyz albedo, w type bits
+		auto materialEmissions() const -> float const* { return m_materialEmissions.data(); }   // float4, xyz emission
+		auto lights() const -> uint32_t const* { return m_lights.data(); }                      // sphere index
+		auto vertexPositions() const -> float const* { return m_vertexPositions.data(); }       // packed float3
+		auto triangleIndices() const -> uint32_t const* { return m_triangleIndices.data(); }    // packed uint3, vertex indices
+		auto triangleMaterials() const -> uint32_t const* { return m_triangleMaterials.data(); }// material index
+
+		auto meshCount() const -> uint32_t { return static_cast<uint32_t>(m_meshes.size()); }
+		auto meshVertexCount() const -> uint32_t { return static_cast<uint32_t>(m_meshVertexPositions.size() / 3); }
+		auto meshTriangleCount() const -> uint32_t { return static_cast<uint32_t>(m_meshTriangleMaterials.size()); }
+		auto instanceCount() const -> uint32_t { return static_cast<uint32_t>(m_instanceMeshes.size()); }
+
+		auto meshes() const -> Mesh const* { return m_meshes.data(); }
+		auto meshVertexPositions() const -> float const* { return m_meshVertexPositions.data(); }        // packed float3
+		auto meshTriangleIndices() const -> uint32_t const* { return m_meshTriangleIndices.data(); }     // packed uint3, mesh vertices
+		auto meshTriangleMaterials() const -> uint32_t const* { return m_meshTriangleMaterials.data(); } // material index
+		auto instanceMeshes() const -> uint32_t const* { return m_instanceMeshes.data(); }               // mesh index
+		auto instanceTransforms() const -> float const* { return m_instanceTransforms.data(); } // 3x4 object to world, then inverse
+		auto instanceBounds() const -> float const* { return m_instanceBounds.data(); }        // world space min xyz, max xyz
+		auto camera() const -> Camera const& { return m_camera; }
+		auto environment() const -> Environment const& { return m_environment; }
+
+	private:
+		std::vector<float> m_sphereGeometry;
+		std::vector<uint32_t> m_sphereMaterials;
+		std::vector<float> m_materialAlbedos;
+		std::vector<float> m_materialEmissions;
+		std::vector<uint32_t> m_lights;
+		std::vector<float> m_vertexPositions;
+		std::vector<uint32_t> m_triangleIndices;
+		std::vector<uint32_t> m_triangleMaterials;
+		std::vector<Mesh> m_meshes;
+		std::vector<float> m_meshVertexPositions;
+		std::vector<uint32_t> m_meshTriangleIndices;
+		std::vector<uint32_t> m_meshTriangleMaterials;
+		std::vector<uint32_t> m_instanceMeshes;
+		std::vector<float> m_instanceTransforms;
+		std::vector<float> m_instanceBounds;
+		Camera m_camera;
+		Environment m_environment;
+	};
+
+	class ThreadPool;
+
+	// the Cornell box previously hardcoded in spectrumTest.comp
+	auto makeCornellBoxScene(Scene* pOutScene) -> void;
+
+	// Text scene description, one entity per line, '#' starts a comment. Materials have to be declared before their use
+	//   material <name> diffuse|specular|refractive <r> <g> <b> [emission <r> <g> <b>]
+	//   sphere <radius> <x> <y> <z> <material name>
+	//   mesh <obj or ply file, relative to the scene file> <material name used by faces without an mtl material>
+	//   object <name> <obj or ply file> <material name>, a mesh which is only rendered through its instances
+	//   instance <object name> <12 numbers, row major 3x4 object to world transform>
+	//   environment <hdr or pfm file> [<scale> [<rotation degrees> [<up x> <up y> <up z>]]], see Environment
+	// pOutDependencies receives the files read, the scene file first. Files with a .json extension are read by loadJsonScene
+	auto loadScene(ThreadPool& pool, char const* filename, Scene* pOutScene, std::vector<std::string>* pOutDependencies = nullptr) -> bool;
+
+	// JSON scene description, every member is optional. Names of materials and objects are the keys of their objects, files are
+	// relative to the scene file. The mesh files, of shapes and objects, are all read at once on the pool, then added to the scene
+	// in the order of the document
+	//   "render":    { "spp": n, "resolution": [w, h], "seed": n, "bvh": "binary|wide|device", "output": "<image file>" }
+	//   "camera":    { "position": [x, y, z], "lookAt": [x, y, z], "up": [x, y, z], "fov": <vertical degrees> }
+	//   "materials": { "<name>": { "type": "diffuse|specular|refractive", "albedo": [r, g, b], "emission": [r, g, b] } }
+	//   "shapes":    [ { "type": "sphere", "center": [x, y, z], "radius": r, "material": "<name>" },
+	//                  { "type": "mesh", "file": "<obj or ply file>", "material": "<name used by faces without an mtl material>" },
+	//                  { "type": "triangles", "positions": [x, y, z, ...], "indices": [i, j, k, ...], "material": "<name>" } ]
+	//   "lights":    [ { "type": "sphere", "center": [x, y, z], "radius": r, "emission": [r, g, b] } ]
+	//   "objects":   { "<name>": { "file": "<obj or ply file>", "material": "<name>" } }, meshes only rendered through instances
+	//   "instances": [ { "object": "<name>", "transform": [12 numbers, row major 3x4 object to world] } ]
+	//   "environment": { "file": "<hdr or pfm file>", "scale": s, "rotation": <degrees>, "up": [x, y, z] }, see Environment
+	auto loadJsonScene(ThreadPool& pool, char const* filename, Scene* pOutScene, std::vector<std::string>* pOutDependencies = nullptr)
+		-> bool;
+
+	// what the "render" object of a JSON scene sets, members it doesn't give keep their value
+	struct RenderSettings
+	{
+		uint32_t samplesPerPixel = 0; // 0 = not given
+		uint32_t width = 0;           // of a headless render, 0 = not given
+		uint32_t height = 0;
+		uint64_t seed = 0;
+		bool hasSeed = false;
+		std::string bvh;              // empty = not given
+		std::string output;           // image written once all passes are done, empty = not given
+	};
+
+	// reads the render settings of a JSON scene, text scenes have none and leave pOut as is
+	auto loadRenderSettings(char const* filename, RenderSettings* pOut) -> bool;
+	// .json extension, whatever its case
+	auto hasJsonExtension(char const* filename) -> bool;
+
+	// A mesh file read without the scene it goes to, such that many can be read at once: the faces, and the materials of the mtl
+	// libraries of an OBJ file, to which the faces refer by index, ParsedMesh::NO_MATERIAL for the default one
+	struct MeshAsset
+	{
+		std::string filename;
+		ParsedMesh mesh;
+		std::vector<Material> materials;
+		std::vector<std::string> dependencies; // the mesh file, then the mtl libraries found
+	};
+
+	// Reads the triangulated faces of a Wavefront OBJ file, parsed in parallel by parseObj (src/MeshParser.h). Materials of the mtl
+	// libraries are read by tinyobjloader: Kd is the albedo, Ke the emission, illum selects specular (3, 5, 8) or refractive (4, 6,
+	// 7, 9) materials. Faces using no material, or one missing from the libraries, use the default one. Doesn't touch any scene,
+	// can run on many threads at once
+	auto readObj(ThreadPool& pool, char const* filename, MeshAsset* pOut) -> bool;
+	// same as readObj for the faces of a PLY file, parsed by parsePly, which all use the default material
+	auto readPly(ThreadPool& pool, char const* filename, MeshAsset* pOut) -> bool;
+	// readPly for .ply files, readObj for anything else
+	auto readMeshFile(ThreadPool& pool, char const* filename, MeshAsset* pOut) -> bool;
+	// Appends the materials then the faces of the asset to the scene, faces without a material use defaultMaterialIndex. With
+	// pOutMeshIndex the faces are added as a mesh to instance. The files read are appended to pOutDependencies
+	auto addMeshAsset(MeshAsset& asset, uint32_t defaultMaterialIndex, Scene* pScene, uint32_t* pOutMeshIndex = nullptr,
+	                  std::vector<std::string>* pOutDependencies = nullptr) -> bool;
+
+	// readObj then addMeshAsset
+	auto loadObj(ThreadPool& pool, char const* filename, uint32_t defaultMaterialIndex, Scene* pScene, uint32_t* pOutMeshIndex = nullptr,
+	             std::vector<std::string>* pOutDependencies = nullptr) -> bool;
+	// readPly then addMeshAsset
+	auto loadPly(ThreadPool& pool, char const* filename, uint32_t materialIndex, Scene* pScene, uint32_t* pOutMeshIndex = nullptr,
+	             std::vector<std::string>* pOutDependencies = nullptr) -> bool;
+
+	class Bvh;
+	class MeshBvhs;
+	class WideBvh;
+
+	// Device local storage buffers holding the streams of a Scene and its BVH, bound by the accumulation shader in the order given
+	// by descriptors. Recreating them is all it takes to change scene, shaders don't depend on its content
+	class SceneBuffers
+	{
+	public:
+		static uint32_t constexpr BINDING_COUNT = 19;
+		static uint32_t constexpr BVH_FIRST_BINDING = 8; // buffers written by update, up to CAMERA_BINDING
+		static uint32_t constexpr CAMERA_BINDING = 12;
+		// light BVH nodes, the leaf of each sphere then of the emissive triangles, and those triangles, see src/LightBvh.h
+		static uint32_t constexpr LIGHT_BVH_BINDING = 13;
+		// the frame and resolution of the environment, its texels and the CDFs of their distribution, see src/Distribution2D.h
+		static uint32_t constexpr ENVIRONMENT_BINDING = 16;
+
+		// What create uploads, laid out as on the device: views of the scene, of the storage filled by gather, or of a mapped
+		// SceneCache. pData is nullptr for buffers written on the device
+		struct Contents
+		{
+			void const* pData[BINDING_COUNT];
+			VkDeviceSize sizes[BINDING_COUNT];
+			uint32_t sphereCount;
+			uint32_t lightCount;
+			uint32_t triangleCount; // not instanced
+			uint32_t firstStreamTriangle; // of the triangle streams, triangleCount when world triangles are paged
+			uint32_t instanceCount;
+			bool wideBvh;
+			std::vector<uint8_t> storage[BINDING_COUNT]; // streams gathered from many sources
+		};
+
+	public:
+		// pBvh has to be built over the primitives of scene, see computePrimitiveBounds in src/Bvh.h. With a collapse of it in
+		// pWideBvh the shaders traverse that one, and the binary nodes aren't uploaded. Without pBvh the top level of the BVH buffers
+		// is left for LbvhBuilder::build to write. The bottom level BVHs of meshBvhs follow the top level in the BVH buffers, the
+		// triangles of the instanced meshes follow those of the scene in the triangle streams. With pagedTriangles the world
+		// triangles are left out of the streams for GeometryPager (src/GeometryPager.h) to stream, only instanced meshes remain
+		static auto gather(Scene const& scene, MeshBvhs const& meshBvhs, Bvh const* pBvh, WideBvh const* pWideBvh, Contents* pOut,
+		                   bool pagedTriangles = false) -> void;
+
+		auto create(VulkanContext* ctx, Contents const& contents) -> bool;
+		// gathers the contents first
+		auto create(VulkanContext* ctx, Scene const& scene, MeshBvhs const& meshBvhs, Bvh const* pBvh, WideBvh const* pWideBvh = nullptr)
+			-> bool;
+		// uploads again the BVH and the instances, after instances moved and the BVH was refit or rebuilt, and with instances the
+		// light BVH and the triangle lights. The other streams have to be the ones of create, and the buffers not in use by the
+		// device. Blocking
+		auto update(VulkanContext* ctx, Scene const& scene, MeshBvhs const& meshBvhs, Bvh const* pBvh, WideBvh const* pWideBvh = nullptr)
+			-> bool;
+		auto destroy(VulkanContext* ctx) -> void;
+
+		// writes BINDING_COUNT descriptors: sphere geometry, sphere materials, material albedos, material emissions, lights,
+		// vertex positions, triangle indices, triangle materials, BVH nodes, BVH primitive indices, wide BVH nodes, instances, camera,
+		// light BVH nodes, light leaves, triangle lights, environment, environment texels, environment CDFs
+		auto descriptors(DescriptorInfo* pOutInfos) const -> void;
+
+		auto sphereCount() const -> uint32_t { return m_sphereCount; }
+		auto lightCount() const -> uint32_t { return m_lightCount; }
+		auto triangleCount() const -> uint32_t { return m_triangleCount; } // not instanced
+		auto firstStreamTriangle() const -> uint32_t { return m_firstStreamTriangle; }
+		auto instanceCount() const -> uint32_t { return m_instanceCount; }
+		auto wideBvh() const -> bool { return m_wideBvh; }
+
+	private:
+		static auto gatherStreams(Scene const& scene, bool pagedTriangles, Contents* pOut) -> void;
+		static auto gatherLights(Scene const& scene, Contents* pOut) -> void;
+		static auto gatherEnvironment(Environment const& environment, Contents* pOut) -> void;
+		static auto gatherBvh(Scene const& scene, MeshBvhs const& meshBvhs, Bvh const* pBvh, WideBvh const* pWideBvh, Contents* pOut) -> void;
+		auto upload(VulkanContext* ctx, void const* data, VkDeviceSize size, Buffer* pBuffer) -> bool;
+
+	private:
+		Buffer m_buffers[BINDING_COUNT] {
+			{0, BufferType_v::STORAGE}, {0, BufferType_v::STORAGE}, {0, BufferType_v::STORAGE},
+			{0, BufferType_v::STORAGE}, {0, BufferType_v::STORAGE}, {0, BufferType_v::STORAGE},
+			{0, BufferType_v::STORAGE}, {0, BufferType_v::STORAGE}, {0, BufferType_v::STORAGE},
+			{0, BufferType_v::STORAGE}, {0, BufferType_v::STORAGE}, {0, BufferType_v::STORAGE},
+			{0, BufferType_v::STORAGE}, {0, BufferType_v::STORAGE}, {0, BufferType_v::STORAGE},
+			{0, BufferType_v::STORAGE}, {0, BufferType_v::STORAGE}, {0, BufferType_v::STORAGE},
+			{0, BufferType_v::STORAGE}
+		};
+		uint32_t m_sphereCount = 0;
+		uint32_t m_lightCount = 0;
+		uint32_t m_triangleCount = 0;
+		uint32_t m_firstStreamTriangle = 0;
+		uint32_t m_instanceCount = 0;
+		bool m_wideBvh = false;
+	};
+}
+
+#endif // MXC_SCENE_H
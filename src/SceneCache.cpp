@@ -0,0 +1,279 @@
+#include "SceneCache.h"
+#include "logging.h"
+
+#include <cstring>
+#include <cstdio>
+#include <filesystem>
+
+namespace mxc
+{
+    static char constexpr SCENE_CACHE_MAGIC[8] { 'M', 'X', 'C', 'S', 'C', 'E', 'N', 'E' };
+    static uint32_t constexpr SCENE_CACHE_VERSION = 6;
+    static uint64_t constexpr SCENE_CACHE_ALIGNMENT = 4096; // sections start on page boundaries
+
+    struct SceneCacheSection
+    {
+        uint64_t offset;
+        uint64_t size;
+        uint32_t present; // 0 for buffers written on the device, which have a size but no data
+        uint32_t pad;
+    };
+
+    struct SceneCacheHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t binding_count;
+        uint32_t dependency_count;
+        uint32_t sphereCount;
+        uint32_t lightCount;
+        uint32_t triangleCount;
+        uint32_t instanceCount;
+        uint32_t wideBvh;
+        SceneCacheSection sections[SceneBuffers::BINDING_COUNT];
+    };
+
+    // follow the header, then the paths they refer to
+    struct SceneCacheDependency
+    {
+        uint64_t hash;
+        uint64_t pathOffset;
+        uint64_t pathLength;
+    };
+
+    static uint64_t constexpr HASH_PRIME_1 = 0x9e3779b185ebca87ull;
+    static uint64_t constexpr HASH_PRIME_2 = 0xc2b2ae3d27d4eb4full;
+    static uint64_t constexpr HASH_PRIME_3 = 0x165667b19e3779f9ull;
+
+    static auto rotl(uint64_t x, int r) -> uint64_t
+    {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    static auto hashRound(uint64_t lane, uint64_t word) -> uint64_t
+    {
+        return rotl(lane + word * HASH_PRIME_2, 31) * HASH_PRIME_1;
+    }
+
+    // four independent multiply rotate lanes over 32 byte blocks keep the multipliers busy, then the tail is folded in
+    static auto hashBytes(uint8_t const* data, size_t size, uint64_t seed) -> uint64_t
+    {
+        uint64_t lanes[4] { seed + HASH_PRIME_1 + HASH_PRIME_2, seed + HASH_PRIME_2, seed, seed - HASH_PRIME_1 };
+        size_t i = 0;
+        for (; i + 32 <= size; i += 32)
+        {
+            for (uint32_t l = 0; l != 4; ++l)
+            {
+                uint64_t word;
+                memcpy(&word, data + i + 8 * l, sizeof(word));
+                lanes[l] = hashRound(lanes[l], word);
+            }
+        }
+        uint64_t h = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18) + size;
+        for (; i + 8 <= size; i += 8)
+        {
+            uint64_t word;
+            memcpy(&word, data + i, sizeof(word));
+            h = rotl(h ^ hashRound(0, word), 27) * HASH_PRIME_1 + HASH_PRIME_3;
+        }
+        for (; i != size; ++i)
+            h = rotl(h ^ (data[i] * HASH_PRIME_3), 11) * HASH_PRIME_1;
+
+        h ^= h >> 33;
+        h *= HASH_PRIME_2;
+        h ^= h >> 29;
+        h *= HASH_PRIME_3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    auto hashFile(char const* filename, uint64_t* pOutHash) -> bool
+    {
+        // empty files can't be mapped
+        std::error_code error;
+        if (std::filesystem::file_size(filename, error) == 0 && !error)
+        {
+            *pOutHash = hashBytes(nullptr, 0, 0);
+            return true;
+        }
+
+        MappedFile file;
+        if (!file.open(filename, MappingMode::READ))
+            return false;
+        *pOutHash = hashBytes(file.data(), file.size(), 0);
+        return true;
+    }
+
+    auto sceneCacheFilename(char const* cacheDir, char const* sceneFilename, char const* variant, std::string* pOutFilename) -> bool
+    {
+        uint64_t hash;
+        if (!hashFile(sceneFilename, &hash))
+            return false;
+        hash = hashBytes(reinterpret_cast<uint8_t const*>(variant), strlen(variant), hash);
+
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.mxcscene", static_cast<unsigned long long>(hash));
+        *pOutFilename = (std::filesystem::path(cacheDir) / name).string();
+        return true;
+    }
+
+    auto SceneCache::open(char const* filename) -> bool
+    {
+        close();
+        std::error_code error;
+        if (!std::filesystem::exists(filename, error))
+            return false;
+        if (!m_file.open(filename, MappingMode::READ))
+            return false;
+
+        SceneCacheHeader header;
+        bool valid = m_file.size() >= sizeof(header);
+        if (valid)
+        {
+            memcpy(&header, m_file.data(), sizeof(header));
+            valid = memcmp(header.magic, SCENE_CACHE_MAGIC, sizeof(SCENE_CACHE_MAGIC)) == 0 && header.version == SCENE_CACHE_VERSION
+                    && header.binding_count == SceneBuffers::BINDING_COUNT;
+        }
+        if (!valid)
+        {
+            MXC_ERROR("%s isn't a scene cache of version %u", filename, SCENE_CACHE_VERSION);
+            close();
+            return false;
+        }
+
+        uint64_t const fileSize = m_file.size();
+        bool inBounds = header.dependency_count <= (fileSize - sizeof(header)) / sizeof(SceneCacheDependency);
+        for (uint32_t i = 0; inBounds && i != SceneBuffers::BINDING_COUNT; ++i)
+        {
+            SceneCacheSection const& section = header.sections[i];
+            inBounds = !section.present || (section.offset <= fileSize && section.size <= fileSize - section.offset);
+        }
+        SceneCacheDependency const* pDependencies = reinterpret_cast<SceneCacheDependency const*>(m_file.data() + sizeof(header));
+        for (uint32_t i = 0; inBounds && i != header.dependency_count; ++i)
+            inBounds = pDependencies[i].pathOffset <= fileSize && pDependencies[i].pathLength <= fileSize - pDependencies[i].pathOffset;
+        if (!inBounds)
+        {
+            MXC_ERROR("scene cache %s is truncated", filename);
+            close();
+            return false;
+        }
+
+        for (uint32_t i = 0; i != header.dependency_count; ++i)
+        {
+            SceneCacheDependency const& dependency = pDependencies[i];
+            std::string const path(reinterpret_cast<char const*>(m_file.data() + dependency.pathOffset), dependency.pathLength);
+            uint64_t hash;
+            if (!std::filesystem::exists(path, error) || !hashFile(path.c_str(), &hash) || hash != dependency.hash)
+            {
+                MXC_INFO("scene cache %s is stale, %s changed", filename, path.c_str());
+                close();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    auto SceneCache::close() -> void
+    {
+        m_file.close();
+    }
+
+    auto SceneCache::contents(SceneBuffers::Contents* pOut) const -> void
+    {
+        MXC_ASSERT(m_file.isOpen(), "SceneCache: contents of a cache which isn't open");
+        SceneCacheHeader header;
+        memcpy(&header, m_file.data(), sizeof(header));
+        pOut->sphereCount = header.sphereCount;
+        pOut->lightCount = header.lightCount;
+        pOut->triangleCount = header.triangleCount;
+        pOut->firstStreamTriangle = 0;
+        pOut->instanceCount = header.instanceCount;
+        pOut->wideBvh = header.wideBvh != 0;
+        for (uint32_t i = 0; i != SceneBuffers::BINDING_COUNT; ++i)
+        {
+            SceneCacheSection const& section = header.sections[i];
+            pOut->storage[i].clear();
+            pOut->pData[i] = section.present ? m_file.data() + section.offset : nullptr;
+            pOut->sizes[i] = section.size;
+        }
+    }
+
+    auto SceneCache::write(char const* filename, SceneBuffers::Contents const& contents, std::vector<std::string> const& dependencies)
+        -> bool
+    {
+        MXC_ASSERT(contents.firstStreamTriangle == 0, "SceneCache: paged world triangles aren't in the contents, the scene can't be cached");
+        SceneCacheHeader header{};
+        memcpy(header.magic, SCENE_CACHE_MAGIC, sizeof(SCENE_CACHE_MAGIC));
+        header.version = SCENE_CACHE_VERSION;
+        header.binding_count = SceneBuffers::BINDING_COUNT;
+        header.dependency_count = static_cast<uint32_t>(dependencies.size());
+        header.sphereCount = contents.sphereCount;
+        header.lightCount = contents.lightCount;
+        header.triangleCount = contents.triangleCount;
+        header.instanceCount = contents.instanceCount;
+        header.wideBvh = contents.wideBvh ? 1 : 0;
+
+        // absolute paths, such that the cache stays valid whatever the working directory
+        std::vector<SceneCacheDependency> records(dependencies.size());
+        std::vector<std::string> paths(dependencies.size());
+        uint64_t offset = sizeof(header) + dependencies.size() * sizeof(SceneCacheDependency);
+        for (size_t i = 0; i != dependencies.size(); ++i)
+        {
+            std::error_code error;
+            paths[i] = std::filesystem::absolute(dependencies[i], error).lexically_normal().string();
+            if (error || !hashFile(paths[i].c_str(), &records[i].hash))
+            {
+                MXC_ERROR("couldn't hash %s, dependency of the scene cache %s", dependencies[i].c_str(), filename);
+                return false;
+            }
+            records[i].pathOffset = offset;
+            records[i].pathLength = paths[i].size();
+            offset += paths[i].size();
+        }
+
+        for (uint32_t i = 0; i != SceneBuffers::BINDING_COUNT; ++i)
+        {
+            bool const present = contents.pData[i] != nullptr && contents.sizes[i] != 0;
+            offset = (offset + SCENE_CACHE_ALIGNMENT - 1) & ~(SCENE_CACHE_ALIGNMENT - 1);
+            header.sections[i] = { .offset = present ? offset : 0, .size = contents.sizes[i], .present = present ? 1u : 0u, .pad = 0 };
+            if (present)
+                offset += contents.sizes[i];
+        }
+
+        std::error_code error;
+        std::filesystem::path const parent = std::filesystem::path(filename).parent_path();
+        if (!parent.empty())
+            std::filesystem::create_directories(parent, error);
+
+        std::string const temporaryFilename = std::string(filename) + ".tmp";
+        MappedFile file;
+        if (!file.open(temporaryFilename.c_str(), MappingMode::READ_WRITE, offset))
+            return false;
+        memcpy(file.data(), &header, sizeof(header));
+        if (!records.empty())
+            memcpy(file.data() + sizeof(header), records.data(), records.size() * sizeof(SceneCacheDependency));
+        for (size_t i = 0; i != paths.size(); ++i)
+            memcpy(file.data() + records[i].pathOffset, paths[i].data(), paths[i].size());
+        for (uint32_t i = 0; i != SceneBuffers::BINDING_COUNT; ++i)
+            if (header.sections[i].present)
+                memcpy(file.data() + header.sections[i].offset, contents.pData[i], header.sections[i].size);
+
+        bool const flushed = file.flush();
+        file.close();
+        if (!flushed)
+        {
+            MXC_ERROR("couldn't write scene cache %s to disk", temporaryFilename.c_str());
+            return false;
+        }
+
+        std::filesystem::rename(temporaryFilename, filename, error);
+        if (error)
+        {
+            MXC_ERROR("couldn't rename %s to %s: %s", temporaryFilename.c_str(), filename, error.message().c_str());
+            return false;
+        }
+
+        MXC_INFO("scene cache %s written, %llu bytes", filename, static_cast<unsigned long long>(offset));
+        return true;
+    }
+}
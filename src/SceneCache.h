@@ -0,0 +1,42 @@
+#ifndef MXC_SCENE_CACHE_H
+#define MXC_SCENE_CACHE_H
+
+#include "Scene.h"
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace mxc
+{
+	// 64 bit hash of the content of a file, read through a memory mapping at memory bandwidth. Not cryptographic
+	auto hashFile(char const* filename, uint64_t* pOutHash) -> bool;
+
+	// <cacheDir>/<hash of the scene file and variant>.mxcscene. variant tells apart caches of the same scene built differently,
+	// such as with another kind of BVH
+	auto sceneCacheFilename(char const* cacheDir, char const* sceneFilename, char const* variant, std::string* pOutFilename) -> bool;
+
+	// Binary image of SceneBuffers::Contents, the streams laid out as on the device on page aligned sections, after a header and the
+	// content hashes of the files the scene was loaded from. A warm start maps the file and uploads the sections from the mapping,
+	// skipping parsing, BVH builds and gathering. The cache is stale, and open fails, as soon as one of the files changed
+	class SceneCache
+	{
+	public:
+		// checks the magic, the version, the section bounds and the hash of every dependency
+		auto open(char const* filename) -> bool;
+		auto close() -> void;
+
+		// views into the mapping, valid until close
+		auto contents(SceneBuffers::Contents* pOut) const -> void;
+
+		// dependencies are the files read to build contents, see loadScene. Written under filename.tmp and renamed once flushed
+		static auto write(char const* filename, SceneBuffers::Contents const& contents, std::vector<std::string> const& dependencies)
+			-> bool;
+
+	private:
+		MappedFile m_file;
+	};
+}
+
+#endif // MXC_SCENE_CACHE_H
@@ -0,0 +1,404 @@
+#include "Scene.h"
+#include "Json.h"
+#include "ThreadPool.h"
+#include "logging.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+
+namespace mxc
+{
+    // count numbers in an array
+    static auto readFloats(JsonValue const* pValue, float* pOut, uint32_t count) -> bool
+    {
+        if (!pValue || !pValue->isArray() || pValue->size() != count)
+            return false;
+        for (uint32_t i = 0; i != count; ++i)
+        {
+            if (!(*pValue)[i].isNumber())
+                return false;
+            pOut[i] = static_cast<float>((*pValue)[i].number());
+        }
+        return true;
+    }
+
+    static auto isUint(JsonValue const* pValue) -> bool
+    {
+        return pValue && pValue->isNumber() && pValue->number() >= 0. && pValue->number() <= 4294967295.
+               && std::floor(pValue->number()) == pValue->number();
+    }
+
+    static auto typeOf(JsonValue const& value) -> char const*
+    {
+        JsonValue const* pType = value.find("type");
+        return pType && pType->isString() ? pType->string().c_str() : "";
+    }
+
+    class JsonSceneLoader
+    {
+    public:
+        JsonSceneLoader(char const* filename, Scene* pScene) : m_filename(filename), m_pScene(pScene) {}
+
+        auto load(ThreadPool& pool, JsonValue const& root, std::vector<std::string>* pOutDependencies) -> bool
+        {
+            if (!root.isObject())
+                return fail(root, "expected an object at the root of the scene");
+            for (size_t i = 0; i != root.size(); ++i)
+            {
+                std::string const& key = root.member(i).first;
+                if (key != "render" && key != "camera" && key != "materials" && key != "shapes" && key != "lights" && key != "objects"
+                    && key != "instances" && key != "environment")
+                    MXC_WARN("%s:%u: unknown member %s, ignored", m_filename, root.member(i).second.line(), key.c_str());
+            }
+
+            JsonValue const* pCamera = root.find("camera");
+            JsonValue const* pMaterials = root.find("materials");
+            JsonValue const* pShapes = root.find("shapes");
+            JsonValue const* pLights = root.find("lights");
+            JsonValue const* pObjects = root.find("objects");
+            JsonValue const* pInstances = root.find("instances");
+            if ((pMaterials && !pMaterials->isObject()) || (pObjects && !pObjects->isObject()))
+                return fail(pMaterials && !pMaterials->isObject() ? *pMaterials : *pObjects, "expected an object of named declarations");
+            for (JsonValue const* pArray : { pShapes, pLights, pInstances })
+                if (pArray && !pArray->isArray())
+                    return fail(*pArray, "expected an array");
+
+            if (pCamera && !readCamera(*pCamera))
+                return false;
+            if (root.find("environment") && !readEnvironment(*root.find("environment"), pOutDependencies))
+                return false;
+            for (size_t i = 0; pMaterials && i != pMaterials->size(); ++i)
+                if (!readMaterial(pMaterials->member(i).first, pMaterials->member(i).second))
+                    return false;
+
+            // mesh files are read all at once, parsing every one of them in parallel as well, before any is added
+            std::vector<std::string> jobs; // paths of the mesh files, shapes first
+            for (size_t i = 0; pShapes && i != pShapes->size(); ++i)
+                if (strcmp(typeOf((*pShapes)[i]), "mesh") == 0 && !addJob((*pShapes)[i], &jobs))
+                    return false;
+            for (size_t i = 0; pObjects && i != pObjects->size(); ++i)
+                if (!addJob(pObjects->member(i).second, &jobs))
+                    return false;
+            auto const start = std::chrono::steady_clock::now();
+            std::vector<MeshAsset> assets(jobs.size());
+            std::vector<uint8_t> read(jobs.size(), 0);
+            pool.parallelFor(static_cast<uint32_t>(jobs.size()), 1, [&](uint32_t begin, uint32_t end) {
+                for (uint32_t i = begin; i != end; ++i)
+                    read[i] = readMeshFile(pool, jobs[i].c_str(), &assets[i]);
+            });
+            for (uint8_t ok : read)
+                if (!ok)
+                    return false;
+            if (!jobs.empty())
+                MXC_INFO("%s: read %zu mesh files in %.1f ms", m_filename, jobs.size(),
+                         std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+            size_t job = 0;
+            for (size_t i = 0; pShapes && i != pShapes->size(); ++i)
+                if (!addShape((*pShapes)[i], assets, &job, pOutDependencies))
+                    return false;
+            for (size_t i = 0; pLights && i != pLights->size(); ++i)
+                if (!addLight((*pLights)[i]))
+                    return false;
+            for (size_t i = 0; pObjects && i != pObjects->size(); ++i)
+            {
+                JsonValue const& object = pObjects->member(i).second;
+                uint32_t meshIndex = 0;
+                if (!addMeshAsset(assets[job++], m_materials.at(object.find("material")->string()), m_pScene, &meshIndex, pOutDependencies))
+                    return false;
+                if (!m_objects.emplace(pObjects->member(i).first, meshIndex).second)
+                    return fail(object, "object declared twice");
+            }
+            for (size_t i = 0; pInstances && i != pInstances->size(); ++i)
+                if (!addInstance((*pInstances)[i]))
+                    return false;
+            return true;
+        }
+
+    private:
+        auto fail(JsonValue const& value, char const* what) const -> bool
+        {
+            MXC_ERROR("%s:%u: %s", m_filename, value.line(), what);
+            return false;
+        }
+
+        auto readCamera(JsonValue const& value) -> bool
+        {
+            if (!value.isObject())
+                return fail(value, "expected the camera object");
+            Camera camera;
+            JsonValue const* pFov = value.find("fov");
+            if ((value.find("position") && !readFloats(value.find("position"), camera.position, 3))
+                || (value.find("lookAt") && !readFloats(value.find("lookAt"), camera.lookAt, 3))
+                || (value.find("up") && !readFloats(value.find("up"), camera.up, 3)))
+                return fail(value, "expected position, lookAt and up as arrays of 3 numbers");
+            if (pFov && (!pFov->isNumber() || pFov->number() <= 0. || pFov->number() >= 180.))
+                return fail(*pFov, "expected a vertical field of view between 0 and 180 degrees");
+            if (pFov)
+                camera.verticalFov = static_cast<float>(pFov->number());
+
+            // the basis is built from these, a degenerate one would give NaN rays
+            float const forward[3] { camera.lookAt[0] - camera.position[0], camera.lookAt[1] - camera.position[1],
+                                     camera.lookAt[2] - camera.position[2] };
+            float const side[3] { forward[1] * camera.up[2] - forward[2] * camera.up[1], forward[2] * camera.up[0] - forward[0] * camera.up[2],
+                                  forward[0] * camera.up[1] - forward[1] * camera.up[0] };
+            if (side[0] == 0.f && side[1] == 0.f && side[2] == 0.f)
+                return fail(value, "the camera looks along its up direction");
+            m_pScene->setCamera(camera);
+            return true;
+        }
+
+        auto readEnvironment(JsonValue const& value, std::vector<std::string>* pOutDependencies) -> bool
+        {
+            JsonValue const* pFile = value.find("file");
+            JsonValue const* pScale = value.find("scale");
+            JsonValue const* pRotation = value.find("rotation");
+            if (!value.isObject() || !pFile || !pFile->isString())
+                return fail(value, "expected the file of the environment");
+            if ((pScale && !pScale->isNumber()) || (pRotation && !pRotation->isNumber()))
+                return fail(value, "expected the scale and the rotation as numbers");
+            Environment environment;
+            if (value.find("up") && !readFloats(value.find("up"), environment.up, 3))
+                return fail(value, "expected up as an array of 3 numbers");
+            if (environment.up[0] == 0.f && environment.up[1] == 0.f && environment.up[2] == 0.f)
+                return fail(value, "the environment has no up direction");
+
+            std::string const path = (std::filesystem::path(m_filename).parent_path() / pFile->string()).string();
+            if (!loadEnvironment(path.c_str(), pScale ? static_cast<float>(pScale->number()) : 1.f, &environment))
+                return false;
+            if (pRotation)
+                environment.rotation = static_cast<float>(pRotation->number());
+            m_pScene->setEnvironment(std::move(environment));
+            if (pOutDependencies)
+                pOutDependencies->push_back(path);
+            return true;
+        }
+
+        auto readMaterial(std::string const& name, JsonValue const& value) -> bool
+        {
+            if (!value.isObject())
+                return fail(value, "expected a material object");
+            Material material{};
+            char const* type = typeOf(value);
+            if (strcmp(type, "diffuse") == 0 || value.find("type") == nullptr) material.type = MaterialType::DIFFUSE;
+            else if (strcmp(type, "specular") == 0)                            material.type = MaterialType::SPECULAR;
+            else if (strcmp(type, "refractive") == 0)                          material.type = MaterialType::REFRACTIVE;
+            else
+                return fail(value, "expected a material type of diffuse, specular or refractive");
+            if ((value.find("albedo") && !readFloats(value.find("albedo"), material.albedo, 3))
+                || (value.find("emission") && !readFloats(value.find("emission"), material.emission, 3)))
+                return fail(value, "expected albedo and emission as arrays of 3 numbers");
+            if (!m_materials.emplace(name, m_pScene->addMaterial(material)).second)
+                return fail(value, "material declared twice");
+            return true;
+        }
+
+        auto findMaterial(JsonValue const& declaration, uint32_t* pOut) const -> bool
+        {
+            JsonValue const* pName = declaration.find("material");
+            if (!pName || !pName->isString())
+                return fail(declaration, "expected the name of a material");
+            auto const it = m_materials.find(pName->string());
+            if (it == m_materials.end())
+            {
+                MXC_ERROR("%s:%u: material %s not declared", m_filename, pName->line(), pName->string().c_str());
+                return false;
+            }
+            *pOut = it->second;
+            return true;
+        }
+
+        auto addJob(JsonValue const& declaration, std::vector<std::string>* pJobs) const -> bool
+        {
+            uint32_t materialIndex;
+            JsonValue const* pFile = declaration.find("file");
+            if (!declaration.isObject() || !pFile || !pFile->isString())
+                return fail(declaration, "expected the file of a mesh");
+            if (!findMaterial(declaration, &materialIndex))
+                return false;
+            pJobs->push_back((std::filesystem::path(m_filename).parent_path() / pFile->string()).string());
+            return true;
+        }
+
+        auto addShape(JsonValue const& shape, std::vector<MeshAsset>& assets, size_t* pJob, std::vector<std::string>* pOutDependencies)
+            -> bool
+        {
+            char const* type = typeOf(shape);
+            uint32_t materialIndex = 0;
+            if (strcmp(type, "mesh") == 0)
+            {
+                // found by addJob already. Materials of the mtl libraries are appended to the scene, they can't be referenced by name
+                findMaterial(shape, &materialIndex);
+                return addMeshAsset(assets[(*pJob)++], materialIndex, m_pScene, nullptr, pOutDependencies);
+            }
+            if (strcmp(type, "sphere") == 0)
+            {
+                float center[3];
+                JsonValue const* pRadius = shape.find("radius");
+                if (!readFloats(shape.find("center"), center, 3) || !pRadius || !pRadius->isNumber())
+                    return fail(shape, "expected the center and the radius of a sphere");
+                if (!findMaterial(shape, &materialIndex))
+                    return false;
+                m_pScene->addSphere(center, static_cast<float>(pRadius->number()), materialIndex);
+                return true;
+            }
+            if (strcmp(type, "triangles") == 0)
+            {
+                JsonValue const* pPositions = shape.find("positions");
+                JsonValue const* pIndices = shape.find("indices");
+                if (!pPositions || !pPositions->isArray() || pPositions->size() % 3 != 0 || !pIndices || !pIndices->isArray()
+                    || pIndices->size() % 3 != 0)
+                    return fail(shape, "expected positions and indices as arrays of 3 numbers per vertex and per triangle");
+                uint32_t const vertex_count = static_cast<uint32_t>(pPositions->size() / 3);
+                uint32_t const triangle_count = static_cast<uint32_t>(pIndices->size() / 3);
+                std::vector<float> positions(pPositions->size());
+                std::vector<uint32_t> indices(pIndices->size());
+                if (!readFloats(pPositions, positions.data(), static_cast<uint32_t>(positions.size())))
+                    return fail(*pPositions, "expected numbers");
+                for (uint32_t i = 0; i != indices.size(); ++i)
+                {
+                    if (!isUint(&(*pIndices)[i]) || (*pIndices)[i].number() >= vertex_count)
+                        return fail((*pIndices)[i], "expected the index of a vertex of the triangles");
+                    indices[i] = static_cast<uint32_t>((*pIndices)[i].number());
+                }
+                if (!findMaterial(shape, &materialIndex))
+                    return false;
+                std::vector<uint32_t> const materials(triangle_count, materialIndex);
+                m_pScene->addTriangleMesh(positions.data(), vertex_count, indices.data(), materials.data(), triangle_count);
+                return true;
+            }
+            return fail(shape, "expected a shape type of sphere, mesh or triangles");
+        }
+
+        // an emissive sphere which doesn't reflect, through a material of its own
+        auto addLight(JsonValue const& light) -> bool
+        {
+            if (strcmp(typeOf(light), "sphere") != 0)
+                return fail(light, "expected a light type of sphere");
+            Material material{};
+            float center[3];
+            JsonValue const* pRadius = light.find("radius");
+            if (!readFloats(light.find("center"), center, 3) || !pRadius || !pRadius->isNumber()
+                || !readFloats(light.find("emission"), material.emission, 3))
+                return fail(light, "expected the center, the radius and the emission of a sphere light");
+            material.type = MaterialType::DIFFUSE;
+            m_pScene->addSphere(center, static_cast<float>(pRadius->number()), m_pScene->addMaterial(material));
+            return true;
+        }
+
+        auto addInstance(JsonValue const& instance) -> bool
+        {
+            JsonValue const* pObject = instance.find("object");
+            float m[12];
+            if (!pObject || !pObject->isString() || !readFloats(instance.find("transform"), m, 12))
+                return fail(instance, "expected the object and the 12 numbers of a row major 3x4 transform");
+            auto const it = m_objects.find(pObject->string());
+            if (it == m_objects.end())
+            {
+                MXC_ERROR("%s:%u: object %s not declared", m_filename, pObject->line(), pObject->string().c_str());
+                return false;
+            }
+            float const determinant = m[0] * (m[5] * m[10] - m[6] * m[9]) - m[1] * (m[4] * m[10] - m[6] * m[8])
+                                      + m[2] * (m[4] * m[9] - m[5] * m[8]);
+            if (determinant == 0.f)
+                return fail(instance, "instance transform isn't invertible");
+            m_pScene->addInstance(it->second, m);
+            return true;
+        }
+
+    private:
+        char const* m_filename;
+        Scene* m_pScene;
+        std::unordered_map<std::string, uint32_t> m_materials;
+        std::unordered_map<std::string, uint32_t> m_objects; // mesh index
+    };
+
+    auto loadJsonScene(ThreadPool& pool, char const* filename, Scene* pOutScene, std::vector<std::string>* pOutDependencies) -> bool
+    {
+        JsonValue root;
+        if (!parseJsonFile(filename, &root))
+            return false;
+        if (pOutDependencies)
+            pOutDependencies->emplace_back(filename);
+
+        pOutScene->clear();
+        if (!JsonSceneLoader(filename, pOutScene).load(pool, root, pOutDependencies))
+            return false;
+        MXC_INFO("loaded scene %s: %u spheres, %u triangles, %u instances of %u meshes, %u materials, %u lights", filename,
+                 pOutScene->sphereCount(), pOutScene->triangleCount(), pOutScene->instanceCount(), pOutScene->meshCount(),
+                 pOutScene->materialCount(), pOutScene->lightCount());
+        return true;
+    }
+
+    auto loadRenderSettings(char const* filename, RenderSettings* pOut) -> bool
+    {
+        if (!hasJsonExtension(filename))
+            return true;
+        JsonValue root;
+        if (!parseJsonFile(filename, &root))
+            return false;
+        JsonValue const* pRender = root.find("render");
+        if (!pRender)
+            return true;
+        if (!pRender->isObject())
+        {
+            MXC_ERROR("%s:%u: expected the render object", filename, pRender->line());
+            return false;
+        }
+
+        JsonValue const* pSpp = pRender->find("spp");
+        JsonValue const* pResolution = pRender->find("resolution");
+        JsonValue const* pSeed = pRender->find("seed");
+        JsonValue const* pBvh = pRender->find("bvh");
+        JsonValue const* pOutput = pRender->find("output");
+        if (pSpp && (!isUint(pSpp) || pSpp->number() == 0.))
+        {
+            MXC_ERROR("%s:%u: expected a positive number of samples per pixel", filename, pSpp->line());
+            return false;
+        }
+        if (pResolution && (!pResolution->isArray() || pResolution->size() != 2 || !isUint(&(*pResolution)[0])
+                            || !isUint(&(*pResolution)[1]) || (*pResolution)[0].number() == 0. || (*pResolution)[1].number() == 0.))
+        {
+            MXC_ERROR("%s:%u: expected the resolution as [width, height]", filename, pResolution->line());
+            return false;
+        }
+        if (pSeed && (!pSeed->isNumber() || pSeed->number() < 0. || std::floor(pSeed->number()) != pSeed->number()))
+        {
+            MXC_ERROR("%s:%u: expected a non negative integer seed", filename, pSeed->line());
+            return false;
+        }
+        if (pBvh && (!pBvh->isString() || (pBvh->string() != "binary" && pBvh->string() != "wide" && pBvh->string() != "device")))
+        {
+            MXC_ERROR("%s:%u: expected a bvh of binary, wide or device", filename, pBvh->line());
+            return false;
+        }
+        if (pOutput && !pOutput->isString())
+        {
+            MXC_ERROR("%s:%u: expected the filename of the output image", filename, pOutput->line());
+            return false;
+        }
+
+        if (pSpp)
+            pOut->samplesPerPixel = static_cast<uint32_t>(pSpp->number());
+        if (pResolution)
+        {
+            pOut->width = static_cast<uint32_t>((*pResolution)[0].number());
+            pOut->height = static_cast<uint32_t>((*pResolution)[1].number());
+        }
+        if (pSeed)
+        {
+            pOut->seed = static_cast<uint64_t>(pSeed->number());
+            pOut->hasSeed = true;
+        }
+        if (pBvh)
+            pOut->bvh = pBvh->string();
+        // relative to the working directory, as the --output of the command line
+        if (pOutput)
+            pOut->output = pOutput->string();
+        return true;
+    }
+}
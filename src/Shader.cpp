@@ -29,7 +29,7 @@ namespace mxc
     auto compileShader(std::wstring const& filename, std::wstring_view shaderDir) -> CComPtr<IDxcBlob>;
     constexpr auto VkDescriptorTypeToString(VkDescriptorType descriptorType) -> char const*;
 
-    auto ShaderResources::create(VulkanContext* ctx, ResourceConfiguration const& config, VkShaderStageFlagBits const* stageFlags, 
+    auto ShaderResources::create(VulkanContext* ctx, ResourceConfiguration const& config, VkShaderStageFlags stageFlags, 
                                  bool usePushDescriptors) -> bool
     {
         MXC_WARN("Current version of shaderResources puts all bindings, even bindings destined to different descriptor pools, in the same"
@@ -60,30 +60,32 @@ namespace mxc
             .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
             .pNext = nullptr,
             .flags = usePushDescriptors ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR : 0,
-            .bindingCount = std::accumulate(config.pBindingNumbers_counts, config.pBindingNumbers_counts+config.poolSizes_count, 0), /*==2*/
+            .bindingCount = std::accumulate(config.pBindingNumbers_counts, config.pBindingNumbers_counts+config.poolSizes_count, 0u),
             .pBindings = setLayoutBinding};
-        MXC_ASSERT(layoutCreateInfo.bindingCount == 2, "What"); // TODO remove
+        MXC_ASSERT(layoutCreateInfo.bindingCount <= MAX_DESCRIPTOR_COUNT_PER_TYPE * MAX_DESCRIPTOR_SETS_COUNT, "Too many bindings");
 
-        descriptorSetLayouts.resize(ctx->swapchain.images.size()); // TODO configurable?
+        descriptorSetLayouts.resize(ctx->outputImageCount()); // TODO configurable?
         uint32_t index = 0;
-        for (uint32_t i = 0; i!=1/*i != descriptorSetLayouts.size()*/; ++i) // TODO 
+        for (uint32_t i = 0; i != config.poolSizes_count; ++i) // all descriptor types end up in the same layout
         {
-            MXC_DEBUG("Creating Descriptor Set Layout with %u bindings", config.pBindingNumbers_counts[i]);
-            for (uint32_t j = 0; j != 2/*config.pBindingNumbers_counts[i]*/; ++j)
+            MXC_DEBUG("Adding %u bindings of type %s to the Descriptor Set Layout", 
+                      config.pBindingNumbers_counts[i], VkDescriptorTypeToString(config.pPoolSizes[i].type));
+            MXC_ASSERT(config.pBindingNumbers_counts[i] <= MAX_DESCRIPTOR_COUNT_PER_TYPE, "Too many bindings for a single descriptor type");
+            for (uint32_t j = 0; j != config.pBindingNumbers_counts[i]; ++j)
             {
                 setLayoutBinding[index].binding = config.pBindingNumbers[runningOffset + j];
                 setLayoutBinding[index].descriptorType = config.pPoolSizes[i].type;
                 // This allows you to create arrays of descriptors and bind them to a single binding number.
                 setLayoutBinding[index].descriptorCount = 1; // descriptors per binding number
-                setLayoutBinding[index].stageFlags = stageFlags[i];
+                setLayoutBinding[index].stageFlags = stageFlags;
                 setLayoutBinding[index++].pImmutableSamplers = nullptr;
             }
             runningOffset += config.pBindingNumbers_counts[i];
         }
 
         VK_CHECK(vkCreateDescriptorSetLayout(ctx->device.logical, &layoutCreateInfo, nullptr, descriptorSetLayouts.data()));
-        MXC_ASSERT(ctx->swapchain.images.size() <= 3, "More than three swapchain images. Not allowed");
-        descriptorSets_count = static_cast<uint8_t>(ctx->swapchain.images.size());
+        MXC_ASSERT(ctx->outputImageCount() <= 3, "More than three swapchain images. Not allowed");
+        descriptorSets_count = static_cast<uint8_t>(ctx->outputImageCount());
         if (!usePushDescriptors)
         {
             std::fill(++descriptorSetLayouts.begin(), descriptorSetLayouts.end(), descriptorSetLayouts[0]);
@@ -105,7 +107,7 @@ namespace mxc
         {
             MXC_DEBUG("descriptor type number: %u, %s", i, VkDescriptorTypeToString(config.pPoolSizes[i].type));
             // TODO refactor
-            m_descriptorsMetadata.push_back({config.pPoolSizes[i].type, config.pPoolSizes[i].descriptorCount, {0}});
+            m_descriptorsMetadata.push_back({config.pPoolSizes[i].type, config.pBindingNumbers_counts[i], {0}});
             for (uint32_t j = 0; j != config.pBindingNumbers_counts[i]; ++j)
             {
                 MXC_DEBUG("\tbinding number: %u", j);
@@ -124,8 +126,10 @@ namespace mxc
                 vkDestroyDescriptorUpdateTemplate(ctx->device.logical, dTemplate, nullptr);
         // TODO remember to uncomment this when working with regular descriptors
         //vkFreeDescriptorSets(ctx->device.logical, descriptorPool, descriptorSets_count, descriptorSets);
-        for (auto layout : descriptorSetLayouts)
-            vkDestroyDescriptorSetLayout(ctx->device.logical, layout, nullptr);
+        // all the entries are copies of the first layout
+        if (!descriptorSetLayouts.empty())
+            vkDestroyDescriptorSetLayout(ctx->device.logical, descriptorSetLayouts[0], nullptr);
+        descriptorSetLayouts.clear();
 
         vkDestroyDescriptorPool(ctx->device.logical, descriptorPool, nullptr);
     }
@@ -136,6 +140,11 @@ namespace mxc
         VkShaderModuleCreateInfo createInfo {};
         createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
 
+        // every binding is visible from every stage in the set
+        VkShaderStageFlags allStages = 0;
+        for (uint8_t i = 0; i != config.stage_count; ++i)
+            allStages |= config.stageFlags[i];
+
         for (uint8_t i = 0; i != config.stage_count; ++i)
         {
             CComPtr<IDxcBlob> compiledShader = compileShader(config.filenames[i], config.shaderDir);
@@ -158,19 +167,19 @@ namespace mxc
     		.pName = "main",
     		.pSpecializationInfo = nullptr // Note: might be useful in the future
             };
+        }
             
-            if (resConfig.poolSizes_count != 0)
-            {
-                #if defined(_DEBUG)
-                if (!resConfig.pPoolSizes)
-                    MXC_WARN("creating shader resources with a poolSizes count > 0 but pPoolSizes == nullptr");
-                #endif
-                resources.create(ctx, resConfig, config.stageFlags, resConfig.usePushDescriptors); // TODO configurable bool 
-                noResources = false;
-            }
-            else
-                noResources = true;
+        if (resConfig.poolSizes_count != 0)
+        {
+            #if defined(_DEBUG)
+            if (!resConfig.pPoolSizes)
+                MXC_WARN("creating shader resources with a poolSizes count > 0 but pPoolSizes == nullptr");
+            #endif
+            resources.create(ctx, resConfig, allStages, resConfig.usePushDescriptors); // TODO configurable bool 
+            noResources = false;
         }
+        else
+            noResources = true;
 
         // save inputs to vertex shader
         if (config.attributeDescriptions_count != 0)
@@ -216,14 +225,14 @@ namespace mxc
                     .dstArrayElement = 0,
                     .descriptorCount = 1,
                     .descriptorType = m_descriptorsMetadata[i].type,
-                    .offset = j * sizeof(VkDescriptorImageInfo), // TODO: make configurable
-                    .stride = 0 // no stride since we are binding storage images for now. TODO: make configurable
+                    // data is a packed array of DescriptorInfo, in the order in which bindings were given in the ResourceConfiguration
+                    .offset = (runningTotal + j) * sizeof(DescriptorInfo),
+                    .stride = sizeof(DescriptorInfo) // ignored, descriptorCount == 1
                 });
             }
 
             runningTotal += m_descriptorsMetadata[i].descriptorCount;
         }
-        MXC_ASSERT(descriptorUpdateTemplateEntries.size()==2&&runningTotal==2,"in spectrum test there should be 2 descriptorUpdateTemplateEntries");
 
         // create a template for each set
         VkDescriptorUpdateTemplateCreateInfo templateCreateInfo {
@@ -12,6 +12,16 @@
 namespace mxc
 {
 
+	// one element of the data given to ShaderResources::update/updateAll and push descriptors, such that images and buffers can be
+	// mixed in the same template. pImageInfo/pBufferInfo fields of the same binding have the same size on every platform we target
+	union DescriptorInfo
+	{
+		VkDescriptorImageInfo image;
+		VkDescriptorBufferInfo buffer;
+	};
+	static_assert(sizeof(VkDescriptorImageInfo) == sizeof(VkDescriptorBufferInfo), "descriptor infos must be interchangeable");
+
+	// bindings are grouped by descriptor type, pBindingNumbers holds pBindingNumbers_counts[i] entries for pPoolSizes[i]
 	struct ResourceConfiguration
 	{
 		VkDescriptorPoolSize const* pPoolSizes;
@@ -23,11 +33,11 @@ namespace mxc
 	
 	class ShaderResources
 	{
-		static uint32_t constexpr MAX_DESCRIPTOR_COUNT_PER_TYPE = 4;
+		static uint32_t constexpr MAX_DESCRIPTOR_COUNT_PER_TYPE = 16;
 		static uint32_t constexpr MAX_DESCRIPTOR_SETS_COUNT = 8;
 	public:
-		// as many stageFlags as poolSizes_count
-		auto create(VulkanContext* ctx, ResourceConfiguration const& config, VkShaderStageFlagBits const* stageFlags, bool usePushDescriptor) -> bool;
+		// stageFlags are applied to every binding
+		auto create(VulkanContext* ctx, ResourceConfiguration const& config, VkShaderStageFlags stageFlags, bool usePushDescriptor) -> bool;
 		auto destroy(VulkanContext* ctx) -> void;
 
 		// stride is the size of each descriptor in bytes, returned from vkGet*MemoryRequirements. assumed to be equal to the count of descriptor sets
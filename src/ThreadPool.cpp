@@ -0,0 +1,129 @@
+#include "ThreadPool.h"
+#include "logging.h"
+
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+namespace mxc
+{
+    // shared between the caller of parallelFor and the workers helping it. Owned through a shared_ptr, since a worker can start
+    // after the caller returned, in which case it finds no range left and never touches the function
+    struct ParallelForState
+    {
+        ThreadPool::RangeFunction const* pFunction;
+        uint32_t count;
+        uint32_t grainSize;
+        uint32_t range_count;
+        std::atomic<uint32_t> nextRange{0};
+        std::atomic<uint32_t> finishedRanges{0};
+        std::mutex mutex;
+        std::condition_variable cv;
+    };
+
+    // runs ranges until none is left, returns true if it finished the last one
+    static auto runRanges(ParallelForState& state) -> bool
+    {
+        bool finishedLast = false;
+        for (uint32_t r = state.nextRange.fetch_add(1); r < state.range_count; r = state.nextRange.fetch_add(1))
+        {
+            uint32_t const begin = r * state.grainSize;
+            (*state.pFunction)(begin, std::min(begin + state.grainSize, state.count));
+            finishedLast = state.finishedRanges.fetch_add(1) + 1 == state.range_count;
+        }
+        return finishedLast;
+    }
+
+    auto ThreadPool::create(uint32_t threadCount) -> void
+    {
+        if (threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency()) - 1;
+
+        m_stop = false;
+        m_workers.reserve(threadCount);
+        for (uint32_t i = 0; i != threadCount; ++i)
+            m_workers.emplace_back(&ThreadPool::workerLoop, this);
+        MXC_INFO("ThreadPool: %u workers", threadCount);
+    }
+
+    auto ThreadPool::destroy() -> void
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_all();
+        for (std::thread& worker : m_workers)
+            worker.join();
+        m_workers.clear();
+    }
+
+    auto ThreadPool::enqueue(Task task) -> void
+    {
+        if (m_workers.empty())
+        {
+            task();
+            return;
+        }
+
+        {
+            std::lock_guard lock(m_mutex);
+            m_tasks.push_back(std::move(task));
+        }
+        m_cv.notify_one();
+    }
+
+    auto ThreadPool::parallelFor(uint32_t count, uint32_t grainSize, RangeFunction const& function) -> void
+    {
+        if (count == 0)
+            return;
+
+        grainSize = std::max(1u, grainSize);
+        uint32_t const range_count = (count + grainSize - 1) / grainSize;
+        if (range_count == 1 || m_workers.empty())
+        {
+            function(0, count);
+            return;
+        }
+
+        auto state = std::make_shared<ParallelForState>();
+        state->pFunction = &function;
+        state->count = count;
+        state->grainSize = grainSize;
+        state->range_count = range_count;
+
+        uint32_t const helper_count = std::min(range_count - 1, threadCount());
+        for (uint32_t i = 0; i != helper_count; ++i)
+        {
+            enqueue([state] {
+                if (runRanges(*state))
+                {
+                    std::lock_guard lock(state->mutex);
+                    state->cv.notify_all();
+                }
+            });
+        }
+
+        runRanges(*state);
+
+        std::unique_lock lock(state->mutex);
+        state->cv.wait(lock, [&state] { return state->finishedRanges.load() == state->range_count; });
+    }
+
+    auto ThreadPool::workerLoop() -> void
+    {
+        for (;;)
+        {
+            Task task;
+            {
+                std::unique_lock lock(m_mutex);
+                m_cv.wait(lock, [this] { return m_stop || !m_tasks.empty(); });
+                if (m_tasks.empty())
+                    return;
+                task = std::move(m_tasks.front());
+                m_tasks.pop_front();
+            }
+            task();
+        }
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef MXC_THREAD_POOL_H
+#define MXC_THREAD_POOL_H
+
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mxc
+{
+	// Fixed set of worker threads consuming a FIFO of tasks. Meant for CPU side work which splits in independent chunks (image
+	// encoding, scene processing), not for anything touching Vulkan objects externally synchronized by the render loop
+	class ThreadPool
+	{
+	public:
+		using Task = std::function<void()>;
+		// called with a [begin, end) range of indices
+		using RangeFunction = std::function<void(uint32_t, uint32_t)>;
+
+	public:
+		// 0 = one worker per hardware thread, minus the calling one
+		auto create(uint32_t threadCount = 0) -> void;
+		// finishes the tasks already enqueued, then joins the workers
+		auto destroy() -> void;
+
+		auto enqueue(Task task) -> void;
+
+		// splits [0, count) in ranges of at most grainSize indices and runs them on the workers and on the calling thread, returning
+		// once every range has been processed. Safe to call from a worker and from many threads at once, since the caller never
+		// waits for a worker to pick up a range, only for the ones already started to finish
+		auto parallelFor(uint32_t count, uint32_t grainSize, RangeFunction const& function) -> void;
+
+		auto threadCount() const -> uint32_t { return static_cast<uint32_t>(m_workers.size()); }
+
+	private:
+		auto workerLoop() -> void;
+
+	private:
+		std::vector<std::thread> m_workers;
+		std::mutex m_mutex;
+		std::condition_variable m_cv;
+		std::deque<Task> m_tasks;
+		bool m_stop = false;
+	};
+}
+
+#endif // MXC_THREAD_POOL_H
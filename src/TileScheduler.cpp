@@ -0,0 +1,213 @@
+#include "TileScheduler.h"
+#include "VulkanContext.inl"
+#include "logging.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace mxc
+{
+    // position of (x, y) along the curve filling a n x n grid, n power of two
+    static auto hilbertIndex(uint32_t n, uint32_t x, uint32_t y) -> uint64_t
+    {
+        uint64_t d = 0;
+        for (uint32_t s = n / 2; s > 0; s /= 2)
+        {
+            uint32_t const rx = (x & s) > 0;
+            uint32_t const ry = (y & s) > 0;
+            d += static_cast<uint64_t>(s) * s * ((3 * rx) ^ ry);
+            // rotate the quadrant such that the curve enters and leaves it from the right sides
+            if (ry == 0)
+            {
+                if (rx == 1)
+                {
+                    x = n - 1 - x;
+                    y = n - 1 - y;
+                }
+                std::swap(x, y);
+            }
+        }
+        return d;
+    }
+
+    static auto mortonIndex(uint32_t x, uint32_t y) -> uint64_t
+    {
+        auto spreadBits = [](uint64_t v) -> uint64_t {
+            v &= 0xffffffffull;
+            v = (v | (v << 16)) & 0x0000ffff0000ffffull;
+            v = (v | (v << 8))  & 0x00ff00ff00ff00ffull;
+            v = (v | (v << 4))  & 0x0f0f0f0f0f0f0f0full;
+            v = (v | (v << 2))  & 0x3333333333333333ull;
+            v = (v | (v << 1))  & 0x5555555555555555ull;
+            return v;
+        };
+        return spreadBits(x) | (spreadBits(y) << 1);
+    }
+
+    auto TileScheduler::create(VulkanContext* ctx, TileSchedulerConfig const& config, uint32_t filmWidth, uint32_t filmHeight) -> bool
+    {
+        MXC_ASSERT(config.tileSize != 0 && config.timeBudgetMs > 0.f, "TileScheduler needs a positive tile size and time budget");
+        m_config = config;
+
+        // timestamps are written from the graphics queue, which is used for compute work too
+        if (ctx->device.properties.limits.timestampComputeAndGraphics)
+        {
+            m_timestampPeriodNs = ctx->device.properties.limits.timestampPeriod;
+            VkQueryPoolCreateInfo const createInfo {
+                .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+                .queryType = VK_QUERY_TYPE_TIMESTAMP,
+                .queryCount = QUERY_COUNT,
+                .pipelineStatistics = 0
+            };
+            VK_CHECK(vkCreateQueryPool(ctx->device.logical, &createInfo, nullptr, &m_queryPool));
+        }
+        else
+            MXC_WARN("TileScheduler: device doesn't support timestamps on compute queues, submitting one tile at a time");
+
+        resize(filmWidth, filmHeight);
+        return true;
+    }
+
+    auto TileScheduler::destroy(VulkanContext* ctx) -> void
+    {
+        if (m_queryPool != VK_NULL_HANDLE)
+            vkDestroyQueryPool(ctx->device.logical, m_queryPool, nullptr);
+        m_queryPool = VK_NULL_HANDLE;
+        m_tiles.clear();
+    }
+
+    auto TileScheduler::resize(uint32_t filmWidth, uint32_t filmHeight) -> void
+    {
+        VkRect2D crop = m_config.cropWindow;
+        if (crop.extent.width == 0 || crop.extent.height == 0)
+            crop = {{0, 0}, {filmWidth, filmHeight}};
+
+        // clamp to the film, a crop window outside of it degenerates to the whole film
+        uint32_t const x0 = std::min(static_cast<uint32_t>(std::max(crop.offset.x, 0)), filmWidth);
+        uint32_t const y0 = std::min(static_cast<uint32_t>(std::max(crop.offset.y, 0)), filmHeight);
+        uint32_t const x1 = std::min(x0 + crop.extent.width, filmWidth);
+        uint32_t const y1 = std::min(y0 + crop.extent.height, filmHeight);
+        if (x1 == x0 || y1 == y0)
+        {
+            MXC_WARN("TileScheduler: crop window doesn't intersect the %ux%u film, rendering all of it", filmWidth, filmHeight);
+            m_crop = {{0, 0}, {filmWidth, filmHeight}};
+        }
+        else
+            m_crop = {{static_cast<int32_t>(x0), static_cast<int32_t>(y0)}, {x1 - x0, y1 - y0}};
+
+        generateTiles();
+        m_nextTile = 0;
+    }
+
+    auto TileScheduler::generateTiles() -> void
+    {
+        uint32_t const size = m_config.tileSize;
+        uint32_t const tilesX = (m_crop.extent.width + size - 1) / size;
+        uint32_t const tilesY = (m_crop.extent.height + size - 1) / size;
+        uint32_t gridSize = 1;
+        while (gridSize < tilesX || gridSize < tilesY)
+            gridSize <<= 1;
+
+        struct KeyedTile { uint64_t key; Tile tile; };
+        std::vector<KeyedTile> keyedTiles;
+        keyedTiles.reserve(tilesX * tilesY);
+        for (uint32_t ty = 0; ty != tilesY; ++ty)
+        {
+            for (uint32_t tx = 0; tx != tilesX; ++tx)
+            {
+                uint64_t key = 0;
+                switch (m_config.order)
+                {
+                    case TileOrder::SCANLINE: key = static_cast<uint64_t>(ty) * tilesX + tx; break;
+                    case TileOrder::MORTON:   key = mortonIndex(tx, ty);                     break;
+                    case TileOrder::HILBERT:  key = hilbertIndex(gridSize, tx, ty);          break;
+                }
+
+                uint32_t const x = m_crop.offset.x + tx * size;
+                uint32_t const y = m_crop.offset.y + ty * size;
+                keyedTiles.push_back({key, {
+                    .x = x, .y = y,
+                    .width = std::min(size, m_crop.offset.x + m_crop.extent.width - x),
+                    .height = std::min(size, m_crop.offset.y + m_crop.extent.height - y)
+                }});
+            }
+        }
+        std::sort(keyedTiles.begin(), keyedTiles.end(), [](KeyedTile const& a, KeyedTile const& b) { return a.key < b.key; });
+
+        m_tiles.resize(keyedTiles.size());
+        std::transform(keyedTiles.cbegin(), keyedTiles.cend(), m_tiles.begin(), [](KeyedTile const& kt) { return kt.tile; });
+        MXC_DEBUG("TileScheduler: %u tiles of %u pixels over a %ux%u crop window",
+                  tileCount(), size, m_crop.extent.width, m_crop.extent.height);
+    }
+
+    auto TileScheduler::collectTiming(VulkanContext* ctx) -> void
+    {
+        if (!m_queryPending)
+            return;
+        m_queryPending = false;
+
+        uint64_t timestamps[QUERY_COUNT];
+        VkResult const res = vkGetQueryPoolResults(ctx->device.logical, m_queryPool, 0, QUERY_COUNT, sizeof(timestamps), timestamps,
+                                                   sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+        if (res != VK_SUCCESS || timestamps[1] <= timestamps[0] || m_batchPixels == 0)
+            return;
+
+        float const batchMs = static_cast<float>(timestamps[1] - timestamps[0]) * m_timestampPeriodNs * 1e-6f;
+        float const msPerPixel = batchMs / m_batchPixels;
+        m_msPerPixel = m_msPerPixel == 0.f ? msPerPixel : COST_SMOOTHING * msPerPixel + (1.f - COST_SMOOTHING) * m_msPerPixel;
+        MXC_TRACE("TileScheduler: last batch took %f ms, %f us per pixel", batchMs, m_msPerPixel * 1e3f);
+    }
+
+    auto TileScheduler::beginBatch(VulkanContext* ctx, VkCommandBuffer cmdBuf) -> TileBatch
+    {
+        MXC_ASSERT(!m_tiles.empty(), "TileScheduler::beginBatch called without tiles");
+        collectTiming(ctx);
+
+        // greedy fill of the time budget, at least one tile, never across the end of a pass. Until there is a measurement, the
+        // first batch is a single tile
+        uint32_t const remaining = tileCount() - m_nextTile;
+        uint32_t count = 1;
+        if (m_msPerPixel > 0.f)
+        {
+            float const pixelBudget = m_config.timeBudgetMs / m_msPerPixel;
+            uint32_t pixels = m_tiles[m_nextTile].width * m_tiles[m_nextTile].height;
+            while (count != remaining)
+            {
+                Tile const& next = m_tiles[m_nextTile + count];
+                if (static_cast<float>(pixels + next.width * next.height) > pixelBudget)
+                    break;
+                pixels += next.width * next.height;
+                ++count;
+            }
+        }
+
+        TileBatch const batch {
+            .pTiles = &m_tiles[m_nextTile],
+            .tile_count = count,
+            .completesPass = count == remaining
+        };
+
+        m_batchPixels = 0;
+        for (uint32_t i = 0; i != count; ++i)
+            m_batchPixels += batch.pTiles[i].width * batch.pTiles[i].height;
+        m_nextTile = batch.completesPass ? 0 : m_nextTile + count;
+
+        if (m_queryPool != VK_NULL_HANDLE)
+        {
+            vkCmdResetQueryPool(cmdBuf, m_queryPool, 0, QUERY_COUNT);
+            vkCmdWriteTimestamp(cmdBuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_queryPool, 0);
+        }
+        return batch;
+    }
+
+    auto TileScheduler::endBatch(VkCommandBuffer cmdBuf) -> void
+    {
+        if (m_queryPool == VK_NULL_HANDLE)
+            return;
+
+        vkCmdWriteTimestamp(cmdBuf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPool, 1);
+        m_queryPending = true;
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef MXC_TILE_SCHEDULER_H
+#define MXC_TILE_SCHEDULER_H
+
+#include <vulkan/vulkan.h>
+#include "VulkanCommon.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace mxc
+{
+	enum class TileOrder : uint8_t
+	{
+		SCANLINE, MORTON, HILBERT
+	};
+
+	struct Tile
+	{
+		uint32_t x, y;
+		uint32_t width, height; // smaller than the tile size on the right and bottom borders of the crop window
+	};
+
+	struct TileSchedulerConfig
+	{
+		VkRect2D cropWindow = {{0, 0}, {0, 0}}; // region of interest, a zero extent renders the whole film
+		uint32_t tileSize = 64;
+		float timeBudgetMs = 30.f; // GPU time a single submission should take, well below the driver watchdog
+		TileOrder order = TileOrder::HILBERT;
+	};
+
+	// tiles of the current pass given to a single submission
+	struct TileBatch
+	{
+		Tile const* pTiles;
+		uint32_t tile_count;
+		bool completesPass; // after this batch every tile of the crop window received one more pass
+	};
+
+	// Splits the film (or its crop window) into tiles walked in a space filling curve order, such that consecutive dispatches touch
+	// neighbouring pixels, and hands out as many as fit in the time budget of a submission. The cost of a tile is estimated from
+	// timestamp queries around the previous batch, with an exponential moving average of the GPU time per pixel
+	class TileScheduler
+	{
+		static uint32_t constexpr QUERY_COUNT = 2;
+		static float constexpr COST_SMOOTHING = 0.25f; // weight of the newest measurement in the moving average
+	public:
+		auto create(VulkanContext* ctx, TileSchedulerConfig const& config, uint32_t filmWidth, uint32_t filmHeight) -> bool;
+		auto destroy(VulkanContext* ctx) -> void;
+
+		// regenerates the tiles, and restarts the pass from the first one. The crop window is clamped to the new extent
+		auto resize(uint32_t filmWidth, uint32_t filmHeight) -> void;
+
+		// collects the timing of the previous batch, whose command buffer has to be complete by now, chooses the tiles of the next one
+		// and records the first timestamp. To be called inside a recording command buffer, with endBatch after the tile dispatches
+		auto beginBatch(VulkanContext* ctx, VkCommandBuffer cmdBuf) -> TileBatch;
+		auto endBatch(VkCommandBuffer cmdBuf) -> void;
+
+		auto tileCount() const -> uint32_t { return static_cast<uint32_t>(m_tiles.size()); }
+		auto cropWindow() const -> VkRect2D { return m_crop; }
+
+	private:
+		auto generateTiles() -> void;
+		auto collectTiming(VulkanContext* ctx) -> void;
+
+	private:
+		TileSchedulerConfig m_config;
+		VkRect2D m_crop;
+		std::vector<Tile> m_tiles;
+		uint32_t m_nextTile = 0;
+		uint32_t m_batchPixels = 0;
+
+		VkQueryPool m_queryPool = VK_NULL_HANDLE;
+		float m_timestampPeriodNs = 0.f; // 0 when timestamps are not supported, and batches are then sized by tile count only
+		float m_msPerPixel = 0.f; // 0 until the first measurement
+		bool m_queryPending = false;
+	};
+}
+
+#endif // MXC_TILE_SCHEDULER_H
@@ -34,7 +34,7 @@ namespace mxc
     auto VulkanApplication::run() -> void
     {
         std::chrono::high_resolution_clock::time_point lastTime = std::chrono::high_resolution_clock::now();
-        while (!glfwWindowShouldClose(m_window) && !layersEmpty() && m_state == ApplicationState::OK)
+        while ((m_headless || !glfwWindowShouldClose(m_window)) && !layersEmpty() && m_state == ApplicationState::OK)
         {
             float deltaTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - lastTime).count();
             lastTime = std::chrono::high_resolution_clock::now();
@@ -42,7 +42,9 @@ namespace mxc
 
             tick(deltaTime);
 
-	    glfwWaitEventsTimeout(0.016666666f);
+            // no events to wait for when headless, submit the next batch of work right away
+            if (!m_headless)
+	        glfwWaitEventsTimeout(0.016666666f);
         }
 	MXC_INFO("--- Closing The Window ---");
 
@@ -62,6 +64,8 @@ namespace mxc
     auto VulkanApplication::init() -> bool
     {
 	MXC_TRACE("VulkanApplication::init");
+        if (m_headless)
+            return initHeadless();
         
 	if (!glfwInit())
 	{
@@ -128,14 +132,44 @@ namespace mxc
         return true;
     }
 
+    auto VulkanApplication::initHeadless() -> bool
+    {
+        MXC_INFO("Running headless, %ux%u offscreen images", m_headlessExtent.width, m_headlessExtent.height);
+        mxc::RendererConfig config{};
+        config.windowWidth = m_headlessExtent.width;
+        config.windowHeight = m_headlessExtent.height;
+        config.headless = true;
+
+	MXC_DEBUG("creating the renderer");
+    	if (!m_renderer.init(config))
+	{
+	    MXC_ERROR("Failed to initialize the renderer");
+	    return false;
+	}
+	MXC_INFO("renderer successfully created");
+
+	MXC_DEBUG("initializing application layers");
+        if (!Application::init())
+	{
+	    MXC_ERROR("Failed to initialize application layers");
+            return false;
+	}
+	MXC_INFO("Application layers initialized");
+
+        return true;
+    }
+
     auto VulkanApplication::shutdown() -> void
     {
         // necessary before buffers
         m_renderer.resetCommandBuffersForDestruction();
 
         m_renderer.cleanup();
-        glfwDestroyWindow(m_window);
-        glfwTerminate();
+        if (!m_headless)
+        {
+            glfwDestroyWindow(m_window);
+            glfwTerminate();
+        }
     }
 
     auto VulkanApplication::handleSignal(ApplicationSignal_t sig, uint32_t emitterLayerIndex) -> bool
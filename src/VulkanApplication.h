@@ -38,15 +38,24 @@ namespace mxc
 		auto getRenderer() & -> Renderer& { return m_renderer; }
 		auto getWindowExtent() const -> WindowExtent
 		{ 
+			if (m_headless)
+				return m_headlessExtent;
+
 			int32_t width, height;
 			glfwGetFramebufferSize(m_window, &width, &height);
 			return { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
 		}
 
+		// to be called before init (i.e. from initializeApplication). No window is created and GLFW is never initialized, 
+		// the renderer draws into offscreen images of the given extent. The application runs until a layer closes it
+		auto setHeadless(WindowExtent extent) -> void { m_headless = true; m_headlessExtent = extent; }
+		auto isHeadless() const -> bool { return m_headless; }
+
 	private:
 		auto run() -> void;
 		
 		auto init() -> bool;
+		auto initHeadless() -> bool;
 		auto tick(float deltaTime) -> void;
 		auto shutdown() -> void;
 
@@ -59,6 +68,8 @@ namespace mxc
 	private:
 		GLFWwindow* m_window;
 		Renderer m_renderer;
+		WindowExtent m_headlessExtent{};
+		bool m_headless = false;
 	};
 
 }
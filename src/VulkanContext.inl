@@ -32,6 +32,8 @@ namespace mxc
 		VkDebugUtilsMessengerEXT debugMessenger;
 #endif
 
+		// headless: no surface nor swapchain, compute work writes into offscreenImages instead
+		bool headless = false;
 		VkSurfaceKHR surface = VK_NULL_HANDLE;
 		Swapchain swapchain;
 
@@ -50,6 +52,20 @@ namespace mxc
 		VkFormat depthFormat;
 		struct ImageViewPair {Image image; ImageView view;};
 		std::vector<ImageViewPair> depthImages; // as many as command buffers. Type to be replaced
+
+		VkFormat offscreenFormat = VK_FORMAT_R8G8B8A8_UNORM; // guaranteed to support VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT
+		std::vector<ImageViewPair> offscreenImages; // headless only, stand in for the swapchain images
+
+		// images the renderer hands to compute commands, swapchain images or offscreen images in headless mode
+		auto outputImageCount() const -> uint32_t 
+		{ 
+			return static_cast<uint32_t>(headless ? offscreenImages.size() : swapchain.images.size()); 
+		}
+		auto outputImage(uint32_t i) const -> SwapchainImage
+		{
+			return headless ? SwapchainImage{offscreenImages[i].image.handle, offscreenImages[i].view.handle} : swapchain.images[i];
+		}
+		auto outputFormat() const -> VkFormat { return headless ? offscreenFormat : swapchain.imageFormat.format; }
 	};
 }
 
@@ -0,0 +1,400 @@
+#include "WideBvh.h"
+#include "Bvh.h"
+#include "logging.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <random>
+
+namespace mxc
+{
+    // a child of a wide node is either a binary interior node, collapsed further, or a range of the leaf sorted primitive indices,
+    // a leaf slot if it fits in one, otherwise an interior slot whose node splits it in chunks
+    struct CollapseChild
+    {
+        float boundsMin[3];
+        float boundsMax[3];
+        uint32_t binaryNode; // UINT32_MAX for ranges
+        uint32_t first;
+        uint32_t count;
+    };
+
+    static auto isInterior(CollapseChild const& child) -> bool
+    {
+        return child.binaryNode != UINT32_MAX || child.count > WIDE_BVH_MAX_LEAF_PRIMITIVES;
+    }
+
+    struct CollapseState
+    {
+        BvhNode const* pBinaryNodes;
+        uint32_t const* pBinaryPrimitives;
+        std::vector<uint32_t> subtreeFirst; // range of the leaf sorted primitives under each binary node
+        std::vector<uint32_t> subtreeCount;
+        std::vector<WideBvhNode>* pNodes;
+        std::vector<uint32_t>* pPrimitives;
+        uint32_t depth;
+    };
+
+    // subtrees small enough for a leaf slot are taken whole, their primitives are consecutive since the binary BVH is depth first
+    static auto fromBinary(CollapseState const& state, uint32_t nodeIndex) -> CollapseChild
+    {
+        BvhNode const& node = state.pBinaryNodes[nodeIndex];
+        bool const range = (node.info & 0xffff) != 0 || state.subtreeCount[nodeIndex] <= WIDE_BVH_MAX_LEAF_PRIMITIVES;
+        CollapseChild child {
+            .boundsMin = { node.boundsMin[0], node.boundsMin[1], node.boundsMin[2] },
+            .boundsMax = { node.boundsMax[0], node.boundsMax[1], node.boundsMax[2] },
+            .binaryNode = range ? UINT32_MAX : nodeIndex,
+            .first = state.subtreeFirst[nodeIndex],
+            .count = state.subtreeCount[nodeIndex]
+        };
+        return child;
+    }
+
+    static auto surfaceArea(CollapseChild const& child) -> float
+    {
+        float const dx = child.boundsMax[0] - child.boundsMin[0];
+        float const dy = child.boundsMax[1] - child.boundsMin[1];
+        float const dz = child.boundsMax[2] - child.boundsMin[2];
+        return 2.f * (dx * dy + dy * dz + dz * dx);
+    }
+
+    // children of the wide node replacing source
+    static auto gatherChildren(CollapseState const& state, CollapseChild const& source, CollapseChild* pOutChildren) -> uint32_t
+    {
+        if (source.binaryNode == UINT32_MAX)
+        {
+            // chunks of a leaf too large for a slot, keeping its bounds, it only happens at the depth limit of the binary builder
+            uint32_t const chunkSize = std::max(WIDE_BVH_MAX_LEAF_PRIMITIVES, (source.count + WIDE_BVH_WIDTH - 1) / WIDE_BVH_WIDTH);
+            uint32_t child_count = 0;
+            for (uint32_t first = 0; first < source.count; first += chunkSize)
+            {
+                pOutChildren[child_count] = source;
+                pOutChildren[child_count].first = source.first + first;
+                pOutChildren[child_count].count = std::min(chunkSize, source.count - first);
+                ++child_count;
+            }
+            return child_count;
+        }
+
+        BvhNode const* pNodes = state.pBinaryNodes;
+        pOutChildren[0] = fromBinary(state, source.binaryNode + 1);
+        pOutChildren[1] = fromBinary(state, pNodes[source.binaryNode].offset);
+        uint32_t child_count = 2;
+        while (child_count != WIDE_BVH_WIDTH)
+        {
+            uint32_t largest = UINT32_MAX;
+            float largestArea = -1.f;
+            for (uint32_t c = 0; c != child_count; ++c)
+            {
+                if (pOutChildren[c].binaryNode != UINT32_MAX && surfaceArea(pOutChildren[c]) > largestArea)
+                {
+                    largest = c;
+                    largestArea = surfaceArea(pOutChildren[c]);
+                }
+            }
+            if (largest == UINT32_MAX)
+                break;
+
+            uint32_t const opened = pOutChildren[largest].binaryNode;
+            pOutChildren[largest] = fromBinary(state, opened + 1);
+            pOutChildren[child_count++] = fromBinary(state, pNodes[opened].offset);
+        }
+        return child_count;
+    }
+
+    // greedy matching of children to slots, slot bit a set for the positive side along axis a of the node center
+    static auto assignSlots(CollapseChild const* pChildren, uint32_t child_count, float const boundsMin[3], float const boundsMax[3],
+                            uint32_t* pOutSlots) -> void
+    {
+        float scores[WIDE_BVH_WIDTH][WIDE_BVH_WIDTH];
+        for (uint32_t c = 0; c != child_count; ++c)
+        {
+            for (uint32_t s = 0; s != WIDE_BVH_WIDTH; ++s)
+            {
+                scores[c][s] = 0.f;
+                for (uint32_t a = 0; a != 3; ++a)
+                {
+                    float const extent = boundsMax[a] - boundsMin[a];
+                    float const offset = 0.5f * (pChildren[c].boundsMin[a] + pChildren[c].boundsMax[a])
+                                       - 0.5f * (boundsMin[a] + boundsMax[a]);
+                    float const relative = extent > 0.f ? offset / extent : 0.f;
+                    scores[c][s] += (s & (1u << a)) ? relative : -relative;
+                }
+            }
+        }
+
+        bool childAssigned[WIDE_BVH_WIDTH] {};
+        bool slotUsed[WIDE_BVH_WIDTH] {};
+        for (uint32_t assigned = 0; assigned != child_count; ++assigned)
+        {
+            uint32_t bestChild = 0, bestSlot = 0;
+            float bestScore = -std::numeric_limits<float>::infinity();
+            for (uint32_t c = 0; c != child_count; ++c)
+                for (uint32_t s = 0; s != WIDE_BVH_WIDTH; ++s)
+                    if (!childAssigned[c] && !slotUsed[s] && scores[c][s] > bestScore)
+                    {
+                        bestScore = scores[c][s];
+                        bestChild = c;
+                        bestSlot = s;
+                    }
+            childAssigned[bestChild] = true;
+            slotUsed[bestSlot] = true;
+            pOutSlots[bestChild] = bestSlot;
+        }
+    }
+
+    static auto decode(float origin, uint32_t q, float scale) -> float
+    {
+        return origin + static_cast<float>(q) * scale;
+    }
+
+    // smallest power of two step such that 255 steps from origin reach boundsMax, after rounding
+    static auto quantizationExponent(float boundsMin, float boundsMax) -> int32_t
+    {
+        float const extent = boundsMax - boundsMin;
+        int32_t exponent = extent > 0.f ? static_cast<int32_t>(std::ceil(std::log2(static_cast<double>(extent) / 255.0))) : -126;
+        exponent = std::clamp(exponent, -126, 127);
+        while (exponent < 127 && decode(boundsMin, 255, std::ldexp(1.f, exponent)) < boundsMax)
+            ++exponent;
+        return exponent;
+    }
+
+    static auto quantizeMin(float origin, float scale, float value) -> uint8_t
+    {
+        double const steps = std::floor((static_cast<double>(value) - origin) / scale);
+        uint32_t q = static_cast<uint32_t>(std::clamp(steps, 0.0, 255.0));
+        while (q > 0 && decode(origin, q, scale) > value)
+            --q;
+        return static_cast<uint8_t>(q);
+    }
+
+    static auto quantizeMax(float origin, float scale, float value) -> uint8_t
+    {
+        double const steps = std::ceil((static_cast<double>(value) - origin) / scale);
+        uint32_t q = static_cast<uint32_t>(std::clamp(steps, 0.0, 255.0));
+        while (q < 255 && decode(origin, q, scale) < value)
+            ++q;
+        return static_cast<uint8_t>(q);
+    }
+
+    static auto emitNode(CollapseState& state, uint32_t wideIndex, CollapseChild const& source, uint32_t depth) -> void
+    {
+        state.depth = std::max(state.depth, depth + 1);
+
+        CollapseChild children[WIDE_BVH_WIDTH];
+        uint32_t const child_count = gatherChildren(state, source, children);
+        uint32_t slots[WIDE_BVH_WIDTH];
+        assignSlots(children, child_count, source.boundsMin, source.boundsMax, slots);
+
+        WideBvhNode node{};
+        float scale[3];
+        for (uint32_t a = 0; a != 3; ++a)
+        {
+            int32_t const exponent = quantizationExponent(source.boundsMin[a], source.boundsMax[a]);
+            node.origin[a] = source.boundsMin[a];
+            node.exponents[a] = static_cast<uint8_t>(exponent + 127);
+            scale[a] = std::ldexp(1.f, exponent);
+        }
+        for (uint32_t s = 0; s != WIDE_BVH_WIDTH; ++s)
+            for (uint32_t a = 0; a != 3; ++a)
+            {
+                node.qMin[a][s] = 255;
+                node.qMax[a][s] = 0;
+            }
+
+        // interior children get consecutive nodes in slot order, leaves consecutive primitives in slot order
+        CollapseChild const* pBySlot[WIDE_BVH_WIDTH] {};
+        for (uint32_t c = 0; c != child_count; ++c)
+            pBySlot[slots[c]] = &children[c];
+
+        node.childBaseIndex = static_cast<uint32_t>(state.pNodes->size());
+        node.primitiveBaseIndex = static_cast<uint32_t>(state.pPrimitives->size());
+        uint32_t inner_count = 0;
+        for (uint32_t s = 0; s != WIDE_BVH_WIDTH; ++s)
+        {
+            CollapseChild const* pChild = pBySlot[s];
+            if (!pChild)
+                continue;
+
+            for (uint32_t a = 0; a != 3; ++a)
+            {
+                node.qMin[a][s] = quantizeMin(node.origin[a], scale[a], pChild->boundsMin[a]);
+                node.qMax[a][s] = quantizeMax(node.origin[a], scale[a], pChild->boundsMax[a]);
+            }
+
+            if (isInterior(*pChild))
+            {
+                node.innerMask |= static_cast<uint8_t>(1u << s);
+                ++inner_count;
+            }
+            else
+            {
+                uint32_t const offset = static_cast<uint32_t>(state.pPrimitives->size()) - node.primitiveBaseIndex;
+                MXC_ASSERT(offset < 64, "WideBvh: leaf primitives offset %u doesn't fit in 6 bits", offset);
+                node.meta[s] = static_cast<uint8_t>(offset << 2 | (pChild->count - 1));
+                state.pPrimitives->insert(state.pPrimitives->end(), state.pBinaryPrimitives + pChild->first,
+                                          state.pBinaryPrimitives + pChild->first + pChild->count);
+            }
+        }
+
+        state.pNodes->resize(state.pNodes->size() + inner_count);
+        (*state.pNodes)[wideIndex] = node;
+
+        uint32_t rank = 0;
+        for (uint32_t s = 0; s != WIDE_BVH_WIDTH; ++s)
+            if (node.innerMask & (1u << s))
+                emitNode(state, node.childBaseIndex + rank++, *pBySlot[s], depth + 1);
+    }
+
+    auto WideBvh::build(Bvh const& bvh) -> void
+    {
+        clear();
+        if (bvh.nodeCount() == 0)
+            return;
+
+        m_nodes.reserve(bvh.nodeCount() / 4 + 1);
+        m_nodes.resize(1);
+        m_primitiveIndices.reserve(bvh.primitiveCount());
+        CollapseState state {
+            .pBinaryNodes = bvh.nodes(),
+            .pBinaryPrimitives = bvh.primitiveIndices(),
+            .subtreeFirst = std::vector<uint32_t>(bvh.nodeCount()),
+            .subtreeCount = std::vector<uint32_t>(bvh.nodeCount()),
+            .pNodes = &m_nodes,
+            .pPrimitives = &m_primitiveIndices,
+            .depth = 0
+        };
+
+        // children come after their parent in the depth first order
+        for (uint32_t i = bvh.nodeCount(); i-- != 0;)
+        {
+            BvhNode const& node = bvh.nodes()[i];
+            uint32_t const count = node.info & 0xffff;
+            state.subtreeFirst[i] = count != 0 ? node.offset : state.subtreeFirst[i + 1];
+            state.subtreeCount[i] = count != 0 ? count : state.subtreeCount[i + 1] + state.subtreeCount[node.offset];
+        }
+
+        // a root leaf is gathered as a range, ending up in a single slot of the root node
+        emitNode(state, 0, fromBinary(state, 0), 0);
+        m_depth = state.depth;
+        MXC_ASSERT(m_depth <= WIDE_BVH_STACK_SIZE, "WideBvh: depth %u exceeds the traversal stack", m_depth);
+
+        MXC_INFO("WideBvh: %u nodes, depth %u, %.1f KiB against %.1f KiB of the binary BVH", nodeCount(), m_depth,
+                 nodeCount() * sizeof(WideBvhNode) / 1024.f, bvh.nodeCount() * sizeof(BvhNode) / 1024.f);
+    }
+
+    auto WideBvh::clear() -> void
+    {
+        m_nodes.clear();
+        m_primitiveIndices.clear();
+        m_depth = 0;
+    }
+
+    // entry distance of the ray into the box, clamped to 0 for origins inside it, or tMax when it misses before tMax. The exit
+    // distance is widened as in the traversals, such that parents are never culled where their children are hit
+    static auto intersectBox(float const boundsMin[3], float const boundsMax[3], float const origin[3], float const invDir[3], float tMax)
+        -> float
+    {
+        float tEnter = 0.f, tExit = tMax;
+        for (uint32_t a = 0; a != 3; ++a)
+        {
+            float t0 = (boundsMin[a] - origin[a]) * invDir[a];
+            float t1 = (boundsMax[a] - origin[a]) * invDir[a];
+            if (t0 > t1)
+                std::swap(t0, t1);
+            t1 *= 1.f + 6.f * 5.96046448e-8f;
+            tEnter = std::max(tEnter, t0);
+            tExit = std::min(tExit, t1);
+        }
+        return tEnter <= tExit ? tEnter : tMax;
+    }
+
+    // depth first, nearest child first along the split axis, as the binary traversal of the shader. Returns the visited nodes
+    static auto traverseBinary(Bvh const& bvh, Aabb const* pPrimitiveBounds, float const origin[3], float const direction[3],
+                               float const invDir[3], float* pInOutTMax) -> uint32_t
+    {
+        uint32_t stack[BVH_MAX_DEPTH];
+        uint32_t stackSize = 0;
+        uint32_t nodeIndex = 0;
+        uint32_t steps = 0;
+        for (;;)
+        {
+            ++steps;
+            BvhNode const& node = bvh.nodes()[nodeIndex];
+            if (intersectBox(node.boundsMin, node.boundsMax, origin, invDir, *pInOutTMax) != *pInOutTMax)
+            {
+                uint32_t const count = node.info & 0xffff;
+                if (count == 0)
+                {
+                    bool const backFirst = direction[node.info >> 16] < 0.f;
+                    stack[stackSize++] = backFirst ? nodeIndex + 1 : node.offset;
+                    nodeIndex = backFirst ? node.offset : nodeIndex + 1;
+                    continue;
+                }
+                for (uint32_t p = 0; p != count; ++p)
+                {
+                    Aabb const& bounds = pPrimitiveBounds[bvh.primitiveIndices()[node.offset + p]];
+                    *pInOutTMax = intersectBox(bounds.min, bounds.max, origin, invDir, *pInOutTMax);
+                }
+            }
+            if (stackSize == 0)
+                break;
+            nodeIndex = stack[--stackSize];
+        }
+        return steps;
+    }
+
+    auto WideBvh::validate(Bvh const& bvh, Aabb const* pPrimitiveBounds, uint32_t ray_count) const -> bool
+    {
+        if (m_nodes.empty() || bvh.nodeCount() == 0)
+            return true;
+
+        auto const start = std::chrono::steady_clock::now();
+        BvhNode const& root = bvh.nodes()[0];
+        std::mt19937 generator(0x9e3779b9u); // the same rays every run
+        std::uniform_real_distribution<float> uniform(0.f, 1.f);
+        uint64_t binarySteps = 0, wideSteps = 0;
+        uint32_t hit_count = 0;
+        for (uint32_t r = 0; r != ray_count; ++r)
+        {
+            // from a point of the scene bounds, uniformly over the sphere of directions
+            float origin[3], direction[3], invDir[3];
+            for (uint32_t a = 0; a != 3; ++a)
+                origin[a] = root.boundsMin[a] + uniform(generator) * (root.boundsMax[a] - root.boundsMin[a]);
+            float const z = 1.f - 2.f * uniform(generator);
+            float const radius = std::sqrt(std::max(0.f, 1.f - z * z));
+            float const phi = 2.f * 3.14159265f * uniform(generator);
+            direction[0] = radius * std::cos(phi);
+            direction[1] = radius * std::sin(phi);
+            direction[2] = z;
+            for (uint32_t a = 0; a != 3; ++a)
+                invDir[a] = 1.f / direction[a];
+
+            float binaryT = std::numeric_limits<float>::max();
+            binarySteps += traverseBinary(bvh, pPrimitiveBounds, origin, direction, invDir, &binaryT);
+            // traverse takes tMax by value, the closest hit is kept on the way
+            float wideT = std::numeric_limits<float>::max();
+            wideSteps += traverse(origin, direction, wideT, [&](uint32_t primitiveIndex, float tMax) {
+                Aabb const& bounds = pPrimitiveBounds[primitiveIndex];
+                wideT = intersectBox(bounds.min, bounds.max, origin, invDir, tMax);
+                return wideT;
+            });
+
+            if (wideT != binaryT)
+            {
+                MXC_ERROR("WideBvh: ray %u hits a primitive box at %g through the wide BVH, at %g through the binary one", r,
+                          wideT, binaryT);
+                return false;
+            }
+            hit_count += binaryT != std::numeric_limits<float>::max() ? 1 : 0;
+        }
+
+        MXC_INFO("WideBvh: %u rays (%u hits) match the binary BVH, %.1f nodes visited per ray against %.1f, in %.1f ms", ray_count,
+                 hit_count, static_cast<float>(wideSteps) / std::max(1u, ray_count),
+                 static_cast<float>(binarySteps) / std::max(1u, ray_count),
+                 std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+        return true;
+    }
+}
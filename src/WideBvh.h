@@ -0,0 +1,151 @@
+#ifndef MXC_WIDE_BVH_H
+#define MXC_WIDE_BVH_H
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace mxc
+{
+	class Bvh;
+	struct Aabb;
+
+	static uint32_t constexpr WIDE_BVH_WIDTH = 8;
+	static uint32_t constexpr WIDE_BVH_MAX_LEAF_PRIMITIVES = 4; // 2 bits of the leaf meta byte
+	static uint32_t constexpr WIDE_BVH_STACK_SIZE = 64;         // WIDE_BVH_STACK_SIZE in shaders/spectrumTest/bvh.comp
+
+	// 80 bytes for 8 children, against 32 bytes for each of the 2 children of a BvhNode. Child boxes are stored as 8 bit offsets
+	// from origin in units of 2^(exponent - 127) per axis, rounded outwards, such that decoded boxes always contain the original.
+	// Interior children are consecutive nodes from childBaseIndex in slot order, leaf children reference up to 4 consecutive
+	// primitive indices from primitiveBaseIndex. Empty slots have qMin > qMax and are never hit.
+	// Slots are assigned such that slot bit a is set for children on the positive side of the node along axis a, hence visiting
+	// slots i ^ octant for i = 0..7, with octant the signs of the ray direction, goes roughly front to back.
+	// WideBvhNode in shaders/spectrumTest/bvh.comp
+	struct WideBvhNode
+	{
+		float origin[3];
+		uint8_t exponents[3];
+		uint8_t innerMask;           // bit i set: slot i is an interior node
+		uint32_t childBaseIndex;
+		uint32_t primitiveBaseIndex;
+		uint8_t meta[WIDE_BVH_WIDTH]; // leaf slots: offset from primitiveBaseIndex << 2 | (count - 1)
+		uint8_t qMin[3][WIDE_BVH_WIDTH];
+		uint8_t qMax[3][WIDE_BVH_WIDTH];
+	};
+	static_assert(sizeof(WideBvhNode) == 80);
+
+	// Collapse of a binary Bvh into nodes of 8 children: each wide node opens the binary interior child of largest surface area
+	// until it holds 8 children or only leaves. The layout is depth first, with the interior children of a node kept consecutive
+	class WideBvh
+	{
+	public:
+		auto build(Bvh const& bvh) -> void;
+		auto clear() -> void;
+
+		auto nodeCount() const -> uint32_t { return static_cast<uint32_t>(m_nodes.size()); }
+		auto primitiveCount() const -> uint32_t { return static_cast<uint32_t>(m_primitiveIndices.size()); }
+		auto nodes() const -> WideBvhNode const* { return m_nodes.data(); }
+		auto primitiveIndices() const -> uint32_t const* { return m_primitiveIndices.data(); }
+		auto depth() const -> uint32_t { return m_depth; }
+
+		// Same traversal as the shader. intersectPrimitive(uint32_t primitiveIndex, float tMax) -> float returns the distance of a
+		// hit closer than tMax, or tMax when missing. Returns the count of visited nodes
+		template <typename F>
+		auto traverse(float const origin[3], float const direction[3], float tMax, F&& intersectPrimitive) const -> uint32_t;
+
+		// Traces ray_count random rays through the tree and through bvh, the binary BVH it was built from, against the primitive
+		// boxes, and checks both find the same closest boxes. Logs the nodes visited per ray by each, false on a mismatch
+		auto validate(Bvh const& bvh, Aabb const* pPrimitiveBounds, uint32_t ray_count) const -> bool;
+
+	private:
+		std::vector<WideBvhNode> m_nodes;
+		std::vector<uint32_t> m_primitiveIndices;
+		uint32_t m_depth = 0;
+	};
+
+	template <typename F>
+	auto WideBvh::traverse(float const origin[3], float const direction[3], float tMax, F&& intersectPrimitive) const -> uint32_t
+	{
+		if (m_nodes.empty())
+			return 0;
+
+		float invDir[3];
+		uint32_t octant = 0;
+		for (uint32_t a = 0; a != 3; ++a)
+		{
+			invDir[a] = 1.f / direction[a];
+			octant |= (direction[a] < 0.f ? 1u : 0u) << a;
+		}
+
+		struct StackEntry { uint32_t childBaseIndex; uint32_t hitsInnerMask; }; // hits in visit order in the low byte
+		StackEntry stack[WIDE_BVH_STACK_SIZE];
+		uint32_t stackSize = 0;
+		uint32_t nodeIndex = 0;
+		uint32_t steps = 0;
+		for (;;)
+		{
+			++steps;
+			WideBvhNode const& node = m_nodes[nodeIndex];
+			float scale[3];
+			for (uint32_t a = 0; a != 3; ++a)
+			{
+				uint32_t const bits = static_cast<uint32_t>(node.exponents[a]) << 23;
+				memcpy(&scale[a], &bits, sizeof(float));
+			}
+
+			uint32_t innerHits = 0;
+			for (uint32_t i = 0; i != WIDE_BVH_WIDTH; ++i)
+			{
+				uint32_t const slot = i ^ octant;
+				if (node.qMin[0][slot] > node.qMax[0][slot])
+					continue;
+
+				float tEnter = 0.f, tExit = tMax;
+				for (uint32_t a = 0; a != 3; ++a)
+				{
+					float const boundsMin = node.origin[a] + static_cast<float>(node.qMin[a][slot]) * scale[a];
+					float const boundsMax = node.origin[a] + static_cast<float>(node.qMax[a][slot]) * scale[a];
+					float t0 = (boundsMin - origin[a]) * invDir[a];
+					float t1 = (boundsMax - origin[a]) * invDir[a];
+					if (t0 > t1)
+					{
+						float const t = t0;
+						t0 = t1;
+						t1 = t;
+					}
+					t1 *= 1.f + 6.f * 5.96046448e-8f; // 1 + 2 gamma(3), as in the shader
+					tEnter = t0 > tEnter ? t0 : tEnter;
+					tExit = t1 < tExit ? t1 : tExit;
+				}
+				if (tEnter > tExit)
+					continue;
+
+				if (node.innerMask & (1u << slot))
+					innerHits |= 1u << i;
+				else
+				{
+					uint32_t const first = node.primitiveBaseIndex + (node.meta[slot] >> 2);
+					uint32_t const count = (node.meta[slot] & 3u) + 1;
+					for (uint32_t p = 0; p != count; ++p)
+						tMax = intersectPrimitive(m_primitiveIndices[first + p], tMax);
+				}
+			}
+			if (innerHits != 0)
+				stack[stackSize++] = { node.childBaseIndex, innerHits | static_cast<uint32_t>(node.innerMask) << 8 };
+
+			if (stackSize == 0)
+				break;
+			StackEntry& entry = stack[stackSize - 1];
+			uint32_t const i = static_cast<uint32_t>(std::countr_zero(entry.hitsInnerMask & 0xffu));
+			entry.hitsInnerMask &= ~(1u << i);
+			uint32_t const slot = i ^ octant;
+			nodeIndex = entry.childBaseIndex + static_cast<uint32_t>(std::popcount((entry.hitsInnerMask >> 8) & ((1u << slot) - 1)));
+			if ((entry.hitsInnerMask & 0xffu) == 0)
+				--stackSize;
+		}
+		return steps;
+	}
+}
+
+#endif // MXC_WIDE_BVH_H